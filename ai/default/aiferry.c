@@ -26,6 +26,7 @@
 
 /* aicore */
 #include "path_finding.h"
+#include "pf_costgrid.h"
 #include "pf_tools.h"
 
 /* server/advisors */
@@ -389,6 +390,7 @@ int aiferry_avail_boats(struct ai_type *ait, struct player *pplayer)
 **************************************************************************/
 static int combined_land_sea_move(const struct tile *src_tile,
                                   enum pf_move_scope src_scope,
+                                  enum direction8 dir,
                                   const struct tile *tgt_tile,
                                   enum pf_move_scope dst_scope,
                                   const struct pf_parameter *param)
@@ -403,8 +405,8 @@ static int combined_land_sea_move(const struct tile *src_tile,
     move_cost = PF_IMPOSSIBLE_MC;
   } else {
     /* Land-to-Land */
-    move_cost = map_move_cost(&(wld.map), param->owner, param->utype,
-                              src_tile, tgt_tile);
+    move_cost = pf_costgrid_move_cost(&(wld.map), param->owner,
+                                      param->utype, src_tile, dir, tgt_tile);
   }
 
   return move_cost;
@@ -30,6 +30,7 @@
 #include "unitlist.h"
 
 /* aicore */
+#include "pf_cluster.h"
 #include "pf_tools.h"
 
 /* server */
@@ -415,6 +416,33 @@ static void dai_hunter_juiciness(struct player *pplayer, struct unit *punit,
   *stackthreat += *stackcost;
 }
 
+/**********************************************************************//**
+  Return whether some unit of a dangerous player can be reached by the
+  hunter at all, according to the clusters. If not, searching the map for
+  a target is not worth it. How far the targets are is left to the real
+  path-finding.
+**************************************************************************/
+static bool dai_hunter_target_reachable(struct player *pplayer,
+                                        struct unit *punit)
+{
+  const struct unit_type *ptype = unit_type_get(punit);
+
+  players_iterate_alive(aplayer) {
+    if (!adv_is_player_dangerous(pplayer, aplayer)) {
+      continue;
+    }
+
+    unit_list_iterate(aplayer->units, target) {
+      if (pf_cluster_reachable(ptype, unit_tile(punit),
+                               unit_tile(target))) {
+        return TRUE;
+      }
+    } unit_list_iterate_end;
+  } players_iterate_alive_end;
+
+  return FALSE;
+}
+
 /**********************************************************************//**
   Manage a (possibly virtual) hunter. Return the want for building a
   hunter like this. If we return 0, then we have nothing to do with
@@ -443,6 +471,11 @@ int dai_hunter_manage(struct ai_type *ait, struct player *pplayer,
 
   pft_fill_unit_parameter(&parameter, punit);
   parameter.omniscience = !has_handicap(pplayer, H_MAP);
+  if (parameter.omniscience
+      && !dai_hunter_target_reachable(pplayer, punit)) {
+    UNIT_LOG(LOGLEVEL_HUNT, punit, "no reachable hunt target");
+    return 0;
+  }
   pfm = pf_map_new(&parameter);
 
   if (original_target) {
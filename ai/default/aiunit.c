@@ -41,6 +41,7 @@
 
 /* common/aicore */
 #include "caravan.h"
+#include "pf_cluster.h"
 #include "pf_tools.h"
 
 /* server */
@@ -1242,7 +1243,8 @@ int find_something_to_kill(struct ai_type *ait, struct player *pplayer,
 
   pft_fill_unit_attack_param(&parameter, punit);
   parameter.omniscience = !has_handicap(pplayer, H_MAP);
-  punit_map = pf_map_new(&parameter);
+  /* Shared with the other units of the stack. */
+  punit_map = pf_map_cache_get(&parameter);
 
   if (MOVE_NONE == punit_class->adv.sea_move) {
     /* We need boat to move over sea. */
@@ -1510,8 +1512,11 @@ int find_something_to_kill(struct ai_type *ait, struct player *pplayer,
         continue;
       }
 
-      if (!pf_map_position(punit_map, atile, &pos)) {
-        /* Cannot reach it. */
+      if ((pf_map_parameter(punit_map)->omniscience
+           && !pf_cluster_reachable(punit_type, punit_tile, atile))
+          || !pf_map_position(punit_map, atile, &pos)) {
+        /* Cannot reach it. Ask the clusters first when we may, as an
+         * unreachable tile makes the map search everywhere. */
         continue;
       }
 
@@ -1558,7 +1563,6 @@ int find_something_to_kill(struct ai_type *ait, struct player *pplayer,
               ? pf_map_path(punit_map, goto_dest_tile) : NULL);
   }
 
-  pf_map_destroy(punit_map);
   if (NULL != ferry_map
       && (NULL == pferrymap || *pferrymap != ferry_map)) {
     pf_map_destroy(ferry_map);
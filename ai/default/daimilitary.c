@@ -71,7 +71,8 @@
 
 static unsigned int assess_danger(struct ai_type *ait, struct city *pcity,
                                   const struct civ_map *dmap,
-                                  player_unit_list_getter ul_cb);
+                                  player_unit_list_getter ul_cb,
+                                  struct pf_reverse_field **fields);
 
 /**********************************************************************//**
   Choose the best unit the city can build to defend against attacker v.
@@ -406,6 +407,55 @@ static unsigned int assess_danger_unit(const struct city *pcity,
   return danger * 100 / MAX(mod, 1);
 }
 
+/**********************************************************************//**
+  How many turns ahead pplayer looks for the enemy units.
+**************************************************************************/
+static int assess_danger_turns(const struct player *pplayer)
+{
+  if (player_is_cpuhog(pplayer)) {
+    return 6;
+  }
+
+#ifdef FREECIV_WEB
+  return has_handicap(pplayer, H_ASSESS_DANGER_LIMITED) ? 2 : 3;
+#else
+  return 3;
+#endif
+}
+
+/**********************************************************************//**
+  Make a field of how fast the units of aplayer can reach every tile,
+  or NULL if it cannot be used to tell that a city is safe from them.
+**************************************************************************/
+static struct pf_reverse_field *
+assess_danger_field_new(const struct player *pplayer,
+                        const struct player *aplayer,
+                        const struct civ_map *dmap)
+{
+  struct pf_reverse_field *pfrf;
+
+  unit_list_iterate(aplayer->units, punit) {
+    const struct unit_type *utype = unit_type_get(punit);
+
+    if (utype_can_do_action(utype, ACTION_PARADROP)
+        && 0 < utype->paratroopers_range) {
+      /* Do not follow the paths. */
+      return NULL;
+    }
+  } unit_list_iterate_end;
+
+  pfrf = pf_reverse_field_new(aplayer, assess_danger_turns(pplayer),
+                              !has_handicap(pplayer, H_MAP), dmap);
+  unit_list_iterate(aplayer->units, punit) {
+    pf_reverse_field_add_unit(pfrf, punit);
+    if (unit_transported(punit)) {
+      pf_reverse_field_add_unit(pfrf, unit_transport_get(punit));
+    }
+  } unit_list_iterate_end;
+
+  return pfrf;
+}
+
 /**********************************************************************//**
   Call assess_danger() for all cities owned by pplayer.
 
@@ -416,12 +466,51 @@ void dai_assess_danger_player(struct ai_type *ait, struct player *pplayer,
 {
   /* Do nothing if game is not running */
   if (S_S_RUNNING == server_state()) {
+    struct pf_reverse_field *fields[MAX_NUM_PLAYER_SLOTS];
+
+    /* Expand every dangerous player once, rather than once per city. */
+    players_iterate(aplayer) {
+      fields[player_index(aplayer)] =
+        (adv_is_player_dangerous(pplayer, aplayer)
+         ? assess_danger_field_new(pplayer, aplayer, dmap) : NULL);
+    } players_iterate_end;
+
     city_list_iterate(pplayer->cities, pcity) {
-      (void) assess_danger(ait, pcity, dmap, NULL);
+      (void) assess_danger(ait, pcity, dmap, NULL, fields);
     } city_list_iterate_end;
+
+    players_iterate(aplayer) {
+      if (NULL != fields[player_index(aplayer)]) {
+        pf_reverse_field_destroy(fields[player_index(aplayer)]);
+      }
+    } players_iterate_end;
   }
 }
 
+/**********************************************************************//**
+  Can the units in pfrf come to attack the city within max_turns?
+  They need to reach the city or one of its adjacent tiles.
+**************************************************************************/
+static bool assess_danger_field_near(struct pf_reverse_field *pfrf,
+                                     const struct tile *ptile,
+                                     int max_turns)
+{
+  int turns = pf_reverse_field_turns(pfrf, ptile);
+
+  if (PF_IMPOSSIBLE_MC != turns && turns <= max_turns) {
+    return TRUE;
+  }
+
+  adjc_iterate(&(wld.map), ptile, adjc_tile) {
+    turns = pf_reverse_field_turns(pfrf, adjc_tile);
+    if (PF_IMPOSSIBLE_MC != turns && turns <= max_turns) {
+      return TRUE;
+    }
+  } adjc_iterate_end;
+
+  return FALSE;
+}
+
 /**********************************************************************//**
   Set (overwrite) our want for a building. Syela tries to explain:
 
@@ -475,10 +564,15 @@ static void dai_reevaluate_building(struct city *pcity, adv_want *value,
   FIXME: Due to the nature of assess_distance, a city will only be
   afraid of a boat laden with enemies if it stands on the coast (i.e.
   is directly reachable by this boat).
+
+  If fields is not NULL, it holds the reverse fields of the players, see
+  assess_danger_field_new(). The players whose units cannot come near
+  the city are skipped.
 **************************************************************************/
 static unsigned int assess_danger(struct ai_type *ait, struct city *pcity,
                                   const struct civ_map *dmap,
-                                  player_unit_list_getter ul_cb)
+                                  player_unit_list_getter ul_cb,
+                                  struct pf_reverse_field **fields)
 {
   struct player *pplayer = city_owner(pcity);
   struct tile *ptile = city_tile(pcity);
@@ -540,14 +634,7 @@ static unsigned int assess_danger(struct ai_type *ait, struct city *pcity,
     }
   } unit_list_iterate_end;
 
-  if (player_is_cpuhog(pplayer)) {
-    assess_turns = 6;
-  } else {
-    assess_turns = 3;
-#ifdef FREECIV_WEB
-    assess_turns = has_handicap(pplayer, H_ASSESS_DANGER_LIMITED) ? 2 : 3;
-#endif
-  }
+  assess_turns = assess_danger_turns(pplayer);
 
   omnimap = !has_handicap(pplayer, H_MAP);
 
@@ -562,6 +649,13 @@ static unsigned int assess_danger(struct ai_type *ait, struct city *pcity,
     /* Note that we still consider the units of players we are not (yet)
      * at war with. */
 
+    if (NULL != fields && NULL != fields[player_index(aplayer)]
+        && !assess_danger_field_near(fields[player_index(aplayer)],
+                                     ptile, assess_turns)) {
+      /* None of the units can come. */
+      continue;
+    }
+
     pcity_map = pf_reverse_map_new_for_city(pcity, aplayer, assess_turns,
                                             omnimap, dmap);
 
@@ -1438,7 +1532,7 @@ struct adv_choice *military_advisor_choose_build(struct ai_type *ait,
   struct adv_choice *choice = adv_new_choice();
   bool allow_gold_upkeep;
 
-  urgency = assess_danger(ait, pcity, mamap, ul_cb);
+  urgency = assess_danger(ait, pcity, mamap, ul_cb, NULL);
   /* Changing to quadratic to stop AI from building piles 
    * of small units -- Syela */
   /* It has to be AFTER assess_danger thanks to wallvalue. */
@@ -60,6 +60,10 @@
 #include "server_settings.h"
 #include "version.h"
 
+/* common/aicore */
+#include "path_finding.h"
+#include "pf_costgrid.h"
+
 /* client/include */
 #include "chatline_g.h"
 #include "citydlg_g.h"
@@ -281,6 +285,8 @@ static void client_game_free(void)
   free_help_texts();
   attribute_free();
   agents_free();
+  pf_costgrids_free();
+  pf_lattices_free();
   game.client.ruleset_init = FALSE;
   game.client.ruleset_ready = FALSE;
   game_free();
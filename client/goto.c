@@ -697,8 +697,8 @@ static int get_connect_road(const struct tile *src_tile, enum direction8 dir,
     return -1;
   }
 
-  move_cost = param->get_MC(src_tile, PF_MS_NATIVE, dest_tile, PF_MS_NATIVE,
-                            param);
+  move_cost = param->get_MC(src_tile, PF_MS_NATIVE, dir, dest_tile,
+                            PF_MS_NATIVE, param);
   if (move_cost == PF_IMPOSSIBLE_MC) {
     return -1;
   }
@@ -810,8 +810,8 @@ static int get_connect_irrig(const struct tile *src_tile,
     return -1;
   }
 
-  move_cost = param->get_MC(src_tile, PF_MS_NATIVE, dest_tile, PF_MS_NATIVE,
-                            param);
+  move_cost = param->get_MC(src_tile, PF_MS_NATIVE, dir, dest_tile,
+                            PF_MS_NATIVE, param);
   if (move_cost == PF_IMPOSSIBLE_MC) {
     return -1;
   }
@@ -1477,6 +1477,7 @@ bool send_goto_tile(struct unit *punit, struct tile *ptile)
   struct pf_path *path;
 
   goto_fill_parameter_base(&parameter, punit);
+  pft_fill_goal(&parameter, ptile);
   pfm = pf_map_new(&parameter);
   path = pf_map_path(pfm, ptile);
   pf_map_destroy(pfm);
@@ -55,6 +55,9 @@
 #include "unitlist.h"
 #include "worklist.h"
 
+/* common/aicore */
+#include "pf_costgrid.h"
+
 /* client/include */
 #include "chatline_g.h"
 #include "citydlg_g.h"
@@ -3060,6 +3063,9 @@ void handle_tile_info(const struct packet_tile_info *packet)
   }
 
   if (known_changed || tile_changed) {
+    /* The move costs around may have changed. */
+    pf_costgrid_tile_changed(ptile);
+
     /* 
      * A tile can only change if it was known before and is still
      * known. In the other cases the tile is new or removed.
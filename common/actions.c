@@ -78,9 +78,45 @@ static bool actions_initialized = FALSE;
 
 static struct action_enabler_list *action_enablers_by_action[MAX_NUM_ACTIONS];
 
+/* The enablers of each action which an actor of a unit type may satisfy,
+ * indexed by unit type. Built when first needed, see
+ * action_enablers_for_actor(), and dropped when the enablers of the
+ * action change. The target kind is implied by the action. */
+static struct action_enabler_list **action_enablers_by_utype[MAX_NUM_ACTIONS];
+static int action_enablers_by_utype_num[MAX_NUM_ACTIONS];
+
 /* Hard requirements relates to action result. */
 static struct obligatory_req_vector obligatory_hard_reqs[ACTION_COUNT];
 
+/* A remembered action probability, see action_prob_cache_freeze(). The
+ * target is a city, a unit or a tile, as implied by the action. */
+struct act_prob_memo {
+  int actor_id;
+  action_id act;
+  int target_id;
+  int extra_id;                 /* -1 for none. */
+  struct act_prob prob;
+};
+
+static genhash_val_t act_prob_memo_hash_val(const struct act_prob_memo *memo);
+static bool act_prob_memo_hash_cmp(const struct act_prob_memo *memo1,
+                                   const struct act_prob_memo *memo2);
+static void act_prob_memo_destroy(struct act_prob_memo *memo);
+
+/* The key and the data are the same memo. */
+#define SPECHASH_TAG act_prob_memo
+#define SPECHASH_IKEY_TYPE struct act_prob_memo *
+#define SPECHASH_IDATA_TYPE struct act_prob_memo *
+#define SPECHASH_IKEY_VAL act_prob_memo_hash_val
+#define SPECHASH_IKEY_COMP act_prob_memo_hash_cmp
+#define SPECHASH_IDATA_FREE act_prob_memo_destroy
+#include "spechash.h"
+
+static struct {
+  struct act_prob_memo_hash *memos;
+  int frozen;
+} act_prob_cache = { NULL, 0 };
+
 static struct action *action_new(action_id id,
                                  enum action_target_kind target_kind,
                                  bool hostile, enum act_tgt_compl tgt_compl,
@@ -90,6 +126,7 @@ static struct action *action_new(action_id id,
                                  const int max_distance,
                                  bool actor_consuming_always);
 
+static void action_enablers_by_utype_free(action_id action);
 static bool is_enabler_active(const struct action_enabler *enabler,
 			      const struct player *actor_player,
 			      const struct city *actor_city,
@@ -696,6 +733,7 @@ void actions_free(void)
     } action_enabler_list_iterate_end;
 
     action_enabler_list_destroy(action_enablers_by_action[act]);
+    action_enablers_by_utype_free(act);
 
     FC_FREE(actions[act]);
   } action_iterate_end;
@@ -1334,6 +1372,8 @@ void action_enabler_add(struct action_enabler *enabler)
   /* Sanity check: a non existing action doesn't have enablers. */
   fc_assert_ret(action_id_exists(enabler->action));
 
+  action_enablers_by_utype_free(enabler->action);
+
   action_enabler_list_append(
         action_enablers_for_action(enabler->action),
         enabler);
@@ -1351,6 +1391,8 @@ bool action_enabler_remove(struct action_enabler *enabler)
   /* Sanity check: a non existing action doesn't have enablers. */
   fc_assert_ret_val(action_id_exists(enabler->action), FALSE);
 
+  action_enablers_by_utype_free(enabler->action);
+
   return action_enabler_list_remove(
         action_enablers_for_action(enabler->action),
         enabler);
@@ -1368,6 +1410,93 @@ action_enablers_for_action(action_id action)
   return action_enablers_by_action[action];
 }
 
+/**********************************************************************//**
+  Returns TRUE if an actor of the unit type may satisfy the actor
+  requirements of the enabler. Only the requirements which depend on
+  nothing but the unit type are considered.
+**************************************************************************/
+static bool action_enabler_possible_for_utype(
+                                      const struct action_enabler *enabler,
+                                      const struct unit_type *putype)
+{
+  requirement_vector_iterate(&enabler->actor_reqs, preq) {
+    switch (preq->source.kind) {
+    case VUT_UTYPE:
+    case VUT_UTFLAG:
+    case VUT_UCLASS:
+    case VUT_UCFLAG:
+      if (!is_req_active(NULL, NULL, NULL, NULL, NULL, NULL, putype,
+                         NULL, NULL, NULL, preq, RPT_POSSIBLE)) {
+        return FALSE;
+      }
+      break;
+    default:
+      break;
+    }
+  } requirement_vector_iterate_end;
+
+  return TRUE;
+}
+
+/**********************************************************************//**
+  Free the enablers of the action indexed by unit type.
+**************************************************************************/
+static void action_enablers_by_utype_free(action_id action)
+{
+  int i;
+
+  if (action_enablers_by_utype[action] == NULL) {
+    return;
+  }
+
+  for (i = 0; i < action_enablers_by_utype_num[action]; i++) {
+    action_enabler_list_destroy(action_enablers_by_utype[action][i]);
+  }
+  free(action_enablers_by_utype[action]);
+  action_enablers_by_utype[action] = NULL;
+  action_enablers_by_utype_num[action] = 0;
+}
+
+/**********************************************************************//**
+  Get the enablers of an action an actor of the unit type may satisfy.
+  Returns all the enablers of the action if the unit type is NULL.
+**************************************************************************/
+static struct action_enabler_list *
+action_enablers_for_actor(action_id action,
+                          const struct unit_type *actor_unittype)
+{
+  if (actor_unittype == NULL) {
+    return action_enablers_for_action(action);
+  }
+
+  if (action_enablers_by_utype[action] == NULL) {
+    int num = utype_count();
+
+    action_enablers_by_utype[action]
+      = fc_malloc(num * sizeof(*action_enablers_by_utype[action]));
+    action_enablers_by_utype_num[action] = num;
+
+    unit_type_iterate(putype) {
+      struct action_enabler_list *plist = action_enabler_list_new();
+
+      action_enabler_list_iterate(action_enablers_by_action[action],
+                                  enabler) {
+        if (action_enabler_possible_for_utype(enabler, putype)) {
+          action_enabler_list_append(plist, enabler);
+        }
+      } action_enabler_list_iterate_end;
+
+      action_enablers_by_utype[action][utype_index(putype)] = plist;
+    } unit_type_iterate_end;
+  }
+
+  fc_assert_ret_val(utype_index(actor_unittype)
+                    < action_enablers_by_utype_num[action],
+                    action_enablers_for_action(action));
+
+  return action_enablers_by_utype[action][utype_index(actor_unittype)];
+}
+
 /**********************************************************************//**
   Returns an error message text if the action enabler is missing at least
   one of its action's obligatory hard requirement. Returns NULL if all
@@ -1457,6 +1586,9 @@ void action_enabler_obligatory_reqs_add(struct action_enabler *enabler)
   requirement_vector_contradiction_clean(&enabler->actor_reqs);
   requirement_vector_contradiction_clean(&enabler->target_reqs);
 
+  /* The actor requirements may now rule out other unit types. */
+  action_enablers_by_utype_free(enabler->action);
+
   /* Sanity check: obligatory requirement insertion should have fixed the
    * action enabler. */
   fc_assert(action_enabler_obligatory_reqs_missing(enabler) == NULL);
@@ -2788,7 +2920,12 @@ static bool is_action_enabled(const action_id wanted_action,
     return FALSE;
   }
 
-  action_enabler_list_iterate(action_enablers_for_action(wanted_action),
+  if (actor_unittype == NULL && actor_unit != NULL) {
+    actor_unittype = unit_type_get(actor_unit);
+  }
+
+  action_enabler_list_iterate(action_enablers_for_actor(wanted_action,
+                                                        actor_unittype),
                               enabler) {
     if (is_enabler_active(enabler, actor_player, actor_city,
                           actor_building, actor_tile,
@@ -3194,7 +3331,9 @@ action_enabled_local(const action_id wanted_action,
   enum fc_tristate result;
 
   result = TRI_NO;
-  action_enabler_list_iterate(action_enablers_for_action(wanted_action),
+  action_enabler_list_iterate(action_enablers_for_actor(wanted_action,
+                                actor_unit != NULL
+                                ? unit_type_get(actor_unit) : NULL),
                               enabler) {
     current = fc_tristate_and(mke_eval_reqs(actor_player, actor_player,
                                             target_player, actor_city,
@@ -3778,6 +3917,111 @@ action_prob_vs_city_full(const struct unit* actor_unit,
                      NULL, target_utype, NULL, NULL, NULL);
 }
 
+/**********************************************************************//**
+  Hash function for the action probability memos.
+**************************************************************************/
+static genhash_val_t act_prob_memo_hash_val(const struct act_prob_memo *memo)
+{
+  return (((genhash_val_t) memo->actor_id * 31 + memo->act) * 31
+          + memo->target_id) * 31 + memo->extra_id;
+}
+
+/**********************************************************************//**
+  Compare the keys of two action probability memos.
+**************************************************************************/
+static bool act_prob_memo_hash_cmp(const struct act_prob_memo *memo1,
+                                   const struct act_prob_memo *memo2)
+{
+  return (memo1->actor_id == memo2->actor_id
+          && memo1->act == memo2->act
+          && memo1->target_id == memo2->target_id
+          && memo1->extra_id == memo2->extra_id);
+}
+
+/**********************************************************************//**
+  Free an action probability memo.
+**************************************************************************/
+static void act_prob_memo_destroy(struct act_prob_memo *memo)
+{
+  free(memo);
+}
+
+/**********************************************************************//**
+  Start remembering the action probabilities computed for the actor units
+  by action_prob_vs_city() and friends, until the matching
+  action_prob_cache_thaw(). The caller guarantees the game state doesn't
+  change meanwhile, for instance while the actions a unit can do are
+  looked for. May be nested.
+**************************************************************************/
+void action_prob_cache_freeze(void)
+{
+  if (0 == act_prob_cache.frozen++) {
+    act_prob_cache.memos = act_prob_memo_hash_new();
+  }
+}
+
+/**********************************************************************//**
+  Stop remembering the action probabilities, and forget them, see
+  action_prob_cache_freeze().
+**************************************************************************/
+void action_prob_cache_thaw(void)
+{
+  fc_assert_ret(0 < act_prob_cache.frozen);
+
+  if (0 == --act_prob_cache.frozen) {
+    act_prob_memo_hash_destroy(act_prob_cache.memos);
+    act_prob_cache.memos = NULL;
+  }
+}
+
+/**********************************************************************//**
+  Look up the probability of the action remembered while the cache is
+  frozen. Returns FALSE if it isn't known.
+**************************************************************************/
+static bool act_prob_cache_lookup(const struct unit *actor_unit,
+                                  action_id act_id, int target_id,
+                                  int extra_id, struct act_prob *prob)
+{
+  struct act_prob_memo key, *memo;
+
+  if (NULL == act_prob_cache.memos || NULL == actor_unit) {
+    return FALSE;
+  }
+
+  key.actor_id = actor_unit->id;
+  key.act = act_id;
+  key.target_id = target_id;
+  key.extra_id = extra_id;
+  if (act_prob_memo_hash_lookup(act_prob_cache.memos, &key, &memo)) {
+    *prob = memo->prob;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**********************************************************************//**
+  Remember the probability of the action if the cache is frozen.
+**************************************************************************/
+static void act_prob_cache_insert(const struct unit *actor_unit,
+                                  action_id act_id, int target_id,
+                                  int extra_id, struct act_prob prob)
+{
+  struct act_prob_memo *memo;
+
+  if (NULL == act_prob_cache.memos || NULL == actor_unit) {
+    return;
+  }
+
+  memo = fc_malloc(sizeof(*memo));
+  memo->actor_id = actor_unit->id;
+  memo->act = act_id;
+  memo->target_id = target_id;
+  memo->extra_id = extra_id;
+  memo->prob = prob;
+  act_prob_memo_hash_replace(act_prob_cache.memos, memo, memo);
+}
+
 /**********************************************************************//**
   Get the actor unit's probability of successfully performing the chosen
   action on the target city.
@@ -3786,10 +4030,20 @@ struct act_prob action_prob_vs_city(const struct unit* actor_unit,
                                     const action_id act_id,
                                     const struct city* target_city)
 {
-  return action_prob_vs_city_full(actor_unit,
+  int target_id = (target_city != NULL ? target_city->id : -1);
+  struct act_prob prob;
+
+  if (act_prob_cache_lookup(actor_unit, act_id, target_id, -1, &prob)) {
+    return prob;
+  }
+
+  prob = action_prob_vs_city_full(actor_unit,
                                   unit_home(actor_unit),
                                   unit_tile(actor_unit),
                                   act_id, target_city);
+  act_prob_cache_insert(actor_unit, act_id, target_id, -1, prob);
+
+  return prob;
 }
 
 /**********************************************************************//**
@@ -3859,11 +4113,21 @@ struct act_prob action_prob_vs_unit(const struct unit* actor_unit,
                                     const action_id act_id,
                                     const struct unit* target_unit)
 {
-  return action_prob_vs_unit_full(actor_unit,
+  int target_id = (target_unit != NULL ? target_unit->id : -1);
+  struct act_prob prob;
+
+  if (act_prob_cache_lookup(actor_unit, act_id, target_id, -1, &prob)) {
+    return prob;
+  }
+
+  prob = action_prob_vs_unit_full(actor_unit,
                                   unit_home(actor_unit),
                                   unit_tile(actor_unit),
                                   act_id,
                                   target_unit);
+  act_prob_cache_insert(actor_unit, act_id, target_id, -1, prob);
+
+  return prob;
 }
 
 /**********************************************************************//**
@@ -4028,11 +4292,21 @@ struct act_prob action_prob_vs_units(const struct unit* actor_unit,
                                      const action_id act_id,
                                      const struct tile* target_tile)
 {
-  return action_prob_vs_units_full(actor_unit,
+  int target_id = (target_tile != NULL ? tile_index(target_tile) : -1);
+  struct act_prob prob;
+
+  if (act_prob_cache_lookup(actor_unit, act_id, target_id, -1, &prob)) {
+    return prob;
+  }
+
+  prob = action_prob_vs_units_full(actor_unit,
                                    unit_home(actor_unit),
                                    unit_tile(actor_unit),
                                    act_id,
                                    target_tile);
+  act_prob_cache_insert(actor_unit, act_id, target_id, -1, prob);
+
+  return prob;
 }
 
 /**********************************************************************//**
@@ -4101,10 +4375,22 @@ struct act_prob action_prob_vs_tile(const struct unit *actor_unit,
                                     const struct tile *target_tile,
                                     const struct extra_type *target_extra)
 {
-  return action_prob_vs_tile_full(actor_unit,
+  int target_id = (target_tile != NULL ? tile_index(target_tile) : -1);
+  int extra_id = (target_extra != NULL ? extra_number(target_extra) : -1);
+  struct act_prob prob;
+
+  if (act_prob_cache_lookup(actor_unit, act_id, target_id, extra_id,
+                            &prob)) {
+    return prob;
+  }
+
+  prob = action_prob_vs_tile_full(actor_unit,
                                   unit_home(actor_unit),
                                   unit_tile(actor_unit),
                                   act_id, target_tile, target_extra);
+  act_prob_cache_insert(actor_unit, act_id, target_id, extra_id, prob);
+
+  return prob;
 }
 
 /**********************************************************************//**
@@ -4162,10 +4448,19 @@ action_prob_self_full(const struct unit* actor_unit,
 struct act_prob action_prob_self(const struct unit* actor_unit,
                                  const action_id act_id)
 {
-  return action_prob_self_full(actor_unit,
+  struct act_prob prob;
+
+  if (act_prob_cache_lookup(actor_unit, act_id, -1, -1, &prob)) {
+    return prob;
+  }
+
+  prob = action_prob_self_full(actor_unit,
                                unit_home(actor_unit),
                                unit_tile(actor_unit),
                                act_id);
+  act_prob_cache_insert(actor_unit, act_id, -1, -1, prob);
+
+  return prob;
 }
 
 /**********************************************************************//**
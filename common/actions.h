@@ -540,6 +540,9 @@ bool is_action_enabled_unit_on_tile(const action_id wanted_action,
 bool is_action_enabled_unit_on_self(const action_id wanted_action,
                                     const struct unit *actor_unit);
 
+void action_prob_cache_freeze(void);
+void action_prob_cache_thaw(void);
+
 struct act_prob action_prob_vs_city(const struct unit* actor,
                                     const action_id act_id,
                                     const struct city* victim);
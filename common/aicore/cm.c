@@ -20,6 +20,7 @@
 
 /* utility */
 #include "fcintl.h"
+#include "fcthread.h"
 #include "log.h"
 #include "mem.h"
 #include "shared.h"
@@ -28,6 +29,7 @@
 
 /* common */
 #include "city.h"
+#include "effects.h"
 #include "game.h"
 #include "government.h"
 #include "map.h"
@@ -98,13 +100,13 @@
 #ifdef GATHER_TIME_STATS
 static struct {
   struct one_perf {
-    struct timer *wall_timer;
+    double seconds;
     int query_count;
     int apply_count;
     const char *name;
   } greedy, opt;
 
-  struct one_perf *current;
+  fc_mutex mutex;               /* Queries may run in several threads. */
 } performance;
 
 static void print_performance(struct one_perf *counts);
@@ -228,6 +230,87 @@ struct cm_state {
   } choice;
 
   bool *workers_map; /* placement of the workers within the city map */
+
+#ifdef GATHER_TIME_STATS
+  /* statistics of the current search, added to 'perf' by end_search() */
+  struct one_perf *perf;
+  struct timer *wall_timer;
+  int apply_count;
+#endif /* GATHER_TIME_STATS */
+};
+
+/*
+ * Everything the tile lattice of a city is built from: the city radius
+ * and size, then for every city map tile a workable flag and its
+ * production, then the same for every specialist type.  Two equal keys
+ * give the same lattice.
+ */
+struct cm_lattice_key {
+  int num_values;
+  int *values;
+};
+
+/* Number of values per tile or specialist in a cm_lattice_key. */
+#define CM_KEY_STRIDE (1 + O_LAST)
+
+/* Number of results remembered per city. Different callers query the
+ * same city with different parameters, and every query is remembered for
+ * the city before and after the result is applied. */
+#define CM_MEMO_SIZE 4
+
+/* Number of values of a cm_fingerprint which depend on the city state,
+ * see fingerprint_fill_city(). */
+#define CM_FINGERPRINT_CITY_VALUES                                          \
+  (7 * O_LAST + CITIZEN_LAST * FEELING_LAST + SP_MAX + 2)
+
+/*
+ * What is kept of the last query on a city, to start the next query
+ * from it.  The state (and its lattice) is reused as long as the lattice
+ * key does not change.  The last solution is used as the first best
+ * solution of the next search, which lets the search prune much earlier
+ * when only a few tiles changed.
+ */
+struct cm_warm {
+  struct cm_lattice_key key;
+  struct cm_state *state;       /* Built from 'key'. */
+  struct cm_result *last;       /* Last solution found, or NULL. */
+
+  /* Results of the last queries, see cm_memo_lookup(). */
+  struct cm_memo {
+    struct cm_fingerprint {
+      unsigned int hash;
+      int num_values;
+      int *values;
+    } fingerprint;
+    struct cm_result *result;
+  } memo[CM_MEMO_SIZE];
+  int memo_next;                /* Entry to replace next. */
+};
+
+static void cm_warm_free(struct cm_warm *warm);
+
+/* Map city ids to struct cm_warm. */
+#define SPECHASH_TAG cm_warm
+#define SPECHASH_INT_KEY_TYPE
+#define SPECHASH_IDATA_TYPE struct cm_warm *
+#define SPECHASH_IDATA_FREE cm_warm_free
+#include "spechash.h"
+
+static struct cm_warm_hash *cm_warms = NULL;
+/* Protects 'cm_warms', but not the entries: the queries on one city are
+ * never run at the same time, see cm_query_results(). */
+static fc_mutex cm_warms_mutex;
+
+/* Cities queried per thread at least, see cm_query_results(). */
+#define CM_QUERY_MIN_PER_THREAD 4
+
+struct cm_query_tasks {
+  struct city **cities;
+  const struct cm_parameter *params;
+  struct cm_result **results;
+  bool negative_ok;
+  int *order;                   /* Indices to 'cities', by task. */
+  int *task_start;              /* Start of each task in 'order'. */
 };
 
 
@@ -275,6 +358,9 @@ static void real_print_partial_solution(enum log_level level,
 
 static void cm_result_copy(struct cm_result *result,
                            const struct city *pcity, bool *workers_map);
+static void cm_state_free(struct cm_state *state);
+static void fingerprint_fill_city(struct cm_fingerprint *fp,
+                                  const struct city *pcity);
 
 static double estimate_fitness(const struct cm_state *state,
 			       const int production[]);
@@ -288,14 +374,15 @@ static bool choice_is_promising(struct cm_state *state, int newchoice,
 ****************************************************************************/
 void cm_init(void)
 {
-  /* In the B&B algorithm there's not really anything to initialize. */
+  /* The B&B algorithm only keeps the warm start data of the cities. */
+  cm_warms = cm_warm_hash_new();
+  fc_init_mutex(&cm_warms_mutex);
+
 #ifdef GATHER_TIME_STATS
   memset(&performance, 0, sizeof(performance));
+  fc_init_mutex(&performance.mutex);
 
-  performance.greedy.wall_timer = timer_new(TIMER_USER, TIMER_ACTIVE);
   performance.greedy.name = "greedy";
-
-  performance.opt.wall_timer = timer_new(TIMER_USER, TIMER_ACTIVE);
   performance.opt.name = "opt";
 #endif /* GATHER_TIME_STATS */
 }
@@ -311,11 +398,42 @@ void cm_init_citymap(void)
 }
 
 /************************************************************************//**
-  Clear the cache for a city.
+  Clear the cache for a city: forget the results of the previous queries.
+  The fingerprints of the cached results cover the tiles, the specialists,
+  the tracked effect changes and the refreshed state of the city, so this
+  is only needed for changes that they cannot see.
 ****************************************************************************/
 void cm_clear_cache(struct city *pcity)
 {
-  /* The B&B algorithm doesn't have city caches so there's nothing to do. */
+  struct cm_warm *warm;
+
+  if (NULL == cm_warms) {
+    return;
+  }
+
+  fc_allocate_mutex(&cm_warms_mutex);
+  if (cm_warm_hash_lookup(cm_warms, pcity->id, &warm)) {
+    int i;
+
+    /* The warm start data is checked against the city at every query, so
+     * it can be kept. */
+    for (i = 0; i < CM_MEMO_SIZE; i++) {
+      warm->memo[i].fingerprint.num_values = 0;
+    }
+  }
+  fc_release_mutex(&cm_warms_mutex);
+}
+
+/************************************************************************//**
+  Free the warm start data of a city which is going away.
+****************************************************************************/
+void cm_city_free(const struct city *pcity)
+{
+  if (NULL != cm_warms) {
+    fc_allocate_mutex(&cm_warms_mutex);
+    cm_warm_hash_remove(cm_warms, pcity->id);
+    fc_release_mutex(&cm_warms_mutex);
+  }
 }
 
 /************************************************************************//**
@@ -323,12 +441,17 @@ void cm_clear_cache(struct city *pcity)
 ****************************************************************************/
 void cm_free(void)
 {
+  if (NULL != cm_warms) {
+    cm_warm_hash_destroy(cm_warms);
+    cm_warms = NULL;
+    fc_destroy_mutex(&cm_warms_mutex);
+  }
+
 #ifdef GATHER_TIME_STATS
   print_performance(&performance.greedy);
   print_performance(&performance.opt);
 
-  timer_destroy(performance.greedy.wall_timer);
-  timer_destroy(performance.opt.wall_timer);
+  fc_destroy_mutex(&performance.mutex);
   memset(&performance, 0, sizeof(performance));
 #endif /* GATHER_TIME_STATS */
 }
@@ -677,7 +800,7 @@ static void apply_solution(struct cm_state *state,
   int i, citizen_count = 0, city_radius_sq = city_map_radius_sq_get(pcity);
 
 #ifdef GATHER_TIME_STATS
-  performance.current->apply_count++;
+  state->apply_count++;
 #endif
 
   fc_assert_ret(0 == soln->idle);
@@ -876,21 +999,19 @@ static int compare_tile_type_by_fitness(const void *va, const void *vb)
   return compare_tile_type_by_lattice_order(*a, *b);
 }
 
-static Output_type_id compare_key;
-static double compare_key_trade_bonus;
-
 /************************************************************************//**
-  Compare by the production of type compare_key.
+  Compare by the production of type 'stat', where one trade is worth
+  'trade_bonus' of it.
   If a produces more food than b, then a cannot be a child of b, so
   this respects the partial order -- unless a and b produce equal food.
   In that case, use compare_tile_type_by_lattice_order.
 ****************************************************************************/
-static int compare_tile_type_by_stat(const void *va, const void *vb)
+static int compare_tile_type_by_stat(const struct cm_tile_type *a,
+                                     const struct cm_tile_type *b,
+                                     Output_type_id stat,
+                                     double trade_bonus)
 {
-  struct cm_tile_type * const *a = va;
-  struct cm_tile_type * const *b = vb;
-
-  if (*a == *b) {
+  if (a == b) {
     return 0;
   }
 
@@ -898,21 +1019,42 @@ static int compare_tile_type_by_stat(const void *va, const void *vb)
      for compute_max_stats_heuristics, which uses these sorted arrays,
      it is essential, that the sorting is correct, else promising 
      branches get pruned */
-  double valuea = (*a)->production[compare_key] + 
-                    compare_key_trade_bonus * (*a)->production[O_TRADE];
-  double valueb = (*b)->production[compare_key] +
-                    compare_key_trade_bonus * (*b)->production[O_TRADE];
+  double valuea = a->production[stat] + trade_bonus * a->production[O_TRADE];
+  double valueb = b->production[stat] + trade_bonus * b->production[O_TRADE];
 
   /* most production of what we care about goes first */
   /* double compare is ok, both values are calculated in the same way
-     and should only be considered equal, if equal in compare_key 
+     and should only be considered equal, if equal in 'stat'
      and O_TRADE */
   if (valuea != valueb) {
     /* b-a so we sort big numbers first */
     return valueb - valuea;
   }
 
-  return compare_tile_type_by_lattice_order(*a, *b);
+  return compare_tile_type_by_lattice_order(a, b);
+}
+
+/************************************************************************//**
+  Sort the lattice by compare_tile_type_by_stat().  qsort() has no way to
+  pass 'stat' and 'trade_bonus' but globals, which concurrent queries
+  would share; the lattices are small, so insertion sort does as well.
+****************************************************************************/
+static void sort_lattice_by_stat(struct tile_type_vector *lattice,
+                                 Output_type_id stat, double trade_bonus)
+{
+  int i;
+
+  for (i = 1; i < lattice->size; i++) {
+    struct cm_tile_type *ptype = lattice->p[i];
+    int j;
+
+    for (j = i; j > 0 && compare_tile_type_by_stat(lattice->p[j - 1], ptype,
+                                                   stat, trade_bonus) > 0;
+         j--) {
+      lattice->p[j] = lattice->p[j - 1];
+    }
+    lattice->p[j] = ptype;
+  }
 }
 
 /***************************************************************************
@@ -920,18 +1062,63 @@ static int compare_tile_type_by_stat(const void *va, const void *vb)
  ***************************************************************************/
 
 /************************************************************************//**
-  Compute the production of tile [x,y] and stuff it into the tile type.
-  Doesn't touch the other fields.
+  Compute the lattice key of the city: whether every tile can be worked
+  and its production, and the same for the specialists.
 ****************************************************************************/
-static void compute_tile_production(const struct city *pcity,
-				    const struct tile *ptile,
-				    struct cm_tile_type *out)
+static void lattice_key_fill(struct cm_lattice_key *key,
+                             const struct city *pcity)
 {
   bool is_celebrating = base_city_celebrating(pcity);
+  int city_radius_sq = city_map_radius_sq_get(pcity);
+  int ntiles = city_map_tiles(city_radius_sq);
+  struct tile *pcenter = city_tile(pcity);
+  int *spec_values;
+  int *outputs = fc_malloc(ntiles * O_LAST * sizeof(*outputs));
 
-  output_type_iterate(o) {
-    out->production[o] = city_tile_output(pcity, ptile, is_celebrating, o);
-  } output_type_iterate_end;
+  city_tile_outputs(pcity, is_celebrating, outputs);
+
+  key->num_values = 2 + (ntiles + SP_MAX) * CM_KEY_STRIDE;
+  key->values = fc_realloc(key->values,
+                           key->num_values * sizeof(*key->values));
+  memset(key->values, 0, key->num_values * sizeof(*key->values));
+
+  key->values[0] = city_radius_sq;
+  key->values[1] = city_size_get(pcity);
+
+  city_tile_iterate_index(city_radius_sq, pcenter, ptile, ctindex) {
+    int *tile_values = key->values + 2 + ctindex * CM_KEY_STRIDE;
+
+    if (!is_free_worked(pcity, ptile)
+        && city_can_work_tile(pcity, ptile)) {
+      tile_values[0] = TRUE;
+      output_type_iterate(o) {
+        tile_values[1 + o] = outputs[ctindex * O_LAST + o];
+      } output_type_iterate_end;
+    }
+  } city_tile_iterate_index_end;
+  free(outputs);
+
+  spec_values = key->values + 2 + ntiles * CM_KEY_STRIDE;
+  specialist_type_iterate(sp) {
+    if (city_can_use_specialist(pcity, sp)) {
+      spec_values[sp * CM_KEY_STRIDE] = TRUE;
+      output_type_iterate(o) {
+        spec_values[sp * CM_KEY_STRIDE + 1 + o]
+          = get_specialist_output(pcity, sp, o);
+      } output_type_iterate_end;
+    }
+  } specialist_type_iterate_end;
+}
+
+/************************************************************************//**
+  Return TRUE iff the two lattice keys give the same lattice.
+****************************************************************************/
+static bool lattice_key_equal(const struct cm_lattice_key *a,
+                              const struct cm_lattice_key *b)
+{
+  return (a->num_values == b->num_values
+          && 0 == memcmp(a->values, b->values,
+                         a->num_values * sizeof(*a->values)));
 }
 
 /************************************************************************//**
@@ -992,8 +1179,11 @@ static void tile_type_lattice_add(struct tile_type_vector *lattice,
   tile_type for each specialist type.
 ****************************************************************************/
 static void init_specialist_lattice_nodes(struct tile_type_vector *lattice,
-					  const struct city *pcity)
+                                          const struct city *pcity,
+                                          const struct cm_lattice_key *key)
 {
+  const int *spec_values
+    = key->values + 2 + city_map_tiles_from_city(pcity) * CM_KEY_STRIDE;
   struct cm_tile_type type;
 
   tile_type_init(&type);
@@ -1002,10 +1192,10 @@ static void init_specialist_lattice_nodes(struct tile_type_vector *lattice,
   /* for each specialist type, create a tile_type that has as production
    * the bonus for the specialist (if the city is allowed to use it) */
   specialist_type_iterate(i) {
-    if (city_can_use_specialist(pcity, i)) {
+    if (spec_values[i * CM_KEY_STRIDE]) {
       type.spec = i;
       output_type_iterate(output) {
-	type.production[output] = get_specialist_output(pcity, i, output);
+        type.production[output] = spec_values[i * CM_KEY_STRIDE + 1 + output];
       } output_type_iterate_end;
 
       tile_type_lattice_add(lattice, &type, 0);
@@ -1195,29 +1385,31 @@ static void sort_lattice_by_fitness(const struct cm_state *state,
 }
 
 /************************************************************************//**
-  Create the lattice.
+  Create the lattice from the lattice key of the city.
 ****************************************************************************/
 static void init_tile_lattice(struct city *pcity,
-                              struct tile_type_vector *lattice)
+                              struct tile_type_vector *lattice,
+                              const struct cm_lattice_key *key)
 {
   struct cm_tile_type type;
-  struct tile *pcenter = city_tile(pcity);
+  int ctindex;
 
   /* add all the fields into the lattice */
   tile_type_init(&type); /* init just once */
 
-  city_tile_iterate_index(city_map_radius_sq_get(pcity), pcenter, ptile,
-                          ctindex) {
-    if (is_free_worked(pcity, ptile)) {
-      continue;
-    } else if (city_can_work_tile(pcity, ptile)) {
-      compute_tile_production(pcity, ptile, &type); /* clobbers type */
+  for (ctindex = 0; ctindex < city_map_tiles_from_city(pcity); ctindex++) {
+    const int *tile_values = key->values + 2 + ctindex * CM_KEY_STRIDE;
+
+    if (tile_values[0]) {
+      output_type_iterate(o) {
+        type.production[o] = tile_values[1 + o]; /* clobbers type */
+      } output_type_iterate_end;
       tile_type_lattice_add(lattice, &type, ctindex); /* copy type if needed */
     }
-  } city_tile_iterate_index_end;
+  }
 
   /* Add all the specialists into the lattice.  */
-  init_specialist_lattice_nodes(lattice, pcity);
+  init_specialist_lattice_nodes(lattice, pcity, key);
 
   /* Set the lattice_depth fields, and clean up unreachable nodes. */
   top_sort_lattice(lattice);
@@ -1813,53 +2005,69 @@ static bool bb_next(struct cm_state *state, bool negative_ok)
 }
 
 /************************************************************************//**
-  Initialize the state for the branch-and-bound algorithm.
+  Make the copies of the lattice sorted by production, for the heuristic.
+  They depend on the tax rates and the city bonuses, so they are redone
+  for every query.
 ****************************************************************************/
-static struct cm_state *cm_state_init(struct city *pcity, bool negative_ok)
+static void sort_lattice_by_prod(struct cm_state *state)
 {
   const int SCIENCE = 0, TAX = 1, LUXURY = 2;
-  const struct player *pplayer = city_owner(pcity);
-  int numtypes;
-  struct cm_state *state = fc_malloc(sizeof(*state));
+  const struct city *pcity = state->pcity;
   int rates[3];
 
-  log_base(LOG_CM_STATE, "creating cm_state for %s (size %d)",
-           city_name_get(pcity), city_size_get(pcity));
+  get_tax_rates(city_owner(pcity), rates);
 
-  /* copy the arguments */
-  state->pcity = pcity;
-
-  /* create the lattice */
-  tile_type_vector_init(&state->lattice);
-  init_tile_lattice(pcity, &state->lattice);
-  numtypes = tile_type_vector_size(&state->lattice);
-
-  get_tax_rates(pplayer, rates);
-
-  /* For the heuristic, make sorted copies of the lattice */
   output_type_iterate(stat_index) {
-    tile_type_vector_init(&state->lattice_by_prod[stat_index]);
+    double trade_bonus;
+
     tile_type_vector_copy(&state->lattice_by_prod[stat_index], &state->lattice);
-    compare_key = stat_index;
     /* calculate effect of 1 trade production on interesting production */
     switch (stat_index) {
       case O_SCIENCE:
-        compare_key_trade_bonus = rates[SCIENCE] * pcity->bonus[O_TRADE] / 100.0;
+        trade_bonus = rates[SCIENCE] * pcity->bonus[O_TRADE] / 100.0;
 	break;
       case O_LUXURY:
-        compare_key_trade_bonus = rates[LUXURY] * pcity->bonus[O_TRADE] / 100.0;
+        trade_bonus = rates[LUXURY] * pcity->bonus[O_TRADE] / 100.0;
 	break;
       case O_GOLD:
-        compare_key_trade_bonus = rates[TAX] * pcity->bonus[O_TRADE] / 100.0;
+        trade_bonus = rates[TAX] * pcity->bonus[O_TRADE] / 100.0;
 	break;
       default:
-        compare_key_trade_bonus = 0.0;
+        trade_bonus = 0.0;
 	break;
     }
-    qsort(state->lattice_by_prod[stat_index].p, state->lattice_by_prod[stat_index].size,
-          sizeof(*state->lattice_by_prod[stat_index].p),
-          compare_tile_type_by_stat);
+    sort_lattice_by_stat(&state->lattice_by_prod[stat_index], stat_index,
+                         trade_bonus);
   } output_type_iterate_end;
+}
+
+/************************************************************************//**
+  Initialize the state for the branch-and-bound algorithm, with the
+  lattice built from 'key'.
+****************************************************************************/
+static struct cm_state *cm_state_init(struct city *pcity,
+                                      const struct cm_lattice_key *key,
+                                      bool negative_ok)
+{
+  int numtypes;
+  struct cm_state *state = fc_malloc(sizeof(*state));
+
+  log_base(LOG_CM_STATE, "creating cm_state for %s (size %d)",
+           city_name_get(pcity), city_size_get(pcity));
+
+  /* copy the arguments */
+  state->pcity = pcity;
+
+  /* create the lattice */
+  tile_type_vector_init(&state->lattice);
+  init_tile_lattice(pcity, &state->lattice, key);
+  numtypes = tile_type_vector_size(&state->lattice);
+
+  /* For the heuristic, make sorted copies of the lattice */
+  output_type_iterate(stat_index) {
+    tile_type_vector_init(&state->lattice_by_prod[stat_index]);
+  } output_type_iterate_end;
+  sort_lattice_by_prod(state);
 
   state->min_luxury = - FC_INFINITY;
 
@@ -1879,6 +2087,12 @@ static struct cm_state *cm_state_init(struct city *pcity, bool negative_ok)
   state->workers_map = fc_calloc(city_map_tiles_from_city(state->pcity),
                                  sizeof(state->workers_map));
 
+#ifdef GATHER_TIME_STATS
+  state->perf = NULL;
+  state->wall_timer = timer_new(TIMER_USER, TIMER_ACTIVE);
+  state->apply_count = 0;
+#endif /* GATHER_TIME_STATS */
+
   return state;
 }
 
@@ -1891,8 +2105,9 @@ static void begin_search(struct cm_state *state,
                          bool negative_ok)
 {
 #ifdef GATHER_TIME_STATS
-  timer_start(performance.current->wall_timer);
-  performance.current->query_count++;
+  timer_clear(state->wall_timer);
+  timer_start(state->wall_timer);
+  state->apply_count = 0;
 #endif
 
   /* copy the parameter and sort the main lattice by it */
@@ -1902,28 +2117,94 @@ static void begin_search(struct cm_state *state,
 
   /* clear out the old solution */
   state->best_value = worst_fitness();
+  destroy_partial_solution(&state->best);
+  init_partial_solution(&state->best, num_types(state),
+                        city_size_get(state->pcity), negative_ok);
   destroy_partial_solution(&state->current);
   init_partial_solution(&state->current, num_types(state),
 			city_size_get(state->pcity),
                         negative_ok);
   state->choice.size = 0;
+  state->min_luxury = - FC_INFINITY;
+}
+
+/************************************************************************//**
+  Use the solution of the last query on the city as the first best
+  solution of the search.  The workers are counted on the tile types of
+  the current lattice, so the solution must fit the city as it is now:
+  same radius, same size, and only tiles and specialists still usable.
+  Returns TRUE if the solution could be used.
+****************************************************************************/
+static bool warm_start_search(struct cm_state *state,
+                              const struct cm_result *last,
+                              bool negative_ok)
+{
+  struct partial_solution *soln = &state->best;
+  int i;
+
+  if (last->city_radius_sq != city_map_radius_sq_get(state->pcity)) {
+    return FALSE;
+  }
+
+  for (i = 0; i < num_types(state); i++) {
+    const struct cm_tile_type *ptype = tile_type_get(state, i);
+    int nworkers = 0;
+
+    if (ptype->is_specialist) {
+      nworkers = last->specialists[ptype->spec];
+    } else {
+      int j;
+
+      for (j = 0; j < tile_type_num_tiles(ptype); j++) {
+        if (last->worker_positions[tile_get(ptype, j)->index]) {
+          nworkers++;
+        }
+      }
+    }
+
+    if (nworkers > soln->idle) {
+      break;
+    }
+    add_workers(soln, i, nworkers, state);
+  }
+
+  if (i < num_types(state) || 0 != soln->idle) {
+    /* The city changed too much; start from scratch. */
+    destroy_partial_solution(soln);
+    init_partial_solution(soln, num_types(state),
+                          city_size_get(state->pcity), negative_ok);
+    return FALSE;
+  }
+
+  state->best_value = evaluate_solution(state, soln);
+  print_partial_solution(LOG_BETTER_LEAF, soln, state);
+  log_base(LOG_BETTER_LEAF, "-> warm start");
+
+  return TRUE;
 }
 
 
 /************************************************************************//**
   Clean up after a search.
-  Currently, does nothing except stop the timer and output.
+  Currently, does nothing except stop the timer and add the statistics
+  of the search to the totals.
 ****************************************************************************/
 static void end_search(struct cm_state *state)
 {
 #ifdef GATHER_TIME_STATS
-  timer_stop(performance.current->wall_timer);
+  timer_stop(state->wall_timer);
+
+  fc_allocate_mutex(&performance.mutex);
+  state->perf->seconds += timer_read_seconds(state->wall_timer);
+  state->perf->query_count++;
+  state->perf->apply_count += state->apply_count;
 
 #ifdef PRINT_TIME_STATS_EVERY_QUERY
-  print_performance(performance.current);
+  print_performance(state->perf);
 #endif
+  fc_release_mutex(&performance.mutex);
 
-  performance.current = NULL;
+  state->perf = NULL;
 #endif /* GATHER_TIME_STATS */
 }
 
@@ -1941,23 +2222,31 @@ static void cm_state_free(struct cm_state *state)
 
   FC_FREE(state->choice.stack);
   FC_FREE(state->workers_map);
+#ifdef GATHER_TIME_STATS
+  timer_destroy(state->wall_timer);
+#endif
   FC_FREE(state);
 }
 
 
 /************************************************************************//**
-  Run B&B until we find the best solution.
+  Run B&B until we find the best solution.  If 'last' is not NULL, the
+  search starts from this solution of a previous query.  If 'post' is not
+  NULL, its city part is set to the city with the solution applied, see
+  fingerprint_fill_city().
 ****************************************************************************/
 static void cm_find_best_solution(struct cm_state *state,
                                   const struct cm_parameter *const parameter,
-                                  struct cm_result *result, bool negative_ok)
+                                  struct cm_result *result, bool negative_ok,
+                                  const struct cm_result *last,
+                                  struct cm_fingerprint *post)
 {
   int loop_count = 0;
   int max_count;
   struct city backup;
 
 #ifdef GATHER_TIME_STATS
-  performance.current = &performance.opt;
+  state->perf = &performance.opt;
 #endif
 
   begin_search(state, parameter, negative_ok);
@@ -1965,6 +2254,10 @@ static void cm_find_best_solution(struct cm_state *state,
   /* make a backup of the city to restore at the very end */
   memcpy(&backup, state->pcity, sizeof(backup));
 
+  if (NULL != last) {
+    (void) warm_start_search(state, last, negative_ok);
+  }
+
   if (player_is_cpuhog(city_owner(state->pcity))) {
     max_count = CPUHOG_CM_MAX_LOOP;
   } else {
@@ -1989,30 +2282,394 @@ static void cm_find_best_solution(struct cm_state *state,
   /* convert to the caller's format */
   convert_solution_to_result(state, &state->best, result);
 
+  if (NULL != post) {
+    if (0 == state->best.idle) {
+      /* The city has the solution applied. */
+      fingerprint_fill_city(post, state->pcity);
+    } else {
+      post->num_values = 0;
+    }
+  }
+
+  /* The effect cache may have been allocated during the search. */
+  backup.effect_cache = state->pcity->effect_cache;
   memcpy(state->pcity, &backup, sizeof(backup));
 
   end_search(state);
 }
 
+/************************************************************************//**
+  Free the warm start data of a city.
+****************************************************************************/
+static void cm_warm_free(struct cm_warm *warm)
+{
+  int i;
+
+  if (NULL != warm->state) {
+    cm_state_free(warm->state);
+  }
+  cm_result_destroy(warm->last);
+  free(warm->key.values);
+  for (i = 0; i < CM_MEMO_SIZE; i++) {
+    free(warm->memo[i].fingerprint.values);
+    cm_result_destroy(warm->memo[i].result);
+  }
+  free(warm);
+}
+
+/************************************************************************//**
+  Return the state for a query on a real city: the one of the last query
+  if the lattice key did not change, else a new one built from 'key'.
+  Takes the ownership of the values of 'key'.
+****************************************************************************/
+static struct cm_state *cm_warm_state(struct cm_warm *warm,
+                                      struct city *pcity,
+                                      struct cm_lattice_key *key)
+{
+  if (NULL != warm->state && lattice_key_equal(key, &warm->key)) {
+    free(key->values);
+    warm->state->pcity = pcity;
+    sort_lattice_by_prod(warm->state);
+    return warm->state;
+  }
+
+  if (NULL != warm->state) {
+    cm_state_free(warm->state);
+  }
+  free(warm->key.values);
+  warm->key = *key;
+  /* The negative_ok parts of the state are set by begin_search(). */
+  warm->state = cm_state_init(pcity, &warm->key, FALSE);
+
+  return warm->state;
+}
+
+/************************************************************************//**
+  Copy the result 'src' into '*pdst', allocating it if needed.
+****************************************************************************/
+static void cm_result_dup(struct cm_result **pdst,
+                          const struct cm_result *src)
+{
+  struct cm_result *dst = *pdst;
+
+  if (NULL != dst && dst->city_radius_sq != src->city_radius_sq) {
+    cm_result_destroy(dst);
+    dst = NULL;
+  }
+  if (NULL == dst) {
+    dst = fc_calloc(1, sizeof(*dst));
+    dst->city_radius_sq = src->city_radius_sq;
+    dst->worker_positions
+      = fc_calloc(city_map_tiles(src->city_radius_sq),
+                  sizeof(*dst->worker_positions));
+    *pdst = dst;
+  }
+
+  dst->aborted = src->aborted;
+  dst->found_a_valid = src->found_a_valid;
+  dst->disorder = src->disorder;
+  dst->happy = src->happy;
+  memcpy(dst->surplus, src->surplus, sizeof(dst->surplus));
+  memcpy(dst->worker_positions, src->worker_positions,
+         city_map_tiles(src->city_radius_sq)
+         * sizeof(*src->worker_positions));
+  memcpy(dst->specialists, src->specialists, sizeof(dst->specialists));
+}
+
+/************************************************************************//**
+  Fill the part of the fingerprint which depends on the refreshed city:
+  its production, its citizens and its specialists.  This also catches
+  most changes of the effects, buildings and units of the city.  The part
+  is at the end of the fingerprint.
+****************************************************************************/
+static void fingerprint_fill_city(struct cm_fingerprint *fp,
+                                  const struct city *pcity)
+{
+  int *value = fp->values + fp->num_values - CM_FINGERPRINT_CITY_VALUES;
+  unsigned int hash = 0;
+  int i;
+
+  output_type_iterate(o) {
+    *value++ = pcity->surplus[o];
+    *value++ = pcity->waste[o];
+    *value++ = pcity->unhappy_penalty[o];
+    *value++ = pcity->prod[o];
+    *value++ = pcity->citizen_base[o];
+    *value++ = pcity->usage[o];
+    *value++ = pcity->bonus[o];
+  } output_type_iterate_end;
+  for (i = 0; i < CITIZEN_LAST; i++) {
+    int feel;
+
+    for (feel = 0; feel < FEELING_LAST; feel++) {
+      *value++ = pcity->feel[i][feel];
+    }
+  }
+  for (i = 0; i < SP_MAX; i++) {
+    *value++ = pcity->specialists[i];
+  }
+  *value++ = pcity->martial_law;
+  *value++ = pcity->unit_happy_upkeep;
+  fc_assert(value == fp->values + fp->num_values);
+
+  for (i = 0; i < fp->num_values; i++) {
+    hash = hash * 31 + fp->values[i];
+  }
+  fp->hash = hash;
+}
+
+/************************************************************************//**
+  Fill the fingerprint of a query: the lattice key, the parameter, the tax
+  rates, the effects, and the refreshed city.
+
+  Some effects, like a waste reduction in a city working no tile, do not
+  show in the refreshed city.  The changes of the buildings, techs and
+  terrains are seen through the generation of the effect values.  The
+  owner and its government are added as that generation does not cover
+  them, and the turn covers the effects of the turn, the year and the
+  multipliers.
+****************************************************************************/
+static void fingerprint_fill(struct cm_fingerprint *fp,
+                             const struct cm_lattice_key *key,
+                             const struct city *pcity,
+                             const struct cm_parameter *param,
+                             bool negative_ok)
+{
+  int *value;
+  int rates[3];
+
+  fp->num_values = key->num_values + 2 * O_LAST + 5 + 3 + 4
+                   + CM_FINGERPRINT_CITY_VALUES;
+  fp->values = fc_realloc(fp->values, fp->num_values * sizeof(*fp->values));
+
+  memcpy(fp->values, key->values, key->num_values * sizeof(*key->values));
+  value = fp->values + key->num_values;
+
+  output_type_iterate(o) {
+    *value++ = param->minimal_surplus[o];
+    *value++ = param->factor[o];
+  } output_type_iterate_end;
+  *value++ = param->require_happy;
+  *value++ = param->allow_disorder;
+  *value++ = param->allow_specialists;
+  *value++ = param->happy_factor;
+  *value++ = negative_ok;
+
+  get_tax_rates(city_owner(pcity), rates);
+  *value++ = rates[0];
+  *value++ = rates[1];
+  *value++ = rates[2];
+
+  *value++ = effect_value_cache_generation();
+  *value++ = player_number(city_owner(pcity));
+  *value++ = government_number(government_of_city(pcity));
+  *value++ = game.info.turn;
+
+  fingerprint_fill_city(fp, pcity);
+}
+
+/************************************************************************//**
+  Look for the result of a previous query with the same fingerprint, and
+  copy it into 'result'.  Returns TRUE if one was found.
+****************************************************************************/
+static bool cm_memo_lookup(const struct cm_warm *warm,
+                           const struct cm_fingerprint *fp,
+                           struct cm_result *result)
+{
+  int i;
+
+  for (i = 0; i < CM_MEMO_SIZE; i++) {
+    const struct cm_memo *memo = warm->memo + i;
+
+    if (memo->fingerprint.hash == fp->hash
+        && memo->fingerprint.num_values == fp->num_values
+        && 0 == memcmp(memo->fingerprint.values, fp->values,
+                       fp->num_values * sizeof(*fp->values))
+        && memo->result->city_radius_sq == result->city_radius_sq) {
+      cm_result_dup(&result, memo->result);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/************************************************************************//**
+  Remember the result of a query.
+****************************************************************************/
+static void cm_memo_store(struct cm_warm *warm,
+                          const struct cm_fingerprint *fp,
+                          const struct cm_result *result)
+{
+  struct cm_memo *memo;
+  int i;
+
+  if (0 == fp->num_values) {
+    return;
+  }
+
+  for (i = 0; i < CM_MEMO_SIZE; i++) {
+    if (warm->memo[i].fingerprint.num_values == fp->num_values
+        && warm->memo[i].fingerprint.hash == fp->hash
+        && 0 == memcmp(warm->memo[i].fingerprint.values, fp->values,
+                       fp->num_values * sizeof(*fp->values))) {
+      /* Same query, update it. */
+      cm_result_dup(&warm->memo[i].result, result);
+      return;
+    }
+  }
+
+  memo = warm->memo + warm->memo_next;
+  warm->memo_next = (warm->memo_next + 1) % CM_MEMO_SIZE;
+
+  memo->fingerprint.hash = fp->hash;
+  memo->fingerprint.num_values = fp->num_values;
+  memo->fingerprint.values
+    = fc_realloc(memo->fingerprint.values,
+                 fp->num_values * sizeof(*fp->values));
+  memcpy(memo->fingerprint.values, fp->values,
+         fp->num_values * sizeof(*fp->values));
+  cm_result_dup(&memo->result, result);
+}
+
+/************************************************************************//**
+  Query a real city: return the remembered result if the city and the
+  parameter did not change since a previous query, else search from the
+  data of the last query.
+****************************************************************************/
+static void cm_warm_query_result(struct cm_warm *warm, struct city *pcity,
+                                 const struct cm_parameter *param,
+                                 struct cm_result *result, bool negative_ok)
+{
+  struct cm_lattice_key key = { 0, NULL };
+  struct cm_fingerprint pre = { 0, 0, NULL }, post = { 0, 0, NULL };
+  struct cm_state *state;
+
+  lattice_key_fill(&key, pcity);
+
+  /* See cm_query_result(). */
+  city_refresh_from_main_map(pcity, NULL);
+
+  fingerprint_fill(&pre, &key, pcity, param, negative_ok);
+  if (cm_memo_lookup(warm, &pre, result)) {
+    free(key.values);
+    free(pre.values);
+    return;
+  }
+
+  /* Same parameter part, the city part is set by the search. */
+  post.num_values = pre.num_values;
+  post.values = fc_malloc(pre.num_values * sizeof(*pre.values));
+  memcpy(post.values, pre.values, pre.num_values * sizeof(*pre.values));
+
+  state = cm_warm_state(warm, pcity, &key);
+  cm_find_best_solution(state, param, result, negative_ok, warm->last,
+                        &post);
+
+  if (result->city_radius_sq == city_map_radius_sq_get(pcity)) {
+    cm_result_dup(&warm->last, result);
+    cm_memo_store(warm, &pre, result);
+    cm_memo_store(warm, &post, result);
+  }
+
+  free(pre.values);
+  free(post.values);
+}
+
 /************************************************************************//**
   Wrapper that actually runs the branch & bound, and returns the best
   solution.
+
+  For real cities, the results are remembered, and the lattice and the
+  solution are kept for the next query on the same city (warm start).
+  Virtual cities are always solved from scratch.
 ****************************************************************************/
 void cm_query_result(struct city *pcity,
                      const struct cm_parameter *param,
                      struct cm_result *result, bool negative_ok)
 {
-  struct cm_state *state = cm_state_init(pcity, negative_ok);
+  struct cm_lattice_key key = { 0, NULL };
+  struct cm_state *state;
+
+  if (NULL != cm_warms && IDENTITY_NUMBER_ZERO != pcity->id
+      && pcity == game_city_by_number(pcity->id)) {
+    struct cm_warm *warm;
+
+    fc_allocate_mutex(&cm_warms_mutex);
+    if (!cm_warm_hash_lookup(cm_warms, pcity->id, &warm)) {
+      warm = fc_calloc(1, sizeof(*warm));
+      cm_warm_hash_insert(cm_warms, pcity->id, warm);
+    }
+    fc_release_mutex(&cm_warms_mutex);
+
+    cm_warm_query_result(warm, pcity, param, result, negative_ok);
+    return;
+  }
+
+  lattice_key_fill(&key, pcity);
+  state = cm_state_init(pcity, &key, negative_ok);
+  free(key.values);
 
   /* Refresh the city.  Otherwise the CM can give wrong results or just be
    * slower than necessary.  Note that cities are often passed in in an
    * unrefreshed state (which should probably be fixed). */
   city_refresh_from_main_map(pcity, NULL);
 
-  cm_find_best_solution(state, param, result, negative_ok);
+  cm_find_best_solution(state, param, result, negative_ok, NULL, NULL);
   cm_state_free(state);
 }
 
+/************************************************************************//**
+  Query the cities of one task of cm_query_results().
+****************************************************************************/
+static void cm_query_task(int task, void *data)
+{
+  const struct cm_query_tasks *tasks = data;
+  int i;
+
+  for (i = tasks->task_start[task]; i < tasks->task_start[task + 1];
+       i++) {
+    int j = tasks->order[i];
+
+    cm_query_result(tasks->cities[j], &tasks->params[j], tasks->results[j],
+                    tasks->negative_ok);
+  }
+}
+
+/************************************************************************//**
+  cm_query_result() for each of the 'n' cities: results[i] is set to the
+  best solution for cities[i] and params[i].  The cities must be
+  different.
+
+  Every query works on its own state, and only changes its city while it
+  runs, so they run in up to 'num_threads' threads.  The refresh of a
+  city reads its trade partners, so the cities linked by trade routes are
+  queried in the same thread, see city_trade_groups().  The results are
+  the same as with queries in order.
+****************************************************************************/
+void cm_query_results(struct city **cities,
+                      const struct cm_parameter *params,
+                      struct cm_result **results, int n,
+                      bool negative_ok, int num_threads)
+{
+  num_threads = MIN(num_threads, n / CM_QUERY_MIN_PER_THREAD);
+
+  if (num_threads <= 1) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+      cm_query_result(cities[i], &params[i], results[i], negative_ok);
+    }
+  } else {
+    int order[n], task_start[n + 1];
+    struct cm_query_tasks tasks = { cities, params, results, negative_ok,
+                                    order, task_start };
+    int num_tasks = city_trade_groups(cities, n, order, task_start);
+
+    fc_thread_run_tasks(num_tasks, num_threads, cm_query_task, &tasks);
+  }
+}
+
 /************************************************************************//**
   Returns true if the two cm_parameters are equal.
 ****************************************************************************/
@@ -2284,7 +2941,7 @@ static void print_performance(struct one_perf *counts)
   double q;
   int queries, applies;
 
-  s = timer_read_seconds(counts->wall_timer);
+  s = counts->seconds;
   ms = 1000.0 * s;
 
   queries = counts->query_count;
@@ -62,6 +62,7 @@ struct cm_result {
 void cm_init(void);
 void cm_init_citymap(void);
 void cm_clear_cache(struct city *pcity);
+void cm_city_free(const struct city *pcity);
 void cm_free(void);
 
 struct cm_result *cm_result_new(struct city *pcity);
@@ -77,11 +78,23 @@ void cm_query_result(struct city *pcity,
 		     struct cm_result *result, bool negative_ok);
 
 /*
- * Call this function if the city has changed. To be safe call it
- * everytime before you call cm_query_result().
+ * The results of cm_query_result() are remembered per city, and are
+ * reused as long as the tiles, the specialists, the refreshed state of
+ * the city and the parameter are the same. Call this function if the
+ * city has changed in a way which may change the result without
+ * changing any of those.
  */
 void cm_clear_cache(struct city *pcity);
 
+/*
+ * cm_query_result() for many cities at once, spread over up to
+ * 'num_threads' threads. The cities must be different.
+ */
+void cm_query_results(struct city **cities,
+                      const struct cm_parameter *params,
+                      struct cm_result **results, int n,
+                      bool negative_ok, int num_threads);
+
 /***************** utility methods *************************************/
 bool cm_are_parameter_equal(const struct cm_parameter *const p1,
 			    const struct cm_parameter *const p2);
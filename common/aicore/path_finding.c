@@ -15,6 +15,8 @@
 #include <fc_config.h>
 #endif
 
+#include <string.h>
+
 /* utility */
 #include "bitvector.h"
 #include "log.h"
@@ -56,8 +58,8 @@ enum pf_mode {
 #endif /* PF_DEBUG */
 
 enum pf_node_status {
-  NS_UNINIT = 0,        /* memory is calloced, hence zero means
-                         * uninitialised. */
+  NS_UNINIT = 0,        /* nodes are zeroed before their first use,
+                         * hence zero means uninitialised. */
   NS_INIT,              /* node initialized, but we didn't search a route
                          * yet. */
   NS_NEW,               /* the optimal route isn't found yet. */
@@ -191,12 +193,161 @@ static inline void pf_finalize_position(const struct pf_parameter *param,
   }
 }
 
+/************************************************************************//**
+  Lower bound of the MC still needed to reach the goal of the parameter
+  from 'ptile', reached with 'cost' (see pf_turns()). It is the cost of
+  the real_map_distance() steps of 'goal_min_MC' each, reduced at the end
+  of every turn as pf_normal_map_adjust_cost() does. A step never costs
+  less, so this is a consistent estimate: the tiles processed with it
+  still get their best cost.
+****************************************************************************/
+static inline int pf_goal_MC(const struct pf_parameter *param,
+                             const struct tile *ptile, int cost)
+{
+  int move_rate = pf_move_rate(param);
+  int min_MC = param->goal_min_MC;
+  int moves_left, dist, steps;
+
+  if (NULL == param->goal_tile || 0 >= min_MC || 0 >= move_rate) {
+    return 0;
+  }
+
+  dist = real_map_distance(ptile, param->goal_tile);
+  moves_left = pf_moves_left(param, cost);
+
+  /* Steps until the end of this turn. */
+  steps = (moves_left + min_MC - 1) / min_MC;
+  if (dist < steps) {
+    return dist * min_MC;
+  }
+
+  /* Then full turns, and the steps of the last turn. */
+  dist -= steps;
+  steps = (move_rate + min_MC - 1) / min_MC;
+
+  return (moves_left + dist / steps * move_rate
+          + dist % steps * min_MC);
+}
+
 static struct pf_path *
 pf_path_new_to_start_tile(const struct pf_parameter *param);
 static void pf_position_fill_start_tile(struct pf_position *pos,
                                         const struct pf_parameter *param);
 
 
+/* ============================ Lattice pool ============================= */
+
+/* The lattices hold one node per tile, and the maps are created and
+ * destroyed very often, notably by the AI. So the lattices of the
+ * destroyed maps are kept for the next maps of the same kind. Instead of
+ * clearing the whole lattice, each node records the generation of the map
+ * which used it last. The nodes of older generations are considered as
+ * uninitialised, and are cleared when accessed for the first time (see
+ * pf_normal_map_node() and co.).
+ *
+ * The pools are not protected against concurrent accesses, the maps must
+ * be created and destroyed by the main thread only. */
+
+/* Maximum number of idle lattices kept for every kind of map. */
+#define PF_LATTICE_POOL_SIZE 8
+
+/* A lattice of nodes. */
+struct pf_lattice {
+  void *nodes;                  /* Array of 'size' nodes. */
+  int size;                     /* MAP_INDEX_SIZE at allocation time. */
+  unsigned short generation;    /* Generation of the current map. Never 0,
+                                 * which is the one of unused nodes. */
+};
+
+/* Idle lattices for one kind of map. */
+struct pf_lattice_pool {
+  size_t node_size;
+  /* Free the memory referenced by a node, can be NULL. */
+  void (*node_release) (void *node);
+  int num;
+  struct pf_lattice idle[PF_LATTICE_POOL_SIZE];
+};
+
+/************************************************************************//**
+  Release the memory referenced by all the nodes of the lattice, whatever
+  their generation.
+****************************************************************************/
+static void pf_lattice_release_nodes(const struct pf_lattice_pool *pool,
+                                     struct pf_lattice *lattice)
+{
+  if (NULL != pool->node_release) {
+    char *node = lattice->nodes;
+    int i;
+
+    for (i = 0; i < lattice->size; i++, node += pool->node_size) {
+      pool->node_release(node);
+    }
+  }
+}
+
+/************************************************************************//**
+  Free the lattice completely.
+****************************************************************************/
+static void pf_lattice_free(const struct pf_lattice_pool *pool,
+                            struct pf_lattice *lattice)
+{
+  pf_lattice_release_nodes(pool, lattice);
+  free(lattice->nodes);
+  lattice->nodes = NULL;
+}
+
+/************************************************************************//**
+  Get a lattice for a new map, from the pool if possible. All the nodes are
+  uninitialised for the new generation.
+****************************************************************************/
+static void pf_lattice_get(struct pf_lattice_pool *pool,
+                           struct pf_lattice *lattice)
+{
+  while (0 < pool->num) {
+    *lattice = pool->idle[--pool->num];
+    if (lattice->size == MAP_INDEX_SIZE) {
+      if (0 == ++lattice->generation) {
+        /* Wrapped around, the old nodes would look in use again. */
+        pf_lattice_release_nodes(pool, lattice);
+        memset(lattice->nodes, 0, lattice->size * pool->node_size);
+        lattice->generation = 1;
+      }
+      return;
+    }
+    /* Made for a map of another size. */
+    pf_lattice_free(pool, lattice);
+  }
+
+  lattice->size = MAP_INDEX_SIZE;
+  lattice->nodes = fc_calloc(lattice->size, pool->node_size);
+  lattice->generation = 1;
+}
+
+/************************************************************************//**
+  Give back the lattice of a destroyed map to the pool.
+****************************************************************************/
+static void pf_lattice_put(struct pf_lattice_pool *pool,
+                           struct pf_lattice *lattice)
+{
+  if (PF_LATTICE_POOL_SIZE > pool->num
+      && lattice->size == MAP_INDEX_SIZE) {
+    pool->idle[pool->num++] = *lattice;
+  } else {
+    pf_lattice_free(pool, lattice);
+  }
+}
+
+/************************************************************************//**
+  Free all the idle lattices of the pool.
+****************************************************************************/
+static void pf_lattice_pool_free(struct pf_lattice_pool *pool)
+{
+  while (0 < pool->num) {
+    pf_lattice_free(pool, &pool->idle[--pool->num]);
+  }
+}
+
+
 /* ================ Specific pf_normal_* mode structures ================= */
 
 /* Normal path-finding maps are used for most of units with standard rules.
@@ -220,6 +371,7 @@ struct pf_normal_node {
   unsigned behavior : 2;        /* 'enum tile_behavior' really. */
   unsigned zoc_number : 2;      /* 'enum pf_zoc_type' really. */
   unsigned short extra_tile;    /* EC */
+  unsigned short generation;    /* See pf_lattice_get(). */
 };
 
 /* Derived structure of struct pf_map. */
@@ -229,7 +381,8 @@ struct pf_normal_map {
   struct map_index_pq *queue; /* Queue of nodes we have reached but not
                                * processed yet (NS_NEW), sorted by their
                                * total_CC. */
-  struct pf_normal_node *lattice; /* Lattice of nodes. */
+  struct pf_lattice lattice;    /* Lattice of nodes, see
+                                 * pf_normal_map_node(). */
 };
 
 /* Up-cast macro. */
@@ -251,6 +404,25 @@ pf_normal_map_check(struct pf_map *pfm, const char *file,
 
 /* ================  Specific pf_normal_* mode functions ================= */
 
+/************************************************************************//**
+  Return the node at 'tindex'. Clears it if it was left by a previous map
+  (see pf_lattice_get()).
+****************************************************************************/
+static inline struct pf_normal_node *
+pf_normal_map_node(const struct pf_normal_map *pfnm, int tindex)
+{
+  struct pf_normal_node *node = pfnm->lattice.nodes;
+
+  node += tindex;
+
+  if (node->generation != pfnm->lattice.generation) {
+    memset(node, 0, sizeof(*node));
+    node->generation = pfnm->lattice.generation;
+  }
+
+  return node;
+}
+
 /************************************************************************//**
   Calculates cached values of the target node. Set the node status to
   NS_INIT to avoid recalculating all values. Returns FALSE if we cannot
@@ -328,7 +500,7 @@ static inline bool pf_normal_node_init(struct pf_normal_map *pfnm,
       node->action = action;
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
     } else {
-      /* Nodes are allocated by fc_calloc(), so should be already set to
+      /* Nodes are zeroed before use, so should be already set to
        * 0. */
       node->action = PF_ACTION_NONE;
 #endif
@@ -365,7 +537,7 @@ static inline bool pf_normal_node_init(struct pf_normal_map *pfnm,
                           ? ZOC_ALLIED : ZOC_NO);
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
     } else {
-      /* Nodes are allocated by fc_calloc(), so should be already set to
+      /* Nodes are zeroed before use, so should be already set to
        * 0. */
       node->zoc_number = ZOC_MINE;
 #endif
@@ -373,7 +545,7 @@ static inline bool pf_normal_node_init(struct pf_normal_map *pfnm,
   } else {
     node->move_scope = PF_MS_NATIVE;
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
-    /* Nodes are allocated by fc_calloc(), so  should be already set to 0. */
+    /* Nodes are zeroed before use, so  should be already set to 0. */
     node->action = PF_ACTION_NONE;
     node->zoc_number = ZOC_MINE;
 #endif
@@ -384,7 +556,7 @@ static inline bool pf_normal_node_init(struct pf_normal_map *pfnm,
     node->extra_tile = params->get_EC(ptile, node_known_type, params);
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
   } else {
-    /* Nodes are allocated by fc_calloc(), so  should be already set to 0. */
+    /* Nodes are zeroed before use, so  should be already set to 0. */
     node->extra_tile = 0;
 #endif
   }
@@ -401,7 +573,7 @@ static void pf_normal_map_fill_position(const struct pf_normal_map *pfnm,
                                         struct pf_position *pos)
 {
   int tindex = tile_index(ptile);
-  struct pf_normal_node *node = pfnm->lattice + tindex;
+  struct pf_normal_node *node = pf_normal_map_node(pfnm, tindex);
   const struct pf_parameter *params = pf_map_parameter(PF_MAP(pfnm));
 
 #ifdef PF_DEBUG
@@ -436,7 +608,8 @@ static struct pf_path *
 pf_normal_map_construct_path(const struct pf_normal_map *pfnm,
                              struct tile *dest_tile)
 {
-  struct pf_normal_node *node = pfnm->lattice + tile_index(dest_tile);
+  struct pf_normal_node *node = pf_normal_map_node(pfnm,
+                                                   tile_index(dest_tile));
   const struct pf_parameter *params = pf_map_parameter(PF_MAP(pfnm));
   enum direction8 dir_next = direction8_invalid();
   struct pf_path *path;
@@ -461,7 +634,7 @@ pf_normal_map_construct_path(const struct pf_normal_map *pfnm,
     }
 
     ptile = mapstep(params->map, ptile, DIR_REVERSE(node->dir_to_here));
-    node = pfnm->lattice + tile_index(ptile);
+    node = pf_normal_map_node(pfnm, tile_index(ptile));
   }
 
   /* 2: Allocate the memory */
@@ -470,7 +643,7 @@ pf_normal_map_construct_path(const struct pf_normal_map *pfnm,
 
   /* 3: Backtrack again and fill the positions this time */
   ptile = dest_tile;
-  node = pfnm->lattice + tile_index(ptile);
+  node = pf_normal_map_node(pfnm, tile_index(ptile));
 
   for (; i >= 0; i--) {
     pf_normal_map_fill_position(pfnm, ptile, &path->positions[i]);
@@ -482,7 +655,7 @@ pf_normal_map_construct_path(const struct pf_normal_map *pfnm,
     if (i > 0) {
       /* Step further back, if we haven't finished yet */
       ptile = mapstep(params->map, ptile, DIR_REVERSE(dir_next));
-      node = pfnm->lattice + tile_index(ptile);
+      node = pf_normal_map_node(pfnm, tile_index(ptile));
     }
   }
 
@@ -521,7 +694,7 @@ static bool pf_jumbo_map_iterate(struct pf_map *pfm)
   struct pf_normal_map *pfnm = PF_NORMAL_MAP(pfm);
   struct tile *tile = pfm->tile;
   int tindex = tile_index(tile);
-  struct pf_normal_node *node = pfnm->lattice + tindex;
+  struct pf_normal_node *node = pf_normal_map_node(pfnm, tindex);
   const struct pf_parameter *params = pf_map_parameter(pfm);
 
   /* Processing Stage */
@@ -534,7 +707,7 @@ static bool pf_jumbo_map_iterate(struct pf_map *pfm)
     /* Calculate the cost of every adjacent position and set them in the
      * priority queue for next call to pf_jumbo_map_iterate(). */
     int tindex1 = tile_index(tile1);
-    struct pf_normal_node *node1 = pfnm->lattice + tindex1;
+    struct pf_normal_node *node1 = pf_normal_map_node(pfnm, tindex1);
     int priority, cost1, extra_cost1;
 
     /* As for the previous position, 'tile1', 'node1' and 'tindex1' are
@@ -582,12 +755,12 @@ static bool pf_jumbo_map_iterate(struct pf_map *pfm)
   }
 
 #ifdef PF_DEBUG
-  fc_assert(NS_NEW == pfnm->lattice[tindex].status);
+  fc_assert(NS_NEW == pf_normal_map_node(pfnm, tindex)->status);
 #endif
 
   /* Change the pf_map iterator. Node status step B. to C. */
   pfm->tile = index_to_tile(params->map, tindex);
-  pfnm->lattice[tindex].status = NS_PROCESSED;
+  pf_normal_map_node(pfnm, tindex)->status = NS_PROCESSED;
 
   return TRUE;
 }
@@ -613,7 +786,7 @@ static bool pf_normal_map_iterate(struct pf_map *pfm)
   struct pf_normal_map *pfnm = PF_NORMAL_MAP(pfm);
   struct tile *tile = pfm->tile;
   int tindex = tile_index(tile);
-  struct pf_normal_node *node = pfnm->lattice + tindex;
+  struct pf_normal_node *node = pf_normal_map_node(pfnm, tindex);
   const struct pf_parameter *params = pf_map_parameter(pfm);
   int cost_of_path;
   enum pf_move_scope scope = node->move_scope;
@@ -632,7 +805,7 @@ static bool pf_normal_map_iterate(struct pf_map *pfm)
       /* Calculate the cost of every adjacent position and set them in the
        * priority queue for next call to pf_normal_map_iterate(). */
       int tindex1 = tile_index(tile1);
-      struct pf_normal_node *node1 = pfnm->lattice + tindex1;
+      struct pf_normal_node *node1 = pf_normal_map_node(pfnm, tindex1);
       int cost;
       int extra = 0;
 
@@ -680,7 +853,8 @@ static bool pf_normal_map_iterate(struct pf_map *pfm)
       } else if (node1->node_known_type == TILE_UNKNOWN) {
         cost = params->utype->unknown_move_cost;
       } else {
-        cost = params->get_MC(tile, scope, tile1, node1->move_scope, params);
+        cost = params->get_MC(tile, scope, dir, tile1, node1->move_scope,
+                              params);
       }
       if (cost == PF_IMPOSSIBLE_MC) {
         continue;
@@ -710,8 +884,11 @@ static bool pf_normal_map_iterate(struct pf_map *pfm)
         node1->extra_cost = extra;
         node1->cost = cost;
         node1->dir_to_here = dir;
-        /* As we prefer lower costs, let's reverse the cost of the path. */
-        map_index_pq_insert(pfnm->queue, tindex1, -cost_of_path);
+        /* As we prefer lower costs, let's reverse the cost of the path.
+         * With a goal, add the estimated cost to reach it. */
+        map_index_pq_insert(pfnm->queue, tindex1,
+                            -(cost_of_path + PF_TURN_FACTOR
+                              * pf_goal_MC(params, tile1, cost)));
       } else if (cost_of_path < pf_total_CC(params, node1->cost,
                                             node1->extra_cost)) {
         /* We found a better route to 'tile1'. Let's register 'tindex1' to
@@ -721,7 +898,9 @@ static bool pf_normal_map_iterate(struct pf_map *pfm)
         node1->cost = cost;
         node1->dir_to_here = dir;
         /* As we prefer lower costs, let's reverse the cost of the path. */
-        map_index_pq_replace(pfnm->queue, tindex1, -cost_of_path);
+        map_index_pq_replace(pfnm->queue, tindex1,
+                             -(cost_of_path + PF_TURN_FACTOR
+                               * pf_goal_MC(params, tile1, cost)));
       }
     } adjc_dir_iterate_end;
   }
@@ -733,12 +912,12 @@ static bool pf_normal_map_iterate(struct pf_map *pfm)
   }
 
 #ifdef PF_DEBUG
-  fc_assert(NS_NEW == pfnm->lattice[tindex].status);
+  fc_assert(NS_NEW == pf_normal_map_node(pfnm, tindex)->status);
 #endif
 
   /* Change the pf_map iterator. Node status step C. to D. */
   pfm->tile = index_to_tile(params->map, tindex);
-  pfnm->lattice[tindex].status = NS_PROCESSED;
+  pf_normal_map_node(pfnm, tindex)->status = NS_PROCESSED;
 
   return TRUE;
 }
@@ -750,7 +929,7 @@ static inline bool pf_normal_map_iterate_until(struct pf_normal_map *pfnm,
                                                struct tile *ptile)
 {
   struct pf_map *pfm = PF_MAP(pfnm);
-  struct pf_normal_node *node = pfnm->lattice + tile_index(ptile);
+  struct pf_normal_node *node = pf_normal_map_node(pfnm, tile_index(ptile));
 
   if (NULL == pf_map_parameter(pfm)->get_costs) {
     /* Start position is handled in every function calling this function. */
@@ -789,7 +968,7 @@ static int pf_normal_map_move_cost(struct pf_map *pfm, struct tile *ptile)
   if (ptile == pfm->params.start_tile) {
     return 0;
   } else if (pf_normal_map_iterate_until(pfnm, ptile)) {
-    return (pfnm->lattice[tile_index(ptile)].cost
+    return (pf_normal_map_node(pfnm, tile_index(ptile))->cost
             - pf_move_rate(pf_map_parameter(pfm))
             + pf_moves_left_initially(pf_map_parameter(pfm)));
   } else {
@@ -836,6 +1015,11 @@ static bool pf_normal_map_position(struct pf_map *pfm, struct tile *ptile,
   }
 }
 
+/* Idle lattices for pf_normal_map. */
+static struct pf_lattice_pool pf_normal_lattices = {
+  sizeof(struct pf_normal_node), NULL, 0
+};
+
 /************************************************************************//**
   'pf_normal_map' destructor.
 ****************************************************************************/
@@ -843,7 +1027,7 @@ static void pf_normal_map_destroy(struct pf_map *pfm)
 {
   struct pf_normal_map *pfnm = PF_NORMAL_MAP(pfm);
 
-  free(pfnm->lattice);
+  pf_lattice_put(&pf_normal_lattices, &pfnm->lattice);
   map_index_pq_destroy(pfnm->queue);
   free(pfnm);
 }
@@ -867,7 +1051,7 @@ static struct pf_map *pf_normal_map_new(const struct pf_parameter *parameter)
 #endif /* PF_DEBUG */
 
   /* Allocate the map. */
-  pfnm->lattice = fc_calloc(MAP_INDEX_SIZE, sizeof(struct pf_normal_node));
+  pf_lattice_get(&pf_normal_lattices, &pfnm->lattice);
   pfnm->queue = map_index_pq_new(INITIAL_QUEUE_SIZE);
 
   if (NULL == parameter->get_costs) {
@@ -893,7 +1077,7 @@ static struct pf_map *pf_normal_map_new(const struct pf_parameter *parameter)
   }
 
   /* Initialise starting node. */
-  node = pfnm->lattice + tile_index(params->start_tile);
+  node = pf_normal_map_node(pfnm, tile_index(params->start_tile));
   if (NULL == params->get_costs) {
     if (!pf_normal_node_init(pfnm, node, params->start_tile, PF_MS_NONE)) {
       /* Always fails. */
@@ -931,6 +1115,39 @@ static struct pf_map *pf_normal_map_new(const struct pf_parameter *parameter)
   return PF_MAP(pfnm);
 }
 
+/************************************************************************//**
+  Add 'ptile' as another start position of a 'pf_normal_map' which has not
+  been iterated yet. The paths from it cannot be constructed, only the
+  costs are meaningful. Returns FALSE if the path-finding cannot start
+  from 'ptile'.
+****************************************************************************/
+static bool pf_normal_map_add_source(struct pf_normal_map *pfnm,
+                                     struct tile *ptile)
+{
+  const struct pf_parameter *params = pf_map_parameter(PF_MAP(pfnm));
+  int tindex = tile_index(ptile);
+  struct pf_normal_node *node = pf_normal_map_node(pfnm, tindex);
+
+  if (NS_UNINIT != node->status) {
+    /* Already a start position. */
+    return TRUE;
+  }
+
+  if (!pf_normal_node_init(pfnm, node, ptile, PF_MS_NONE)) {
+    return FALSE;
+  }
+
+  /* Same cost as the start tile, see pf_normal_map_new(). */
+  node->cost = pf_move_rate(params) - pf_moves_left_initially(params);
+  node->extra_cost = 0;
+  node->dir_to_here = direction8_invalid();
+  node->status = NS_NEW;
+  map_index_pq_insert(pfnm->queue, tindex,
+                      -pf_total_CC(params, node->cost, 0));
+
+  return TRUE;
+}
+
 
 /* ================ Specific pf_danger_* mode structures ================= */
 
@@ -959,6 +1176,7 @@ struct pf_danger_node {
   bool is_dangerous : 1;        /* Whether we cannot end the turn there. */
   bool waited : 1;              /* TRUE if waited to get there. */
   unsigned short extra_tile;    /* EC */
+  unsigned short generation;    /* See pf_lattice_get(). */
 
   /* Segment leading across the danger area back to the nearest safe node:
    * need to remeber costs and stuff. */
@@ -977,7 +1195,8 @@ struct pf_danger_map {
                                  * processed yet (NS_NEW and NS_WAITING),
                                  * sorted by their total_CC. */
   struct map_index_pq *danger_queue; /* Dangerous positions. */
-  struct pf_danger_node *lattice; /* Lattice of nodes. */
+  struct pf_lattice lattice;    /* Lattice of nodes, see
+                                 * pf_danger_map_node(). */
 };
 
 /* Up-cast macro. */
@@ -999,6 +1218,39 @@ pf_danger_map_check(struct pf_map *pfm, const char *file,
 
 /* ===============  Specific pf_danger_* mode functions ================== */
 
+/************************************************************************//**
+  Free the danger segment of the node.
+****************************************************************************/
+static void pf_danger_node_release(void *node)
+{
+  struct pf_danger_node *pnode = node;
+
+  if (NULL != pnode->danger_segment) {
+    free(pnode->danger_segment);
+    pnode->danger_segment = NULL;
+  }
+}
+
+/************************************************************************//**
+  Return the node at 'tindex'. Clears it if it was left by a previous map
+  (see pf_lattice_get()).
+****************************************************************************/
+static inline struct pf_danger_node *
+pf_danger_map_node(const struct pf_danger_map *pfdm, int tindex)
+{
+  struct pf_danger_node *node = pfdm->lattice.nodes;
+
+  node += tindex;
+
+  if (node->generation != pfdm->lattice.generation) {
+    pf_danger_node_release(node);
+    memset(node, 0, sizeof(*node));
+    node->generation = pfdm->lattice.generation;
+  }
+
+  return node;
+}
+
 /************************************************************************//**
   Calculates cached values of the target node. Set the node status to
   NS_INIT to avoid recalculating all values. Returns FALSE if we cannot
@@ -1076,7 +1328,7 @@ static inline bool pf_danger_node_init(struct pf_danger_map *pfdm,
       node->action = action;
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
     } else {
-      /* Nodes are allocated by fc_calloc(), so should be already set to
+      /* Nodes are zeroed before use, so should be already set to
        * 0. */
       node->action = PF_ACTION_NONE;
 #endif
@@ -1113,7 +1365,7 @@ static inline bool pf_danger_node_init(struct pf_danger_map *pfdm,
                           ? ZOC_ALLIED : ZOC_NO);
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
     } else {
-      /* Nodes are allocated by fc_calloc(), so should be already set to
+      /* Nodes are zeroed before use, so should be already set to
        * 0. */
       node->zoc_number = ZOC_MINE;
 #endif
@@ -1121,7 +1373,7 @@ static inline bool pf_danger_node_init(struct pf_danger_map *pfdm,
   } else {
     node->move_scope = PF_MS_NATIVE;
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
-    /* Nodes are allocated by fc_calloc(), so  should be already set to 0. */
+    /* Nodes are zeroed before use, so  should be already set to 0. */
     node->action = PF_ACTION_NONE;
     node->zoc_number = ZOC_MINE;
 #endif
@@ -1132,13 +1384,13 @@ static inline bool pf_danger_node_init(struct pf_danger_map *pfdm,
     node->extra_tile = params->get_EC(ptile, node_known_type, params);
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
   } else {
-    /* Nodes are allocated by fc_calloc(), so should be already set to 0. */
+    /* Nodes are zeroed before use, so should be already set to 0. */
     node->extra_tile = 0;
 #endif
   }
 
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
-  /* Nodes are allocated by fc_calloc(), so should be already set to
+  /* Nodes are zeroed before use, so should be already set to
    * FALSE. */
   node->waited = FALSE;
 #endif
@@ -1158,7 +1410,7 @@ static void pf_danger_map_fill_position(const struct pf_danger_map *pfdm,
                                         struct pf_position *pos)
 {
   int tindex = tile_index(ptile);
-  struct pf_danger_node *node = pfdm->lattice + tindex;
+  struct pf_danger_node *node = pf_danger_map_node(pfdm, tindex);
   const struct pf_parameter *params = pf_map_parameter(PF_MAP(pfdm));
 
 #ifdef PF_DEBUG
@@ -1216,7 +1468,7 @@ pf_danger_map_construct_path(const struct pf_danger_map *pfdm,
   enum direction8 dir_next = direction8_invalid();
   struct pf_danger_pos *danger_seg = NULL;
   bool waited = FALSE;
-  struct pf_danger_node *node = pfdm->lattice + tile_index(ptile);
+  struct pf_danger_node *node = pf_danger_map_node(pfdm, tile_index(ptile));
   int length = 1;
   struct tile *iter_tile = ptile;
   const struct pf_parameter *params = pf_map_parameter(PF_MAP(pfdm));
@@ -1253,7 +1505,7 @@ pf_danger_map_construct_path(const struct pf_danger_map *pfdm,
 
     /* Step backward. */
     iter_tile = mapstep(params->map, iter_tile, DIR_REVERSE(dir_next));
-    node = pfdm->lattice + tile_index(iter_tile);
+    node = pf_danger_map_node(pfdm, tile_index(iter_tile));
   }
 
   /* Allocate memory for path. */
@@ -1262,7 +1514,7 @@ pf_danger_map_construct_path(const struct pf_danger_map *pfdm,
 
   /* Reset variables for main iteration. */
   iter_tile = ptile;
-  node = pfdm->lattice + tile_index(ptile);
+  node = pf_danger_map_node(pfdm, tile_index(ptile));
   danger_seg = NULL;
   waited = FALSE;
 
@@ -1344,7 +1596,7 @@ pf_danger_map_construct_path(const struct pf_danger_map *pfdm,
 
     /* 5: Step further back. */
     iter_tile = mapstep(params->map, iter_tile, DIR_REVERSE(dir_next));
-    node = pfdm->lattice + tile_index(iter_tile);
+    node = pf_danger_map_node(pfdm, tile_index(iter_tile));
   }
 
   fc_assert_msg(FALSE, "Cannot get to the starting point!");
@@ -1373,7 +1625,7 @@ static void pf_danger_map_create_segment(struct pf_danger_map *pfdm,
                                          struct pf_danger_node *node1)
 {
   struct tile *ptile = PF_MAP(pfdm)->tile;
-  struct pf_danger_node *node = pfdm->lattice + tile_index(ptile);
+  struct pf_danger_node *node = pf_danger_map_node(pfdm, tile_index(ptile));
   struct pf_danger_pos *pos;
   int length = 0, i;
   const struct pf_parameter *params = pf_map_parameter(PF_MAP(pfdm));
@@ -1388,7 +1640,7 @@ static void pf_danger_map_create_segment(struct pf_danger_map *pfdm,
   while (node->is_dangerous && direction8_is_valid(node->dir_to_here)) {
     length++;
     ptile = mapstep(params->map, ptile, DIR_REVERSE(node->dir_to_here));
-    node = pfdm->lattice + tile_index(ptile);
+    node = pf_danger_map_node(pfdm, tile_index(ptile));
   }
 
   /* Allocate memory for segment */
@@ -1396,7 +1648,7 @@ static void pf_danger_map_create_segment(struct pf_danger_map *pfdm,
 
   /* Reset tile and node pointers for main iteration */
   ptile = PF_MAP(pfdm)->tile;
-  node = pfdm->lattice + tile_index(ptile);
+  node = pf_danger_map_node(pfdm, tile_index(ptile));
 
   /* Now fill the positions */
   for (i = 0, pos = node1->danger_segment; i < length; i++, pos++) {
@@ -1411,7 +1663,7 @@ static void pf_danger_map_create_segment(struct pf_danger_map *pfdm,
 
     /* Step further down the tree */
     ptile = mapstep(params->map, ptile, DIR_REVERSE(node->dir_to_here));
-    node = pfdm->lattice + tile_index(ptile);
+    node = pf_danger_map_node(pfdm, tile_index(ptile));
   }
 
 #ifdef PF_DEBUG
@@ -1485,7 +1737,7 @@ static bool pf_danger_map_iterate(struct pf_map *pfm)
   const struct pf_parameter *const params = pf_map_parameter(pfm);
   struct tile *tile = pfm->tile;
   int tindex = tile_index(tile);
-  struct pf_danger_node *node = pfdm->lattice + tindex;
+  struct pf_danger_node *node = pf_danger_map_node(pfdm, tindex);
   enum pf_move_scope scope = node->move_scope;
 
   /* The previous position is defined by 'tile' (tile pointer), 'node'
@@ -1526,7 +1778,7 @@ static bool pf_danger_map_iterate(struct pf_map *pfm)
         /* Calculate the cost of every adjacent position and set them in
          * the priority queues for next call to pf_danger_map_iterate(). */
         int tindex1 = tile_index(tile1);
-        struct pf_danger_node *node1 = pfdm->lattice + tindex1;
+        struct pf_danger_node *node1 = pf_danger_map_node(pfdm, tindex1);
         int cost;
         int extra = 0;
 
@@ -1575,7 +1827,7 @@ static bool pf_danger_map_iterate(struct pf_map *pfm)
         } else if (node1->node_known_type == TILE_UNKNOWN) {
           cost = params->utype->unknown_move_cost;
         } else {
-          cost = params->get_MC(tile, scope, tile1, node1->move_scope,
+          cost = params->get_MC(tile, scope, dir, tile1, node1->move_scope,
                                 params);
         }
         if (cost == PF_IMPOSSIBLE_MC) {
@@ -1694,7 +1946,7 @@ static bool pf_danger_map_iterate(struct pf_map *pfm)
       /* Change the pf_map iterator and reset data. */
       tile = index_to_tile(params->map, tindex);
       pfm->tile = tile;
-      node = pfdm->lattice + tindex;
+      node = pf_danger_map_node(pfdm, tindex);
     } else {
       /* No dangerous nodes to process, go for a safe one. */
       if (!map_index_pq_remove(pfdm->queue, &tindex)) {
@@ -1703,13 +1955,13 @@ static bool pf_danger_map_iterate(struct pf_map *pfm)
       }
 
 #ifdef PF_DEBUG
-      fc_assert(NS_PROCESSED != pfdm->lattice[tindex].status);
+      fc_assert(NS_PROCESSED != pf_danger_map_node(pfdm, tindex)->status);
 #endif
 
       /* Change the pf_map iterator and reset data. */
       tile = index_to_tile(params->map, tindex);
       pfm->tile = tile;
-      node = pfdm->lattice + tindex;
+      node = pf_danger_map_node(pfdm, tindex);
       if (NS_WAITING != node->status) {
         /* Node status step C. and D. */
 #ifdef PF_DEBUG
@@ -1746,7 +1998,7 @@ static inline bool pf_danger_map_iterate_until(struct pf_danger_map *pfdm,
                                                struct tile *ptile)
 {
   struct pf_map *pfm = PF_MAP(pfdm);
-  struct pf_danger_node *node = pfdm->lattice + tile_index(ptile);
+  struct pf_danger_node *node = pf_danger_map_node(pfdm, tile_index(ptile));
 
   /* Start position is handled in every function calling this function. */
 
@@ -1785,7 +2037,7 @@ static int pf_danger_map_move_cost(struct pf_map *pfm, struct tile *ptile)
   if (ptile == pfm->params.start_tile) {
     return 0;
   } else if (pf_danger_map_iterate_until(pfdm, ptile)) {
-    return (pfdm->lattice[tile_index(ptile)].cost
+    return (pf_danger_map_node(pfdm, tile_index(ptile))->cost
             - pf_move_rate(pf_map_parameter(pfm))
             + pf_moves_left_initially(pf_map_parameter(pfm)));
   } else {
@@ -1832,22 +2084,20 @@ static bool pf_danger_map_position(struct pf_map *pfm, struct tile *ptile,
   }
 }
 
+/* Idle lattices for pf_danger_map. The dangling danger segments are freed
+ * when the nodes are reused. */
+static struct pf_lattice_pool pf_danger_lattices = {
+  sizeof(struct pf_danger_node), pf_danger_node_release, 0
+};
+
 /************************************************************************//**
   'pf_danger_map' destructor.
 ****************************************************************************/
 static void pf_danger_map_destroy(struct pf_map *pfm)
 {
   struct pf_danger_map *pfdm = PF_DANGER_MAP(pfm);
-  struct pf_danger_node *node;
-  int i;
 
-  /* Need to clean up the dangling danger segments. */
-  for (i = 0, node = pfdm->lattice; i < MAP_INDEX_SIZE; i++, node++) {
-    if (node->danger_segment) {
-      free(node->danger_segment);
-    }
-  }
-  free(pfdm->lattice);
+  pf_lattice_put(&pf_danger_lattices, &pfdm->lattice);
   map_index_pq_destroy(pfdm->queue);
   map_index_pq_destroy(pfdm->danger_queue);
   free(pfdm);
@@ -1872,7 +2122,7 @@ static struct pf_map *pf_danger_map_new(const struct pf_parameter *parameter)
 #endif /* PF_DEBUG */
 
   /* Allocate the map. */
-  pfdm->lattice = fc_calloc(MAP_INDEX_SIZE, sizeof(struct pf_danger_node));
+  pf_lattice_get(&pf_danger_lattices, &pfdm->lattice);
   pfdm->queue = map_index_pq_new(INITIAL_QUEUE_SIZE);
   pfdm->danger_queue = map_index_pq_new(INITIAL_QUEUE_SIZE);
 
@@ -1896,7 +2146,7 @@ static struct pf_map *pf_danger_map_new(const struct pf_parameter *parameter)
   base_map->iterate = pf_danger_map_iterate;
 
   /* Initialise starting node. */
-  node = pfdm->lattice + tile_index(params->start_tile);
+  node = pf_danger_map_node(pfdm, tile_index(params->start_tile));
   if (!pf_danger_node_init(pfdm, node, params->start_tile, PF_MS_NONE)) {
     /* Always fails. */
     fc_assert(TRUE == pf_danger_node_init(pfdm, node, params->start_tile,
@@ -1959,6 +2209,7 @@ struct pf_fuel_node {
                                  * FIXME: this is right only for units with
                                  * constant move costs! */
   unsigned short extra_tile;    /* EC */
+  unsigned short generation;    /* See pf_lattice_get(). */
   unsigned char cost_to_here[DIR8_MAGIC_MAX]; /* Step cost[dir to here] */
 
   /* Segment leading across the danger area back to the nearest safe node:
@@ -1989,7 +2240,8 @@ struct pf_fuel_map {
                                  * total_CC */
   struct map_index_pq *waited_queue; /* Queue of nodes to reach farer
                                       * positions after having refueled. */
-  struct pf_fuel_node *lattice; /* Lattice of nodes */
+  struct pf_lattice lattice;    /* Lattice of nodes, see
+                                 * pf_fuel_map_node(). */
 };
 
 /* Up-cast macro. */
@@ -2109,7 +2361,7 @@ static inline bool pf_fuel_node_init(struct pf_fuel_map *pffm,
 #endif
     } else {
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
-      /* Nodes are allocated by fc_calloc(), so should be already set to
+      /* Nodes are zeroed before use, so should be already set to
        * 0. */
       node->action = PF_ACTION_NONE;
 #endif
@@ -2157,7 +2409,7 @@ static inline bool pf_fuel_node_init(struct pf_fuel_map *pffm,
                           ? ZOC_ALLIED : ZOC_NO);
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
     } else {
-      /* Nodes are allocated by fc_calloc(), so should be already set to
+      /* Nodes are zeroed before use, so should be already set to
        * 0. */
       node->zoc_number = ZOC_MINE;
 #endif
@@ -2177,7 +2429,7 @@ static inline bool pf_fuel_node_init(struct pf_fuel_map *pffm,
 
     node->move_scope = PF_MS_NATIVE;
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
-    /* Nodes are allocated by fc_calloc(), so  should be already set to 0. */
+    /* Nodes are zeroed before use, so  should be already set to 0. */
     node->action = PF_ACTION_NONE;
     node->zoc_number = ZOC_MINE;
 #endif
@@ -2188,13 +2440,13 @@ static inline bool pf_fuel_node_init(struct pf_fuel_map *pffm,
     node->extra_tile = params->get_EC(ptile, node_known_type, params);
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
   } else {
-    /* Nodes are allocated by fc_calloc(), so should be already set to 0. */
+    /* Nodes are zeroed before use, so should be already set to 0. */
     node->extra_tile = 0;
 #endif
   }
 
 #ifdef ZERO_VARIABLES_FOR_SEARCHING
-  /* Nodes are allocated by fc_calloc(), so should be already set to 0. */
+  /* Nodes are zeroed before use, so should be already set to 0. */
   node->pos = NULL;
   node->segment = NULL;
 #endif
@@ -2241,6 +2493,39 @@ static inline void pf_fuel_pos_unref(struct pf_fuel_pos *pos)
   }
 }
 
+/************************************************************************//**
+  Forget the positions of the node.
+****************************************************************************/
+static void pf_fuel_node_release(void *node)
+{
+  struct pf_fuel_node *pnode = node;
+
+  pf_fuel_pos_unref(pnode->pos);
+  pnode->pos = NULL;
+  pf_fuel_pos_unref(pnode->segment);
+  pnode->segment = NULL;
+}
+
+/************************************************************************//**
+  Return the node at 'tindex'. Clears it if it was left by a previous map
+  (see pf_lattice_get()).
+****************************************************************************/
+static inline struct pf_fuel_node *
+pf_fuel_map_node(const struct pf_fuel_map *pffm, int tindex)
+{
+  struct pf_fuel_node *node = pffm->lattice.nodes;
+
+  node += tindex;
+
+  if (node->generation != pffm->lattice.generation) {
+    pf_fuel_node_release(node);
+    memset(node, 0, sizeof(*node));
+    node->generation = pffm->lattice.generation;
+  }
+
+  return node;
+}
+
 /************************************************************************//**
   Replace the position (unreferences it). Instead of destroying, re-use the
   memory, else return a newly allocated position.
@@ -2320,7 +2605,7 @@ static void pf_fuel_map_fill_position(const struct pf_fuel_map *pffm,
                                       struct pf_position *pos)
 {
   int tindex = tile_index(ptile);
-  struct pf_fuel_node *node = pffm->lattice + tindex;
+  struct pf_fuel_node *node = pf_fuel_map_node(pffm, tindex);
   struct pf_fuel_pos *head = node->segment;
   const struct pf_parameter *params = pf_map_parameter(PF_MAP(pffm));
 
@@ -2362,7 +2647,7 @@ pf_fuel_map_construct_path(const struct pf_fuel_map *pffm,
 {
   struct pf_path *path = fc_malloc(sizeof(*path));
   enum direction8 dir_next = direction8_invalid();
-  struct pf_fuel_node *node = pffm->lattice + tile_index(ptile);
+  struct pf_fuel_node *node = pf_fuel_map_node(pffm, tile_index(ptile));
   struct pf_fuel_pos *segment = node->segment;
   int length = 1;
   struct tile *iter_tile = ptile;
@@ -2395,7 +2680,7 @@ pf_fuel_map_construct_path(const struct pf_fuel_map *pffm,
     /* Step backward. */
     iter_tile = mapstep(params->map, iter_tile,
                         DIR_REVERSE(segment->dir_to_here));
-    node = pffm->lattice + tile_index(iter_tile);
+    node = pf_fuel_map_node(pffm, tile_index(iter_tile));
     segment = segment->prev;
 #ifdef PF_DEBUG
     fc_assert(NULL != segment);
@@ -2412,7 +2697,7 @@ pf_fuel_map_construct_path(const struct pf_fuel_map *pffm,
 
   /* Reset variables for main iteration. */
   iter_tile = ptile;
-  node = pffm->lattice + tile_index(ptile);
+  node = pf_fuel_map_node(pffm, tile_index(ptile));
   segment = node->segment;
 
   for (i = length - 1; i >= 0; i--) {
@@ -2465,7 +2750,7 @@ pf_fuel_map_construct_path(const struct pf_fuel_map *pffm,
 
     /* 5: Step further back. */
     iter_tile = mapstep(params->map, iter_tile, DIR_REVERSE(dir_next));
-    node = pffm->lattice + tile_index(iter_tile);
+    node = pf_fuel_map_node(pffm, tile_index(iter_tile));
     segment = segment->prev;
 #ifdef PF_DEBUG
     fc_assert(NULL != segment);
@@ -2507,7 +2792,7 @@ static inline void pf_fuel_map_create_segment(struct pf_fuel_map *pffm,
   do {
     next = pos;
     ptile = mapstep(params->map, ptile, DIR_REVERSE(node->dir_to_here));
-    node = pffm->lattice + tile_index(ptile);
+    node = pf_fuel_map_node(pffm, tile_index(ptile));
     pos = node->pos;
     if (NULL != pos) {
       if (pos->cost == node->cost
@@ -2618,7 +2903,7 @@ static bool pf_fuel_map_iterate(struct pf_map *pfm)
   const struct pf_parameter *const params = pf_map_parameter(pfm);
   struct tile *tile = pfm->tile;
   int tindex = tile_index(tile);
-  struct pf_fuel_node *node = pffm->lattice + tindex;
+  struct pf_fuel_node *node = pf_fuel_map_node(pffm, tindex);
   enum pf_move_scope scope = node->move_scope;
   int priority, waited_priority;
   bool waited = FALSE;
@@ -2664,7 +2949,7 @@ static bool pf_fuel_map_iterate(struct pf_map *pfm)
         /* Calculate the cost of every adjacent position and set them in
          * the priority queues for next call to pf_fuel_map_iterate(). */
         int tindex1 = tile_index(tile1);
-        struct pf_fuel_node *node1 = pffm->lattice + tindex1;
+        struct pf_fuel_node *node1 = pf_fuel_map_node(pffm, tindex1);
         int cost, extra = 0;
         int moves_left;
         int cost_of_path, old_cost_of_path;
@@ -2720,7 +3005,7 @@ static bool pf_fuel_map_iterate(struct pf_map *pfm)
           } else if (node1->node_known_type == TILE_UNKNOWN) {
             cost = params->utype->unknown_move_cost;
           } else {
-            cost = params->get_MC(tile, scope, tile1, node1->move_scope,
+            cost = params->get_MC(tile, scope, dir, tile1, node1->move_scope,
                                   params);
           }
 #ifdef PF_DEBUG
@@ -2892,7 +3177,7 @@ static bool pf_fuel_map_iterate(struct pf_map *pfm)
       /* Change the pf_map iterator and reset data. */
       tile = index_to_tile(params->map, tindex);
       pfm->tile = tile;
-      node = pffm->lattice + tindex;
+      node = pf_fuel_map_node(pffm, tindex);
       waited = TRUE;
 #ifdef PF_DEBUG
       fc_assert(0 < node->moves_left_req);
@@ -2909,7 +3194,7 @@ static bool pf_fuel_map_iterate(struct pf_map *pfm)
       /* Change the pf_map iterator and reset data. */
       tile = index_to_tile(params->map, tindex);
       pfm->tile = tile;
-      node = pffm->lattice + tindex;
+      node = pf_fuel_map_node(pffm, tindex);
 #ifdef PF_DEBUG
       fc_assert(NS_PROCESSED != node->status);
 #endif
@@ -2952,7 +3237,7 @@ static inline bool pf_fuel_map_iterate_until(struct pf_fuel_map *pffm,
                                              struct tile *ptile)
 {
   struct pf_map *pfm = PF_MAP(pffm);
-  struct pf_fuel_node *node = pffm->lattice + tile_index(ptile);
+  struct pf_fuel_node *node = pf_fuel_map_node(pffm, tile_index(ptile));
 
   /* Start position is handled in every function calling this function. */
 
@@ -2990,7 +3275,8 @@ static int pf_fuel_map_move_cost(struct pf_map *pfm, struct tile *ptile)
   if (ptile == pfm->params.start_tile) {
     return 0;
   } else if (pf_fuel_map_iterate_until(pffm, ptile)) {
-    const struct pf_fuel_node *node = pffm->lattice + tile_index(ptile);
+    const struct pf_fuel_node *node = pf_fuel_map_node(pffm,
+                                                       tile_index(ptile));
 
     return (node->segment->cost
             - pf_move_rate(pf_map_parameter(pfm))
@@ -3039,21 +3325,20 @@ static bool pf_fuel_map_position(struct pf_map *pfm, struct tile *ptile,
   }
 }
 
+/* Idle lattices for pf_fuel_map. The dangling fuel segments are freed
+ * when the nodes are reused. */
+static struct pf_lattice_pool pf_fuel_lattices = {
+  sizeof(struct pf_fuel_node), pf_fuel_node_release, 0
+};
+
 /************************************************************************//**
   'pf_fuel_map' destructor.
 ****************************************************************************/
 static void pf_fuel_map_destroy(struct pf_map *pfm)
 {
   struct pf_fuel_map *pffm = PF_FUEL_MAP(pfm);
-  struct pf_fuel_node *node;
-  int i;
 
-  /* Need to clean up the dangling fuel segments. */
-  for (i = 0, node = pffm->lattice; i < MAP_INDEX_SIZE; i++, node++) {
-    pf_fuel_pos_unref(node->pos);
-    pf_fuel_pos_unref(node->segment);
-  }
-  free(pffm->lattice);
+  pf_lattice_put(&pf_fuel_lattices, &pffm->lattice);
   map_index_pq_destroy(pffm->queue);
   map_index_pq_destroy(pffm->waited_queue);
   free(pffm);
@@ -3078,7 +3363,7 @@ static struct pf_map *pf_fuel_map_new(const struct pf_parameter *parameter)
 #endif /* PF_DEBUG */
 
   /* Allocate the map. */
-  pffm->lattice = fc_calloc(MAP_INDEX_SIZE, sizeof(struct pf_fuel_node));
+  pf_lattice_get(&pf_fuel_lattices, &pffm->lattice);
   pffm->queue = map_index_pq_new(INITIAL_QUEUE_SIZE);
   pffm->waited_queue = map_index_pq_new(INITIAL_QUEUE_SIZE);
 
@@ -3102,7 +3387,7 @@ static struct pf_map *pf_fuel_map_new(const struct pf_parameter *parameter)
   base_map->iterate = pf_fuel_map_iterate;
 
   /* Initialise starting node. */
-  node = pffm->lattice + tile_index(params->start_tile);
+  node = pf_fuel_map_node(pffm, tile_index(params->start_tile));
   if (!pf_fuel_node_init(pffm, node, params->start_tile, PF_MS_NONE)) {
     /* Always fails. */
     fc_assert(TRUE == pf_fuel_node_init(pffm, node, params->start_tile,
@@ -3169,6 +3454,17 @@ void pf_map_destroy(struct pf_map *pfm)
   pfm->destroy(pfm);
 }
 
+/************************************************************************//**
+  Free the lattices kept for the next pf_maps. Call it when the map is
+  freed; pf_maps can still be created after.
+****************************************************************************/
+void pf_lattices_free(void)
+{
+  pf_lattice_pool_free(&pf_normal_lattices);
+  pf_lattice_pool_free(&pf_danger_lattices);
+  pf_lattice_pool_free(&pf_fuel_lattices);
+}
+
 /************************************************************************//**
   Tries to find the minimal move cost to reach ptile. Returns
   PF_IMPOSSIBLE_MC if not reachable. If ptile has not been reached yet,
@@ -3700,7 +3996,6 @@ pf_reverse_map_pos(struct pf_reverse_map *pfrm,
   struct pf_map *pfm;
   struct pf_parameter *copy;
   struct tile *target_tile;
-  const struct pf_normal_node *lattice;
   int max_cost;
 
   /* Check if we already processed something similar. */
@@ -3710,12 +4005,12 @@ pf_reverse_map_pos(struct pf_reverse_map *pfrm,
 
   /* We didn't. Build map and iterate. */
   pfm = pf_normal_map_new(param);
-  lattice = PF_NORMAL_MAP(pfm)->lattice;
   target_tile = pfrm->target_tile;
   if (pfrm->max_turns >= 0) {
     max_cost = param->move_rate * (pfrm->max_turns + 1);
     do {
-      if (lattice[tile_index(pfm->tile)].cost >= max_cost) {
+      if (pf_normal_map_node(PF_NORMAL_MAP(pfm),
+                             tile_index(pfm->tile))->cost >= max_cost) {
         break;
       } else if (pfm->tile == target_tile) {
         /* Found our position. Insert in hash, destroy map, and return. */
@@ -3862,3 +4157,296 @@ bool pf_reverse_map_unit_position(struct pf_reverse_map *pfrm,
     return FALSE;
   }
 }
+
+
+/* ======================= pf_reverse_field functions ====================== */
+
+/* A reverse field answers "how fast can any of these units reach this
+ * tile", for a set of units and for all the tiles at once. The units are
+ * grouped by move type, and each group is expanded in a single pass from
+ * all the positions of its units. */
+
+/* Units sharing the same move rules. */
+struct pf_reverse_field_group {
+  struct pf_parameter param;    /* 'start_tile' is the first source. */
+  struct tile_list *sources;    /* The other positions. */
+};
+
+struct pf_reverse_field {
+  int max_turns;                /* The maximum of turns. */
+  struct pf_parameter template; /* Keep a parameter ready for usage. */
+  int num_groups;
+  struct pf_reverse_field_group *groups;
+  bool incomplete;              /* Some unit could not be handled. */
+  int *turns;                   /* Turns to reach every tile, computed
+                                 * at the first request. */
+};
+
+/************************************************************************//**
+  'pf_reverse_field' constructor. If 'max_turns' is positive, then the
+  tiles beyond this number of turns are considered unreachable.
+****************************************************************************/
+struct pf_reverse_field *pf_reverse_field_new(const struct player *pplayer,
+                                              int max_turns,
+                                              bool omniscient,
+                                              const struct civ_map *map)
+{
+  struct pf_reverse_field *pfrf = fc_malloc(sizeof(*pfrf));
+  struct pf_parameter *param = &pfrf->template;
+
+  pfrf->max_turns = max_turns;
+  pfrf->num_groups = 0;
+  pfrf->groups = NULL;
+  pfrf->incomplete = FALSE;
+  pfrf->turns = NULL;
+
+  /* Initialize the parameter. There is no target tile. */
+  pft_fill_reverse_parameter(param, NULL);
+  param->owner = pplayer;
+  param->omniscience = omniscient;
+  param->map = map;
+
+  return pfrf;
+}
+
+/************************************************************************//**
+  'pf_reverse_field' destructor.
+****************************************************************************/
+void pf_reverse_field_destroy(struct pf_reverse_field *pfrf)
+{
+  int i;
+
+  fc_assert_ret(NULL != pfrf);
+
+  for (i = 0; i < pfrf->num_groups; i++) {
+    tile_list_destroy(pfrf->groups[i].sources);
+  }
+  free(pfrf->groups);
+  free(pfrf->turns);
+  free(pfrf);
+}
+
+/************************************************************************//**
+  Add a unit to the field. As for pf_reverse_map, the unit is supposed to
+  have its whole move rate. Must be called before any request.
+****************************************************************************/
+void pf_reverse_field_add_unit(struct pf_reverse_field *pfrf,
+                               const struct unit *punit)
+{
+  struct pf_parameter *param = &pfrf->template;
+  struct pf_reverse_field_group *group;
+  int i;
+
+  fc_assert_ret(NULL == pfrf->turns);
+
+  param->start_tile = unit_tile(punit);
+  param->move_rate = unit_move_rate(punit);
+  param->moves_left_initially = param->move_rate;
+  param->utype = unit_type_get(punit);
+
+  for (i = 0; i < pfrf->num_groups; i++) {
+    group = pfrf->groups + i;
+    if (group->param.utype == param->utype
+        && group->param.move_rate == param->move_rate) {
+      tile_list_append(group->sources, param->start_tile);
+      return;
+    }
+  }
+
+  pfrf->groups = fc_realloc(pfrf->groups,
+                            (pfrf->num_groups + 1) * sizeof(*pfrf->groups));
+  group = pfrf->groups + pfrf->num_groups++;
+  group->param = *param;
+  group->sources = tile_list_new();
+}
+
+/************************************************************************//**
+  Expand the group from all its sources, and keep the lowest number of
+  turns for every tile.
+****************************************************************************/
+static void pf_reverse_field_expand(struct pf_reverse_field *pfrf,
+                                    const struct pf_reverse_field_group
+                                    *group)
+{
+  const struct pf_parameter *param = &group->param;
+  struct pf_map *pfm = pf_normal_map_new(param);
+  struct pf_normal_map *pfnm = PF_NORMAL_MAP(pfm);
+  int max_cost = (0 <= pfrf->max_turns
+                  ? param->move_rate * (pfrf->max_turns + 1)
+                  : FC_INFINITY);
+
+  tile_list_iterate(group->sources, ptile) {
+    if (!pf_normal_map_add_source(pfnm, ptile)) {
+      /* The path-finding would only accept it as start tile. */
+      pfrf->incomplete = TRUE;
+    }
+  } tile_list_iterate_end;
+
+  do {
+    int tindex = tile_index(pfm->tile);
+    const struct pf_normal_node *node = pf_normal_map_node(pfnm, tindex);
+    int turn;
+
+    if (node->cost >= max_cost) {
+      break;
+    }
+    turn = pf_turns(param, node->cost);
+    if (turn < pfrf->turns[tindex]) {
+      pfrf->turns[tindex] = turn;
+    }
+  } while (pfm->iterate(pfm));
+
+  pf_map_destroy(pfm);
+}
+
+/************************************************************************//**
+  Returns the number of turns the fastest unit of the field needs to reach
+  'ptile', or PF_IMPOSSIBLE_MC if none can. The first request computes the
+  whole field.
+
+  Every unit must have been handled, else 0 is returned for any tile.
+****************************************************************************/
+int pf_reverse_field_turns(struct pf_reverse_field *pfrf,
+                           const struct tile *ptile)
+{
+  int turn;
+
+  if (NULL == pfrf->turns) {
+    int i;
+
+    pfrf->turns = fc_malloc(MAP_INDEX_SIZE * sizeof(*pfrf->turns));
+    for (i = 0; i < MAP_INDEX_SIZE; i++) {
+      pfrf->turns[i] = FC_INFINITY;
+    }
+    for (i = 0; i < pfrf->num_groups; i++) {
+      pf_reverse_field_expand(pfrf, pfrf->groups + i);
+    }
+  }
+
+  if (pfrf->incomplete) {
+    return 0;
+  }
+
+  turn = pfrf->turns[tile_index(ptile)];
+
+  return (FC_INFINITY == turn ? PF_IMPOSSIBLE_MC : turn);
+}
+
+
+/* ======================== pf_map cache functions ======================= */
+
+/* Many units share the same parameters (stacks, units built in the same
+ * city...), and each of them used to make the same pf_map. The cache
+ * keeps the maps until the world changes, see pf_map_cache_clear(). */
+
+/* Maximum number of maps in the cache. */
+#define PF_MAP_CACHE_SIZE 16
+
+/************************************************************************//**
+  Hash function for the parameter of the cached maps.
+****************************************************************************/
+static genhash_val_t pf_map_cache_hash_val(const struct pf_parameter *param)
+{
+  return (tile_index(param->start_tile)
+          ^ (utype_index(param->utype) << 16)
+          ^ (param->moves_left_initially << 24)
+          ^ (NULL != param->owner ? player_index(param->owner) << 8 : 0));
+}
+
+/************************************************************************//**
+  Comparison function for the parameter of the cached maps. All the fields
+  must be equal, the callbacks may use any of them.
+****************************************************************************/
+static bool pf_map_cache_hash_cmp(const struct pf_parameter *param1,
+                                  const struct pf_parameter *param2)
+{
+  return (param1->start_tile == param2->start_tile
+          && param1->utype == param2->utype
+          && param1->owner == param2->owner
+          && param1->moves_left_initially == param2->moves_left_initially
+          && param1->fuel_left_initially == param2->fuel_left_initially
+          && param1->transported_by_initially
+             == param2->transported_by_initially
+          && param1->cargo_depth == param2->cargo_depth
+          && BV_ARE_EQUAL(param1->cargo_types, param2->cargo_types)
+          && param1->move_rate == param2->move_rate
+          && param1->fuel == param2->fuel
+          && param1->omniscience == param2->omniscience
+          && param1->map == param2->map
+          && param1->get_MC == param2->get_MC
+          && param1->get_move_scope == param2->get_move_scope
+          && param1->ignore_none_scopes == param2->ignore_none_scopes
+          && param1->get_TB == param2->get_TB
+          && param1->get_EC == param2->get_EC
+          && param1->get_action == param2->get_action
+          && param1->actions == param2->actions
+          && param1->is_action_possible == param2->is_action_possible
+          && param1->get_zoc == param2->get_zoc
+          && param1->is_pos_dangerous == param2->is_pos_dangerous
+          && param1->get_moves_left_req == param2->get_moves_left_req
+          && param1->get_costs == param2->get_costs
+          && param1->goal_tile == param2->goal_tile
+          && param1->goal_min_MC == param2->goal_min_MC
+          && param1->data == param2->data);
+}
+
+/* The keys are the parameters of the maps themselves. */
+#define SPECHASH_TAG pf_map_cache
+#define SPECHASH_IKEY_TYPE const struct pf_parameter *
+#define SPECHASH_IDATA_TYPE struct pf_map *
+#define SPECHASH_IKEY_VAL pf_map_cache_hash_val
+#define SPECHASH_IKEY_COMP pf_map_cache_hash_cmp
+#define SPECHASH_IDATA_FREE pf_map_destroy
+#include "spechash.h"
+
+static struct pf_map_cache_hash *pf_map_cache = NULL;
+
+/************************************************************************//**
+  Returns a map for the parameter, shared with the other users of the same
+  parameter. The map belongs to the cache: do not destroy it, and only use
+  the functions which look up a given tile (pf_map_move_cost(),
+  pf_map_path(), pf_map_position()), the iterator of the map is shared.
+
+  The map is valid until the next call to pf_map_cache_clear(). The 'data'
+  of the parameter must stay valid as long as the map.
+****************************************************************************/
+struct pf_map *pf_map_cache_get(const struct pf_parameter *parameter)
+{
+  struct pf_map *pfm;
+
+  if (NULL == pf_map_cache) {
+    pf_map_cache = pf_map_cache_hash_new();
+  } else if (pf_map_cache_hash_lookup(pf_map_cache, parameter, &pfm)) {
+    return pfm;
+  } else if (PF_MAP_CACHE_SIZE <= pf_map_cache_hash_size(pf_map_cache)) {
+    pf_map_cache_hash_clear(pf_map_cache);
+  }
+
+  pfm = pf_map_new(parameter);
+  pf_map_cache_hash_insert(pf_map_cache, pf_map_parameter(pfm), pfm);
+
+  return pfm;
+}
+
+/************************************************************************//**
+  Destroy all the cached maps. Must be called whenever the paths could
+  change: units moving, appearing or disappearing, tiles or diplomatic
+  states changing, and at turn change.
+****************************************************************************/
+void pf_map_cache_clear(void)
+{
+  if (NULL != pf_map_cache) {
+    pf_map_cache_hash_clear(pf_map_cache);
+  }
+}
+
+/************************************************************************//**
+  Free the cache.
+****************************************************************************/
+void pf_map_cache_free(void)
+{
+  if (NULL != pf_map_cache) {
+    pf_map_cache_hash_destroy(pf_map_cache);
+    pf_map_cache = NULL;
+  }
+}
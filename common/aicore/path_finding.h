@@ -194,6 +194,13 @@ extern "C" {
  *
  * You may call pf_map_path() multiple times with the same pfm.
  *
+ * If you only want the path to one tile, set it as the goal of the
+ * parameter with pft_fill_goal() before creating the map. The map then
+ * explores the tiles in the direction of the goal first (A* search)
+ * instead of all the tiles nearer than the goal. The paths are the same,
+ * but the iteration macros below do not follow the order of increasing
+ * costs any more, so don't use them on such a map.
+ *
  * B) the caller doesn't know the map position of the goal yet (but knows
  * what he is looking for, e.g. a port) and wants to iterate over
  * all paths in order of increasing costs (total_CC):
@@ -370,6 +377,7 @@ struct pf_parameter {
    * is provided to ease the implementation of the callback. */
   int (*get_MC) (const struct tile *from_tile,
                  enum pf_move_scope src_move_scope,
+                 enum direction8 dir,
                  const struct tile *to_tile,
                  enum pf_move_scope dst_move_scope,
                  const struct pf_parameter *param);
@@ -456,6 +464,15 @@ struct pf_parameter {
                     int *to_cost, int *to_extra,
                     const struct pf_parameter *param);
 
+  /* If set, the map is meant to reach this tile and is explored toward
+   * it first. 'goal_min_MC' must then be a lower bound of the MC of any
+   * step, which makes the estimated cost to the goal admissible. A null
+   * 'goal_min_MC' means there is no usable bound. Only used by the
+   * normal maps (without danger nor fuel), ignored by the others. See
+   * pft_fill_goal(). */
+  struct tile *goal_tile;
+  int goal_min_MC;
+
   /* User provided data. Can be used to attach arbitrary information
    * to the map. */
   void *data;
@@ -467,6 +484,9 @@ struct pf_map;
 /* The reverse map strucure. Opaque type. */
 struct pf_reverse_map;
 
+/* Opaque type for the reverse field. */
+struct pf_reverse_field;
+
 
 
 /* ========================= Public Interface ============================ */
@@ -475,6 +495,7 @@ struct pf_reverse_map;
 struct pf_map *pf_map_new(const struct pf_parameter *parameter)
                fc__warn_unused_result;
 void pf_map_destroy(struct pf_map *pfm);
+void pf_lattices_free(void);
 
 /* Method A) functions. */
 int pf_map_move_cost(struct pf_map *pfm, struct tile *ptile);
@@ -537,6 +558,23 @@ bool pf_reverse_map_unit_position(struct pf_reverse_map *pfrm,
                                   const struct unit *punit,
                                   struct pf_position *pos);
 
+/* Reverse fields (Turns for any of several units to reach the tiles). */
+struct pf_reverse_field *pf_reverse_field_new(const struct player *pplayer,
+                                              int max_turns,
+                                              bool omniscient,
+                                              const struct civ_map *map)
+                         fc__warn_unused_result;
+void pf_reverse_field_destroy(struct pf_reverse_field *pfrf);
+void pf_reverse_field_add_unit(struct pf_reverse_field *pfrf,
+                               const struct unit *punit);
+int pf_reverse_field_turns(struct pf_reverse_field *pfrf,
+                           const struct tile *ptile);
+
+/* Maps shared by the users of the same parameter, see pf_map_cache_get(). */
+struct pf_map *pf_map_cache_get(const struct pf_parameter *parameter);
+void pf_map_cache_clear(void);
+void pf_map_cache_free(void);
+
 
 
 /* This macro iterates all reachable tiles.
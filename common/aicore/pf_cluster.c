@@ -0,0 +1,816 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 2003 - The Freeciv Project
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <fc_config.h>
+#endif
+
+#include <string.h>
+
+/* utility */
+#include "log.h"
+#include "mem.h"
+#include "shared.h"
+#include "support.h"
+
+/* common */
+#include "game.h"
+#include "map.h"
+#include "movement.h"
+#include "unittype.h"
+
+/* common/aicore */
+#include "path_finding.h"
+
+#include "pf_cluster.h"
+
+/* CLUSTERS - coarse path-finding
+ *
+ * The map is cut in square clusters of PF_CLUSTER_SIZE x PF_CLUSTER_SIZE
+ * native tiles. For a unit type, the tiles of a cluster where it can
+ * exist are grouped in regions: the tiles connected inside the cluster.
+ * Each region has a center tile, and we keep the move cost from it to
+ * every tile of the region. Two regions of adjacent clusters are linked
+ * when some of their tiles are adjacent; the cost of the link is the
+ * cost from one center to the other through the cheapest of these tiles.
+ *
+ * Searching this graph of regions instead of the tiles gives estimates of
+ * the long move costs, and a coarse route made of the centers to go by.
+ * The regions linked together are also known, which tells exactly whether
+ * a tile can be reached at all with the terrain of the map.
+ *
+ * The move costs ignore units, ZOC, borders and the knowledge of the
+ * players, and are capped at the move rate of the unit type, as a move
+ * can always be done with full moves left.
+ *
+ * The graph of a unit type is built the first time it is used. Then only
+ * the clusters of the tiles given to pf_cluster_tile_changed() are built
+ * again, with the links of the clusters around them. */
+
+#define SPECPQ_TAG pf_cluster
+#define SPECPQ_DATA_TYPE int
+#define SPECPQ_PRIORITY_TYPE int
+#include "specpq.h"
+#define INITIAL_QUEUE_SIZE 64
+
+#define PF_CLUSTER_TILES (PF_CLUSTER_SIZE * PF_CLUSTER_SIZE)
+
+/* Tile index marks used while building the regions of a cluster. */
+#define PFC_NO_REGION (-1)
+#define PFC_NEW_REGION (-2)
+
+/* Link to a region of an adjacent cluster. */
+struct pfc_edge {
+  int cluster;
+  int region;                   /* Index in the cluster. */
+  int cost;                     /* From center to center. */
+};
+
+/* Tiles of a cluster connected inside it. */
+struct pfc_region {
+  struct tile *center;
+  int index;                    /* Index in the whole graph. */
+  int component;                /* The same for all the linked regions. */
+  int num_edges;
+  struct pfc_edge *edges;
+};
+
+struct pfc_cluster {
+  bool dirty;                   /* The regions must be built again. */
+  int num_regions;
+  struct pfc_region *regions;
+};
+
+/* The clusters of one unit type. */
+struct pfc_graph {
+  const struct unit_type *utype;
+  int xsize, ysize;             /* Number of clusters. */
+  struct pfc_cluster *clusters;
+  short *region;                /* Region of every tile in its cluster, or
+                                 * PFC_NO_REGION. */
+  int *center_cost;             /* Move cost of every tile from the center
+                                 * of its region. */
+  bool dirty;                   /* Some clusters are dirty. */
+  int num_regions;
+  struct pfc_region **regions;  /* All the regions, by index. */
+};
+
+/* End of a search: a tile of a region and the cost to add. */
+struct pfc_end {
+  struct tile *ptile;
+  int cost;
+};
+
+/* Graphs by unit type index, NULL until used. */
+static struct pfc_graph **graphs = NULL;
+static int num_graphs = 0;
+
+/**********************************************************************//**
+  Return the index of the cluster of the tile.
+**************************************************************************/
+static inline int pfc_cluster_of(const struct pfc_graph *graph,
+                                 const struct tile *ptile)
+{
+  int nat_x, nat_y;
+
+  index_to_native_pos(&nat_x, &nat_y, tile_index(ptile));
+
+  return (nat_y / PF_CLUSTER_SIZE * graph->xsize
+          + nat_x / PF_CLUSTER_SIZE);
+}
+
+/**********************************************************************//**
+  Return the index of the tile inside its cluster.
+**************************************************************************/
+static inline int pfc_local_index(const struct tile *ptile)
+{
+  int nat_x, nat_y;
+
+  index_to_native_pos(&nat_x, &nat_y, tile_index(ptile));
+
+  return (nat_y % PF_CLUSTER_SIZE * PF_CLUSTER_SIZE
+          + nat_x % PF_CLUSTER_SIZE);
+}
+
+/**********************************************************************//**
+  Return the region of the tile, which must have one.
+**************************************************************************/
+static inline struct pfc_region *
+pfc_region_of(const struct pfc_graph *graph, const struct tile *ptile)
+{
+  return (graph->clusters[pfc_cluster_of(graph, ptile)].regions
+          + graph->region[tile_index(ptile)]);
+}
+
+/**********************************************************************//**
+  Fill 'tiles' with the tiles of the cluster and return their number.
+**************************************************************************/
+static int pfc_cluster_tiles(const struct pfc_graph *graph, int cluster,
+                             struct tile **tiles)
+{
+  int x0 = cluster % graph->xsize * PF_CLUSTER_SIZE;
+  int y0 = cluster / graph->xsize * PF_CLUSTER_SIZE;
+  int x1 = MIN(x0 + PF_CLUSTER_SIZE, wld.map.xsize);
+  int y1 = MIN(y0 + PF_CLUSTER_SIZE, wld.map.ysize);
+  int x, y, num = 0;
+
+  for (y = y0; y < y1; y++) {
+    for (x = x0; x < x1; x++) {
+      tiles[num++] = native_pos_to_tile(&(wld.map), x, y);
+    }
+  }
+
+  return num;
+}
+
+/**********************************************************************//**
+  Move cost of a single step of the unit type.
+**************************************************************************/
+static inline int pfc_move_cost(const struct pfc_graph *graph,
+                                const struct tile *src_tile,
+                                const struct tile *dest_tile)
+{
+  int cost = map_move_cost(&(wld.map), NULL, graph->utype,
+                           src_tile, dest_tile);
+  int move_rate = graph->utype->move_rate;
+
+  if (0 < move_rate && cost > move_rate) {
+    /* The move can be done with full moves left. */
+    cost = move_rate;
+  }
+
+  return cost;
+}
+
+/**********************************************************************//**
+  Fill 'costs', by local index, with the move costs from 'start' to the
+  tiles of its region. The others get FC_INFINITY.
+**************************************************************************/
+static void pfc_region_costs(const struct pfc_graph *graph, int cluster,
+                             const struct tile *start, int *costs)
+{
+  struct pf_cluster_pq *queue = pf_cluster_pq_new(INITIAL_QUEUE_SIZE);
+  int tindex, i;
+
+  for (i = 0; i < PF_CLUSTER_TILES; i++) {
+    costs[i] = FC_INFINITY;
+  }
+  costs[pfc_local_index(start)] = 0;
+  pf_cluster_pq_insert(queue, tile_index(start), 0);
+
+  while (pf_cluster_pq_remove(queue, &tindex)) {
+    struct tile *ptile = index_to_tile(&(wld.map), tindex);
+    int cost = costs[pfc_local_index(ptile)];
+
+    adjc_iterate(&(wld.map), ptile, ptile1) {
+      int local1, cost1;
+
+      if (0 > graph->region[tile_index(ptile1)]
+          || pfc_cluster_of(graph, ptile1) != cluster) {
+        continue;
+      }
+
+      local1 = pfc_local_index(ptile1);
+      cost1 = cost + pfc_move_cost(graph, ptile, ptile1);
+      if (cost1 < costs[local1]) {
+        costs[local1] = cost1;
+        /* As we prefer lower costs, let's reverse the cost. */
+        pf_cluster_pq_replace(queue, tile_index(ptile1), -cost1);
+      }
+    } adjc_iterate_end;
+  }
+
+  pf_cluster_pq_destroy(queue);
+}
+
+/**********************************************************************//**
+  Free the regions of the cluster.
+**************************************************************************/
+static void pfc_cluster_free_regions(struct pfc_cluster *pcluster)
+{
+  int i;
+
+  for (i = 0; i < pcluster->num_regions; i++) {
+    free(pcluster->regions[i].edges);
+  }
+  free(pcluster->regions);
+  pcluster->regions = NULL;
+  pcluster->num_regions = 0;
+}
+
+/**********************************************************************//**
+  Build the regions of the cluster, with their center costs. The links
+  are left empty.
+**************************************************************************/
+static void pfc_cluster_build_regions(struct pfc_graph *graph, int cluster)
+{
+  struct pfc_cluster *pcluster = graph->clusters + cluster;
+  struct tile *tiles[PF_CLUSTER_TILES], *members[PF_CLUSTER_TILES];
+  int costs[PF_CLUSTER_TILES];
+  int num_tiles = pfc_cluster_tiles(graph, cluster, tiles);
+  int i, j;
+
+  pfc_cluster_free_regions(pcluster);
+
+  for (i = 0; i < num_tiles; i++) {
+    graph->region[tile_index(tiles[i])]
+      = (can_exist_at_tile(&(wld.map), graph->utype, tiles[i])
+         ? PFC_NEW_REGION : PFC_NO_REGION);
+  }
+
+  for (i = 0; i < num_tiles; i++) {
+    struct pfc_region *pregion;
+    struct tile *center = NULL;
+    int num_members = 0, sum_x = 0, sum_y = 0;
+    int best_dist = FC_INFINITY;
+
+    if (PFC_NEW_REGION != graph->region[tile_index(tiles[i])]) {
+      continue;
+    }
+
+    /* Collect the tiles connected to this one. */
+    graph->region[tile_index(tiles[i])] = pcluster->num_regions;
+    members[num_members++] = tiles[i];
+    for (j = 0; j < num_members; j++) {
+      adjc_iterate(&(wld.map), members[j], ptile) {
+        if (PFC_NEW_REGION == graph->region[tile_index(ptile)]
+            && pfc_cluster_of(graph, ptile) == cluster) {
+          graph->region[tile_index(ptile)] = pcluster->num_regions;
+          members[num_members++] = ptile;
+        }
+      } adjc_iterate_end;
+    }
+
+    /* The center is the tile nearest to the middle of the region. */
+    for (j = 0; j < num_members; j++) {
+      int local = pfc_local_index(members[j]);
+
+      sum_x += local % PF_CLUSTER_SIZE;
+      sum_y += local / PF_CLUSTER_SIZE;
+    }
+    for (j = 0; j < num_members; j++) {
+      int local = pfc_local_index(members[j]);
+      int dx = local % PF_CLUSTER_SIZE * num_members - sum_x;
+      int dy = local / PF_CLUSTER_SIZE * num_members - sum_y;
+
+      if (dx * dx + dy * dy < best_dist) {
+        best_dist = dx * dx + dy * dy;
+        center = members[j];
+      }
+    }
+
+    pcluster->regions = fc_realloc(pcluster->regions,
+                                   (pcluster->num_regions + 1)
+                                   * sizeof(*pcluster->regions));
+    pregion = pcluster->regions + pcluster->num_regions++;
+    pregion->center = center;
+    pregion->index = -1;
+    pregion->component = -1;
+    pregion->num_edges = 0;
+    pregion->edges = NULL;
+
+    pfc_region_costs(graph, cluster, center, costs);
+    for (j = 0; j < num_members; j++) {
+      graph->center_cost[tile_index(members[j])]
+        = costs[pfc_local_index(members[j])];
+    }
+  }
+
+  pcluster->dirty = FALSE;
+}
+
+/**********************************************************************//**
+  Build the links from the regions of the cluster. The regions of the
+  adjacent clusters must be up to date.
+**************************************************************************/
+static void pfc_cluster_build_edges(struct pfc_graph *graph, int cluster)
+{
+  struct pfc_cluster *pcluster = graph->clusters + cluster;
+  struct tile *tiles[PF_CLUSTER_TILES];
+  int num_tiles = pfc_cluster_tiles(graph, cluster, tiles);
+  int i;
+
+  for (i = 0; i < pcluster->num_regions; i++) {
+    free(pcluster->regions[i].edges);
+    pcluster->regions[i].edges = NULL;
+    pcluster->regions[i].num_edges = 0;
+  }
+
+  for (i = 0; i < num_tiles; i++) {
+    struct pfc_region *pregion;
+
+    if (0 > graph->region[tile_index(tiles[i])]) {
+      continue;
+    }
+    pregion = pcluster->regions + graph->region[tile_index(tiles[i])];
+
+    adjc_iterate(&(wld.map), tiles[i], ptile) {
+      int cluster1 = pfc_cluster_of(graph, ptile);
+      int region1 = graph->region[tile_index(ptile)];
+      int cost, k;
+
+      if (cluster1 == cluster || 0 > region1) {
+        continue;
+      }
+
+      cost = (graph->center_cost[tile_index(tiles[i])]
+              + pfc_move_cost(graph, tiles[i], ptile)
+              + graph->center_cost[tile_index(ptile)]);
+
+      for (k = 0; k < pregion->num_edges; k++) {
+        if (pregion->edges[k].cluster == cluster1
+            && pregion->edges[k].region == region1) {
+          break;
+        }
+      }
+      if (k == pregion->num_edges) {
+        pregion->edges = fc_realloc(pregion->edges,
+                                    (k + 1) * sizeof(*pregion->edges));
+        pregion->edges[k].cluster = cluster1;
+        pregion->edges[k].region = region1;
+        pregion->edges[k].cost = cost;
+        pregion->num_edges++;
+      } else if (cost < pregion->edges[k].cost) {
+        pregion->edges[k].cost = cost;
+      }
+    } adjc_iterate_end;
+  }
+}
+
+/**********************************************************************//**
+  Return the representative of the set of 'i', for the union-find of
+  pfc_graph_update().
+**************************************************************************/
+static int pfc_component(int *parent, int i)
+{
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+
+  return i;
+}
+
+/**********************************************************************//**
+  Build again the dirty clusters and the links around them, then number
+  the regions and find the linked ones.
+**************************************************************************/
+static void pfc_graph_update(struct pfc_graph *graph)
+{
+  int num_clusters = graph->xsize * graph->ysize;
+  bool *edges_dirty;
+  int *parent;
+  int c, i, k, num;
+
+  if (!graph->dirty) {
+    return;
+  }
+
+  edges_dirty = fc_calloc(num_clusters, sizeof(*edges_dirty));
+  for (c = 0; c < num_clusters; c++) {
+    struct tile *tiles[PF_CLUSTER_TILES];
+    int num_tiles;
+
+    if (!graph->clusters[c].dirty) {
+      continue;
+    }
+
+    pfc_cluster_build_regions(graph, c);
+
+    /* The links of the adjacent clusters lead to the old regions. */
+    num_tiles = pfc_cluster_tiles(graph, c, tiles);
+    for (i = 0; i < num_tiles; i++) {
+      adjc_iterate(&(wld.map), tiles[i], ptile) {
+        edges_dirty[pfc_cluster_of(graph, ptile)] = TRUE;
+      } adjc_iterate_end;
+    }
+    edges_dirty[c] = TRUE;
+  }
+  for (c = 0; c < num_clusters; c++) {
+    if (edges_dirty[c]) {
+      pfc_cluster_build_edges(graph, c);
+    }
+  }
+  free(edges_dirty);
+
+  /* Number the regions. */
+  num = 0;
+  for (c = 0; c < num_clusters; c++) {
+    num += graph->clusters[c].num_regions;
+  }
+  graph->regions = fc_realloc(graph->regions,
+                              MAX(num, 1) * sizeof(*graph->regions));
+  graph->num_regions = num;
+  num = 0;
+  for (c = 0; c < num_clusters; c++) {
+    for (i = 0; i < graph->clusters[c].num_regions; i++) {
+      graph->clusters[c].regions[i].index = num;
+      graph->regions[num++] = graph->clusters[c].regions + i;
+    }
+  }
+
+  /* Join the linked regions. */
+  parent = fc_malloc(MAX(num, 1) * sizeof(*parent));
+  for (i = 0; i < num; i++) {
+    parent[i] = i;
+  }
+  for (i = 0; i < num; i++) {
+    const struct pfc_region *pregion = graph->regions[i];
+
+    for (k = 0; k < pregion->num_edges; k++) {
+      const struct pfc_edge *pedge = pregion->edges + k;
+      int a = pfc_component(parent, i);
+      int b = pfc_component(parent, graph->clusters[pedge->cluster]
+                                    .regions[pedge->region].index);
+
+      parent[MAX(a, b)] = MIN(a, b);
+    }
+  }
+  for (i = 0; i < num; i++) {
+    graph->regions[i]->component = pfc_component(parent, i);
+  }
+  free(parent);
+
+  graph->dirty = FALSE;
+}
+
+/**********************************************************************//**
+  Free the graph.
+**************************************************************************/
+static void pfc_graph_destroy(struct pfc_graph *graph)
+{
+  int c;
+
+  for (c = 0; c < graph->xsize * graph->ysize; c++) {
+    pfc_cluster_free_regions(graph->clusters + c);
+  }
+  free(graph->clusters);
+  free(graph->region);
+  free(graph->center_cost);
+  free(graph->regions);
+  free(graph);
+}
+
+/**********************************************************************//**
+  Return the up to date graph of the unit type, creating it if needed.
+**************************************************************************/
+static struct pfc_graph *pfc_graph_get(const struct unit_type *punittype)
+{
+  int index = utype_index(punittype);
+  struct pfc_graph *graph;
+
+  if (index >= num_graphs) {
+    graphs = fc_realloc(graphs, (index + 1) * sizeof(*graphs));
+    memset(graphs + num_graphs, 0,
+           (index + 1 - num_graphs) * sizeof(*graphs));
+    num_graphs = index + 1;
+  }
+
+  graph = graphs[index];
+  if (NULL == graph) {
+    int i;
+
+    graph = fc_calloc(1, sizeof(*graph));
+    graph->utype = punittype;
+    graph->xsize = (wld.map.xsize + PF_CLUSTER_SIZE - 1) / PF_CLUSTER_SIZE;
+    graph->ysize = (wld.map.ysize + PF_CLUSTER_SIZE - 1) / PF_CLUSTER_SIZE;
+    graph->clusters = fc_calloc(graph->xsize * graph->ysize,
+                                sizeof(*graph->clusters));
+    for (i = 0; i < graph->xsize * graph->ysize; i++) {
+      graph->clusters[i].dirty = TRUE;
+    }
+    graph->region = fc_malloc(MAP_INDEX_SIZE * sizeof(*graph->region));
+    for (i = 0; i < MAP_INDEX_SIZE; i++) {
+      graph->region[i] = PFC_NO_REGION;
+    }
+    graph->center_cost = fc_calloc(MAP_INDEX_SIZE,
+                                   sizeof(*graph->center_cost));
+    graph->dirty = TRUE;
+    graphs[index] = graph;
+  }
+
+  pfc_graph_update(graph);
+
+  return graph;
+}
+
+/**********************************************************************//**
+  Fill 'ends' with the tiles of regions to start from ('from' is TRUE) or
+  to end at 'ptile', and return their number. It is 'ptile' itself if
+  the unit type can be there, else the adjacent tiles, with the cost of
+  the move from or to 'ptile'. 'ends' must have room for 8 of them.
+**************************************************************************/
+static int pfc_ends(const struct pfc_graph *graph, const struct tile *ptile,
+                    bool from, struct pfc_end *ends)
+{
+  int num = 0;
+
+  if (0 <= graph->region[tile_index(ptile)]) {
+    ends[0].ptile = index_to_tile(&(wld.map), tile_index(ptile));
+    ends[0].cost = 0;
+    return 1;
+  }
+
+  adjc_iterate(&(wld.map), ptile, ptile1) {
+    if (0 <= graph->region[tile_index(ptile1)]) {
+      ends[num].ptile = ptile1;
+      ends[num].cost = (from ? pfc_move_cost(graph, ptile, ptile1)
+                        : pfc_move_cost(graph, ptile1, ptile));
+      num++;
+    }
+  } adjc_iterate_end;
+
+  return num;
+}
+
+/**********************************************************************//**
+  Search the graph for the cheapest way from 'src_tile' to 'dest_tile'
+  and return its cost, or PF_IMPOSSIBLE_MC. If 'route' is not NULL, the
+  centers of the regions to go by are appended to it, then 'dest_tile'.
+**************************************************************************/
+static int pfc_search(const struct pfc_graph *graph,
+                      const struct tile *src_tile,
+                      const struct tile *dest_tile,
+                      struct tile_list *route)
+{
+  struct pfc_end srcs[8], dests[8];
+  int num_srcs, num_dests;
+  struct pf_cluster_pq *queue;
+  int *costs, *goal_costs, *prev;
+  int best_cost = FC_INFINITY, best = -1;
+  int i, j, index;
+
+  if (same_pos(src_tile, dest_tile)) {
+    return 0;
+  }
+
+  num_srcs = pfc_ends(graph, src_tile, TRUE, srcs);
+  num_dests = pfc_ends(graph, dest_tile, FALSE, dests);
+
+  /* Discard the ends we cannot join at all. */
+  for (i = 0; i < num_srcs; i++) {
+    for (j = 0; j < num_dests; j++) {
+      if (pfc_region_of(graph, srcs[i].ptile)->component
+          == pfc_region_of(graph, dests[j].ptile)->component) {
+        break;
+      }
+    }
+    if (j == num_dests) {
+      srcs[i--] = srcs[--num_srcs];
+    }
+  }
+  if (0 == num_srcs) {
+    return PF_IMPOSSIBLE_MC;
+  }
+
+  costs = fc_malloc(graph->num_regions * sizeof(*costs));
+  goal_costs = fc_malloc(graph->num_regions * sizeof(*goal_costs));
+  prev = fc_malloc(graph->num_regions * sizeof(*prev));
+  for (i = 0; i < graph->num_regions; i++) {
+    costs[i] = FC_INFINITY;
+    goal_costs[i] = FC_INFINITY;
+    prev[i] = -1;
+  }
+
+  for (j = 0; j < num_dests; j++) {
+    index = pfc_region_of(graph, dests[j].ptile)->index;
+    goal_costs[index] = MIN(goal_costs[index],
+                            graph->center_cost[tile_index(dests[j].ptile)]
+                            + dests[j].cost);
+  }
+
+  queue = pf_cluster_pq_new(INITIAL_QUEUE_SIZE);
+  for (i = 0; i < num_srcs; i++) {
+    const struct pfc_region *pregion = pfc_region_of(graph, srcs[i].ptile);
+    int cost = (srcs[i].cost
+                + graph->center_cost[tile_index(srcs[i].ptile)]);
+    int local_costs[PF_CLUSTER_TILES];
+    bool local_done = FALSE;
+
+    if (cost < costs[pregion->index]) {
+      costs[pregion->index] = cost;
+      pf_cluster_pq_replace(queue, pregion->index, -cost);
+    }
+
+    /* Inside a region, going by its center may be much longer. */
+    for (j = 0; j < num_dests; j++) {
+      if (pfc_region_of(graph, dests[j].ptile) != pregion) {
+        continue;
+      }
+      if (!local_done) {
+        pfc_region_costs(graph, pfc_cluster_of(graph, srcs[i].ptile),
+                         srcs[i].ptile, local_costs);
+        local_done = TRUE;
+      }
+      cost = (srcs[i].cost + local_costs[pfc_local_index(dests[j].ptile)]
+              + dests[j].cost);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best = -1;
+      }
+    }
+  }
+
+  while (pf_cluster_pq_remove(queue, &index)) {
+    const struct pfc_region *pregion = graph->regions[index];
+    int cost = costs[index];
+
+    if (cost >= best_cost) {
+      /* Nothing better to find. */
+      break;
+    }
+
+    if (FC_INFINITY > goal_costs[index]
+        && cost + goal_costs[index] < best_cost) {
+      best_cost = cost + goal_costs[index];
+      best = index;
+    }
+
+    for (j = 0; j < pregion->num_edges; j++) {
+      const struct pfc_edge *pedge = pregion->edges + j;
+      int index1 = graph->clusters[pedge->cluster]
+                     .regions[pedge->region].index;
+      int cost1 = cost + pedge->cost;
+
+      if (cost1 < costs[index1]) {
+        costs[index1] = cost1;
+        prev[index1] = index;
+        /* As we prefer lower costs, let's reverse the cost. */
+        pf_cluster_pq_replace(queue, index1, -cost1);
+      }
+    }
+  }
+  pf_cluster_pq_destroy(queue);
+
+  if (NULL != route && FC_INFINITY > best_cost) {
+    struct tile_list *centers = tile_list_new();
+
+    for (index = best; 0 <= index; index = prev[index]) {
+      tile_list_prepend(centers, graph->regions[index]->center);
+    }
+    tile_list_iterate(centers, ptile) {
+      tile_list_append(route, ptile);
+    } tile_list_iterate_end;
+    tile_list_append(route, index_to_tile(&(wld.map),
+                                          tile_index(dest_tile)));
+    tile_list_destroy(centers);
+  }
+
+  free(costs);
+  free(goal_costs);
+  free(prev);
+
+  return (FC_INFINITY > best_cost ? best_cost : PF_IMPOSSIBLE_MC);
+}
+
+/**********************************************************************//**
+  Return whether a unit of the type could go from 'src_tile' to
+  'dest_tile' (or next to it, if it cannot be there), considering only
+  the terrain, extras and cities.
+**************************************************************************/
+bool pf_cluster_reachable(const struct unit_type *punittype,
+                          const struct tile *src_tile,
+                          const struct tile *dest_tile)
+{
+  const struct pfc_graph *graph;
+  struct pfc_end srcs[8], dests[8];
+  int num_srcs, num_dests, i, j;
+
+  if (same_pos(src_tile, dest_tile)) {
+    return TRUE;
+  }
+
+  graph = pfc_graph_get(punittype);
+  num_srcs = pfc_ends(graph, src_tile, TRUE, srcs);
+  num_dests = pfc_ends(graph, dest_tile, FALSE, dests);
+
+  for (i = 0; i < num_srcs; i++) {
+    for (j = 0; j < num_dests; j++) {
+      if (pfc_region_of(graph, srcs[i].ptile)->component
+          == pfc_region_of(graph, dests[j].ptile)->component) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+/**********************************************************************//**
+  Return an estimate of the move cost for a unit of the type to go from
+  'src_tile' to 'dest_tile', or PF_IMPOSSIBLE_MC if it cannot. See
+  pf_cluster_reachable().
+**************************************************************************/
+int pf_cluster_move_cost(const struct unit_type *punittype,
+                         const struct tile *src_tile,
+                         const struct tile *dest_tile)
+{
+  return pfc_search(pfc_graph_get(punittype), src_tile, dest_tile, NULL);
+}
+
+/**********************************************************************//**
+  Append to 'route' the tiles to go by for a unit of the type to go from
+  'src_tile' to 'dest_tile', a few clusters apart from each other, ending
+  with 'dest_tile'. Returns FALSE, leaving 'route' untouched, if it cannot
+  go there.
+**************************************************************************/
+bool pf_cluster_route(const struct unit_type *punittype,
+                      const struct tile *src_tile,
+                      const struct tile *dest_tile,
+                      struct tile_list *route)
+{
+  return (PF_IMPOSSIBLE_MC
+          != pfc_search(pfc_graph_get(punittype), src_tile, dest_tile,
+                        route));
+}
+
+/**********************************************************************//**
+  Called when the terrain, the extras or the city of the tile changed.
+  Its cluster and the ones around will be built again when next used.
+**************************************************************************/
+void pf_cluster_tile_changed(const struct tile *ptile)
+{
+  int i;
+
+  for (i = 0; i < num_graphs; i++) {
+    struct pfc_graph *graph = graphs[i];
+
+    if (NULL == graph) {
+      continue;
+    }
+
+    /* Cities next to the tile may become reachable or not. */
+    graph->clusters[pfc_cluster_of(graph, ptile)].dirty = TRUE;
+    adjc_iterate(&(wld.map), ptile, ptile1) {
+      graph->clusters[pfc_cluster_of(graph, ptile1)].dirty = TRUE;
+    } adjc_iterate_end;
+    graph->dirty = TRUE;
+  }
+}
+
+/**********************************************************************//**
+  Free all the cluster graphs.
+**************************************************************************/
+void pf_clusters_free(void)
+{
+  int i;
+
+  for (i = 0; i < num_graphs; i++) {
+    if (NULL != graphs[i]) {
+      pfc_graph_destroy(graphs[i]);
+    }
+  }
+  free(graphs);
+  graphs = NULL;
+  num_graphs = 0;
+}
@@ -0,0 +1,56 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 2003 - The Freeciv Project
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+#ifndef FC__PF_CLUSTER_H
+#define FC__PF_CLUSTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* utility */
+#include "support.h"    /* bool type */
+
+/* common */
+#include "fc_types.h"
+#include "tile.h"       /* struct tile_list */
+
+/* Coarse path-finding over clusters of tiles, see "pf_cluster.c".
+ *
+ * It answers long-range questions much faster than a pf_map, but only
+ * considers the terrain, extras and cities: units, ZOC, borders and the
+ * knowledge of the player are ignored. Use it to discard the destinations
+ * which cannot be reached at all or which are obviously too far, then
+ * use a pf_map for the real paths. */
+
+/* Side of the square clusters, in native tiles. */
+#define PF_CLUSTER_SIZE 16
+
+bool pf_cluster_reachable(const struct unit_type *punittype,
+                          const struct tile *src_tile,
+                          const struct tile *dest_tile);
+int pf_cluster_move_cost(const struct unit_type *punittype,
+                         const struct tile *src_tile,
+                         const struct tile *dest_tile);
+bool pf_cluster_route(const struct unit_type *punittype,
+                      const struct tile *src_tile,
+                      const struct tile *dest_tile,
+                      struct tile_list *route);
+
+void pf_cluster_tile_changed(const struct tile *ptile);
+void pf_clusters_free(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* FC__PF_CLUSTER_H */
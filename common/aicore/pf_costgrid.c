@@ -0,0 +1,199 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 2003 - The Freeciv Project
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <fc_config.h>
+#endif
+
+/* utility */
+#include "log.h"
+#include "mem.h"
+#include "shared.h"
+
+/* common */
+#include "game.h"
+#include "map.h"
+#include "movement.h"
+#include "unittype.h"
+
+#include "pf_costgrid.h"
+
+/* MOVE COST GRIDS
+ *
+ * tile_move_cost_ptrs() looks at the terrains, roads and rivers of both
+ * tiles for every move. Without a unit, the result only depends on the
+ * unit class, on whether the unit type has the "IgTer" flag, and on
+ * whether the infrastructure is restricted for the move. So for each of
+ * these move types, a grid keeps the costs from every tile in the 8
+ * directions, with and without restricted infrastructure. Whether the
+ * infrastructure is restricted depends on the player and on the borders,
+ * it is checked for every move (see restrict_infra()).
+ *
+ * The costs from a tile are computed the first time they are needed.
+ * pf_costgrid_tile_changed() forgets the costs from the changed tile and
+ * from the tiles around, which may move to it or along it. */
+
+/* Stored in place of FC_INFINITY, see tile_move_cost_ptrs(). */
+#define PF_COSTGRID_INFINITY 0xFFFF
+
+struct pf_costgrid {
+  const struct unit_type *punittype; /* Any unit type of the move type. */
+  int size;                     /* MAP_INDEX_SIZE at creation time. */
+  bool *valid;                  /* Whether the costs from the tile are
+                                 * computed. */
+  unsigned short *costs;        /* [tile][restricted infra][direction] */
+};
+
+static struct pf_costgrid *pf_costgrids[UCL_LAST][2];
+
+/*******************************************************************//**
+  Free the grid.
+***********************************************************************/
+static void pf_costgrid_destroy(struct pf_costgrid *grid)
+{
+  free(grid->valid);
+  free(grid->costs);
+  free(grid);
+}
+
+/*******************************************************************//**
+  Returns the grid of the move type of the unit type. Creates it if
+  needed.
+***********************************************************************/
+static struct pf_costgrid *pf_costgrid_get(const struct unit_type *punittype)
+{
+  struct pf_costgrid **pgrid =
+    &pf_costgrids[uclass_index(utype_class(punittype))]
+                 [utype_has_flag(punittype, UTYF_IGTER) ? 1 : 0];
+
+  if (NULL != *pgrid && (*pgrid)->size != MAP_INDEX_SIZE) {
+    /* Made for another map. */
+    pf_costgrid_destroy(*pgrid);
+    *pgrid = NULL;
+  }
+
+  if (NULL == *pgrid) {
+    struct pf_costgrid *grid = fc_malloc(sizeof(*grid));
+
+    grid->punittype = punittype;
+    grid->size = MAP_INDEX_SIZE;
+    grid->valid = fc_calloc(grid->size, sizeof(*grid->valid));
+    grid->costs = fc_malloc(grid->size * 2 * DIR8_MAGIC_MAX
+                            * sizeof(*grid->costs));
+    *pgrid = grid;
+  }
+
+  return *pgrid;
+}
+
+/*******************************************************************//**
+  Compute the costs of the moves from the tile.
+***********************************************************************/
+static void pf_costgrid_fill(struct pf_costgrid *grid,
+                             const struct civ_map *nmap,
+                             const struct tile *ptile)
+{
+  unsigned short *costs = (grid->costs
+                           + tile_index(ptile) * 2 * DIR8_MAGIC_MAX);
+
+  adjc_dir_iterate(nmap, ptile, ptile1, dir) {
+    int ri;
+
+    for (ri = 0; ri < 2; ri++) {
+      int cost = tile_move_cost_infra(nmap, NULL, grid->punittype, ri,
+                                      ptile, ptile1);
+
+      fc_assert(PF_COSTGRID_INFINITY > cost || FC_INFINITY == cost);
+      costs[ri * DIR8_MAGIC_MAX + dir] = MIN(cost, PF_COSTGRID_INFINITY);
+    }
+  } adjc_dir_iterate_end;
+
+  grid->valid[tile_index(ptile)] = TRUE;
+}
+
+/*******************************************************************//**
+  Returns the cost to move from 'src_tile' to the adjacent 'dst_tile' in
+  the direction 'dir', as map_move_cost() would do. 'dir' can be
+  direction8_invalid() if unknown.
+***********************************************************************/
+int pf_costgrid_move_cost(const struct civ_map *nmap,
+                          const struct player *pplayer,
+                          const struct unit_type *punittype,
+                          const struct tile *src_tile,
+                          enum direction8 dir,
+                          const struct tile *dst_tile)
+{
+  struct pf_costgrid *grid;
+  int tindex, cost;
+
+  if (!uclass_has_flag(utype_class(punittype), UCF_TERRAIN_SPEED)) {
+    /* Constant cost, see tile_move_cost_ptrs(). */
+    return SINGLE_MOVE;
+  }
+
+  if (nmap != &(wld.map) || !is_valid_dir(dir)) {
+    return map_move_cost(nmap, pplayer, punittype, src_tile, dst_tile);
+  }
+
+  grid = pf_costgrid_get(punittype);
+  tindex = tile_index(src_tile);
+  if (!grid->valid[tindex]) {
+    pf_costgrid_fill(grid, nmap, src_tile);
+  }
+
+  cost = grid->costs[(tindex * 2
+                      + (restrict_infra(pplayer, src_tile, dst_tile)
+                         ? 1 : 0)) * DIR8_MAGIC_MAX + dir];
+
+  return (PF_COSTGRID_INFINITY == cost ? FC_INFINITY : cost);
+}
+
+/*******************************************************************//**
+  Forget the move costs which may depend on the tile.
+***********************************************************************/
+void pf_costgrid_tile_changed(const struct tile *ptile)
+{
+  int i, j;
+
+  for (i = 0; i < UCL_LAST; i++) {
+    for (j = 0; j < 2; j++) {
+      struct pf_costgrid *grid = pf_costgrids[i][j];
+
+      if (NULL == grid || grid->size != MAP_INDEX_SIZE) {
+        continue;
+      }
+
+      grid->valid[tile_index(ptile)] = FALSE;
+      adjc_iterate(&(wld.map), ptile, ptile1) {
+        grid->valid[tile_index(ptile1)] = FALSE;
+      } adjc_iterate_end;
+    }
+  }
+}
+
+/*******************************************************************//**
+  Free all the grids. Call it when the map or the ruleset is freed.
+***********************************************************************/
+void pf_costgrids_free(void)
+{
+  int i, j;
+
+  for (i = 0; i < UCL_LAST; i++) {
+    for (j = 0; j < 2; j++) {
+      if (NULL != pf_costgrids[i][j]) {
+        pf_costgrid_destroy(pf_costgrids[i][j]);
+        pf_costgrids[i][j] = NULL;
+      }
+    }
+  }
+}
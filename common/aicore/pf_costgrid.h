@@ -0,0 +1,41 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 2003 - The Freeciv Project
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+#ifndef FC__PF_COSTGRID_H
+#define FC__PF_COSTGRID_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* common */
+#include "fc_types.h"
+#include "map.h"
+
+/* Precomputed move costs between adjacent tiles, see "pf_costgrid.c".
+ * Gives the same results as map_move_cost(). */
+
+int pf_costgrid_move_cost(const struct civ_map *nmap,
+                          const struct player *pplayer,
+                          const struct unit_type *punittype,
+                          const struct tile *src_tile,
+                          enum direction8 dir,
+                          const struct tile *dst_tile);
+
+void pf_costgrid_tile_changed(const struct tile *ptile);
+void pf_costgrids_free(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* FC__PF_COSTGRID_H */
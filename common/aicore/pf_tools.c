@@ -27,10 +27,14 @@
 #include "combat.h"
 #include "game.h"
 #include "movement.h"
+#include "road.h"
 #include "tile.h"
 #include "unit.h"
 #include "unittype.h"
 
+/* common/aicore */
+#include "pf_costgrid.h"
+
 #include "pf_tools.h"
 
 /* ===================== Capability Functions ======================== */
@@ -346,12 +350,14 @@ static inline bool pf_move_possible(const struct tile *src,
 ****************************************************************************/
 static int normal_move(const struct tile *src,
                        enum pf_move_scope src_scope,
+                       enum direction8 dir,
                        const struct tile *dst,
                        enum pf_move_scope dst_scope,
                        const struct pf_parameter *param)
 {
   if (pf_move_possible(src, src_scope, dst, dst_scope, param)) {
-    return map_move_cost(param->map, param->owner, param->utype, src, dst);
+    return pf_costgrid_move_cost(param->map, param->owner, param->utype,
+                                 src, dir, dst);
   }
   return PF_IMPOSSIBLE_MC;
 }
@@ -365,12 +371,14 @@ static int normal_move(const struct tile *src,
 ****************************************************************************/
 static int overlap_move(const struct tile *src,
                         enum pf_move_scope src_scope,
+                        enum direction8 dir,
                         const struct tile *dst,
                         enum pf_move_scope dst_scope,
                         const struct pf_parameter *param)
 {
   if (pf_move_possible(src, src_scope, dst, dst_scope, param)) {
-    return map_move_cost(param->map, param->owner, param->utype, src, dst);
+    return pf_costgrid_move_cost(param->map, param->owner, param->utype,
+                                 src, dir, dst);
   } else if (!(PF_MS_NATIVE & dst_scope)) {
     /* This should always be the last tile reached. */
     return param->move_rate;
@@ -383,6 +391,7 @@ static int overlap_move(const struct tile *src,
 ****************************************************************************/
 static int amphibious_move(const struct tile *ptile,
                            enum pf_move_scope src_scope,
+                           enum direction8 dir,
                            const struct tile *ptile1,
                            enum pf_move_scope dst_scope,
                            const struct pf_parameter *param)
@@ -395,13 +404,13 @@ static int amphibious_move(const struct tile *ptile,
       /* Sea move, moving from native terrain to a city, or leaving port. */
       cost = amphibious->sea.get_MC(ptile,
                                     (PF_MS_CITY & src_scope) | PF_MS_NATIVE,
-                                    ptile1,
+                                    dir, ptile1,
                                     (PF_MS_CITY & dst_scope) | PF_MS_NATIVE,
                                     &amphibious->sea);
       scale = amphibious->sea_scale;
     } else if (PF_MS_NATIVE & dst_scope) {
       /* Disembark; use land movement function to handle non-native attacks. */
-      cost = amphibious->land.get_MC(ptile, PF_MS_TRANSPORT, ptile1,
+      cost = amphibious->land.get_MC(ptile, PF_MS_TRANSPORT, dir, ptile1,
                                      PF_MS_NATIVE, &amphibious->land);
       scale = amphibious->land_scale;
     } else {
@@ -410,7 +419,7 @@ static int amphibious_move(const struct tile *ptile,
     }
   } else if ((PF_MS_NATIVE | PF_MS_CITY) & dst_scope) {
     /* Land move */
-    cost = amphibious->land.get_MC(ptile, PF_MS_NATIVE, ptile1,
+    cost = amphibious->land.get_MC(ptile, PF_MS_NATIVE, dir, ptile1,
                                    PF_MS_NATIVE, &amphibious->land);
     scale = amphibious->land_scale;
   } else {
@@ -668,6 +677,8 @@ pft_fill_default_parameter(struct pf_parameter *parameter,
   parameter->get_action = NULL;
   parameter->is_action_possible = NULL;
   parameter->actions = PF_AA_NONE;
+  parameter->goal_tile = NULL;
+  parameter->goal_min_MC = 0;
 
   parameter->utype = punittype;
 }
@@ -979,6 +990,54 @@ void pft_fill_reverse_parameter(struct pf_parameter *parameter,
   /* Other data may stay at zero. */
 }
 
+/************************************************************************//**
+  Return a lower bound of the MC of any step with the move cost callbacks
+  of this file, see tile_move_cost_ptrs().
+****************************************************************************/
+static int pf_min_move_cost(const struct pf_parameter *param)
+{
+  const struct unit_class *pclass = utype_class(param->utype);
+  int min_MC = SINGLE_MOVE;     /* (Dis)embarking, constant costs. */
+
+  if (uclass_has_flag(pclass, UCF_TERRAIN_SPEED)) {
+    bool native_extras
+      = (0 < extra_type_list_size(pclass->cache.native_tile_extras));
+
+    terrain_type_iterate(pterrain) {
+      if ((native_extras || is_native_to_class(pclass, pterrain, NULL))
+          && pterrain->movement_cost * SINGLE_MOVE < min_MC) {
+        min_MC = pterrain->movement_cost * SINGLE_MOVE;
+      }
+    } terrain_type_iterate_end;
+
+    extra_type_list_iterate(pclass->cache.bonus_roads, pextra) {
+      min_MC = MIN(min_MC, extra_road_get(pextra)->move_cost);
+    } extra_type_list_iterate_end;
+
+    if (utype_has_flag(param->utype, UTYF_IGTER)) {
+      min_MC = MIN(min_MC, MOVE_COST_IGTER);
+    }
+  }
+
+  if (!param->omniscience) {
+    min_MC = MIN(min_MC, param->utype->unknown_move_cost);
+  }
+
+  /* overlap_move() and attacks may cost the whole move rate. */
+  return MAX(0, MIN(min_MC, param->move_rate));
+}
+
+/************************************************************************//**
+  Make the parameter go to 'goal_tile' only, see pf_parameter. Must be
+  called after the other fields are set, with the move cost callbacks of
+  this file.
+****************************************************************************/
+void pft_fill_goal(struct pf_parameter *parameter, struct tile *goal_tile)
+{
+  parameter->goal_tile = goal_tile;
+  parameter->goal_min_MC = pf_min_move_cost(parameter);
+}
+
 /************************************************************************//**
   Fill parameters for combined sea-land movement.
   This is suitable for the case of a land unit riding a ferry.
@@ -1022,6 +1081,8 @@ void pft_fill_amphibious_parameter(struct pft_amphibious *parameter)
   }
   parameter->combined.get_action = NULL;
   parameter->combined.is_action_possible = NULL;
+  parameter->combined.goal_tile = NULL;
+  parameter->combined.goal_min_MC = 0;
 
   parameter->combined.data = parameter;
 }
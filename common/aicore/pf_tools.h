@@ -64,6 +64,7 @@ void pft_fill_utype_attack_param(struct pf_parameter *parameter,
                                  struct player *pplayer);
 void pft_fill_reverse_parameter(struct pf_parameter *parameter,
                                 struct tile *target_tile);
+void pft_fill_goal(struct pf_parameter *parameter, struct tile *goal_tile);
 
 void pft_fill_amphibious_parameter(struct pft_amphibious *parameter);
 enum tile_behavior no_fights_or_unknown(const struct tile *ptile,
@@ -28,8 +28,22 @@
 
 #include "capstr.h"
 
+/* Optional capabilities for the packet stream compression methods we
+ * can decompress, see common/networking/packets.c */
+#if defined(USE_COMPRESSION) && defined(FREECIV_HAVE_LIBZSTD)
+#define CAPSTRING_ZSTD " zstd"
+#else
+#define CAPSTRING_ZSTD ""
+#endif
+#if defined(USE_COMPRESSION) && defined(FREECIV_HAVE_LIBLZ4)
+#define CAPSTRING_LZ4 " lz4"
+#else
+#define CAPSTRING_LZ4 ""
+#endif
+
 #define NETWORK_CAPSTRING (NETWORK_CAPSTRING_MANDATORY " "	\
-                           NETWORK_CAPSTRING_OPTIONAL)
+                           NETWORK_CAPSTRING_OPTIONAL		\
+                           CAPSTRING_ZSTD CAPSTRING_LZ4)
 
 static char our_capability_internal[MAX_LEN_CAPSTR];
 const char *const our_capability = our_capability_internal;
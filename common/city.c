@@ -1213,21 +1213,64 @@ int city_improvement_upkeep(const struct city *pcity,
   return upkeep;
 }
 
+/* The tile output effects, see city_tile_outputs(). The activity bonus
+ * is EFT_MINING_PCT for the shields and EFT_IRRIGATION_PCT for the food,
+ * without output type. */
+enum tile_output_effect {
+  TOE_ACTIVITY_PCT,
+  TOE_ADD_TILE,
+  TOE_PENALTY_TILE,
+  TOE_INC_TILE_CELEBRATE,
+  TOE_INC_TILE,
+  TOE_PER_TILE,
+  TOE_TILE_PUNISH_PCT,
+  TOE_COUNT
+};
+
+static const enum effect_type tile_output_effects[TOE_COUNT] = {
+  [TOE_ACTIVITY_PCT] = EFT_COUNT,
+  [TOE_ADD_TILE] = EFT_OUTPUT_ADD_TILE,
+  [TOE_PENALTY_TILE] = EFT_OUTPUT_PENALTY_TILE,
+  [TOE_INC_TILE_CELEBRATE] = EFT_OUTPUT_INC_TILE_CELEBRATE,
+  [TOE_INC_TILE] = EFT_OUTPUT_INC_TILE,
+  [TOE_PER_TILE] = EFT_OUTPUT_PER_TILE,
+  [TOE_TILE_PUNISH_PCT] = EFT_OUTPUT_TILE_PUNISH_PCT
+};
+
 /**********************************************************************//**
-  Calculate the output for the tile.
-  pcity may be NULL.
-  is_celebrating may be speculative.
-  otype is the output type (generally O_FOOD, O_TRADE, or O_SHIELD).
+  Return the tile output effect bonus, from 'bonuses' if it was evaluated
+  already by city_tile_outputs().
+**************************************************************************/
+static inline int tile_output_bonus(const struct city *pcity,
+                                    const struct tile *ptile,
+                                    Output_type_id otype,
+                                    const int *bonuses,
+                                    enum tile_output_effect toe)
+{
+  if (NULL != bonuses) {
+    return bonuses[toe];
+  } else if (TOE_ACTIVITY_PCT == toe) {
+    return get_tile_output_bonus(pcity, ptile, NULL,
+                                 O_SHIELD == otype
+                                 ? EFT_MINING_PCT : EFT_IRRIGATION_PCT);
+  } else {
+    return get_tile_output_bonus(pcity, ptile, &output_types[otype],
+                                 tile_output_effects[toe]);
+  }
+}
 
-  This can be used to calculate the benefits celebration would give.
+/**********************************************************************//**
+  Calculate the output for the tile, see city_tile_output(). 'bonuses'
+  holds the tile output effect bonuses, or is NULL to evaluate them as
+  needed.
 **************************************************************************/
-int city_tile_output(const struct city *pcity, const struct tile *ptile,
-		     bool is_celebrating, Output_type_id otype)
+static int city_tile_output_full(const struct city *pcity,
+                                 const struct tile *ptile,
+                                 bool is_celebrating, Output_type_id otype,
+                                 const int *bonuses)
 {
   int prod;
   struct terrain *pterrain = tile_terrain(ptile);
-  const struct output_type *output = &output_types[otype];
-  struct player *pplayer = NULL;
 
   fc_assert_ret_val(otype >= 0 && otype < O_LAST, 0);
 
@@ -1242,26 +1285,18 @@ int city_tile_output(const struct city *pcity, const struct tile *ptile,
     prod += tile_resource(ptile)->data.resource->output[otype];
   }
 
-  if (pcity != NULL) {
-    pplayer = city_owner(pcity);
-  }
-
   switch (otype) {
   case O_SHIELD:
     if (pterrain->mining_shield_incr != 0) {
       prod += pterrain->mining_shield_incr
-        * get_target_bonus_effects(NULL, pplayer, NULL, pcity, NULL,
-                                   ptile, NULL, NULL, NULL, NULL, NULL,
-                                   EFT_MINING_PCT)
+        * tile_output_bonus(pcity, ptile, otype, bonuses, TOE_ACTIVITY_PCT)
         / 100;
     }
     break;
   case O_FOOD:
     if (pterrain->irrigation_food_incr != 0) {
       prod += pterrain->irrigation_food_incr
-        * get_target_bonus_effects(NULL, pplayer, NULL, pcity, NULL,
-                                   ptile, NULL, NULL, NULL, NULL, NULL,
-                                   EFT_IRRIGATION_PCT)
+        * tile_output_bonus(pcity, ptile, otype, bonuses, TOE_ACTIVITY_PCT)
         / 100;
     }
     break;
@@ -1276,21 +1311,20 @@ int city_tile_output(const struct city *pcity, const struct tile *ptile,
   prod += tile_roads_output_incr(ptile, otype);
   prod += (prod * tile_roads_output_bonus(ptile, otype) / 100);
 
-  prod += get_tile_output_bonus(pcity, ptile, output, EFT_OUTPUT_ADD_TILE);
+  prod += tile_output_bonus(pcity, ptile, otype, bonuses, TOE_ADD_TILE);
   if (prod > 0) {
-    int penalty_limit = get_tile_output_bonus(pcity, ptile, output,
-                                              EFT_OUTPUT_PENALTY_TILE);
+    int penalty_limit = tile_output_bonus(pcity, ptile, otype, bonuses,
+                                          TOE_PENALTY_TILE);
 
     if (is_celebrating) {
-      prod += get_tile_output_bonus(pcity, ptile, output,
-                                    EFT_OUTPUT_INC_TILE_CELEBRATE);
+      prod += tile_output_bonus(pcity, ptile, otype, bonuses,
+                                TOE_INC_TILE_CELEBRATE);
       penalty_limit = 0; /* no penalty if celebrating */
     }
-    prod += get_tile_output_bonus(pcity, ptile, output,
-                                  EFT_OUTPUT_INC_TILE);
-    prod += (prod 
-             * get_tile_output_bonus(pcity, ptile, output,
-                                     EFT_OUTPUT_PER_TILE)) 
+    prod += tile_output_bonus(pcity, ptile, otype, bonuses, TOE_INC_TILE);
+    prod += (prod
+             * tile_output_bonus(pcity, ptile, otype, bonuses,
+                                 TOE_PER_TILE))
             / 100;
     if (!is_celebrating && penalty_limit > 0 && prod > penalty_limit) {
       prod--;
@@ -1298,8 +1332,8 @@ int city_tile_output(const struct city *pcity, const struct tile *ptile,
   }
 
   prod -= (prod
-           * get_tile_output_bonus(pcity, ptile, output,
-                                   EFT_OUTPUT_TILE_PUNISH_PCT))
+           * tile_output_bonus(pcity, ptile, otype, bonuses,
+                               TOE_TILE_PUNISH_PCT))
            / 100;
 
   if (NULL != pcity && is_city_center(pcity, ptile)) {
@@ -1309,6 +1343,77 @@ int city_tile_output(const struct city *pcity, const struct tile *ptile,
   return prod;
 }
 
+/**********************************************************************//**
+  Calculate the output for the tile.
+  pcity may be NULL.
+  is_celebrating may be speculative.
+  otype is the output type (generally O_FOOD, O_TRADE, or O_SHIELD).
+
+  This can be used to calculate the benefits celebration would give.
+**************************************************************************/
+int city_tile_output(const struct city *pcity, const struct tile *ptile,
+		     bool is_celebrating, Output_type_id otype)
+{
+  return city_tile_output_full(pcity, ptile, is_celebrating, otype, NULL);
+}
+
+/**********************************************************************//**
+  Calculate the output of every tile of the city map, as city_tile_output()
+  does: outputs[city_tile_index * O_LAST + otype] is set, and is 0 for the
+  tiles outside of the map.
+
+  The tile output effects are evaluated for all the tiles at once, see
+  get_city_tiles_output_bonus().
+**************************************************************************/
+void city_tile_outputs(const struct city *pcity, bool is_celebrating,
+                       int *outputs)
+{
+  int radius_sq = city_map_radius_sq_get(pcity);
+  int ntiles = city_map_tiles(radius_sq);
+  const struct tile *tiles[ntiles];
+  int stride = O_LAST * TOE_COUNT;
+  int *bonuses = fc_malloc(ntiles * stride * sizeof(*bonuses));
+  int i;
+
+  memset(tiles, 0, sizeof(tiles));
+  city_tile_iterate_index(radius_sq, city_tile(pcity), ptile, ctindex) {
+    tiles[ctindex] = ptile;
+  } city_tile_iterate_index_end;
+
+  output_type_iterate(o) {
+    enum tile_output_effect toe;
+
+    for (toe = TOE_ACTIVITY_PCT + 1; toe < TOE_COUNT; toe++) {
+      get_city_tiles_output_bonus(pcity, tiles, ntiles, &output_types[o],
+                                  tile_output_effects[toe],
+                                  bonuses + o * TOE_COUNT + toe, stride);
+    }
+    if (O_SHIELD == o || O_FOOD == o) {
+      get_city_tiles_output_bonus(pcity, tiles, ntiles, NULL,
+                                  O_SHIELD == o
+                                  ? EFT_MINING_PCT : EFT_IRRIGATION_PCT,
+                                  bonuses + o * TOE_COUNT + TOE_ACTIVITY_PCT,
+                                  stride);
+    } else {
+      for (i = 0; i < ntiles; i++) {
+        bonuses[i * stride + o * TOE_COUNT + TOE_ACTIVITY_PCT] = 0;
+      }
+    }
+  } output_type_iterate_end;
+
+  for (i = 0; i < ntiles; i++) {
+    output_type_iterate(o) {
+      outputs[i * O_LAST + o]
+        = (NULL != tiles[i]
+           ? city_tile_output_full(pcity, tiles[i], is_celebrating, o,
+                                   bonuses + i * stride + o * TOE_COUNT)
+           : 0);
+    } output_type_iterate_end;
+  }
+
+  free(bonuses);
+}
+
 /**********************************************************************//**
   Calculate the production output the given tile is capable of producing
   for the city.  The output type is given by 'otype' (generally O_FOOD,
@@ -2261,6 +2366,9 @@ static inline void city_tile_cache_update(struct city *pcity)
 {
   bool is_celebrating = base_city_celebrating(pcity);
   int radius_sq = city_map_radius_sq_get(pcity);
+  int ntiles = city_map_tiles(radius_sq);
+  int outputs[ntiles * O_LAST];
+  int i;
 
   /* initialize tile_cache if needed */
   if (pcity->tile_cache == NULL || pcity->tile_cache_radius_sq == -1
@@ -2271,14 +2379,12 @@ static inline void city_tile_cache_update(struct city *pcity)
     pcity->tile_cache_radius_sq = radius_sq;
   }
 
-  /* Any unreal tiles are skipped - these values should have been memset
-   * to 0 when the city was created. */
-  city_tile_iterate_index(radius_sq, pcity->tile, ptile, city_tile_index) {
+  city_tile_outputs(pcity, is_celebrating, outputs);
+  for (i = 0; i < ntiles; i++) {
     output_type_iterate(o) {
-      (pcity->tile_cache[city_tile_index]).output[o]
-        = city_tile_output(pcity, ptile, is_celebrating, o);
+      (pcity->tile_cache[i]).output[o] = outputs[i * O_LAST + o];
     } output_type_iterate_end;
-  } city_tile_iterate_index_end;
+  }
 }
 
 /**********************************************************************//**
@@ -3017,6 +3123,97 @@ void city_refresh_from_main_map(struct city *pcity, bool *workers_map)
   set_surpluses(pcity);
 }
 
+struct city_id_index {
+  int id;
+  int index;
+};
+
+/**********************************************************************//**
+  Compare the ids of two struct city_id_index, for qsort() and bsearch().
+**************************************************************************/
+static int city_id_index_cmp(const void *a, const void *b)
+{
+  return ((const struct city_id_index *) a)->id
+         - ((const struct city_id_index *) b)->id;
+}
+
+/**********************************************************************//**
+  Return the smallest index of the group of 'i', see city_trade_groups().
+**************************************************************************/
+static int city_trade_group(int *group, int i)
+{
+  while (group[i] != i) {
+    group[i] = group[group[i]];
+    i = group[i];
+  }
+
+  return i;
+}
+
+/**********************************************************************//**
+  Split the 'n' cities into groups for refreshing them in parallel.
+  city_refresh_from_main_map() only changes the city itself but reads its
+  trade partners, so the cities linked by trade routes are in the same
+  group. Returns the number of groups; the indices to 'cities' of the
+  group g are order[group_start[g]] to order[group_start[g + 1] - 1], in
+  their order in 'cities'. 'order' has 'n' elements and 'group_start'
+  n + 1.
+**************************************************************************/
+int city_trade_groups(struct city **cities, int n, int *order,
+                      int *group_start)
+{
+  struct city_id_index ids[n];
+  int group[n], group_of[n], next[n];
+  int num_groups = 0;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    ids[i].id = cities[i]->id;
+    ids[i].index = i;
+    group[i] = i;
+  }
+  qsort(ids, n, sizeof(*ids), city_id_index_cmp);
+
+  /* Join the groups of the trade partners. Each group is known by its
+   * smallest index. */
+  for (i = 0; i < n; i++) {
+    trade_partners_iterate(cities[i], partner) {
+      if (NULL != partner) {
+        struct city_id_index key = { partner->id, 0 };
+        const struct city_id_index *found
+          = bsearch(&key, ids, n, sizeof(*ids), city_id_index_cmp);
+
+        if (NULL != found) {
+          int a = city_trade_group(group, i);
+          int b = city_trade_group(group, found->index);
+
+          group[MAX(a, b)] = MIN(a, b);
+        }
+      }
+    } trade_partners_iterate_end;
+  }
+
+  /* Count the cities of the groups, then place them in order. */
+  for (i = 0; i < n; i++) {
+    group[i] = city_trade_group(group, i);
+    if (group[i] == i) {
+      group_of[i] = num_groups++;
+      group_start[num_groups] = 0;
+    }
+    group_start[group_of[group[i]] + 1]++;
+  }
+  group_start[0] = 0;
+  for (i = 0; i < num_groups; i++) {
+    group_start[i + 1] += group_start[i];
+    next[i] = group_start[i];
+  }
+  for (i = 0; i < n; i++) {
+    order[next[group_of[group[i]]]++] = i;
+  }
+
+  return num_groups;
+}
+
 /**********************************************************************//**
   Give corruption/waste generated by city.  otype gives the output type
   (O_SHIELD/O_TRADE).  'total' gives the total output of this type in the
@@ -3181,6 +3378,8 @@ void city_add_improvement(struct city *pcity,
     /* Client just read the info from the packets. */
     wonder_built(pcity, pimprove);
   }
+
+  effect_value_cache_changed(VUT_IMPROVEMENT);
 }
 
 /**********************************************************************//**
@@ -3198,6 +3397,8 @@ void city_remove_improvement(struct city *pcity,
     /* Client just read the info from the packets. */
     wonder_destroyed(pcity, pimprove);
   }
+
+  effect_value_cache_changed(VUT_IMPROVEMENT);
 }
 
 /**********************************************************************//**
@@ -3319,6 +3520,8 @@ void destroy_city_virtual(struct city *pcity)
 {
   CALL_FUNC_EACH_AI(city_free, pcity);
 
+  cm_city_free(pcity);
+
   citizens_free(pcity);
 
   while (worker_task_list_size(pcity->task_reqs) > 0) {
@@ -3335,6 +3538,7 @@ void destroy_city_virtual(struct city *pcity)
   if (pcity->tile_cache != NULL) {
     free(pcity->tile_cache);
   }
+  effect_value_cache_free(&pcity->effect_cache);
 
   if (!is_server()) {
     unit_list_destroy(pcity->client.info_units_supported);
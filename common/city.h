@@ -299,6 +299,7 @@ enum city_build_result {
 };
 
 struct tile_cache; /* defined and only used within city.c */
+struct effect_value_cache; /* defined and only used within effects.c */
 
 struct adv_city; /* defined in ./server/advisors/infracache.h */
 
@@ -333,6 +334,9 @@ struct city {
    * radius. */
   int tile_cache_radius_sq;
 
+  /* Effect values of the city, see get_city_bonus(). */
+  struct effect_value_cache *effect_cache;
+
   /* the productions */
   int surplus[O_LAST]; /* Final surplus in each category. */
   int waste[O_LAST]; /* Waste/corruption in each category. */
@@ -410,6 +414,10 @@ struct city {
        * Set inside city_refresh() and city_refresh_queue_add(). */
       bool needs_refresh;
 
+      /* Refreshed at turn end before its turn, and not since. Set inside
+       * update_city_activities(). */
+      bool refreshed_ahead;
+
       /* the city map is synced with the client. */
       bool synced;
 
@@ -634,6 +642,8 @@ void city_production_caravan_shields_init(void);
 /* output on spot */
 int city_tile_output(const struct city *pcity, const struct tile *ptile,
 		     bool is_celebrating, Output_type_id otype);
+void city_tile_outputs(const struct city *pcity, bool is_celebrating,
+                       int *outputs);
 int city_tile_output_now(const struct city *pcity, const struct tile *ptile,
 			 Output_type_id otype);
 
@@ -685,6 +695,8 @@ void city_remove_improvement(struct city *pcity,
 
 /* city update functions */
 void city_refresh_from_main_map(struct city *pcity, bool *workers_map);
+int city_trade_groups(struct city **cities, int n, int *order,
+                      int *group_start);
 
 int city_waste(const struct city *pcity, Output_type_id otype, int total,
                int *breakdown);
@@ -19,7 +19,9 @@
 
 /* utility */
 #include "astring.h"
+#include "bitvector.h"
 #include "fcintl.h"
+#include "fcthread.h"
 #include "log.h"
 #include "mem.h"
 #include "support.h"
@@ -34,6 +36,7 @@
 #include "map.h"
 #include "packets.h"
 #include "player.h"
+#include "research.h"
 #include "tech.h"
 
 #include "effects.h"
@@ -99,6 +102,14 @@ static bool initialized = FALSE;
   number of possible sources increases.
 **************************************************************************/
 
+/* Effects of a type whose requirements include the same gate, see
+ * effect_gate(). */
+struct effect_bucket {
+  struct universal gate;
+  enum req_range range;
+  struct effect_list *effects;
+};
+
 /**************************************************************************
   Ruleset cache. The cache is created during ruleset loading and the data
   is organized to enable fast queries.
@@ -119,8 +130,62 @@ static struct {
     /* ...advances... */
     struct effect_list *advances[A_LAST];
   } reqs;
+
+  /* The effects of each type again, bucketed by their gate, so the
+   * lookups only visit the buckets whose gate holds for the target. */
+  struct {
+    struct effect_list *ungated;
+    struct effect_bucket *buckets;
+    int num_buckets;
+  } index[EFT_COUNT];
 } ruleset_cache;
 
+/**************************************************************************
+  Effect value cache. get_player_bonus(), get_city_bonus() and the output
+  variants remember their results in the target, in a struct
+  effect_value_cache.
+
+  For each effect type, 'deps' holds the kinds of universals the
+  requirements of its effects depend on, and 'generation' changes when
+  the game state of one of them changes, see effect_value_cache_changed().
+  A remembered value is valid while its generation is the one of its
+  effect type. The government and the owner of the target are checked at
+  every lookup instead. The changes of the other kinds of universals are
+  not tracked, so the effect types which depend on them are not cached.
+
+  The caches of players are shared by the threads refreshing their
+  cities, so they are protected by a mutex. A city is refreshed by one
+  thread at a time.
+**************************************************************************/
+/* Kinds of universals, and an extra bit for the changes which are not
+ * tracked. */
+#define EFFECT_DEP_UNTRACKED VUT_COUNT
+BV_DEFINE(bv_effect_deps, VUT_COUNT + 1);
+
+static struct {
+  bv_effect_deps deps[EFT_COUNT];
+  unsigned int generation[EFT_COUNT];
+
+  /* Source of the generations. It is never reset, so values remembered
+   * with a previous ruleset are never valid. */
+  unsigned int clock;
+
+  fc_mutex players_mutex;
+} value_cache = { .clock = 0 };
+
+struct effect_value {
+  unsigned int generation;      /* 0: none. */
+  int value;
+};
+
+struct effect_value_cache {
+  const struct player *owner;
+  const struct government *government;
+
+  struct effect_value bonus[EFT_COUNT];
+  struct effect_value output_bonus[O_LAST][EFT_COUNT];
+};
+
 
 /**********************************************************************//**
   Get a list of effects of this type.
@@ -165,6 +230,132 @@ struct effect_list *get_req_source_effects(struct universal *psource)
   }
 }
 
+/**********************************************************************//**
+  Find the gate of the effect: its most selective positive requirement
+  whose evaluation is cheap, and which can only be active for a player,
+  a city or a tech state known in advance. Returns FALSE if there is
+  none.
+
+  Buildings are preferred, then nations, governments and techs.
+**************************************************************************/
+static bool effect_gate(const struct effect *peffect,
+                        struct effect_bucket *gate)
+{
+  int best = 0;
+
+  requirement_vector_iterate(&peffect->reqs, preq) {
+    int rank = 0;
+
+    if (!preq->present || preq->survives) {
+      continue;
+    }
+
+    switch (preq->source.kind) {
+    case VUT_IMPROVEMENT:
+      if (REQ_RANGE_CITY == preq->range
+          || (REQ_RANGE_PLAYER == preq->range
+              && is_wonder(preq->source.value.building))) {
+        rank = 4;
+      }
+      break;
+    case VUT_NATION:
+      if (REQ_RANGE_PLAYER == preq->range) {
+        rank = 3;
+      }
+      break;
+    case VUT_GOVERNMENT:
+      rank = 2;
+      break;
+    case VUT_ADVANCE:
+      if (REQ_RANGE_PLAYER == preq->range) {
+        rank = 1;
+      }
+      break;
+    default:
+      break;
+    }
+
+    if (rank > best) {
+      best = rank;
+      gate->gate = preq->source;
+      gate->range = preq->range;
+    }
+  } requirement_vector_iterate_end;
+
+  return 0 < best;
+}
+
+/**********************************************************************//**
+  Return whether the gate of the bucket holds for the target. If not, none
+  of the effects of the bucket is active.
+**************************************************************************/
+static bool effect_gate_open(const struct effect_bucket *bucket,
+                             const struct player *target_player,
+                             const struct city *target_city)
+{
+  switch (bucket->gate.kind) {
+  case VUT_IMPROVEMENT:
+    if (REQ_RANGE_CITY == bucket->range) {
+      return (NULL != target_city
+              && city_has_building(target_city,
+                                   bucket->gate.value.building));
+    }
+    return (NULL != target_player
+            && wonder_is_built(target_player, bucket->gate.value.building));
+  case VUT_NATION:
+    return (NULL != target_player
+            && nation_of_player(target_player) == bucket->gate.value.nation);
+  case VUT_GOVERNMENT:
+    return (NULL != target_player
+            && government_of_player(target_player)
+               == bucket->gate.value.govern);
+  case VUT_ADVANCE:
+    return (NULL != target_player
+            && TECH_KNOWN == research_invention_state(
+                               research_get(target_player),
+                               advance_number(bucket->gate.value.advance)));
+  default:
+    break;
+  }
+
+  fc_assert_msg(FALSE, "Invalid gate kind %d.", bucket->gate.kind);
+
+  return TRUE;
+}
+
+/**********************************************************************//**
+  Return the list of the index holding the effect, which is added to a
+  new bucket if needed.
+**************************************************************************/
+static struct effect_list *effect_index_list(const struct effect *peffect)
+{
+  struct effect_bucket gate;
+  int i;
+
+  if (!effect_gate(peffect, &gate)) {
+    return ruleset_cache.index[peffect->type].ungated;
+  }
+
+  for (i = 0; i < ruleset_cache.index[peffect->type].num_buckets; i++) {
+    const struct effect_bucket *bucket
+      = &ruleset_cache.index[peffect->type].buckets[i];
+
+    if (bucket->range == gate.range
+        && are_universals_equal(&bucket->gate, &gate.gate)) {
+      return bucket->effects;
+    }
+  }
+
+  gate.effects = effect_list_new();
+  ruleset_cache.index[peffect->type].buckets
+    = fc_realloc(ruleset_cache.index[peffect->type].buckets,
+                 (i + 1) * sizeof(gate));
+  ruleset_cache.index[peffect->type].buckets[i] = gate;
+  ruleset_cache.index[peffect->type].num_buckets++;
+
+  return gate.effects;
+}
+
 /**********************************************************************//**
   Add effect to ruleset cache.
 **************************************************************************/
@@ -180,10 +371,18 @@ struct effect *effect_new(enum effect_type type, int value,
   peffect->multiplier = pmul;
 
   requirement_vector_init(&peffect->reqs);
+  peffect->prog = req_program_new(&peffect->reqs);
+
+  if (NULL != pmul) {
+    /* The multipliers of the players are not tracked. */
+    BV_SET(value_cache.deps[type], EFFECT_DEP_UNTRACKED);
+  }
+  value_cache.generation[type] = ++value_cache.clock;
 
   /* Now add the effect to the ruleset cache. */
   effect_list_append(ruleset_cache.tracker, peffect);
   effect_list_append(get_effects(type), peffect);
+  effect_list_append(effect_index_list(peffect), peffect);
 
   return peffect;
 }
@@ -203,15 +402,106 @@ struct effect *effect_copy(struct effect *old)
   return new_eff;
 }
 
+/**********************************************************************//**
+  Add the kinds of universals the evaluation of the requirement depends
+  on to 'deps', see value_cache. 'visited' holds the buildings whose
+  obsolescence has been added already; NULL for none.
+**************************************************************************/
+static void effect_deps_add_req(bv_effect_deps *deps,
+                                const struct requirement *req,
+                                bv_imprs *visited)
+{
+  switch (req->range) {
+  case REQ_RANGE_TRADEROUTE:
+  case REQ_RANGE_TEAM:
+  case REQ_RANGE_ALLIANCE:
+    /* Trade routes and diplomatic states are not tracked. */
+    BV_SET(*deps, EFFECT_DEP_UNTRACKED);
+    break;
+  case REQ_RANGE_CONTINENT:
+    /* The continents change with the terrain. */
+    BV_SET(*deps, VUT_TERRAIN);
+    break;
+  default:
+    break;
+  }
+
+  switch (req->source.kind) {
+  case VUT_NONE:
+  case VUT_OTYPE:
+  case VUT_SPECIALIST:
+  case VUT_ACTION:
+  case VUT_UTYPE:
+  case VUT_UTFLAG:
+  case VUT_UCLASS:
+  case VUT_UCFLAG:
+  case VUT_IMPR_GENUS:
+    /* Only depends on the arguments of the query. */
+    break;
+  case VUT_GOVERNMENT:
+    /* Checked at every lookup. */
+    break;
+  case VUT_ADVANCE:
+  case VUT_TECHFLAG:
+  case VUT_MINTECHS:
+    BV_SET(*deps, VUT_ADVANCE);
+    break;
+  case VUT_TERRAIN:
+  case VUT_TERRAINCLASS:
+  case VUT_TERRFLAG:
+    BV_SET(*deps, VUT_TERRAIN);
+    break;
+  case VUT_IMPROVEMENT:
+    {
+      const struct impr_type *pimprove = req->source.value.building;
+      bv_imprs none;
+
+      BV_SET(*deps, VUT_IMPROVEMENT);
+
+      /* The building may become obsolete. */
+      if (NULL == visited) {
+        BV_CLR_ALL(none);
+        visited = &none;
+      }
+      if (!BV_ISSET(*visited, improvement_index(pimprove))) {
+        BV_SET(*visited, improvement_index(pimprove));
+        requirement_vector_iterate(&pimprove->obsolete_by, preq) {
+          effect_deps_add_req(deps, preq, visited);
+        } requirement_vector_iterate_end;
+      }
+    }
+    break;
+  default:
+    /* The kind is recorded for effect_values_depend_on(). */
+    BV_SET(*deps, req->source.kind);
+    BV_SET(*deps, EFFECT_DEP_UNTRACKED);
+    break;
+  }
+}
+
 /**********************************************************************//**
   Append requirement to effect.
 **************************************************************************/
 void effect_req_append(struct effect *peffect, struct requirement req)
 {
   struct effect_list *eff_list = get_req_source_effects(&req.source);
+  struct effect_list *old_index_list = effect_index_list(peffect);
+  struct effect_list *new_index_list;
 
   requirement_vector_append(&peffect->reqs, req);
 
+  new_index_list = effect_index_list(peffect);
+  if (new_index_list != old_index_list) {
+    effect_list_remove(old_index_list, peffect);
+    effect_list_append(new_index_list, peffect);
+  }
+
+  req_program_destroy(peffect->prog);
+  peffect->prog = req_program_new(&peffect->reqs);
+
+  effect_deps_add_req(&value_cache.deps[peffect->type], &req, NULL);
+  value_cache.generation[peffect->type] = ++value_cache.clock;
+
   if (eff_list) {
     effect_list_append(eff_list, peffect);
   }
@@ -230,9 +520,20 @@ void ruleset_cache_init(void)
 
   ruleset_cache.tracker = effect_list_new();
 
+  for (i = 0; i < ARRAY_SIZE(value_cache.deps); i++) {
+    BV_CLR_ALL(value_cache.deps[i]);
+    value_cache.generation[i] = ++value_cache.clock;
+  }
+  fc_init_mutex(&value_cache.players_mutex);
+
   for (i = 0; i < ARRAY_SIZE(ruleset_cache.effects); i++) {
     ruleset_cache.effects[i] = effect_list_new();
   }
+  for (i = 0; i < ARRAY_SIZE(ruleset_cache.index); i++) {
+    ruleset_cache.index[i].ungated = effect_list_new();
+    ruleset_cache.index[i].buckets = NULL;
+    ruleset_cache.index[i].num_buckets = 0;
+  }
   for (i = 0; i < ARRAY_SIZE(ruleset_cache.reqs.buildings); i++) {
     ruleset_cache.reqs.buildings[i] = effect_list_new();
   }
@@ -256,12 +557,17 @@ void ruleset_cache_free(void)
   if (tracker_list) {
     effect_list_iterate(tracker_list, peffect) {
       requirement_vector_free(&peffect->reqs);
+      req_program_destroy(peffect->prog);
       free(peffect);
     } effect_list_iterate_end;
     effect_list_destroy(tracker_list);
     ruleset_cache.tracker = NULL;
   }
 
+  if (initialized) {
+    fc_destroy_mutex(&value_cache.players_mutex);
+  }
+
   for (i = 0; i < ARRAY_SIZE(ruleset_cache.effects); i++) {
     struct effect_list *plist = ruleset_cache.effects[i];
 
@@ -271,6 +577,23 @@ void ruleset_cache_free(void)
     }
   }
 
+  for (i = 0; i < ARRAY_SIZE(ruleset_cache.index); i++) {
+    int j;
+
+    if (ruleset_cache.index[i].ungated) {
+      effect_list_destroy(ruleset_cache.index[i].ungated);
+      ruleset_cache.index[i].ungated = NULL;
+    }
+    for (j = 0; j < ruleset_cache.index[i].num_buckets; j++) {
+      effect_list_destroy(ruleset_cache.index[i].buckets[j].effects);
+    }
+    if (ruleset_cache.index[i].buckets) {
+      free(ruleset_cache.index[i].buckets);
+      ruleset_cache.index[i].buckets = NULL;
+    }
+    ruleset_cache.index[i].num_buckets = 0;
+  }
+
   for (i = 0; i < ARRAY_SIZE(ruleset_cache.reqs.buildings); i++) {
     struct effect_list *plist = ruleset_cache.reqs.buildings[i];
 
@@ -586,6 +909,25 @@ bool is_building_replaced(const struct city *pcity,
   return TRUE;
 }
 
+/**********************************************************************//**
+  Return the value the active effect adds for the target player. If there
+  is a multiplier for the effect, the value is multiplied by the factor of
+  the player (and is 0 without player).
+**************************************************************************/
+static int effect_value(const struct effect *peffect,
+                        const struct player *target_player)
+{
+  if (NULL == peffect->multiplier) {
+    return peffect->value;
+  } else if (NULL != target_player) {
+    return (peffect->value
+            * player_multiplier_effect_value(target_player,
+                                             peffect->multiplier)) / 100;
+  } else {
+    return 0;
+  }
+}
+
 /**********************************************************************//**
   Returns the effect bonus of a given type for any target.
 
@@ -612,37 +954,214 @@ int get_target_bonus_effects(struct effect_list *plist,
                              enum effect_type effect_type)
 {
   int bonus = 0;
+  int i;
 
-  /* Loop over all effects of this type. */
-  effect_list_iterate(get_effects(effect_type), peffect) {
-    /* For each effect, see if it is active. */
-    if (are_reqs_active(target_player, other_player, target_city,
-                        target_building, target_tile,
-                        target_unit, target_unittype,
-                        target_output, target_specialist, target_action,
-			&peffect->reqs, RPT_CERTAIN)) {
-      /* This code will add value of effect. If there's multiplier for 
-       * effect and target_player aren't null, then value is multiplied
-       * by player's multiplier factor. */
-      if (peffect->multiplier) {
-        if (target_player) {
-          bonus += (peffect->value
-            * player_multiplier_effect_value(target_player,
-                                             peffect->multiplier)) / 100;
-        }
-      } else {
-        bonus += peffect->value;
+  if (NULL != plist) {
+    /* Keep the order of the ruleset in the list of the active effects. */
+    effect_list_iterate(get_effects(effect_type), peffect) {
+      if (req_program_active(peffect->prog, target_player, other_player,
+                             target_city, target_building, target_tile,
+                             target_unit, target_unittype,
+                             target_output, target_specialist,
+                             target_action, RPT_CERTAIN)) {
+        bonus += effect_value(peffect, target_player);
+        effect_list_append(plist, peffect);
       }
+    } effect_list_iterate_end;
 
-      if (plist) {
-	effect_list_append(plist, peffect);
-      }
+    return bonus;
+  }
+
+  /* Only visit the effects whose gate holds. */
+  effect_list_iterate(ruleset_cache.index[effect_type].ungated, peffect) {
+    if (req_program_active(peffect->prog, target_player, other_player,
+                           target_city, target_building, target_tile,
+                           target_unit, target_unittype,
+                           target_output, target_specialist, target_action,
+                           RPT_CERTAIN)) {
+      bonus += effect_value(peffect, target_player);
     }
   } effect_list_iterate_end;
 
+  for (i = 0; i < ruleset_cache.index[effect_type].num_buckets; i++) {
+    const struct effect_bucket *bucket
+      = &ruleset_cache.index[effect_type].buckets[i];
+
+    if (!effect_gate_open(bucket, target_player, target_city)) {
+      continue;
+    }
+    effect_list_iterate(bucket->effects, peffect) {
+      if (req_program_active(peffect->prog, target_player, other_player,
+                             target_city, target_building, target_tile,
+                             target_unit, target_unittype,
+                             target_output, target_specialist,
+                             target_action, RPT_CERTAIN)) {
+        bonus += effect_value(peffect, target_player);
+      }
+    } effect_list_iterate_end;
+  }
+
   return bonus;
 }
 
+/**********************************************************************//**
+  Return whether the values of the effect type are cached. The client
+  does not track the changes, as it gets them from the server.
+**************************************************************************/
+static bool effect_value_cacheable(enum effect_type effect_type)
+{
+  return (is_server()
+          && !BV_ISSET(value_cache.deps[effect_type], EFFECT_DEP_UNTRACKED));
+}
+
+/**********************************************************************//**
+  Return the slot of the effect type and output type (NULL for none) in
+  the cache, which is allocated or cleared if needed. 'owner' is the owner
+  of the target, or the target player.
+**************************************************************************/
+static struct effect_value *
+effect_value_slot(struct effect_value_cache **pcache,
+                  const struct player *owner,
+                  const struct output_type *poutput,
+                  enum effect_type effect_type)
+{
+  struct effect_value_cache *cache = *pcache;
+  const struct government *gov = government_of_player(owner);
+
+  if (NULL == cache) {
+    cache = fc_calloc(1, sizeof(*cache));
+    *pcache = cache;
+    cache->owner = owner;
+    cache->government = gov;
+  } else if (cache->owner != owner || cache->government != gov) {
+    memset(cache, 0, sizeof(*cache));
+    cache->owner = owner;
+    cache->government = gov;
+  }
+
+  return (NULL != poutput
+          ? &cache->output_bonus[poutput->index][effect_type]
+          : &cache->bonus[effect_type]);
+}
+
+/**********************************************************************//**
+  Look up a value remembered by effect_value_store(). 'mutex' protects
+  the cache, if needed.
+**************************************************************************/
+static bool effect_value_lookup(struct effect_value_cache **pcache,
+                                fc_mutex *mutex,
+                                const struct player *owner,
+                                const struct output_type *poutput,
+                                enum effect_type effect_type, int *value)
+{
+  const struct effect_value *slot;
+  bool found;
+
+  if (NULL != mutex) {
+    fc_allocate_mutex(mutex);
+  }
+  slot = effect_value_slot(pcache, owner, poutput, effect_type);
+  found = (slot->generation == value_cache.generation[effect_type]);
+  if (found) {
+    *value = slot->value;
+  }
+  if (NULL != mutex) {
+    fc_release_mutex(mutex);
+  }
+
+  return found;
+}
+
+/**********************************************************************//**
+  Remember the value of the effect type for the target of the cache.
+**************************************************************************/
+static void effect_value_store(struct effect_value_cache **pcache,
+                               fc_mutex *mutex,
+                               const struct player *owner,
+                               const struct output_type *poutput,
+                               enum effect_type effect_type, int value)
+{
+  struct effect_value *slot;
+
+  if (NULL != mutex) {
+    fc_allocate_mutex(mutex);
+  }
+  slot = effect_value_slot(pcache, owner, poutput, effect_type);
+  slot->generation = value_cache.generation[effect_type];
+  slot->value = value;
+  if (NULL != mutex) {
+    fc_release_mutex(mutex);
+  }
+}
+
+/**********************************************************************//**
+  The game state of a kind of universals changed: forget the cached
+  values of the effect types which depend on it. Only VUT_IMPROVEMENT,
+  VUT_ADVANCE (with the tech flags and the tech counts) and VUT_TERRAIN
+  (with the terrain classes and flags, and the continents) are tracked.
+**************************************************************************/
+void effect_value_cache_changed(enum universals_n kind)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(value_cache.deps); i++) {
+    if (BV_ISSET(value_cache.deps[i], kind)) {
+      value_cache.generation[i] = ++value_cache.clock;
+    }
+  }
+}
+
+/**********************************************************************//**
+  Forget all the cached effect values, after changes which are not
+  tracked, like the loading of a game.
+**************************************************************************/
+void effect_value_cache_flush(void)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(value_cache.generation); i++) {
+    value_cache.generation[i] = ++value_cache.clock;
+  }
+}
+
+/**********************************************************************//**
+  Return a number which changes whenever a tracked change makes cached
+  effect values stale, see effect_value_cache_changed(). Callers keeping
+  results derived from effect values can compare it to detect changes.
+**************************************************************************/
+unsigned int effect_value_cache_generation(void)
+{
+  return value_cache.clock;
+}
+
+/**********************************************************************//**
+  Return whether the requirements of some effect depend on the kind of
+  universals.
+**************************************************************************/
+bool effect_values_depend_on(enum universals_n kind)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(value_cache.deps); i++) {
+    if (BV_ISSET(value_cache.deps[i], kind)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**********************************************************************//**
+  Free the effect values cached for a city or a player.
+**************************************************************************/
+void effect_value_cache_free(struct effect_value_cache **pcache)
+{
+  if (NULL != *pcache) {
+    free(*pcache);
+    *pcache = NULL;
+  }
+}
+
 /**********************************************************************//**
   Returns the effect bonus for the whole world.
 **************************************************************************/
@@ -664,14 +1183,33 @@ int get_world_bonus(enum effect_type effect_type)
 int get_player_bonus(const struct player *pplayer,
 		     enum effect_type effect_type)
 {
+  struct effect_value_cache **pcache;
+  int value;
+
   if (!initialized) {
     return 0;
   }
 
-  return get_target_bonus_effects(NULL,
-                                  pplayer, NULL, NULL, NULL,
-                                  NULL, NULL, NULL, NULL, NULL,
-                                  NULL, effect_type);
+  if (NULL == pplayer || !effect_value_cacheable(effect_type)) {
+    return get_target_bonus_effects(NULL,
+                                    pplayer, NULL, NULL, NULL,
+                                    NULL, NULL, NULL, NULL, NULL,
+                                    NULL, effect_type);
+  }
+
+  /* The cache is not part of the state of the player. */
+  pcache = &((struct player *) pplayer)->effect_cache;
+  if (!effect_value_lookup(pcache, &value_cache.players_mutex, pplayer,
+                           NULL, effect_type, &value)) {
+    value = get_target_bonus_effects(NULL,
+                                     pplayer, NULL, NULL, NULL,
+                                     NULL, NULL, NULL, NULL, NULL,
+                                     NULL, effect_type);
+    effect_value_store(pcache, &value_cache.players_mutex, pplayer,
+                       NULL, effect_type, value);
+  }
+
+  return value;
 }
 
 /**********************************************************************//**
@@ -679,14 +1217,33 @@ int get_player_bonus(const struct player *pplayer,
 **************************************************************************/
 int get_city_bonus(const struct city *pcity, enum effect_type effect_type)
 {
+  struct effect_value_cache **pcache;
+  int value;
+
   if (!initialized) {
     return 0;
   }
 
-  return get_target_bonus_effects(NULL,
-                                  city_owner(pcity), NULL, pcity, NULL,
-                                  city_tile(pcity), NULL, NULL, NULL, NULL,
-                                  NULL, effect_type);
+  if (!effect_value_cacheable(effect_type)) {
+    return get_target_bonus_effects(NULL,
+                                    city_owner(pcity), NULL, pcity, NULL,
+                                    city_tile(pcity), NULL, NULL, NULL, NULL,
+                                    NULL, effect_type);
+  }
+
+  /* The cache is not part of the state of the city. */
+  pcache = &((struct city *) pcity)->effect_cache;
+  if (!effect_value_lookup(pcache, NULL, city_owner(pcity), NULL,
+                           effect_type, &value)) {
+    value = get_target_bonus_effects(NULL,
+                                     city_owner(pcity), NULL, pcity, NULL,
+                                     city_tile(pcity), NULL, NULL, NULL, NULL,
+                                     NULL, effect_type);
+    effect_value_store(pcache, NULL, city_owner(pcity), NULL, effect_type,
+                       value);
+  }
+
+  return value;
 }
 
 /**********************************************************************//**
@@ -751,6 +1308,75 @@ int get_tile_output_bonus(const struct city *pcity,
                                   effect_type);
 }
 
+/**********************************************************************//**
+  Batch version of get_tile_output_bonus() for many tiles of the city:
+  bonuses[i * stride] is set to the bonus at tiles[i] (0 for NULL tiles).
+
+  The requirements which do not depend on the tile are evaluated once for
+  all the tiles, so only the tile ones are evaluated for each tile, and
+  only for the effects which may still be active.
+**************************************************************************/
+void get_city_tiles_output_bonus(const struct city *pcity,
+                                 const struct tile *const *tiles,
+                                 int num_tiles,
+                                 const struct output_type *poutput,
+                                 enum effect_type effect_type,
+                                 int *bonuses, int stride)
+{
+  const struct player *pplayer = city_owner(pcity);
+  int i;
+
+  for (i = 0; i < num_tiles; i++) {
+    bonuses[i * stride] = 0;
+  }
+
+  if (!initialized) {
+    return;
+  }
+
+  effect_list_iterate(get_effects(effect_type), peffect) {
+    int num_reqs = requirement_vector_size(&peffect->reqs);
+    const struct requirement *tile_reqs[num_reqs + 1];
+    int num_tile_reqs = 0;
+    bool possible = TRUE;
+    int value;
+
+    requirement_vector_iterate(&peffect->reqs, preq) {
+      if (is_req_tile_dependent(preq)) {
+        tile_reqs[num_tile_reqs++] = preq;
+      } else if (!is_req_active(pplayer, NULL, pcity, NULL, NULL, NULL,
+                                NULL, poutput, NULL, NULL, preq,
+                                RPT_CERTAIN)) {
+        possible = FALSE;
+        break;
+      }
+    } requirement_vector_iterate_end;
+
+    value = (possible ? effect_value(peffect, pplayer) : 0);
+    if (0 == value) {
+      continue;
+    }
+
+    for (i = 0; i < num_tiles; i++) {
+      int j;
+
+      if (NULL == tiles[i]) {
+        continue;
+      }
+      for (j = 0; j < num_tile_reqs; j++) {
+        if (!is_req_active(pplayer, NULL, pcity, NULL, tiles[i], NULL,
+                           NULL, poutput, NULL, NULL, tile_reqs[j],
+                           RPT_CERTAIN)) {
+          break;
+        }
+      }
+      if (j == num_tile_reqs) {
+        bonuses[i * stride] += value;
+      }
+    }
+  } effect_list_iterate_end;
+}
+
 /**********************************************************************//**
   Returns the player effect bonus of an output.
 **************************************************************************/
@@ -758,6 +1384,9 @@ int get_player_output_bonus(const struct player *pplayer,
                             const struct output_type *poutput,
                             enum effect_type effect_type)
 {
+  struct effect_value_cache **pcache;
+  int value;
+
   if (!initialized) {
     return 0;
   }
@@ -765,9 +1394,24 @@ int get_player_output_bonus(const struct player *pplayer,
   fc_assert_ret_val(pplayer != NULL, 0);
   fc_assert_ret_val(poutput != NULL, 0);
   fc_assert_ret_val(effect_type != EFT_COUNT, 0);
-  return get_target_bonus_effects(NULL, pplayer, NULL, NULL, NULL, NULL,
-                                  NULL, NULL, poutput, NULL, NULL,
-                                  effect_type);
+
+  if (!effect_value_cacheable(effect_type)) {
+    return get_target_bonus_effects(NULL, pplayer, NULL, NULL, NULL, NULL,
+                                    NULL, NULL, poutput, NULL, NULL,
+                                    effect_type);
+  }
+
+  pcache = &((struct player *) pplayer)->effect_cache;
+  if (!effect_value_lookup(pcache, &value_cache.players_mutex, pplayer,
+                           poutput, effect_type, &value)) {
+    value = get_target_bonus_effects(NULL, pplayer, NULL, NULL, NULL, NULL,
+                                     NULL, NULL, poutput, NULL, NULL,
+                                     effect_type);
+    effect_value_store(pcache, &value_cache.players_mutex, pplayer,
+                       poutput, effect_type, value);
+  }
+
+  return value;
 }
 
 /**********************************************************************//**
@@ -777,6 +1421,9 @@ int get_city_output_bonus(const struct city *pcity,
                           const struct output_type *poutput,
                           enum effect_type effect_type)
 {
+  struct effect_value_cache **pcache;
+  int value;
+
   if (!initialized) {
     return 0;
   }
@@ -784,10 +1431,26 @@ int get_city_output_bonus(const struct city *pcity,
   fc_assert_ret_val(pcity != NULL, 0);
   fc_assert_ret_val(poutput != NULL, 0);
   fc_assert_ret_val(effect_type != EFT_COUNT, 0);
-  return get_target_bonus_effects(NULL, city_owner(pcity), NULL, pcity,
-                                  NULL, NULL, NULL, NULL, poutput, NULL,
-                                  NULL,
-                                  effect_type);
+
+  if (!effect_value_cacheable(effect_type)) {
+    return get_target_bonus_effects(NULL, city_owner(pcity), NULL, pcity,
+                                    NULL, NULL, NULL, NULL, poutput, NULL,
+                                    NULL,
+                                    effect_type);
+  }
+
+  pcache = &((struct city *) pcity)->effect_cache;
+  if (!effect_value_lookup(pcache, NULL, city_owner(pcity), poutput,
+                           effect_type, &value)) {
+    value = get_target_bonus_effects(NULL, city_owner(pcity), NULL, pcity,
+                                     NULL, NULL, NULL, NULL, poutput, NULL,
+                                     NULL,
+                                     effect_type);
+    effect_value_store(pcache, NULL, city_owner(pcity), poutput,
+                       effect_type, value);
+  }
+
+  return value;
 }
 
 /**********************************************************************//**
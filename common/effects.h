@@ -317,6 +317,9 @@ struct effect {
   /* An effect can have multiple requirements.  The effect will only be
    * active if all of these requirement are met. */
   struct requirement_vector reqs;
+
+  /* 'reqs' compiled, kept up to date by effect_req_append(). */
+  struct req_program *prog;
 };
 
 /* An effect_list is a list of effects. */
@@ -343,6 +346,15 @@ struct packet_ruleset_effect;
 
 void ruleset_cache_init(void);
 void ruleset_cache_free(void);
+
+/* effect value cache functions */
+struct effect_value_cache;
+
+void effect_value_cache_changed(enum universals_n kind);
+void effect_value_cache_flush(void);
+unsigned int effect_value_cache_generation(void);
+bool effect_values_depend_on(enum universals_n kind);
+void effect_value_cache_free(struct effect_value_cache **pcache);
 void recv_ruleset_effect(const struct packet_ruleset_effect *packet);
 void send_ruleset_cache(struct conn_list *dest);
 
@@ -368,6 +380,12 @@ int get_city_tile_output_bonus(const struct city *pcity,
 			       const struct tile *ptile,
 			       const struct output_type *poutput,
 			       enum effect_type effect_type);
+void get_city_tiles_output_bonus(const struct city *pcity,
+                                 const struct tile *const *tiles,
+                                 int num_tiles,
+                                 const struct output_type *poutput,
+                                 enum effect_type effect_type,
+                                 int *bonuses, int stride);
 int get_tile_output_bonus(const struct city *pcity,
                           const struct tile *ptile,
                           const struct output_type *poutput,
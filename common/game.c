@@ -348,6 +348,7 @@ static void game_defaults(bool keep_ruleset_value)
     game.server.auto_ai_toggle    = GAME_DEFAULT_AUTO_AI_TOGGLE;
     game.server.autoattack        = GAME_DEFAULT_AUTOATTACK;
     game.server.barbarianrate     = GAME_DEFAULT_BARBARIANRATE;
+    game.server.city_threads      = GAME_DEFAULT_CITY_THREADS;
     game.server.civilwarsize      = GAME_DEFAULT_CIVILWARSIZE;
     game.server.connectmsg[0]     = '\0';
     game.server.conquercost       = GAME_DEFAULT_CONQUERCOST;
@@ -392,6 +393,9 @@ static void game_defaults(bool keep_ruleset_value)
     game.server.nuclear_winter_percent = GAME_DEFAULT_NUCLEAR_WINTER_PERCENT;
     game.server.plrcolormode      = GAME_DEFAULT_PLRCOLORMODE;
     game.server.netwait           = GAME_DEFAULT_NETWAIT;
+    game.server.netsendqueue      = GAME_DEFAULT_NETSENDQUEUE;
+    game.server.netcompress       = GAME_DEFAULT_NETCOMPRESS;
+    game.server.netlagpolicy      = GAME_DEFAULT_NETLAGPOLICY;
     game.server.occupychance      = GAME_DEFAULT_OCCUPYCHANCE;
     game.server.onsetbarbarian    = GAME_DEFAULT_ONSETBARBARIAN;
     game.server.additional_phase_seconds = 0;
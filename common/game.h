@@ -68,6 +68,12 @@ enum scorelog_level {
   SL_HUMANS
 };
 
+enum netlag_policy {
+  NLP_WAIT = 0,
+  NLP_DROP_OBSERVERS,
+  NLP_CUT
+};
+
 struct user_flag
 {
   char *name;
@@ -130,6 +136,7 @@ struct civ_game {
       int autoupgrade_veteran_loss;
       enum barbarians_rate barbarianrate;
       int base_incite_cost;
+      int city_threads;
       int civilwarsize;
       int conquercost;
       int contactturns;
@@ -162,6 +169,9 @@ struct civ_game {
       int min_players;
       bool natural_city_names;
       int netwait;
+      int netsendqueue;
+      enum compress_method netcompress;
+      enum netlag_policy netlagpolicy;
       int num_phases;
       int occupychance;
       int onsetbarbarian;
@@ -571,6 +581,20 @@ extern struct world wld;
 #define GAME_MIN_NETWAIT             0
 #define GAME_MAX_NETWAIT             20
 
+#define GAME_DEFAULT_NETSENDQUEUE    256   /* KiB */
+#define GAME_MIN_NETSENDQUEUE        16
+#define GAME_MAX_NETSENDQUEUE        16384
+
+#define GAME_DEFAULT_NETLAGPOLICY    NLP_DROP_OBSERVERS
+
+#if defined(FREECIV_HAVE_LIBZSTD)
+#  define GAME_DEFAULT_NETCOMPRESS   COMPRESS_ZSTD
+#elif defined(FREECIV_HAVE_LIBLZ4)
+#  define GAME_DEFAULT_NETCOMPRESS   COMPRESS_LZ4
+#else
+#  define GAME_DEFAULT_NETCOMPRESS   COMPRESS_ZLIB
+#endif
+
 #define GAME_DEFAULT_PINGTIME        20
 #define GAME_MIN_PINGTIME            1
 #define GAME_MAX_PINGTIME            1800
@@ -637,6 +661,10 @@ extern struct world wld;
 
 #define GAME_DEFAULT_THREADED_SAVE   FALSE
 
+#define GAME_DEFAULT_CITY_THREADS    1
+#define GAME_MIN_CITY_THREADS        1
+#define GAME_MAX_CITY_THREADS        64
+
 #define GAME_DEFAULT_USER_META_MESSAGE ""
 
 #define GAME_DEFAULT_SKILL_LEVEL     AI_LEVEL_EASY
@@ -25,6 +25,10 @@ generate_logs=1
 use_log_macro="log_packet_detailed"
 generate_variant_logs=1
 
+# Shortest run of bytewise comparable fields compared with one memcmp()
+# before comparing them one by one.
+min_memcmp_run=3
+
 ### The following parameters CHANGE the protocol. You have been warned.
 fold_bool_into_header=1
 
@@ -225,6 +229,33 @@ class Field:
             return "const %s *"%self.struct_type
         return self.struct_type+" "
 
+    # Returns the entry of this field in the table describing the tagged
+    # encoding of a packet variant. 'delta' tells whether the variant
+    # uses the delta protocol.
+    def get_schema(self,delta):
+        if self.dataio_type=="bitvector":
+            size="sizeof(%(struct_type)s)"%self.__dict__
+        elif self.dataio_type in ["string","estring","city_map"] \
+             and self.is_array==1:
+            size="0"
+        elif self.is_array==2:
+            size=self.array_size1_d
+        elif self.is_array:
+            size=self.array_size_d
+        else:
+            size="0"
+        factor=self.__dict__.get("float_factor",0)
+        if self.is_key:
+            key="TRUE"
+        else:
+            key="FALSE"
+        if delta and self.diff and self.is_array==1:
+            diff="PACKET_SCHEMA_DIFF"
+        else:
+            diff="FALSE"
+        return '''  {"%s", "%s", %d, %s, %d, %s, %s},
+'''%(self.name,self.dataio_type,self.tag,size,factor,key,diff)
+
     # Returns code which is used in the declaration of the field in
     # the packet struct.
     def get_declar(self):
@@ -293,6 +324,61 @@ class Field:
       }
     }'''%self.get_dict(vars())
 
+    # Returns whether two instances of the field are equal exactly when
+    # their bytes are equal, so it can be compared by memcmp() together
+    # with its neighbours.
+    def is_memcmp_safe(self):
+        if self.struct_type=="float" or self.is_struct:
+            return 0
+        if self.dataio_type in ["string", "estring", "memory"]:
+            return 0
+        if self.is_array==0:
+            return 1
+        # Only fixed size arrays; with a variable size, the bytes after
+        # the used part do not count.
+        return self.is_array==1 and self.array_size_u==self.array_size_d
+
+    # Returns the layout class of the field. Consecutive fields of the
+    # same class have no padding between them, so their bytes are all
+    # significant.
+    def get_memcmp_class(self):
+        if self.dataio_type in ["bool8", "bitvector"]:
+            return "char"
+        return self.struct_type
+
+    # Returns a C constant expression of the number of bytes the field
+    # takes on the wire, used to estimate what the delta protocol saves
+    # by not sending it. Variable sized parts are not counted.
+    def get_wire_size(self):
+        sizes={"uint8":1, "sint8":1, "bool8":1,
+               "uint16":2, "sint16":2,
+               "uint32":4, "sint32":4, "ufloat":4, "sfloat":4}
+        if self.is_folded_bool():
+            return "0"
+        if self.dataio_type in ["string", "estring"]:
+            # At least the terminating byte.
+            return "1"
+        if self.dataio_type=="memory":
+            if self.array_size_u==self.array_size_d:
+                return self.array_size_d
+            return "0"
+        if self.dataio_type=="bitvector":
+            size="sizeof(%s)"%self.struct_type
+        elif self.dataio_type in sizes:
+            size="%d"%sizes[self.dataio_type]
+        else:
+            return "0"
+        if self.is_array==0:
+            return size
+        if self.is_array==1 and self.array_size_u==self.array_size_d:
+            return "%s * (%s)"%(size,self.array_size_d)
+        return "0"
+
+    # Returns whether the field is a bool folded into the header.
+    def is_folded_bool(self):
+        return fold_bool_into_header and self.struct_type=="bool" and \
+               not self.is_array
+
     # Returns a code fragment which updates the bit of the this field
     # in the "fields" bitvector. The bit is either a "content-differs"
     # bit or (for bools which gets folded in the header) the actual
@@ -325,7 +411,9 @@ class Field:
     def get_put_wrapper(self,packet,i,deltafragment):
         if fold_bool_into_header and self.struct_type=="bool" and \
            not self.is_array:
-            return "  /* field %(i)d is folded into the header */\n"%vars()
+            return '''  /* field %(i)d is folded into the header */
+  SEND_PACKET_TAG_BOOL(%(tag)d, real_packet->%(name)s);
+'''%self.get_dict(vars())
         put=self.get_put(deltafragment)
         packet_name=packet.name
         log_macro=packet.log_macro
@@ -348,8 +436,34 @@ class Field:
   field_addr.name = \"%(name)s\";
 #endif /* FREECIV_JSON_CONNECTION */
 '''%self.__dict__ \
+               + self.get_put_tag(deltafragment) \
                + self.get_put_real(deltafragment);
 
+    # Returns code which puts the tag of this field in the tagged
+    # encoding. Arrays, memory and bitvectors also get their number of
+    # elements (of bytes for memory and bitvectors), except the diff
+    # arrays which end with the index 255.
+    def get_put_tag(self,deltafragment):
+        if self.dataio_type=="bitvector":
+            count="sizeof(real_packet->%(name)s.vec)"%self.__dict__
+        elif deltafragment and self.diff and self.is_array==1:
+            count=""
+        elif self.dataio_type in ["string","estring","city_map"]:
+            if self.is_array==2:
+                count=self.array_size1_u
+            else:
+                count=""
+        elif self.is_array==2:
+            count=self.array_size1_u
+        elif self.is_array:
+            count=self.array_size_u
+        else:
+            count=""
+
+        if count:
+            return "  SEND_PACKET_TAG_COUNT(%d, %s);\n"%(self.tag,count)
+        return "  SEND_PACKET_TAG(%d);\n"%self.tag
+
     # The code which put this field before it is wrapped in address adding.
     def get_put_real(self,deltafragment):
         if self.dataio_type=="bitvector":
@@ -821,6 +935,7 @@ class Variant:
         self.is_info=packet.is_info
         self.cancel=packet.cancel
         self.want_force=packet.want_force
+        self.want_broadcast=packet.want_broadcast
 
         self.poscaps=poscaps
         self.negcaps=negcaps
@@ -900,7 +1015,16 @@ static char *stats_%(name)s_names[] = {%(names)s};
     # bitvector. Each bit in this bitvector represents one non-key
     # field.    
     def get_bitvector(self):
-        return "BV_DEFINE(%(name)s_fields, %(bits)d);\n"%self.__dict__
+        result="BV_DEFINE(%(name)s_fields, %(bits)d);\n"%self.__dict__
+        if self.bits>0:
+            sizes=",\n  ".join(map(lambda x:x.get_wire_size(),
+                                   self.other_fields))
+            result=result+'''
+static const unsigned int wire_size_%s[] = {
+  %s
+};
+'''%(self.name,sizes)
+        return result
 
     # Returns a code fragment which is the packet specific part of
     # the delta_stats_report() function.
@@ -984,7 +1108,8 @@ static char *stats_%(name)s_names[] = {%(names)s};
         temp='''%(send_prototype)s
 {
 <real_packet1><delta_header>  SEND_PACKET_START(%(type)s);
-<faddr><log><report><pre1><body><pre2><post>  SEND_PACKET_END(%(type)s);
+  SEND_PACKET_SCHEMA(%(no)d);
+<faddr><log><report><pre1><body><pre2><post>  <send_end>;
 }
 
 '''
@@ -1023,6 +1148,12 @@ static char *stats_%(name)s_names[] = {%(names)s};
         else:
             real_packet1=""
 
+        if self.want_broadcast:
+            real_packet1=real_packet1+"  struct packet_broadcast_slot *bslot;\n"
+            send_end="SEND_PACKET_BROADCAST_END(%(type)s, bslot)"
+        else:
+            send_end="SEND_PACKET_END(%(type)s)"
+
         if not self.no_packet:
             if self.delta:
                 if self.want_force:
@@ -1033,7 +1164,7 @@ static char *stats_%(name)s_names[] = {%(names)s};
   %(name)s_fields fields;
   struct %(packet_name)s *old;
   bool differ;
-  struct genhash **hash = pc->phs.sent + %(type)s;
+  struct delta_cache **cache = pc->phs.sent + %(type)s;
   int different = %(diff)s;
 #endif /* FREECIV_DELTA_PROTOCOL */
 '''
@@ -1042,6 +1173,8 @@ static char *stats_%(name)s_names[] = {%(names)s};
                 delta_header=""
                 body="#if 1 /* To match endif */"
             body=body+"\n"
+            if self.want_broadcast:
+                body=body+self.get_broadcast_reuse("NULL, 0", "")+"\n"
             for field in self.fields:
                 body=body+field.get_put(0)+"\n"
             body=body+"\n#endif\n"
@@ -1078,28 +1211,97 @@ static char *stats_%(name)s_names[] = {%(names)s};
 
     # '''
 
+    # Helper for get_send(). Returns the code which looks up the
+    # serialized form of the packet among the ones already made for
+    # other connections during the current broadcast, and sends that
+    # instead when found.
+    def get_broadcast_reuse(self,fields,update):
+        return '''  bslot = packet_broadcast_lookup(pc, %%(type)s, %%(no)d,
+                                  real_packet, sizeof(*real_packet),
+                                  %s);
+  if (packet_broadcast_ready(bslot)) {
+%s    return packet_broadcast_send(pc, bslot);
+  }
+'''%(fields,update)
+
+    # Helper for get_send()
+    def get_cancel_send(self,indent):
+        result=""
+        for i in self.cancel:
+            result=result+'''
+%(indent)scache = pc->phs.sent + %(i)s;
+%(indent)sif (NULL != *cache) {
+%(indent)s  delta_cache_remove(*cache, real_packet);
+%(indent)s}
+'''%{"indent":indent,"i":i}
+        return result
+
+    # Helper for get_send(). Returns the code which fills the "fields"
+    # bitvector. Runs of fields which can be compared bytewise and have
+    # the same layout are first compared as one memory block, so the
+    # common case of nothing changed in them costs a single memcmp()
+    # instead of a branch per field.
+    def get_delta_cmp(self):
+        runs=[]
+        for i in range(len(self.other_fields)):
+            field=self.other_fields[i]
+            safe=field.is_memcmp_safe()
+            if safe and runs and runs[-1][0] \
+               and runs[-1][1][-1][1].get_memcmp_class() \
+                   ==field.get_memcmp_class():
+                runs[-1][1].append((i,field))
+            else:
+                runs.append((safe,[(i,field)]))
+
+        body=""
+        for safe,run in runs:
+            if not safe or len(run)<min_memcmp_run:
+                for i,field in run:
+                    body=body+field.get_cmp_wrapper(i)
+                continue
+
+            first=run[0][1].name
+            last=run[-1][1].name
+            inner=""
+            for i,field in run:
+                inner=inner+field.get_cmp_wrapper(i)
+            inner="\n".join(map(lambda x:x and "  "+x,
+                                 inner.rstrip("\n").split("\n")))
+            body=body+'''  if (0 != memcmp(&old->%s, &real_packet->%s,
+                  (const char *) (&real_packet->%s + 1)
+                  - (const char *) &real_packet->%s)) {
+%s
+  }'''%(first,first,last,first,inner)
+            folded=""
+            for i,field in run:
+                if field.is_folded_bool():
+                    folded=folded+'''    if (packet->%s) {
+      BV_SET(fields, %d);
+    }
+'''%(field.name,i)
+            if folded:
+                body=body+" else {\n"+folded+"  }"
+            body=body+"\n\n"
+        return body
+
     # Helper for get_send()
     def get_delta_send_body(self):
         intro='''
 #ifdef FREECIV_DELTA_PROTOCOL
-  if (NULL == *hash) {
-    *hash = genhash_new_full(hash_%(name)s, cmp_%(name)s,
-                             NULL, NULL, NULL, free);
+  if (NULL == *cache) {
+    *cache = delta_cache_new(hash_%(name)s, cmp_%(name)s,
+                             sizeof(*real_packet));
   }
   BV_CLR_ALL(fields);
 
-  if (!genhash_lookup(*hash, real_packet, (void **) &old)) {
-    old = fc_malloc(sizeof(*old));
-    *old = *real_packet;
-    genhash_insert(*hash, old, old);
+  old = delta_cache_lookup(*cache, real_packet);
+  if (NULL == old) {
+    old = delta_cache_insert(*cache, real_packet);
     memset(old, 0, sizeof(*old));
     different = 1;      /* Force to send. */
   }
 '''
-        body=""
-        for i in range(len(self.other_fields)):
-            field=self.other_fields[i]
-            body=body+field.get_cmp_wrapper(i)
+        body=self.get_delta_cmp()
         if self.gen_log:
             fl='    %(log_macro)s("  no change -> discard");\n'
         else:
@@ -1109,18 +1311,40 @@ static char *stats_%(name)s_names[] = {%(names)s};
         else:
             s=""
 
+        if self.bits>0:
+            profile='''packet_profile_delta(pc, %(type)s, fields.vec,
+                         wire_size_%(name)s, %(bits)d, %%s);
+'''%self.get_dict(vars())
+        else:
+            profile=""
+
         if self.is_info != "no":
+            if profile:
+                pd="    "+profile%"TRUE"
+            else:
+                pd=""
             body=body+'''
   if (different == 0) {
-%(fl)s%(s)s<pre2>    return 0;
+%(fl)s%(s)s%(pd)s<pre2>    return 0;
   }
 '''%self.get_dict(vars())
 
+        if profile:
+            body=body+"\n  "+profile%"FALSE"
+
+        if self.want_broadcast:
+            body=body+"\n"+self.get_broadcast_reuse(
+                "&fields, sizeof(fields)",
+                "    *old = *real_packet;\n"+self.get_cancel_send("    "))
+
         body=body+'''
+  if (!pc->tagged_mode) {
+    /* The tagged encoding has the tags of the fields instead. */
 #ifdef FREECIV_JSON_CONNECTION
-  field_addr.name = "fields";
+    field_addr.name = "fields";
 #endif /* FREECIV_JSON_CONNECTION */
-  DIO_BV_PUT(&dout, &field_addr, fields);
+    DIO_BV_PUT(&dout, &field_addr, fields);
+  }
 '''
 
         for field in self.key_fields:
@@ -1135,13 +1359,7 @@ static char *stats_%(name)s_names[] = {%(names)s};
 '''
 
         # Cancel some is-info packets.
-        for i in self.cancel:
-            body=body+'''
-  hash = pc->phs.sent + %s;
-  if (NULL != *hash) {
-    genhash_remove(*hash, real_packet);
-  }
-'''%i
+        body=body+self.get_cancel_send("  ")
         body=body+'''#endif /* FREECIV_DELTA_PROTOCOL */'''
 
         return intro+body
@@ -1161,7 +1379,7 @@ static char *stats_%(name)s_names[] = {%(names)s};
             delta_header='''#ifdef FREECIV_DELTA_PROTOCOL
   %(name)s_fields fields;
   struct %(packet_name)s *old;
-  struct genhash **hash = pc->phs.received + %(type)s;
+  struct delta_cache **cache = pc->phs.received + %(type)s;
 #endif /* FREECIV_DELTA_PROTOCOL */
 '''
             delta_body1='''
@@ -1231,12 +1449,13 @@ static char *stats_%(name)s_names[] = {%(names)s};
             fl=""
         body='''
 #ifdef FREECIV_DELTA_PROTOCOL
-  if (NULL == *hash) {
-    *hash = genhash_new_full(hash_%(name)s, cmp_%(name)s,
-                             NULL, NULL, NULL, free);
+  if (NULL == *cache) {
+    *cache = delta_cache_new(hash_%(name)s, cmp_%(name)s,
+                             sizeof(*real_packet));
   }
 
-  if (genhash_lookup(*hash, real_packet, (void **) &old)) {
+  old = delta_cache_lookup(*cache, real_packet);
+  if (NULL != old) {
     *real_packet = *old;
   } else {
 %(key1)s%(fl)s    memset(real_packet, 0, sizeof(*real_packet));%(key2)s
@@ -1249,9 +1468,7 @@ static char *stats_%(name)s_names[] = {%(names)s};
 
         extro='''
   if (NULL == old) {
-    old = fc_malloc(sizeof(*old));
-    *old = *real_packet;
-    genhash_insert(*hash, old, old);
+    delta_cache_insert(*cache, real_packet);
   } else {
     *old = *real_packet;
   }
@@ -1260,9 +1477,9 @@ static char *stats_%(name)s_names[] = {%(names)s};
         # Cancel some is-info packets.
         for i in self.cancel:
             extro=extro+'''
-  hash = pc->phs.received + %s;
-  if (NULL != *hash) {
-    genhash_remove(*hash, real_packet);
+  cache = pc->phs.received + %s;
+  if (NULL != *cache) {
+    delta_cache_remove(*cache, real_packet);
   }
 '''%i
 
@@ -1347,6 +1564,9 @@ class Packet:
         self.want_force="force" in arr
         if self.want_force: arr.remove("force")
 
+        self.want_broadcast="broadcast" in arr
+        if self.want_broadcast: arr.remove("broadcast")
+
         self.cancel=[]
         removes=[]
         remaining=[]
@@ -1363,6 +1583,11 @@ class Packet:
         self.fields=[]
         for i in lines:
             self.fields=self.fields+parse_fields(i,types)
+        # The tags of the fields in the tagged encoding, the same in all
+        # the variants.
+        assert len(self.fields)<256,"too many fields in %s"%self.name
+        for i in range(len(self.fields)):
+            self.fields[i].tag=i
         self.key_fields=list(filter(lambda x:x.is_key,self.fields))
         self.other_fields=list(filter(lambda x:not x.is_key,self.fields))
         self.bits=len(self.other_fields)
@@ -1373,6 +1598,12 @@ class Packet:
             self.keys_arg=",\n    "+self.keys_arg
 
         
+        # The serialized form of a broadcast packet must depend only on
+        # the packet and the delta bitvector.
+        if self.want_broadcast:
+            assert not self.want_pre_send,"broadcast packet %s with pre-send"%self.name
+            assert not list(filter(lambda x:x.diff,self.fields)),"broadcast packet %s with diff field"%self.name
+
         self.want_dsend=self.dsend_given
 
         if len(self.fields)==0:
@@ -1484,7 +1715,15 @@ class Packet:
   }
   fc_assert_ret_val_msg(pc->phs.handlers->send[%(type)s].%(func)s != NULL, -1,
                         "Handler for %(type)s not installed");
-  return pc->phs.handlers->send[%(type)s].%(func)s(pc%(args)s);
+  {
+    int result;
+
+    packet_profile_begin();
+    result = pc->phs.handlers->send[%(type)s].%(func)s(pc%(args)s);
+    packet_profile_end(pc, %(type)s);
+
+    return result;
+  }
 }
 
 '''%self.get_dict(vars())
@@ -1506,14 +1745,20 @@ class Packet:
     # lsend function.
     def get_lsend(self):
         if not self.want_lsend: return ""
+        if self.want_broadcast:
+            begin="  packet_broadcast_begin();\n"
+            end="  packet_broadcast_end();\n"
+        else:
+            begin=""
+            end=""
         return '''%(lsend_prototype)s
 {
-  conn_list_iterate(dest, pconn) {
+%(begin)s  conn_list_iterate(dest, pconn) {
     send_%(name)s(pconn%(extra_send_args2)s);
   } conn_list_iterate_end;
-}
+%(end)s}
 
-'''%self.__dict__
+'''%self.get_dict(vars())
 
     # Returns a code fragment which is the implementation of the
     # dsend function.
@@ -1653,6 +1898,30 @@ def get_packet_has_game_info_flag(packets):
 '''
     return intro+body+extro
 
+# Returns a code fragment which defines the packet_schemas[] table,
+# describing the tagged encoding of every packet variant.
+def get_packet_schemas(packets):
+    tables=""
+    body=""
+    num=0
+    for p in packets:
+        for v in p.variants:
+            if v.fields:
+                tables=tables+"static const struct packet_schema_field schema_%s[] = {\n"%v.name
+                for field in v.fields:
+                    tables=tables+field.get_schema(v.delta)
+                tables=tables+"};\n\n"
+                body=body+"  {%s, %d, %d, schema_%s},\n"%(v.type,v.no,len(v.fields),v.name)
+            else:
+                body=body+"  {%s, %d, 0, NULL},\n"%(v.type,v.no)
+            num=num+1
+
+    return tables+'''const struct packet_schema packet_schemas[] = {
+%s};
+const int num_packet_schemas = %d;
+
+'''%(body,num)
+
 # Returns a code fragment which is the implementation of the
 # packet_handlers_fill_initial() function.
 def get_packet_handlers_fill_initial(packets):
@@ -1947,6 +2216,7 @@ void delta_stats_reset(void);
 #include "capstr.h"
 #include "connection.h"
 #include "dataio.h"
+#include "delta_cache.h"
 #include "game.h"
 
 #include "packets.h"
@@ -1991,6 +2261,7 @@ static int stats_total_sent;
             output_c.write(p.get_dsend())
             output_c.write(p.get_dlsend())
 
+        output_c.write(get_packet_schemas(packets))
         output_c.write(get_packet_handlers_fill_initial(packets))
         output_c.write(get_packet_handlers_fill_capability(packets))
         output_c.close()
@@ -92,9 +92,6 @@ static bool dir_validity[9];    /* Including invalid one */
 static bool is_valid_dir_calculate(enum direction8 dir);
 static bool is_cardinal_dir_calculate(enum direction8 dir);
 
-static bool restrict_infra(const struct player *pplayer, const struct tile *t1,
-                           const struct tile *t2);
-
 /*******************************************************************//**
   Return a bitfield of the extras on the tile that are infrastructure.
 ***********************************************************************/
@@ -769,12 +766,25 @@ int tile_move_cost_ptrs(const struct civ_map *nmap,
                         const struct unit_type *punittype,
                         const struct player *pplayer,
                         const struct tile *t1, const struct tile *t2)
+{
+  return tile_move_cost_infra(nmap, punit, punittype,
+                              restrict_infra(pplayer, t1, t2), t1, t2);
+}
+
+/*******************************************************************//**
+  Same as tile_move_cost_ptrs(), but the player is replaced by whether
+  the infrastructure is restricted for the move (see restrict_infra()).
+***********************************************************************/
+int tile_move_cost_infra(const struct civ_map *nmap,
+                         const struct unit *punit,
+                         const struct unit_type *punittype,
+                         bool ri,
+                         const struct tile *t1, const struct tile *t2)
 {
   const struct unit_class *pclass = utype_class(punittype);
   int cost;
   bool cardinality_checked = FALSE;
   bool cardinal_move BAD_HEURISTIC_INIT(FALSE);
-  bool ri;
 
   /* Try to exit early for detectable conditions */
   if (!uclass_has_flag(pclass, UCF_TERRAIN_SPEED)) {
@@ -811,7 +821,6 @@ int tile_move_cost_ptrs(const struct civ_map *nmap,
   }
 
   cost = tile_terrain(t2)->movement_cost * SINGLE_MOVE;
-  ri = restrict_infra(pplayer, t1, t2);
 
   extra_type_list_iterate(pclass->cache.bonus_roads, pextra) {
     struct road_type *proad = extra_road_get(pextra);
@@ -895,8 +904,8 @@ int tile_move_cost_ptrs(const struct civ_map *nmap,
   nation. This means that one can not use of the infrastructure (road,
   railroad) on this tile.
 ***********************************************************************/
-static bool restrict_infra(const struct player *pplayer, const struct tile *t1,
-                           const struct tile *t2)
+bool restrict_infra(const struct player *pplayer, const struct tile *t1,
+                    const struct tile *t2)
 {
   struct player *plr1 = tile_owner(t1), *plr2 = tile_owner(t2);
 
@@ -281,6 +281,13 @@ int tile_move_cost_ptrs(const struct civ_map *nmap,
                         const struct unit_type *punittype,
                         const struct player *pplayer,
                         const struct tile *t1, const struct tile *t2);
+int tile_move_cost_infra(const struct civ_map *nmap,
+                         const struct unit *punit,
+                         const struct unit_type *punittype,
+                         bool ri,
+                         const struct tile *t1, const struct tile *t2);
+bool restrict_infra(const struct player *pplayer, const struct tile *t1,
+                    const struct tile *t2);
 
 /***************************************************************
   The cost to move punit from where it is to tile x,y.
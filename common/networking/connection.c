@@ -34,13 +34,13 @@
 
 /* utility */
 #include "fcintl.h"
-#include "genhash.h"
 #include "log.h"
 #include "mem.h"
 #include "netintf.h"
 #include "support.h"            /* fc_str(n)casecmp */
 
 /* common */
+#include "delta_cache.h"
 #include "game.h"               /* game.all_connections */
 #include "packets.h"
 
@@ -109,7 +109,7 @@ static bool buffer_ensure_free_extra_space(struct socket_packet_buffer *buf,
     buf->nsize = buf->ndata + extra_space;
 
     /* added this check so we don't gobble up too much mem */
-    if (buf->nsize > MAX_LEN_BUFFER) {
+    if (buf->nsize > buf->limit) {
       return FALSE;
     }
     buf->data = (unsigned char *) fc_realloc(buf->data, buf->nsize);
@@ -129,14 +129,24 @@ int read_socket_data(int sock, struct socket_packet_buffer *buffer)
 {
   int didget;
 
+  if (0 < buffer->start
+      && buffer->nsize - buffer->start - buffer->ndata < MAX_LEN_PACKET) {
+    /* Move the incomplete packet at the end back to the front, to make
+     * room after it. */
+    memmove(buffer->data, buffer->data + buffer->start, buffer->ndata);
+    buffer->start = 0;
+  }
+
   if (!buffer_ensure_free_extra_space(buffer, MAX_LEN_PACKET)) {
     log_error("can't grow buffer");
     return -1;
   }
 
-  log_debug("try reading %d bytes", buffer->nsize - buffer->ndata);
-  didget = fc_readsocket(sock, (char *) (buffer->data + buffer->ndata),
-			 buffer->nsize - buffer->ndata);
+  log_debug("try reading %d bytes",
+            buffer->nsize - buffer->start - buffer->ndata);
+  didget = fc_readsocket(sock, (char *) (buffer->data + buffer->start
+                                         + buffer->ndata),
+			 buffer->nsize - buffer->start - buffer->ndata);
 
   if (didget > 0) {
     buffer->ndata+=didget;
@@ -157,21 +167,26 @@ int read_socket_data(int sock, struct socket_packet_buffer *buffer)
 }
 
 /**********************************************************************//**
-  write wrapper function -vasc
+  Check whether the socket of the connection can be written to without
+  blocking. Returns 1 if it can, 0 if not, and -1 if the connection got
+  closed.
 **************************************************************************/
-static int write_socket_data(struct connection *pc,
-			     struct socket_packet_buffer *buf, int limit)
+static int socket_writable(struct connection *pc)
 {
-  int start, nput, nblock;
+  fd_set writefs, exceptfs;
+  fc_timeval tv;
+  int result;
 
-  if (is_server() && pc->server.is_closing) {
-    return 0;
+#ifdef NONBLOCKING_SOCKETS
+  if (is_server()) {
+    /* Server sockets are non-blocking, so a write that does not fit just
+     * fails with EAGAIN. They may also be beyond FD_SETSIZE; the server
+     * event loop tells when they become writable again. */
+    return 1;
   }
+#endif /* NONBLOCKING_SOCKETS */
 
-  for (start=0; buf->ndata-start>limit;) {
-    fd_set writefs, exceptfs;
-    fc_timeval tv;
-
+  do {
     FC_FD_ZERO(&writefs);
     FC_FD_ZERO(&exceptfs);
     FD_SET(pc->sock, &writefs);
@@ -179,47 +194,130 @@ static int write_socket_data(struct connection *pc,
 
     tv.tv_sec = 0; tv.tv_usec = 0;
 
-    if (fc_select(pc->sock+1, NULL, &writefs, &exceptfs, &tv) <= 0) {
-      if (errno != EINTR) {
-	break;
-      } else {
-	/* EINTR can happen sometimes, especially when compiling with -pg.
-	 * Generally we just want to run select again. */
-	continue;
-      }
-    }
+    result = fc_select(pc->sock + 1, NULL, &writefs, &exceptfs, &tv);
+    /* EINTR can happen sometimes, especially when compiling with -pg.
+     * Generally we just want to run select again. */
+  } while (result == -1 && errno == EINTR);
+
+  if (result <= 0) {
+    return 0;
+  }
+
+  if (FD_ISSET(pc->sock, &exceptfs)) {
+    connection_close(pc, _("network exception"));
+    return -1;
+  }
+
+  return FD_ISSET(pc->sock, &writefs) ? 1 : 0;
+}
 
-    if (FD_ISSET(pc->sock, &exceptfs)) {
-      connection_close(pc, _("network exception"));
+/**********************************************************************//**
+  write wrapper function -vasc
+  Writes from the send ring buffer until at most 'limit' bytes are left
+  or the socket would block.
+**************************************************************************/
+static int write_socket_data(struct connection *pc,
+			     struct socket_packet_buffer *buf, int limit)
+{
+  int nput, nblock, written = 0;
+
+  if (is_server() && pc->server.is_closing) {
+    return 0;
+  }
+
+  while (buf->ndata > limit) {
+    int writable = socket_writable(pc);
+
+    if (writable < 0) {
       return -1;
+    } else if (writable == 0) {
+      pc->statistics.send_stalls++;
+      break;
     }
 
-    if (FD_ISSET(pc->sock, &writefs)) {
-      nblock=MIN(buf->ndata-start, MAX_LEN_PACKET);
-      log_debug("trying to write %d limit=%d", nblock, limit);
-      if ((nput = fc_writesocket(pc->sock, 
-                                 (const char *)buf->data+start, nblock)) == -1) {
+    /* Up to the end of the storage; the rest wraps around. */
+    nblock = MIN(buf->ndata, buf->nsize - buf->start);
 #ifdef NONBLOCKING_SOCKETS
-	if (errno == EWOULDBLOCK || errno == EAGAIN) {
-	  break;
-	}
+    if (!is_server())
 #endif
-        connection_close(pc, _("lagging connection"));
-        return -1;
+    {
+      /* Blocking sockets: don't risk to block for long. */
+      nblock = MIN(nblock, MAX_LEN_PACKET);
+    }
+    log_debug("trying to write %d limit=%d", nblock, limit);
+    if ((nput = fc_writesocket(pc->sock,
+                               (const char *)buf->data + buf->start,
+                               nblock)) == -1) {
+#ifdef NONBLOCKING_SOCKETS
+      if (errno == EWOULDBLOCK || errno == EAGAIN) {
+        pc->statistics.send_stalls++;
+        break;
       }
-      start += nput;
+#endif
+      connection_close(pc, _("lagging connection"));
+      return -1;
     }
+    buf->start = (buf->start + nput) % buf->nsize;
+    buf->ndata -= nput;
+    written += nput;
+    if (nput < nblock) {
+      /* The socket is full. */
+      pc->statistics.send_stalls++;
+      break;
+    }
+  }
+
+  if (0 == buf->ndata) {
+    buf->start = 0;
   }
 
-  if (start > 0) {
-    buf->ndata -= start;
-    memmove(buf->data, buf->data+start, buf->ndata);
+  if (written > 0) {
     pc->last_write = timer_renew(pc->last_write, TIMER_USER, TIMER_ACTIVE);
     timer_start(pc->last_write);
   }
   return 0;
 }
 
+/**********************************************************************//**
+  Append data to the send ring buffer, growing the storage if needed.
+  Returns FALSE if that would take more than buf->limit bytes.
+**************************************************************************/
+static bool send_buffer_append(struct socket_packet_buffer *buf,
+                               const unsigned char *data, int len)
+{
+  int tail, first;
+
+  if (len <= 0) {
+    return TRUE;
+  }
+
+  if (buf->nsize - buf->ndata < len) {
+    /* Grow geometrically, and straighten the data out on the way. */
+    int nsize = MAX(buf->ndata + len, MIN(2 * buf->nsize, buf->limit));
+    unsigned char *data2;
+
+    if (nsize > buf->limit) {
+      return FALSE;
+    }
+
+    data2 = fc_malloc(nsize);
+    first = MIN(buf->ndata, buf->nsize - buf->start);
+    memcpy(data2, buf->data + buf->start, first);
+    memcpy(data2 + first, buf->data, buf->ndata - first);
+    free(buf->data);
+    buf->data = data2;
+    buf->nsize = nsize;
+    buf->start = 0;
+  }
+
+  tail = (buf->start + buf->ndata) % buf->nsize;
+  first = MIN(len, buf->nsize - tail);
+  memcpy(buf->data + tail, data, first);
+  memcpy(buf->data, data + first, len - first);
+  buf->ndata += len;
+
+  return TRUE;
+}
 
 /**********************************************************************//**
   flush'em
@@ -267,13 +365,14 @@ static bool add_connection_data(struct connection *pconn,
 
   buf = pconn->send_buffer;
   log_debug("add %d bytes to %d (space =%d)", len, buf->ndata, buf->nsize);
-  if (!buffer_ensure_free_extra_space(buf, len)) {
+  if (!send_buffer_append(buf, data, len)) {
     connection_close(pconn, _("buffer overflow"));
     return FALSE;
   }
 
-  memcpy(buf->data + buf->ndata, data, len);
-  buf->ndata += len;
+  if (buf->ndata > pconn->statistics.send_queue_peak) {
+    pconn->statistics.send_queue_peak = buf->ndata;
+  }
   return TRUE;
 }
 
@@ -435,6 +534,8 @@ struct socket_packet_buffer *new_socket_packet_buffer(void)
   buf->ndata = 0;
   buf->do_buffer_sends = 0;
   buf->nsize = 10*MAX_LEN_PACKET;
+  buf->start = 0;
+  buf->limit = MAX_LEN_BUFFER;
   buf->data = (unsigned char *)fc_malloc(buf->nsize);
   return buf;
 }
@@ -452,6 +553,38 @@ static void free_socket_packet_buffer(struct socket_packet_buffer *buf)
   }
 }
 
+/**********************************************************************//**
+  Drop the first 'len' bytes of the data waiting in the receive buffer.
+**************************************************************************/
+void socket_packet_buffer_consume(struct socket_packet_buffer *buf, int len)
+{
+  fc_assert_ret(0 <= len && len <= buf->ndata);
+
+  buf->ndata -= len;
+  if (0 == buf->ndata) {
+    buf->start = 0;
+  } else {
+    buf->start += len;
+  }
+}
+
+/**********************************************************************//**
+  Return the buffer the next received packet of the connection is read
+  from: the decompressed data if there is any left, else the socket
+  buffer.
+**************************************************************************/
+struct socket_packet_buffer *conn_receive_buffer(struct connection *pconn)
+{
+#ifdef USE_COMPRESSION
+  if (NULL != pconn->compression.inflated
+      && 0 < pconn->compression.inflated->ndata) {
+    return pconn->compression.inflated;
+  }
+#endif /* USE_COMPRESSION */
+
+  return pconn->buffer;
+}
+
 /**********************************************************************//**
   Return pointer to static string containing a description for this
   connection, based on pconn->name, pconn->addr, and (if applicable)
@@ -526,12 +659,14 @@ int get_next_request_id(int old_request_id)
 }
 
 /**********************************************************************//**
-  Free compression queue for given connection.
+  Free compression queue and decompression buffer for given connection.
 **************************************************************************/
 void free_compression_queue(struct connection *pc)
 {
 #ifdef USE_COMPRESSION
   byte_vector_free(&pc->compression.queue);
+  free_socket_packet_buffer(pc->compression.inflated);
+  pc->compression.inflated = NULL;
 #endif
 }
 
@@ -562,7 +697,7 @@ static void free_packet_hashes(struct connection *pc)
   if (pc->phs.sent) {
     for (i = 0; i < PACKET_LAST; i++) {
       if (pc->phs.sent[i] != NULL) {
-        genhash_destroy(pc->phs.sent[i]);
+        delta_cache_destroy(pc->phs.sent[i]);
       }
     }
     free(pc->phs.sent);
@@ -572,7 +707,7 @@ static void free_packet_hashes(struct connection *pc)
   if (pc->phs.received) {
     for (i = 0; i < PACKET_LAST; i++) {
       if (pc->phs.received[i] != NULL) {
-        genhash_destroy(pc->phs.received[i]);
+        delta_cache_destroy(pc->phs.received[i]);
       }
     }
     free(pc->phs.received);
@@ -594,15 +729,21 @@ void connection_common_init(struct connection *pconn)
   pconn->buffer = new_socket_packet_buffer();
   pconn->send_buffer = new_socket_packet_buffer();
   pconn->statistics.bytes_send = 0;
+  pconn->statistics.send_queue_peak = 0;
+  pconn->statistics.send_stalls = 0;
+  pconn->statistics.packets = NULL;
 #ifdef FREECIV_JSON_CONNECTION
   pconn->json_mode = TRUE;
 #endif /* FREECIV_JSON_CONNECTION */
+  pconn->tagged_mode = FALSE;
 
   init_packet_hashs(pconn);
 
 #ifdef USE_COMPRESSION
   byte_vector_init(&pconn->compression.queue);
   pconn->compression.frozen_level = 0;
+  pconn->compression.method = COMPRESS_ZLIB;
+  pconn->compression.inflated = NULL;
 #endif
 }
 
@@ -634,6 +775,7 @@ void connection_common_close(struct connection *pconn)
 
     free_compression_queue(pconn);
     free_packet_hashes(pconn);
+    FC_FREE(pconn->statistics.packets);
   }
 }
 
@@ -658,10 +800,10 @@ void conn_reset_delta_state(struct connection *pc)
   for (i = 0; i < PACKET_LAST; i++) {
     if (packet_has_game_info_flag(i)) {
       if (NULL != pc->phs.sent && NULL != pc->phs.sent[i]) {
-        genhash_clear(pc->phs.sent[i]);
+        delta_cache_clear(pc->phs.sent[i]);
       }
       if (NULL != pc->phs.received && NULL != pc->phs.received[i]) {
-        genhash_clear(pc->phs.received[i]);
+        delta_cache_clear(pc->phs.received[i]);
       }
     }
   }
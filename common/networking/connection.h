@@ -48,8 +48,9 @@ extern "C" {
 #include "fc_types.h"
 
 struct conn_pattern_list;
-struct genhash;
+struct delta_cache;
 struct packet_handlers;
+struct packet_profile;
 struct timer_list;
 
 /* Used in the network protocol. */
@@ -88,6 +89,18 @@ struct timer_list;
 #define SPECENUM_COUNT CMDLEVEL_COUNT
 #include "specenum_gen.h"
 
+/* Methods to compress the packet stream with. The names are also the
+ * optional network capabilities telling that the peer can decompress
+ * it. zlib is always available. */
+#define SPECENUM_NAME compress_method
+#define SPECENUM_VALUE0 COMPRESS_ZLIB
+#define SPECENUM_VALUE0NAME "zlib"
+#define SPECENUM_VALUE1 COMPRESS_ZSTD
+#define SPECENUM_VALUE1NAME "zstd"
+#define SPECENUM_VALUE2 COMPRESS_LZ4
+#define SPECENUM_VALUE2NAME "lz4"
+#include "specenum_gen.h"
+
 /***************************************************************************
   On the distinction between nations(formerly races), players, and users,
   see doc/HACKING
@@ -117,11 +130,21 @@ struct connection;
 /***********************************************************
   This is a buffer where the data is first collected,
   whenever it arrives to the client/server.
+
+  When used as send buffer, it is a ring buffer: the data
+  waiting to be written starts at 'start' and may wrap around
+  the end of the storage. In receive buffers the data waiting
+  to be read starts at 'start' too, but never wraps: packets
+  are decoded in place and consumed by moving 'start', and the
+  incomplete packet left at the end is only moved back to the
+  front when more room is needed for reading.
 ***********************************************************/
 struct socket_packet_buffer {
   int ndata;
   int do_buffer_sends;
   int nsize;
+  int start;
+  int limit;                    /* Maximum amount of data, in bytes. */
   unsigned char *data;
 };
 
@@ -162,6 +185,8 @@ struct connection {
   bool json_mode;
   json_t *json_packet;
 #endif /* FREECIV_JSON_CONNECTION */
+  /* Packets are sent in the tagged encoding, see packets.h. */
+  bool tagged_mode;
 
   double ping_time;
 
@@ -235,6 +260,11 @@ struct connection {
        * but the closing has been postponed. */
       bool is_closing;
 
+      /* The send queue is above the 'netsendqueue' high-water mark, and
+       * the number of times it went there. */
+      bool send_backlogged;
+      int send_backlogs;
+
       /* If we use delegation the original player (playing) is replaced. Save
        * it here to easily restore it. */
       struct {
@@ -262,20 +292,27 @@ struct connection {
 				  int packet_type, int size,
 				  int request_id);
   struct {
-    struct genhash **sent;
-    struct genhash **received;
+    struct delta_cache **sent;
+    struct delta_cache **received;
     const struct packet_handlers *handlers;
   } phs;
 
 #ifdef USE_COMPRESSION
   struct {
     int frozen_level;
+    enum compress_method method;
 
     struct byte_vector queue;
+    /* Data of the received compressed packets, read before the
+     * rest of 'buffer'. NULL until needed. */
+    struct socket_packet_buffer *inflated;
   } compression;
 #endif
   struct {
     int bytes_send;
+    int send_queue_peak;        /* Most data ever waiting to be sent. */
+    int send_stalls;            /* Writes the socket did not fully take. */
+    struct packet_profile *packets;     /* Per packet type, or NULL. */
   } statistics;
 };
 
@@ -301,6 +338,8 @@ struct connection *conn_by_user_prefix(const char *user_name,
 struct connection *conn_by_number(int id);
 
 struct socket_packet_buffer *new_socket_packet_buffer(void);
+void socket_packet_buffer_consume(struct socket_packet_buffer *buf, int len);
+struct socket_packet_buffer *conn_receive_buffer(struct connection *pconn);
 void connection_common_init(struct connection *pconn);
 void connection_common_close(struct connection *pconn);
 void conn_set_capability(struct connection *pconn, const char *capability);
@@ -310,6 +349,9 @@ void conn_reset_delta_state(struct connection *pconn);
 void conn_compression_freeze(struct connection *pconn);
 bool conn_compression_thaw(struct connection *pconn);
 bool conn_compression_frozen(const struct connection *pconn);
+bool compress_method_supported(enum compress_method method);
+void conn_compression_set_method(struct connection *pconn,
+                                 enum compress_method method);
 void conn_list_compression_freeze(const struct conn_list *pconn_list);
 void conn_list_compression_thaw(const struct conn_list *pconn_list);
 
@@ -0,0 +1,278 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 1996 - A Kjeldberg, L Gregersen, P Unold
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+
+/***********************************************************************
+  Delta cache, see delta_cache.h.
+
+  The table uses linear probing over a power of two number of slots.
+  Each slot has a small header (the full hash value and its state) kept
+  apart from the packet storage, so probing does not touch the packets
+  unless the hash values match. Removed entries leave a tombstone, so
+  the other entries never move; tombstones are purged when the table is
+  rebuilt on growth.
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <fc_config.h>
+#endif
+
+#include <string.h>
+
+/* utility */
+#include "log.h"
+#include "mem.h"
+#include "shared.h"            /* MAX() */
+
+#include "delta_cache.h"
+
+#define DELTA_CACHE_MIN_SLOTS   16
+
+enum delta_slot_state {
+  DELTA_SLOT_EMPTY = 0,
+  DELTA_SLOT_USED,
+  DELTA_SLOT_REMOVED
+};
+
+struct delta_slot {
+  genhash_val_t hash_val;
+  unsigned char state;          /* enum delta_slot_state */
+};
+
+struct delta_cache {
+  genhash_val_fn_t key_val_func;
+  genhash_comp_fn_t key_comp_func;
+  size_t packet_size;
+
+  struct delta_slot *slots;
+  unsigned char *packets;       /* num_slots * packet_size */
+  size_t num_slots;             /* 0 or a power of two */
+  size_t num_entries;
+  size_t num_removed;
+};
+
+/*******************************************************************//**
+  Returns the first slot to probe for the hash value. The hash functions
+  of the packets are often just the key, so mix it before masking.
+***********************************************************************/
+static inline size_t delta_cache_first_slot(const struct delta_cache *pcache,
+                                            genhash_val_t hash_val)
+{
+  return ((hash_val * 2654435769U) ^ (hash_val >> 16))
+         & (pcache->num_slots - 1);
+}
+
+/*******************************************************************//**
+  Returns the packet storage of the slot 'i'.
+***********************************************************************/
+static inline void *delta_cache_packet(const struct delta_cache *pcache,
+                                       size_t i)
+{
+  return pcache->packets + i * pcache->packet_size;
+}
+
+/*******************************************************************//**
+  Returns the slot holding the packet with the same key as 'packet',
+  or -1 if there is none.
+***********************************************************************/
+static long delta_cache_find(const struct delta_cache *pcache,
+                             const void *packet, genhash_val_t hash_val)
+{
+  size_t mask = pcache->num_slots - 1;
+  size_t i;
+
+  if (0 == pcache->num_entries) {
+    return -1;
+  }
+
+  for (i = delta_cache_first_slot(pcache, hash_val);
+       DELTA_SLOT_EMPTY != pcache->slots[i].state;
+       i = (i + 1) & mask) {
+    if (DELTA_SLOT_USED == pcache->slots[i].state
+        && pcache->slots[i].hash_val == hash_val
+        && pcache->key_comp_func(delta_cache_packet(pcache, i), packet)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/*******************************************************************//**
+  Rebuild the table with 'num_slots' slots, dropping the tombstones.
+***********************************************************************/
+static void delta_cache_resize(struct delta_cache *pcache, size_t num_slots)
+{
+  struct delta_slot *old_slots = pcache->slots;
+  unsigned char *old_packets = pcache->packets;
+  size_t old_num_slots = pcache->num_slots;
+  size_t mask = num_slots - 1;
+  size_t i, j;
+
+  pcache->slots = fc_calloc(num_slots, sizeof(*pcache->slots));
+  pcache->packets = fc_malloc(num_slots * pcache->packet_size);
+  pcache->num_slots = num_slots;
+  pcache->num_removed = 0;
+
+  for (i = 0; i < old_num_slots; i++) {
+    if (DELTA_SLOT_USED != old_slots[i].state) {
+      continue;
+    }
+    for (j = delta_cache_first_slot(pcache, old_slots[i].hash_val);
+         DELTA_SLOT_EMPTY != pcache->slots[j].state;
+         j = (j + 1) & mask) {
+      /* Find a free slot. */
+    }
+    pcache->slots[j] = old_slots[i];
+    memcpy(delta_cache_packet(pcache, j),
+           old_packets + i * pcache->packet_size, pcache->packet_size);
+  }
+
+  free(old_slots);
+  free(old_packets);
+}
+
+/*******************************************************************//**
+  Create a new delta cache for packets of 'packet_size' bytes.
+***********************************************************************/
+struct delta_cache *delta_cache_new(genhash_val_fn_t key_val_func,
+                                    genhash_comp_fn_t key_comp_func,
+                                    size_t packet_size)
+{
+  struct delta_cache *pcache = fc_calloc(1, sizeof(*pcache));
+
+  pcache->key_val_func = key_val_func;
+  pcache->key_comp_func = key_comp_func;
+  pcache->packet_size = packet_size;
+
+  return pcache;
+}
+
+/*******************************************************************//**
+  Free the delta cache and all the packets it holds.
+***********************************************************************/
+void delta_cache_destroy(struct delta_cache *pcache)
+{
+  fc_assert_ret(NULL != pcache);
+
+  free(pcache->slots);
+  free(pcache->packets);
+  free(pcache);
+}
+
+/*******************************************************************//**
+  Remove all the packets from the delta cache. The memory is kept for
+  reuse.
+***********************************************************************/
+void delta_cache_clear(struct delta_cache *pcache)
+{
+  fc_assert_ret(NULL != pcache);
+
+  if (0 < pcache->num_slots) {
+    memset(pcache->slots, 0, pcache->num_slots * sizeof(*pcache->slots));
+  }
+  pcache->num_entries = 0;
+  pcache->num_removed = 0;
+}
+
+/*******************************************************************//**
+  Returns the stored packet with the same key as 'packet', or NULL.
+***********************************************************************/
+void *delta_cache_lookup(const struct delta_cache *pcache,
+                         const void *packet)
+{
+  long i;
+
+  fc_assert_ret_val(NULL != pcache, NULL);
+
+  i = delta_cache_find(pcache, packet, pcache->key_val_func(packet));
+
+  return (0 <= i ? delta_cache_packet(pcache, i) : NULL);
+}
+
+/*******************************************************************//**
+  Store a copy of 'packet', replacing any packet with the same key.
+  Returns the stored copy.
+***********************************************************************/
+void *delta_cache_insert(struct delta_cache *pcache, const void *packet)
+{
+  genhash_val_t hash_val;
+  size_t mask;
+  size_t i;
+  long found;
+  void *stored;
+
+  fc_assert_ret_val(NULL != pcache, NULL);
+
+  hash_val = pcache->key_val_func(packet);
+  found = delta_cache_find(pcache, packet, hash_val);
+  if (0 <= found) {
+    stored = delta_cache_packet(pcache, found);
+    if (stored != packet) {
+      memcpy(stored, packet, pcache->packet_size);
+    }
+    return stored;
+  }
+
+  /* Keep the load (tombstones included) under 3/4. */
+  if (4 * (pcache->num_entries + pcache->num_removed + 1)
+      > 3 * pcache->num_slots) {
+    size_t num_slots = MAX(pcache->num_slots, DELTA_CACHE_MIN_SLOTS);
+
+    while (4 * (pcache->num_entries + 1) > 3 * num_slots / 2) {
+      num_slots *= 2;
+    }
+    delta_cache_resize(pcache, num_slots);
+  }
+
+  mask = pcache->num_slots - 1;
+  for (i = delta_cache_first_slot(pcache, hash_val);
+       DELTA_SLOT_USED == pcache->slots[i].state;
+       i = (i + 1) & mask) {
+    /* Find a free slot. A tombstone can be reused, as the key is not
+     * present further in the chain. */
+  }
+
+  if (DELTA_SLOT_REMOVED == pcache->slots[i].state) {
+    pcache->num_removed--;
+  }
+  pcache->slots[i].hash_val = hash_val;
+  pcache->slots[i].state = DELTA_SLOT_USED;
+  pcache->num_entries++;
+
+  stored = delta_cache_packet(pcache, i);
+  memcpy(stored, packet, pcache->packet_size);
+
+  return stored;
+}
+
+/*******************************************************************//**
+  Remove the packet with the same key as 'packet'. Returns TRUE if there
+  was one.
+***********************************************************************/
+bool delta_cache_remove(struct delta_cache *pcache, const void *packet)
+{
+  long i;
+
+  fc_assert_ret_val(NULL != pcache, FALSE);
+
+  i = delta_cache_find(pcache, packet, pcache->key_val_func(packet));
+  if (0 > i) {
+    return FALSE;
+  }
+
+  pcache->slots[i].state = DELTA_SLOT_REMOVED;
+  pcache->num_entries--;
+  pcache->num_removed++;
+
+  return TRUE;
+}
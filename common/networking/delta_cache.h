@@ -0,0 +1,55 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 1996 - A Kjeldberg, L Gregersen, P Unold
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+#ifndef FC__DELTA_CACHE_H
+#define FC__DELTA_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/***********************************************************************
+  Storage of the last packet sent or received for each key, used by the
+  delta protocol. There is one cache per packet type and direction in
+  every connection.
+
+  The packets are stored by value in one flat open-addressed table, so
+  there is no allocation per entry. The key of an entry is the packet
+  itself, hashed and compared with the functions generated for the
+  packet type. Pointers returned by delta_cache_lookup() and
+  delta_cache_insert() stay valid until the next insertion into the same
+  cache (or clearing of it).
+***********************************************************************/
+
+/* utility */
+#include "genhash.h"            /* genhash_val_fn_t, genhash_comp_fn_t */
+#include "support.h"            /* bool type */
+
+struct delta_cache;             /* opaque */
+
+struct delta_cache *delta_cache_new(genhash_val_fn_t key_val_func,
+                                    genhash_comp_fn_t key_comp_func,
+                                    size_t packet_size)
+                    fc__warn_unused_result;
+void delta_cache_destroy(struct delta_cache *pcache);
+void delta_cache_clear(struct delta_cache *pcache);
+
+void *delta_cache_lookup(const struct delta_cache *pcache,
+                         const void *packet);
+void *delta_cache_insert(struct delta_cache *pcache, const void *packet);
+bool delta_cache_remove(struct delta_cache *pcache, const void *packet);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif  /* FC__DELTA_CACHE_H */
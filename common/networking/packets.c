@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 
 #ifdef HAVE_ARPA_INET_H
 #include <arpa/inet.h>
@@ -35,9 +36,12 @@
 #include "fcintl.h"
 #include "log.h"
 #include "mem.h"
+#include "registry.h"
 #include "support.h"
+#include "timing.h"
 
-/* commmon */
+/* common */
+#include "capstr.h"
 #include "dataio.h"
 #include "game.h"
 #include "events.h"
@@ -47,6 +51,13 @@
 
 #ifdef USE_COMPRESSION
 #include <zlib.h>
+#ifdef FREECIV_HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef FREECIV_HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+
 /*
  * Value for the 16bit size to indicate a jumbo packet
  */
@@ -67,6 +78,20 @@
 
 #define MAX_DECOMPRESSION 400
 
+/*
+ * Compressed data starting with one of these bytes was not compressed
+ * with zlib but with another method. The tag byte is followed by the
+ * size of the uncompressed data (4 bytes) and the compressed data.
+ * A zlib stream always starts with a CMF byte whose low nibble is 8
+ * (deflate), so the two can't be confused, and peers that only know
+ * zlib are not affected.
+ */
+#define COMPRESS_TAG_ZSTD       0x01
+#define COMPRESS_TAG_LZ4        0x02
+#define COMPRESS_TAG_LEN        5
+
+#define DEFAULT_ZSTD_LEVEL      3
+
 #endif /* USE_COMPRESSION */
 
 /* 
@@ -85,28 +110,307 @@ extern const char *const packet_functional_capability;
 
 static struct packet_handler_hash *packet_handlers = NULL;
 
+/* Serialized packets shared by the connections of a broadcast. */
+#define PACKET_BROADCAST_SLOTS          16
+#define PACKET_BROADCAST_MAX_FIELDS     32
+
+struct packet_broadcast_slot {
+  enum packet_type type;
+  int variant;
+  struct packet_header header;
+  bool tagged;
+  unsigned char fields[PACKET_BROADCAST_MAX_FIELDS];
+  size_t fields_size;
+  void *packet;
+  size_t packet_size;
+  size_t packet_alloc;
+  unsigned char *data;
+  int len;
+  int data_alloc;
+};
+
+static struct {
+  int depth;
+  int next;
+  int hits;
+  int misses;
+  struct packet_broadcast_slot slots[PACKET_BROADCAST_SLOTS];
+} broadcast;
+
+/* Packet profile of all the connections, see packet_profile_get(). */
+static struct packet_profile profile_total[PACKET_LAST];
+static int profile_depth = 0;
+#ifdef CLOCK_MONOTONIC
+static unsigned long long profile_start;
+#else  /* CLOCK_MONOTONIC */
+static struct timer *profile_timer = NULL;
+#endif /* CLOCK_MONOTONIC */
+
 #ifdef USE_COMPRESSION
 static int stat_size_alone = 0;
 static int stat_size_uncompressed = 0;
 static int stat_size_compressed = 0;
 static int stat_size_no_compression = 0;
 
+#ifdef FREECIV_HAVE_LIBZSTD
+static ZSTD_CCtx *zstd_cctx = NULL;
+static ZSTD_DCtx *zstd_dctx = NULL;
+#endif
+
 /**********************************************************************//**
-  Returns the compression level. Initilialize it if needed.
+  Returns the compression level to use with 'method'. It can be set with
+  the FREECIV_COMPRESSION_LEVEL environment variable. Initilialize it if
+  needed.
 **************************************************************************/
-static inline int get_compression_level(void)
+static inline int get_compression_level(enum compress_method method)
 {
   static int level = -2;        /* Magic not initialized, see below. */
 
   if (-2 == level) {
     const char *s = getenv("FREECIV_COMPRESSION_LEVEL");
 
-    if (NULL == s || !str_to_int(s, &level) || -1 > level || 9 < level) {
+    if (NULL == s || !str_to_int(s, &level) || -1 > level || 19 < level) {
       level = -1;
     }
   }
 
-  return level;
+  switch (method) {
+  case COMPRESS_ZLIB:
+    return MIN(level, 9);
+  case COMPRESS_ZSTD:
+    return 0 < level ? level : DEFAULT_ZSTD_LEVEL;
+  case COMPRESS_LZ4:
+    /* LZ4 has no levels. */
+    break;
+  }
+
+  return 0;
+}
+
+/**********************************************************************//**
+  Return the room needed to compress 'size' bytes with 'method'.
+**************************************************************************/
+static unsigned long compress_bound(enum compress_method method,
+                                    unsigned long size)
+{
+  switch (method) {
+  case COMPRESS_ZLIB:
+    break;
+  case COMPRESS_ZSTD:
+#ifdef FREECIV_HAVE_LIBZSTD
+    return COMPRESS_TAG_LEN + ZSTD_compressBound(size);
+#else
+    break;
+#endif
+  case COMPRESS_LZ4:
+#ifdef FREECIV_HAVE_LIBLZ4
+    return COMPRESS_TAG_LEN + LZ4_compressBound(size);
+#else
+    break;
+#endif
+  }
+
+  return 12 + 1.001 * size;
+}
+
+#if defined(FREECIV_HAVE_LIBZSTD) || defined(FREECIV_HAVE_LIBLZ4)
+/**********************************************************************//**
+  Write the header of data not compressed with zlib.
+**************************************************************************/
+static void put_compress_tag(unsigned char *dst, int tag,
+                             unsigned long size)
+{
+  struct raw_data_out dout;
+
+  dio_output_init(&dout, dst, COMPRESS_TAG_LEN);
+  dio_put_uint8_raw(&dout, tag);
+  dio_put_uint32_raw(&dout, size);
+}
+#endif /* FREECIV_HAVE_LIBZSTD || FREECIV_HAVE_LIBLZ4 */
+
+/**********************************************************************//**
+  Compress 'size' bytes from 'src' with 'method' into 'dst', which has
+  room for 'dst_size' bytes (see compress_bound()). Returns the size of
+  the compressed data, or 0 on failure.
+**************************************************************************/
+static unsigned long compress_data(enum compress_method method, int level,
+                                   unsigned char *dst,
+                                   unsigned long dst_size,
+                                   const unsigned char *src,
+                                   unsigned long size)
+{
+  switch (method) {
+  case COMPRESS_ZLIB:
+    {
+      uLongf compressed_size = dst_size;
+
+      if (Z_OK != compress2(dst, &compressed_size, src, size, level)) {
+        return 0;
+      }
+      return compressed_size;
+    }
+  case COMPRESS_ZSTD:
+#ifdef FREECIV_HAVE_LIBZSTD
+    {
+      size_t compressed_size;
+
+      if (NULL == zstd_cctx) {
+        zstd_cctx = ZSTD_createCCtx();
+        fc_assert_ret_val(NULL != zstd_cctx, 0);
+      }
+      compressed_size = ZSTD_compressCCtx(zstd_cctx,
+                                          dst + COMPRESS_TAG_LEN,
+                                          dst_size - COMPRESS_TAG_LEN,
+                                          src, size, level);
+      if (ZSTD_isError(compressed_size)) {
+        log_error("zstd: %s", ZSTD_getErrorName(compressed_size));
+        return 0;
+      }
+      put_compress_tag(dst, COMPRESS_TAG_ZSTD, size);
+      return COMPRESS_TAG_LEN + compressed_size;
+    }
+#else
+    break;
+#endif /* FREECIV_HAVE_LIBZSTD */
+  case COMPRESS_LZ4:
+#ifdef FREECIV_HAVE_LIBLZ4
+    {
+      int compressed_size =
+        LZ4_compress_default((const char *) src,
+                             (char *) dst + COMPRESS_TAG_LEN,
+                             size, dst_size - COMPRESS_TAG_LEN);
+
+      if (0 >= compressed_size) {
+        return 0;
+      }
+      put_compress_tag(dst, COMPRESS_TAG_LZ4, size);
+      return COMPRESS_TAG_LEN + compressed_size;
+    }
+#else
+    break;
+#endif /* FREECIV_HAVE_LIBLZ4 */
+  }
+
+  return 0;
+}
+
+/**********************************************************************//**
+  Make sure the storage of 'buf' can hold 'size' bytes. Its contents are
+  not kept.
+**************************************************************************/
+static void inflate_buffer_reserve(struct socket_packet_buffer *buf,
+                                   unsigned long size)
+{
+  if ((unsigned long) buf->nsize < size) {
+    free(buf->data);
+    buf->data = fc_malloc(size);
+    buf->nsize = size;
+  }
+}
+
+/**********************************************************************//**
+  Decompress the 'size' bytes of compressed packet stream at 'src' into
+  the empty buffer 'dest', reusing its storage. Returns FALSE if the
+  data could not be decompressed.
+**************************************************************************/
+static bool decompress_data(const unsigned char *src, unsigned long size,
+                            struct socket_packet_buffer *dest)
+{
+  int decompress_factor = 80;
+  int error = Z_DATA_ERROR;
+  unsigned long decompressed_size;
+
+  fc_assert_ret_val(0 == dest->ndata, FALSE);
+  dest->start = 0;
+
+  if (0 < size && 8 != (src[0] & 0x0f)) {
+    /* Not zlib. */
+    struct data_in din;
+    int tag, len;
+
+    if (COMPRESS_TAG_LEN > size) {
+      return FALSE;
+    }
+
+    dio_input_init(&din, src, COMPRESS_TAG_LEN);
+    if (!dio_get_uint8_raw(&din, &tag)
+        || !dio_get_uint32_raw(&din, &len)
+        /* The sender never compresses this much at once. */
+        || 0 >= len || MAX_LEN_BUFFER < len) {
+      return FALSE;
+    }
+    src += COMPRESS_TAG_LEN;
+    size -= COMPRESS_TAG_LEN;
+
+    inflate_buffer_reserve(dest, len);
+    decompressed_size = 0;
+
+    switch (tag) {
+#ifdef FREECIV_HAVE_LIBZSTD
+    case COMPRESS_TAG_ZSTD:
+      {
+        size_t result;
+
+        if (NULL == zstd_dctx) {
+          zstd_dctx = ZSTD_createDCtx();
+          fc_assert_action(NULL != zstd_dctx, break);
+        }
+        result = ZSTD_decompressDCtx(zstd_dctx, dest->data, len,
+                                     src, size);
+        if (!ZSTD_isError(result)) {
+          decompressed_size = result;
+        }
+      }
+      break;
+#endif /* FREECIV_HAVE_LIBZSTD */
+#ifdef FREECIV_HAVE_LIBLZ4
+    case COMPRESS_TAG_LZ4:
+      {
+        int result = LZ4_decompress_safe((const char *) src,
+                                         (char *) dest->data, size, len);
+
+        if (0 < result) {
+          decompressed_size = result;
+        }
+      }
+      break;
+#endif /* FREECIV_HAVE_LIBLZ4 */
+    default:
+      log_verbose("Unknown packet stream compression %d.", tag);
+      break;
+    }
+
+    if (decompressed_size != (unsigned long) len) {
+      return FALSE;
+    }
+
+    dest->ndata = len;
+    return TRUE;
+  }
+
+  decompressed_size = decompress_factor * size;
+  inflate_buffer_reserve(dest, decompressed_size);
+
+  do {
+    uLongf zsize = dest->nsize;
+
+    error = uncompress(dest->data, &zsize, src, size);
+    decompressed_size = zsize;
+
+    if (error == Z_DATA_ERROR) {
+      decompress_factor += 50;
+      inflate_buffer_reserve(dest, decompress_factor * size);
+    }
+
+    if (error != Z_OK) {
+      if (error != Z_DATA_ERROR || decompress_factor > MAX_DECOMPRESSION) {
+        return FALSE;
+      }
+    }
+  } while (error != Z_OK);
+
+  dest->ndata = decompressed_size;
+  return TRUE;
 }
 
 /**********************************************************************//**
@@ -114,18 +418,19 @@ static inline int get_compression_level(void)
 **************************************************************************/
 static bool conn_compression_flush(struct connection *pconn)
 {
-  int compression_level = get_compression_level();
-  uLongf compressed_size = 12 + 1.001 * pconn->compression.queue.size;
-  int error;
-  Bytef compressed[compressed_size];
+  enum compress_method method = pconn->compression.method;
+  int compression_level = get_compression_level(method);
+  unsigned long compressed_size =
+    compress_bound(method, pconn->compression.queue.size);
+  unsigned char compressed[compressed_size];
   bool jumbo;
   unsigned long compressed_packet_len;
 
-  error = compress2(compressed, &compressed_size,
-                    pconn->compression.queue.p,
-                    pconn->compression.queue.size,
-                    compression_level);
-  fc_assert_ret_val(error == Z_OK, FALSE);
+  compressed_size = compress_data(method, compression_level,
+                                  compressed, compressed_size,
+                                  pconn->compression.queue.p,
+                                  pconn->compression.queue.size);
+  fc_assert_ret_val(0 < compressed_size, FALSE);
 
   /* Compression signalling currently assumes a 2-byte packet length; if that
    * changes, the protocol should probably be changed */
@@ -138,9 +443,10 @@ static bool conn_compression_flush(struct connection *pconn)
   if (compressed_packet_len < pconn->compression.queue.size) {
     struct raw_data_out dout;
 
-    log_compress("COMPRESS: compressed %lu bytes to %ld (level %d)",
+    log_compress("COMPRESS: compressed %lu bytes to %ld (%s level %d)",
                  (unsigned long) pconn->compression.queue.size,
-                 compressed_size, compression_level);
+                 compressed_size, compress_method_name(method),
+                 compression_level);
     stat_size_uncompressed += pconn->compression.queue.size;
     stat_size_compressed += compressed_size;
 
@@ -200,6 +506,70 @@ bool conn_compression_thaw(struct connection *pconn)
   return pconn->used;
 }
 
+/**********************************************************************//**
+  Return whether we can compress and decompress the packet stream with
+  'method'.
+**************************************************************************/
+bool compress_method_supported(enum compress_method method)
+{
+#ifdef USE_COMPRESSION
+  switch (method) {
+  case COMPRESS_ZLIB:
+    return TRUE;
+  case COMPRESS_ZSTD:
+#ifdef FREECIV_HAVE_LIBZSTD
+    return TRUE;
+#else
+    break;
+#endif
+  case COMPRESS_LZ4:
+#ifdef FREECIV_HAVE_LIBLZ4
+    return TRUE;
+#else
+    break;
+#endif
+  }
+#endif /* USE_COMPRESSION */
+
+  return FALSE;
+}
+
+/**********************************************************************//**
+  Set the method to compress the packet stream to the connection with.
+  Falls back to zlib if the other end cannot decompress it.
+**************************************************************************/
+void conn_compression_set_method(struct connection *pconn,
+                                 enum compress_method method)
+{
+#ifdef USE_COMPRESSION
+  if (!compress_method_supported(method)
+      || (COMPRESS_ZLIB != method
+          && !has_capability(compress_method_name(method),
+                             pconn->capability))) {
+    method = COMPRESS_ZLIB;
+  }
+
+  if (method != pconn->compression.method) {
+    log_verbose("%s: compressing with %s.", conn_description(pconn),
+                compress_method_name(method));
+    pconn->compression.method = method;
+  }
+#endif /* USE_COMPRESSION */
+}
+
+/**********************************************************************//**
+  Returns the packet profile table of the connection, allocating it if
+  needed.
+**************************************************************************/
+static struct packet_profile *conn_packet_profile(struct connection *pc)
+{
+  if (NULL == pc->statistics.packets) {
+    pc->statistics.packets = fc_calloc(PACKET_LAST,
+                                       sizeof(*pc->statistics.packets));
+  }
+
+  return pc->statistics.packets;
+}
 
 /**********************************************************************//**
   It returns the request id of the outgoing packet (or 0 if is_server()).
@@ -226,6 +596,21 @@ int send_packet_data(struct connection *pc, unsigned char *data, int len,
     pc->outgoing_packet_notify(pc, packet_type, len, result);
   }
 
+  if (0 <= packet_type && packet_type < PACKET_LAST) {
+    struct packet_profile *pprofile = conn_packet_profile(pc) + packet_type;
+
+    pprofile->sent++;
+    pprofile->bytes += len;
+    profile_total[packet_type].sent++;
+    profile_total[packet_type].bytes += len;
+#ifdef USE_COMPRESSION
+    if (conn_compression_frozen(pc)) {
+      pprofile->queued += len;
+      profile_total[packet_type].queued += len;
+    }
+#endif /* USE_COMPRESSION */
+  }
+
 #ifdef USE_COMPRESSION
   if (TRUE) {
     int size = len;
@@ -360,6 +745,295 @@ int send_packet_data(struct connection *pc, unsigned char *data, int len,
   return result;
 }
 
+#ifdef CLOCK_MONOTONIC
+/**********************************************************************//**
+  Return a monotonic clock reading in nanoseconds. Cheap enough to be
+  read around every packet send.
+**************************************************************************/
+static inline unsigned long long packet_profile_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+#endif /* CLOCK_MONOTONIC */
+
+/**********************************************************************//**
+  Called by the generated send functions before sending a packet, to
+  measure the time spent in it.
+**************************************************************************/
+void packet_profile_begin(void)
+{
+  if (0 < profile_depth++) {
+    return;
+  }
+
+#ifdef CLOCK_MONOTONIC
+  profile_start = packet_profile_now();
+#else  /* CLOCK_MONOTONIC */
+  if (NULL == profile_timer) {
+    profile_timer = timer_new(TIMER_USER, TIMER_ACTIVE);
+  }
+  timer_clear(profile_timer);
+  timer_start(profile_timer);
+#endif /* CLOCK_MONOTONIC */
+}
+
+/**********************************************************************//**
+  Called by the generated send functions after sending a packet of type
+  'type' to the connection.
+**************************************************************************/
+void packet_profile_end(struct connection *pc, enum packet_type type)
+{
+  unsigned long long nsec;
+
+  fc_assert_ret(0 < profile_depth);
+
+  if (0 < --profile_depth) {
+    return;
+  }
+
+#ifdef CLOCK_MONOTONIC
+  nsec = packet_profile_now() - profile_start;
+#else  /* CLOCK_MONOTONIC */
+  timer_stop(profile_timer);
+  nsec = timer_read_seconds(profile_timer) * 1000000000.0;
+#endif /* CLOCK_MONOTONIC */
+
+  if (pc->used && 0 <= type && type < PACKET_LAST) {
+    conn_packet_profile(pc)[type].nsec += nsec;
+  }
+  if (0 <= type && type < PACKET_LAST) {
+    profile_total[type].nsec += nsec;
+  }
+}
+
+/**********************************************************************//**
+  Called by the generated delta protocol send functions. 'fields' is the
+  bitvector of the 'num_fields' fields, where a cleared bit means the
+  field is not sent; 'wire_sizes' are the sizes of the fields on the
+  wire. If 'discarded', the whole packet is not sent.
+**************************************************************************/
+void packet_profile_delta(struct connection *pc, enum packet_type type,
+                          const unsigned char *fields,
+                          const unsigned int *wire_sizes, int num_fields,
+                          bool discarded)
+{
+  struct packet_profile *pprofile = conn_packet_profile(pc) + type;
+  unsigned long saved = 0;
+  int i;
+
+  for (i = 0; i < num_fields; i++) {
+    if (!(fields[i / 8] & (1 << (i % 8)))) {
+      saved += wire_sizes[i];
+    }
+  }
+
+  pprofile->delta_saved += saved;
+  profile_total[type].delta_saved += saved;
+  if (discarded) {
+    pprofile->discarded++;
+    profile_total[type].discarded++;
+  }
+}
+
+/**********************************************************************//**
+  Returns the counters of the packets of type 'type' sent to the
+  connection, or to all the connections if 'pc' is NULL. The totals
+  include the connections which are closed.
+**************************************************************************/
+const struct packet_profile *
+packet_profile_get(const struct connection *pc, enum packet_type type)
+{
+  static const struct packet_profile empty;
+
+  fc_assert_ret_val(0 <= type && type < PACKET_LAST, &empty);
+
+  if (NULL == pc) {
+    return profile_total + type;
+  }
+
+  return (NULL != pc->statistics.packets
+          ? pc->statistics.packets + type : &empty);
+}
+
+/**********************************************************************//**
+  Reset the packet counters of the connection, or the totals if 'pc' is
+  NULL.
+**************************************************************************/
+void packet_profile_reset(struct connection *pc)
+{
+  if (NULL == pc) {
+    memset(profile_total, 0, sizeof(profile_total));
+  } else if (NULL != pc->statistics.packets) {
+    memset(pc->statistics.packets, 0,
+           PACKET_LAST * sizeof(*pc->statistics.packets));
+  }
+}
+
+/**********************************************************************//**
+  Start a broadcast. Until the matching packet_broadcast_end(), packets
+  flagged 'broadcast' in packets.def are serialized only once for all
+  the connections they are sent to with the same delta state. The
+  packet contents may change between the sends; such packets are just
+  serialized again. Broadcasts can be nested.
+**************************************************************************/
+void packet_broadcast_begin(void)
+{
+  broadcast.depth++;
+}
+
+/**********************************************************************//**
+  End a broadcast started with packet_broadcast_begin().
+**************************************************************************/
+void packet_broadcast_end(void)
+{
+  int i;
+
+  fc_assert_ret(0 < broadcast.depth);
+
+  if (0 < --broadcast.depth) {
+    return;
+  }
+
+  for (i = 0; i < PACKET_BROADCAST_SLOTS; i++) {
+    broadcast.slots[i].len = 0;
+  }
+  broadcast.next = 0;
+
+  if (0 < broadcast.hits) {
+    log_packet("broadcast: %d packets reused, %d serialized",
+               broadcast.hits, broadcast.misses);
+  }
+  broadcast.hits = 0;
+  broadcast.misses = 0;
+}
+
+/**********************************************************************//**
+  Find the serialized form of the packet 'packet' (of 'packet_size'
+  bytes) for the connection 'pc', 'fields' being the delta bitvector
+  computed against the last packet sent to it. Returns a ready slot if
+  the same packet was already serialized in the current broadcast, else
+  a slot to store the new serialized packet in with
+  packet_broadcast_store(), or NULL if not in a broadcast.
+**************************************************************************/
+struct packet_broadcast_slot *
+packet_broadcast_lookup(const struct connection *pc,
+                        enum packet_type packet_type, int variant,
+                        const void *packet, size_t packet_size,
+                        const void *fields, size_t fields_size)
+{
+  struct packet_broadcast_slot *bslot;
+  int i;
+
+  if (0 == broadcast.depth
+      || PACKET_BROADCAST_MAX_FIELDS < fields_size) {
+    return NULL;
+  }
+#ifdef FREECIV_JSON_CONNECTION
+  if (pc->json_mode) {
+    return NULL;
+  }
+#endif /* FREECIV_JSON_CONNECTION */
+
+  for (i = 0; i < PACKET_BROADCAST_SLOTS; i++) {
+    bslot = broadcast.slots + i;
+
+    if (0 < bslot->len
+        && bslot->type == packet_type
+        && bslot->variant == variant
+        && bslot->header.length == pc->packet_header.length
+        && bslot->header.type == pc->packet_header.type
+        && bslot->tagged == pc->tagged_mode
+        && bslot->fields_size == fields_size
+        && bslot->packet_size == packet_size
+        && 0 == memcmp(bslot->fields, fields, fields_size)
+        && 0 == memcmp(bslot->packet, packet, packet_size)) {
+      broadcast.hits++;
+      return bslot;
+    }
+  }
+
+  /* Not found, reuse the oldest slot. */
+  broadcast.misses++;
+  bslot = broadcast.slots + broadcast.next;
+  broadcast.next = (broadcast.next + 1) % PACKET_BROADCAST_SLOTS;
+
+  bslot->type = packet_type;
+  bslot->variant = variant;
+  bslot->header = pc->packet_header;
+  bslot->tagged = pc->tagged_mode;
+  bslot->fields_size = fields_size;
+  if (0 < fields_size) {
+    memcpy(bslot->fields, fields, fields_size);
+  }
+  if (bslot->packet_alloc < packet_size) {
+    bslot->packet = fc_realloc(bslot->packet, packet_size);
+    bslot->packet_alloc = packet_size;
+  }
+  memcpy(bslot->packet, packet, packet_size);
+  bslot->packet_size = packet_size;
+  bslot->len = 0;
+
+  return bslot;
+}
+
+/**********************************************************************//**
+  Returns whether the slot holds a serialized packet which can be sent
+  with packet_broadcast_send().
+**************************************************************************/
+bool packet_broadcast_ready(const struct packet_broadcast_slot *bslot)
+{
+  return NULL != bslot && 0 < bslot->len;
+}
+
+/**********************************************************************//**
+  Store the serialized packet in the slot returned by
+  packet_broadcast_lookup(). Does nothing if the slot is NULL.
+**************************************************************************/
+void packet_broadcast_store(struct packet_broadcast_slot *bslot,
+                            const unsigned char *data, int len)
+{
+  if (NULL == bslot) {
+    return;
+  }
+
+  if (bslot->data_alloc < len) {
+    bslot->data = fc_realloc(bslot->data, len);
+    bslot->data_alloc = len;
+  }
+  memcpy(bslot->data, data, len);
+  bslot->len = len;
+}
+
+/**********************************************************************//**
+  Send the serialized packet held by the slot to the connection.
+**************************************************************************/
+int packet_broadcast_send(struct connection *pc,
+                          struct packet_broadcast_slot *bslot)
+{
+  return send_packet_data(pc, bslot->data, bslot->len, bslot->type);
+}
+
+/**********************************************************************//**
+  Called when the data left in 'buffer' is not a whole packet. More may
+  come from the socket, but the decompressed data always holds whole
+  packets, so the connection is closed if it is from there. Returns NULL.
+**************************************************************************/
+static void *incomplete_packet(struct connection *pc,
+                               const struct socket_packet_buffer *buffer)
+{
+  if (buffer != pc->buffer) {
+    log_verbose("The decompressed packet stream ends with a partial "
+                "packet. The connection will be closed now.");
+    connection_close(pc, _("decoding error"));
+  }
+
+  return NULL;
+}
+
 /**********************************************************************//**
   Read and return a packet from the connection 'pc'. The type of the
   packet is written in 'ptype'. On error, the connection is closed and
@@ -375,6 +1049,7 @@ void *get_packet_from_connection_raw(struct connection *pc,
     int itype;
   } utype;
   struct data_in din;
+  struct socket_packet_buffer *buffer;
 #ifdef USE_COMPRESSION
   bool compressed_packet = FALSE;
   int header_size = 0;
@@ -386,12 +1061,14 @@ void *get_packet_from_connection_raw(struct connection *pc,
     return NULL;		/* connection was closed, stop reading */
   }
   
-  if (pc->buffer->ndata < data_type_size(pc->packet_header.length)) {
+  /* Packets are decoded in place, from the decompressed data first. */
+  buffer = conn_receive_buffer(pc);
+  if (buffer->ndata < data_type_size(pc->packet_header.length)) {
     /* Not got enough for a length field yet */
-    return NULL;
+    return incomplete_packet(pc, buffer);
   }
 
-  dio_input_init(&din, pc->buffer->data, pc->buffer->ndata);
+  dio_input_init(&din, buffer->data + buffer->start, buffer->ndata);
   dio_get_type_raw(&din, pc->packet_header.length, &len_read);
 
   /* The non-compressed case */
@@ -421,8 +1098,8 @@ void *get_packet_from_connection_raw(struct connection *pc,
   }
 #endif /* USE_COMPRESSION */
 
-  if ((unsigned)whole_packet_len > pc->buffer->ndata) {
-    return NULL;		/* not all data has been read */
+  if ((unsigned)whole_packet_len > buffer->ndata) {
+    return incomplete_packet(pc, buffer); /* not all data has been read */
   }
 
 #ifdef USE_COMPRESSION
@@ -436,64 +1113,32 @@ void *get_packet_from_connection_raw(struct connection *pc,
 
   if (compressed_packet) {
     uLong compressed_size = whole_packet_len - header_size;
-    int decompress_factor = 80;
-    unsigned long int decompressed_size = decompress_factor * compressed_size;
-    int error = Z_DATA_ERROR;
-    struct socket_packet_buffer *buffer = pc->buffer;
-    void *decompressed = fc_malloc(decompressed_size);
-
-    do {
-      error =
-        uncompress(decompressed, &decompressed_size,
-                   ADD_TO_POINTER(buffer->data, header_size),
-                   compressed_size);
-
-      if (error == Z_DATA_ERROR) {
-        decompress_factor += 50;
-        decompressed_size = decompress_factor * compressed_size;
-        decompressed = fc_realloc(decompressed, decompressed_size);
-      }
-
-      if (error != Z_OK) {
-        if (error != Z_DATA_ERROR || decompress_factor > MAX_DECOMPRESSION ) {
-          log_verbose("Uncompressing of the packet stream failed. "
-                      "The connection will be closed now.");
-          connection_close(pc, _("decoding error"));
-          return NULL;
-        }
-      }
-
-    } while (error != Z_OK);
-
-    buffer->ndata -= whole_packet_len;
-    /* 
-     * Remove the packet with the compressed data and shift all the
-     * remaining data to the front. 
-     */
-    memmove(buffer->data, buffer->data + whole_packet_len, buffer->ndata);
 
-    if (buffer->ndata + decompressed_size > buffer->nsize) {
-      buffer->nsize += decompressed_size;
-      buffer->data = fc_realloc(buffer->data, buffer->nsize);
+    if (buffer != pc->buffer) {
+      log_verbose("Got a compressed packet inside a compressed one. "
+                  "The connection will be closed now.");
+      connection_close(pc, _("decoding error"));
+      return NULL;
     }
 
-    /*
-     * Make place for the uncompressed data by moving the remaining
-     * data.
-     */
-    memmove(buffer->data + decompressed_size, buffer->data, buffer->ndata);
+    if (NULL == pc->compression.inflated) {
+      pc->compression.inflated = new_socket_packet_buffer();
+    }
 
-    /* 
-     * Copy the uncompressed data.
-     */
-    memcpy(buffer->data, decompressed, decompressed_size);
+    if (!decompress_data(buffer->data + buffer->start + header_size,
+                         compressed_size, pc->compression.inflated)) {
+      log_verbose("Uncompressing of the packet stream failed. "
+                  "The connection will be closed now.");
+      connection_close(pc, _("decoding error"));
+      return NULL;
+    }
 
-    free(decompressed);
+    /* The packets are read from the decompressed data until it is
+     * used up, then again from the socket buffer. */
+    socket_packet_buffer_consume(buffer, whole_packet_len);
 
-    buffer->ndata += decompressed_size;
-    
-    log_compress("COMPRESS: decompressed %ld into %ld",
-                 compressed_size, decompressed_size);
+    log_compress("COMPRESS: decompressed %ld into %d",
+                 compressed_size, pc->compression.inflated->ndata);
 
     return get_packet_from_connection(pc, ptype);
   }
@@ -595,10 +1240,9 @@ void remove_packet_from_buffer(struct socket_packet_buffer *buffer)
   struct data_in din;
   int len;
 
-  dio_input_init(&din, buffer->data, buffer->ndata);
+  dio_input_init(&din, buffer->data + buffer->start, buffer->ndata);
   dio_get_uint16_raw(&din, &len);
-  memmove(buffer->data, buffer->data + len, buffer->ndata - len);
-  buffer->ndata -= len;
+  socket_packet_buffer_consume(buffer, len);
   log_debug("remove_packet_from_buffer: remove %d; remaining %d",
             len, buffer->ndata);
 }
@@ -630,7 +1274,8 @@ static inline void packet_header_set(struct packet_header *packet_header)
 }
 
 /**********************************************************************//**
-  Modify if needed the packet header field lengths.
+  Modify if needed the packet header field lengths, and switch to the
+  tagged encoding if it was negotiated.
 **************************************************************************/
 void post_send_packet_server_join_reply(struct connection *pconn,
                                         const struct packet_server_join_reply
@@ -638,6 +1283,10 @@ void post_send_packet_server_join_reply(struct connection *pconn,
 {
   if (packet->you_can_join) {
     packet_header_set(&pconn->packet_header);
+    /* The server confirms the tagged encoding by listing it in the
+     * capabilities of the reply. */
+    pconn->tagged_mode = has_capability(PACKET_TAGGED_CAPABILITY,
+                                        packet->capability);
   }
 }
 
@@ -875,11 +1524,89 @@ const struct packet_handlers *packet_handlers_get(const char *capability)
   return phandlers;
 }
 
+/**********************************************************************//**
+  Write the schemas of the tagged encoding to 'filename'. There is one
+  section per packet variant, named after the packet type and the schema
+  id, with a table of the fields.
+**************************************************************************/
+bool packet_schema_save(const char *filename)
+{
+  struct section_file *sfile = secfile_new(TRUE);
+  bool ok;
+  int i, j;
+
+  secfile_insert_str(sfile, our_capability, "schema.capability");
+  secfile_insert_int(sfile, num_packet_schemas, "schema.count");
+
+  for (i = 0; i < num_packet_schemas; i++) {
+    const struct packet_schema *pschema = packet_schemas + i;
+    char section[64];
+
+    fc_snprintf(section, sizeof(section), "packet_%d_%d",
+                pschema->type, pschema->id);
+    secfile_insert_str(sfile, packet_name(pschema->type), "%s.name",
+                       section);
+    secfile_insert_int(sfile, pschema->type, "%s.type", section);
+    secfile_insert_int(sfile, pschema->id, "%s.id", section);
+
+    for (j = 0; j < pschema->num_fields; j++) {
+      const struct packet_schema_field *pfield = pschema->fields + j;
+
+      secfile_insert_int(sfile, pfield->tag, "%s.fields%d.tag",
+                         section, j);
+      secfile_insert_str(sfile, pfield->name, "%s.fields%d.name",
+                         section, j);
+      secfile_insert_str(sfile, pfield->dataio_type, "%s.fields%d.type",
+                         section, j);
+      secfile_insert_int(sfile, pfield->size, "%s.fields%d.size",
+                         section, j);
+      secfile_insert_int(sfile, pfield->float_factor,
+                         "%s.fields%d.float_factor", section, j);
+      secfile_insert_bool(sfile, pfield->key, "%s.fields%d.key",
+                          section, j);
+      secfile_insert_bool(sfile, pfield->diff, "%s.fields%d.diff",
+                          section, j);
+    }
+  }
+
+  ok = secfile_save(sfile, filename, 0, FZ_PLAIN);
+  if (!ok) {
+    log_error("Failed to write the packet schemas: %s", secfile_error());
+  }
+  secfile_destroy(sfile);
+
+  return ok;
+}
+
 /**********************************************************************//**
   Call when there is no longer a requirement for protocol processing.
   All connections must have been closed.
 **************************************************************************/
 void packets_deinit(void)
 {
+  int i;
+
   packet_handlers_free();
+
+#ifndef CLOCK_MONOTONIC
+  if (NULL != profile_timer) {
+    timer_destroy(profile_timer);
+    profile_timer = NULL;
+  }
+#endif /* CLOCK_MONOTONIC */
+
+  for (i = 0; i < PACKET_BROADCAST_SLOTS; i++) {
+    FC_FREE(broadcast.slots[i].packet);
+    broadcast.slots[i].packet_alloc = 0;
+    FC_FREE(broadcast.slots[i].data);
+    broadcast.slots[i].data_alloc = 0;
+    broadcast.slots[i].len = 0;
+  }
+
+#if defined(USE_COMPRESSION) && defined(FREECIV_HAVE_LIBZSTD)
+  ZSTD_freeCCtx(zstd_cctx);
+  zstd_cctx = NULL;
+  ZSTD_freeDCtx(zstd_dctx);
+  zstd_dctx = NULL;
+#endif /* USE_COMPRESSION && FREECIV_HAVE_LIBZSTD */
 }
@@ -89,6 +89,53 @@ enum authentication_type {
 
 #include "packets_gen.h"
 
+/* The tagged encoding, sent to the connections which ask for it with the
+ * "tagged" capability. It can be decoded without the packet structs:
+ *
+ * After the usual header (length and packet type), a packet has the
+ * schema id (uint16) of the packet variant and then, for every field
+ * sent, its tag (uint8) followed by the value as in the normal
+ * encoding. The delta protocol bitvector is left out; the fields which
+ * are folded into it are sent as bool8 values. Arrays, memory and
+ * bitvectors have the number of elements (uint16, bytes for memory and
+ * bitvectors) after the tag, except the diff arrays which are sent as
+ * in the normal encoding.
+ *
+ * The fields of each schema are written by packet_schema_save(). Only
+ * the server to client direction uses it. */
+#define PACKET_TAGGED_CAPABILITY "tagged"
+
+#ifdef FREECIV_DELTA_PROTOCOL
+#define PACKET_SCHEMA_DIFF TRUE
+#else
+#define PACKET_SCHEMA_DIFF FALSE
+#endif /* FREECIV_DELTA_PROTOCOL */
+
+struct packet_schema_field {
+  const char *name;
+  const char *dataio_type;
+  int tag;
+  int size;                     /* Maximum number of elements (bytes for
+                                 * memory and bitvectors), or 0 when the
+                                 * field has no count. */
+  int float_factor;
+  bool key;
+  bool diff;                    /* Sent as (index, value) pairs ending
+                                 * with the index 255. */
+};
+
+struct packet_schema {
+  enum packet_type type;
+  int id;
+  int num_fields;
+  const struct packet_schema_field *fields;
+};
+
+extern const struct packet_schema packet_schemas[];
+extern const int num_packet_schemas;
+
+bool packet_schema_save(const char *filename);
+
 struct packet_handlers {
   union {
     int (*no_packet)(struct connection *pconn);
@@ -161,17 +208,52 @@ void packets_deinit(void);
     return send_packet_data(pc, buffer, size, packet_type); \
   }
 
+#define SEND_PACKET_BROADCAST_END(packet_type, bslot) \
+  { \
+    size_t size = dio_output_used(&dout); \
+    \
+    dio_output_rewind(&dout); \
+    dio_put_type_raw(&dout, pc->packet_header.length, size); \
+    fc_assert(!dout.too_short); \
+    packet_broadcast_store(bslot, buffer, size); \
+    return send_packet_data(pc, buffer, size, packet_type); \
+  }
+
+#define SEND_PACKET_SCHEMA(schema) \
+  if (pc->tagged_mode) { \
+    dio_put_uint16_raw(&dout, schema); \
+  }
+
+#define SEND_PACKET_TAG(tag) \
+  if (pc->tagged_mode) { \
+    dio_put_uint8_raw(&dout, tag); \
+  }
+
+#define SEND_PACKET_TAG_COUNT(tag, count) \
+  if (pc->tagged_mode) { \
+    dio_put_uint8_raw(&dout, tag); \
+    dio_put_uint16_raw(&dout, count); \
+  }
+
+#define SEND_PACKET_TAG_BOOL(tag, value) \
+  if (pc->tagged_mode) { \
+    dio_put_uint8_raw(&dout, tag); \
+    dio_put_bool8_raw(&dout, value); \
+  }
+
 #define RECEIVE_PACKET_START(packet_type, result) \
   struct data_in din; \
   struct packet_type packet_buf, *result = &packet_buf; \
+  struct socket_packet_buffer *rbuf = conn_receive_buffer(pc); \
   \
-  dio_input_init(&din, pc->buffer->data, \
+  dio_input_init(&din, rbuf->data + rbuf->start, \
                  data_type_size(pc->packet_header.length)); \
   { \
     int size; \
   \
     dio_get_type_raw(&din, pc->packet_header.length, &size); \
-    dio_input_init(&din, pc->buffer->data, MIN(size, pc->buffer->ndata)); \
+    dio_input_init(&din, rbuf->data + rbuf->start, \
+                   MIN(size, rbuf->ndata)); \
   } \
   dio_input_skip(&din, (data_type_size(pc->packet_header.length) \
                         + data_type_size(pc->packet_header.type)));
@@ -180,7 +262,7 @@ void packets_deinit(void);
   if (!packet_check(&din, pc)) { \
     return NULL; \
   } \
-  remove_packet_from_buffer(pc->buffer); \
+  remove_packet_from_buffer(rbuf); \
   result = fc_malloc(sizeof(*result)); \
   *result = packet_buf; \
   return result;
@@ -193,6 +275,43 @@ void packets_deinit(void);
 
 int send_packet_data(struct connection *pc, unsigned char *data, int len,
                      enum packet_type packet_type);
+
+/* Counters about the packets of one type sent to a connection. */
+struct packet_profile {
+  unsigned int sent;            /* Packets sent. */
+  unsigned int discarded;       /* Packets not sent, as unchanged. */
+  unsigned long bytes;          /* Serialized bytes sent. */
+  unsigned long delta_saved;    /* Bytes not sent thanks to the delta
+                                 * protocol (estimated). */
+  unsigned long queued;         /* Bytes sent through the compression
+                                 * queue. */
+  unsigned long long nsec;      /* Time spent in the send function. */
+};
+
+void packet_profile_begin(void);
+void packet_profile_end(struct connection *pc, enum packet_type type);
+void packet_profile_delta(struct connection *pc, enum packet_type type,
+                          const unsigned char *fields,
+                          const unsigned int *wire_sizes, int num_fields,
+                          bool discarded);
+const struct packet_profile *
+packet_profile_get(const struct connection *pc, enum packet_type type);
+void packet_profile_reset(struct connection *pc);
+
+struct packet_broadcast_slot;
+
+void packet_broadcast_begin(void);
+void packet_broadcast_end(void);
+struct packet_broadcast_slot *
+packet_broadcast_lookup(const struct connection *pc,
+                        enum packet_type packet_type, int variant,
+                        const void *packet, size_t packet_size,
+                        const void *fields, size_t fields_size);
+bool packet_broadcast_ready(const struct packet_broadcast_slot *bslot);
+void packet_broadcast_store(struct packet_broadcast_slot *bslot,
+                            const unsigned char *data, int len);
+int packet_broadcast_send(struct connection *pc,
+                          struct packet_broadcast_slot *bslot);
 bool packet_check(struct data_in *din, struct connection *pc);
 
 /* Utilities to exchange strings and string vectors. */
@@ -78,6 +78,7 @@ void *get_packet_from_connection_json(struct connection *pc,
     int itype;
   } utype;
   struct data_in din;
+  unsigned char *packet_data;
   void *data;
   void *(*receive_handler)(struct connection *);
   json_error_t error;
@@ -92,7 +93,8 @@ void *get_packet_from_connection_json(struct connection *pc,
     return NULL;
   }
 
-  dio_input_init(&din, pc->buffer->data, pc->buffer->ndata);
+  packet_data = pc->buffer->data + pc->buffer->start;
+  dio_input_init(&din, packet_data, pc->buffer->ndata);
   dio_get_uint16_raw(&din, &len_read);
 
   /* The non-compressed case */
@@ -120,7 +122,7 @@ void *get_packet_from_connection_json(struct connection *pc,
    */
   if (is_server() && pc->server.last_request_id_seen == 0) {
     /* Try to parse JSON packet. Note that json string has '\0' */
-    pc->json_packet = json_loadb((char*)pc->buffer->data + 2, whole_packet_len - 3, 0, &error);
+    pc->json_packet = json_loadb((char*)packet_data + 2, whole_packet_len - 3, 0, &error);
 
     /* Set the connection mode */
     pc->json_mode = (pc->json_packet != NULL);
@@ -128,19 +130,18 @@ void *get_packet_from_connection_json(struct connection *pc,
 
   if (pc->json_mode) {
     /* Parse JSON packet. Note that json string has '\0' */
-    pc->json_packet = json_loadb((char*)pc->buffer->data + 2, whole_packet_len - 3, 0, &error);
+    pc->json_packet = json_loadb((char*)packet_data + 2, whole_packet_len - 3, 0, &error);
 
     /* Log errors before we scrap the data */
     if (!pc->json_packet) {
-      log_error("ERROR: Unable to parse packet: %s", pc->buffer->data + 2);
+      log_error("ERROR: Unable to parse packet: %s", packet_data + 2);
       log_error("%s", error.text);
     }
 
-    log_packet_json("Json in: %s", pc->buffer->data + 2);
+    log_packet_json("Json in: %s", packet_data + 2);
 
-    /* Shift remaining data to the front */
-    pc->buffer->ndata -= whole_packet_len;
-    memmove(pc->buffer->data, pc->buffer->data + whole_packet_len, pc->buffer->ndata);
+    /* Drop the packet from the buffer */
+    socket_packet_buffer_consume(pc->buffer, whole_packet_len);
 
     if (!pc->json_packet) {
       return NULL;
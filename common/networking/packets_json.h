@@ -67,17 +67,55 @@ void *get_packet_from_connection_json(struct connection *pc,
     return send_packet_data(pc, buffer, size, packet_type);             \
   }
 
+#define SEND_PACKET_BROADCAST_END(packet_type, bslot)                  \
+  {                                                                     \
+    if (!pc->json_mode) {                                               \
+      size_t size = dio_output_used(&dout.raw);                         \
+                                                                        \
+      dio_output_rewind(&dout.raw);                                     \
+      dio_put_type_raw(&dout.raw, pc->packet_header.length, size);      \
+      fc_assert(!dout.raw.too_short);                                   \
+      packet_broadcast_store(bslot, buffer, size);                      \
+      return send_packet_data(pc, buffer, size, packet_type);           \
+    }                                                                   \
+  }                                                                     \
+  SEND_PACKET_END(packet_type)
+
+#define SEND_PACKET_SCHEMA(schema)                                      \
+  if (pc->tagged_mode) {                                                \
+    dio_put_uint16_raw(&dout.raw, schema);                              \
+  }
+
+#define SEND_PACKET_TAG(tag)                                            \
+  if (pc->tagged_mode) {                                                \
+    dio_put_uint8_raw(&dout.raw, tag);                                  \
+  }
+
+#define SEND_PACKET_TAG_COUNT(tag, count)                               \
+  if (pc->tagged_mode) {                                                \
+    dio_put_uint8_raw(&dout.raw, tag);                                  \
+    dio_put_uint16_raw(&dout.raw, count);                               \
+  }
+
+#define SEND_PACKET_TAG_BOOL(tag, value)                                \
+  if (pc->tagged_mode) {                                                \
+    dio_put_uint8_raw(&dout.raw, tag);                                  \
+    dio_put_bool8_raw(&dout.raw, value);                                \
+  }
+
 #define RECEIVE_PACKET_START(packet_type, result)       \
   struct packet_type packet_buf, *result = &packet_buf; \
   struct data_in din;                                   \
+  struct socket_packet_buffer *rbuf = conn_receive_buffer(pc); \
   if (!pc->json_mode) { \
-      dio_input_init(&din, pc->buffer->data, \
+      dio_input_init(&din, rbuf->data + rbuf->start, \
                  data_type_size(pc->packet_header.length)); \
   { \
     int size; \
   \
     dio_get_type_raw(&din, pc->packet_header.length, &size); \
-    dio_input_init(&din, pc->buffer->data, MIN(size, pc->buffer->ndata)); \
+    dio_input_init(&din, rbuf->data + rbuf->start, \
+                   MIN(size, rbuf->ndata)); \
   } \
   dio_input_skip(&din, (data_type_size(pc->packet_header.length) \
                         + data_type_size(pc->packet_header.type))); \
@@ -93,7 +131,7 @@ void *get_packet_from_connection_json(struct connection *pc,
     if (!packet_check(&din, pc)) {              \
       return NULL;                              \
     }                                           \
-    remove_packet_from_buffer(pc->buffer);      \
+    remove_packet_from_buffer(rbuf);            \
     result = fc_malloc(sizeof(*result));        \
     *result = packet_buf;                       \
     return result;                              \
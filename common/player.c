@@ -737,6 +737,7 @@ void player_destroy(struct player *pplayer)
   }
 
   dbv_free(&pplayer->tile_known);
+  effect_value_cache_free(&pplayer->effect_cache);
 
   if (!is_server()) {
     vision_layer_iterate(v) {
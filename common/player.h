@@ -224,6 +224,7 @@ struct attribute_block_s {
 
 struct ai_type;
 struct ai_data;
+struct effect_value_cache; /* defined and only used within effects.c */
 
 bool player_has_flag(const struct player *pplayer, enum plr_flag_id flag);
 
@@ -299,6 +300,9 @@ struct player {
   int culture; /* National level culture - does not include culture of individual
                 * cities. */
 
+  /* Effect values of the player, see get_player_bonus(). */
+  struct effect_value_cache *effect_cache;
+
   union {
     struct {
       /* Only used in the server (./ai/ and ./server/). */
@@ -18,6 +18,7 @@
 #include "astring.h"
 #include "fcintl.h"
 #include "log.h"
+#include "mem.h"
 #include "support.h"
 
 /* common */
@@ -2749,6 +2750,27 @@ is_achievement_in_range(const struct player *target_player,
   }
 }
 
+/**********************************************************************//**
+  Return whether a requirement is active, from the evaluation of its
+  source.
+**************************************************************************/
+static inline bool req_eval_active(enum fc_tristate eval, bool present,
+                                   const enum req_problem_type prob_type)
+{
+  if (eval == TRI_MAYBE) {
+    if (prob_type == RPT_POSSIBLE) {
+      return TRUE;
+    } else {
+      return FALSE;
+    }
+  }
+  if (present) {
+    return (eval == TRI_YES);
+  } else {
+    return (eval == TRI_NO);
+  }
+}
+
 /**********************************************************************//**
   Checks the requirement to see if it is active on the given target.
 
@@ -3088,18 +3110,7 @@ bool is_req_active(const struct player *target_player,
     return FALSE;
   }
 
-  if (eval == TRI_MAYBE) {
-    if (prob_type == RPT_POSSIBLE) {
-      return TRUE;
-    } else {
-      return FALSE;
-    }
-  }
-  if (req->present) {
-    return (eval == TRI_YES);
-  } else {
-    return (eval == TRI_NO);
-  }
+  return req_eval_active(eval, req->present, prob_type);
 }
 
 /**********************************************************************//**
@@ -3140,6 +3151,263 @@ bool are_reqs_active(const struct player *target_player,
   return TRUE;
 }
 
+/* The operations of a struct req_program. The most common requirements
+ * which only look at the targets are evaluated by the program itself,
+ * the others by is_req_active(). */
+enum req_op_code {
+  REQ_OP_OTYPE,
+  REQ_OP_SPECIALIST,
+  REQ_OP_ACTION,
+  REQ_OP_GOVERNMENT,
+  REQ_OP_MINSIZE,               /* Not at Traderoute range */
+  REQ_OP_UTYPE,
+  REQ_OP_UCLASS,
+  REQ_OP_GENERIC
+};
+
+struct req_op {
+  enum req_op_code code;
+  struct requirement req;
+};
+
+/* A requirement vector compiled for req_program_active(). */
+struct req_program {
+  bool never;                   /* Some requirement can never be met. */
+  int num_ops;
+  struct req_op *ops;           /* Cheapest first. */
+};
+
+/**********************************************************************//**
+  Return the operation evaluating the requirement.
+**************************************************************************/
+static enum req_op_code req_op_code(const struct requirement *req)
+{
+  switch (req->source.kind) {
+  case VUT_OTYPE:
+    return REQ_OP_OTYPE;
+  case VUT_SPECIALIST:
+    return REQ_OP_SPECIALIST;
+  case VUT_ACTION:
+    return REQ_OP_ACTION;
+  case VUT_GOVERNMENT:
+    return REQ_OP_GOVERNMENT;
+  case VUT_MINSIZE:
+    return (req->range == REQ_RANGE_TRADEROUTE
+            ? REQ_OP_GENERIC : REQ_OP_MINSIZE);
+  case VUT_UTYPE:
+    return REQ_OP_UTYPE;
+  case VUT_UCLASS:
+    return REQ_OP_UCLASS;
+  default:
+    return REQ_OP_GENERIC;
+  }
+}
+
+/**********************************************************************//**
+  Return a rough cost of the evaluation of the requirement. The
+  operations done by the program cost nothing; the others cost more for
+  the ranges which look at many tiles, cities or players, and for the
+  kinds which iterate over units, citizens or history.
+**************************************************************************/
+static int req_op_cost(const struct requirement *req)
+{
+  int cost = 1;
+
+  if (req_op_code(req) != REQ_OP_GENERIC) {
+    return 0;
+  }
+
+  switch (req->range) {
+  case REQ_RANGE_LOCAL:
+  case REQ_RANGE_CITY:
+  case REQ_RANGE_PLAYER:
+  case REQ_RANGE_WORLD:
+    break;
+  case REQ_RANGE_CADJACENT:
+  case REQ_RANGE_ADJACENT:
+  case REQ_RANGE_TRADEROUTE:
+    cost += 1;
+    break;
+  case REQ_RANGE_CONTINENT:
+  case REQ_RANGE_TEAM:
+  case REQ_RANGE_ALLIANCE:
+  case REQ_RANGE_COUNT:
+    cost += 2;
+    break;
+  }
+
+  switch (req->source.kind) {
+  case VUT_NATIONALITY:
+  case VUT_DIPLREL:
+  case VUT_MINCULTURE:
+  case VUT_ACHIEVEMENT:
+  case VUT_MAXTILEUNITS:
+  case VUT_TERRAINALTER:
+    cost += 2;
+    break;
+  default:
+    break;
+  }
+
+  return cost;
+}
+
+/**********************************************************************//**
+  Compile the requirement vector for req_program_active(). The
+  requirements which are always met are left out, the duplicates too,
+  and the others are ordered from the cheapest to evaluate: as a
+  requirement vector is active only if all its requirements are, the
+  first one not met ends the evaluation.
+
+  The program keeps copies of the requirements, so it has to be made
+  again if 'reqs' changes.
+**************************************************************************/
+struct req_program *req_program_new(const struct requirement_vector *reqs)
+{
+  struct req_program *prog = fc_malloc(sizeof(*prog));
+  int i;
+
+  prog->never = FALSE;
+  prog->num_ops = 0;
+  prog->ops = fc_malloc(MAX(1, requirement_vector_size(reqs))
+                        * sizeof(*prog->ops));
+
+  requirement_vector_iterate(reqs, preq) {
+    int cost = req_op_cost(preq);
+    bool duplicate = FALSE;
+    int j;
+
+    if (preq->source.kind == VUT_NONE) {
+      if (!preq->present) {
+        prog->never = TRUE;
+      }
+      continue;
+    }
+
+    for (i = 0; i < prog->num_ops; i++) {
+      if (are_requirements_equal(&prog->ops[i].req, preq)) {
+        duplicate = TRUE;
+        break;
+      }
+    }
+    if (duplicate) {
+      continue;
+    }
+
+    /* Insert after the ops which cost as much, to keep the ruleset order
+     * among them. */
+    for (j = prog->num_ops;
+         j > 0 && req_op_cost(&prog->ops[j - 1].req) > cost; j--) {
+      prog->ops[j] = prog->ops[j - 1];
+    }
+    prog->ops[j].code = req_op_code(preq);
+    prog->ops[j].req = *preq;
+    prog->num_ops++;
+  } requirement_vector_iterate_end;
+
+  return prog;
+}
+
+/**********************************************************************//**
+  Free a program made by req_program_new().
+**************************************************************************/
+void req_program_destroy(struct req_program *prog)
+{
+  free(prog->ops);
+  free(prog);
+}
+
+/**********************************************************************//**
+  Does the same as are_reqs_active() on the requirement vector 'prog' was
+  compiled from.
+**************************************************************************/
+bool req_program_active(const struct req_program *prog,
+                        const struct player *target_player,
+                        const struct player *other_player,
+                        const struct city *target_city,
+                        const struct impr_type *target_building,
+                        const struct tile *target_tile,
+                        const struct unit *target_unit,
+                        const struct unit_type *target_unittype,
+                        const struct output_type *target_output,
+                        const struct specialist *target_specialist,
+                        const struct action *target_action,
+                        const enum req_problem_type prob_type)
+{
+  int i;
+
+  if (prog->never) {
+    return FALSE;
+  }
+
+  /* Done once here rather than by every is_req_active(). */
+  if (target_unittype == NULL && target_unit != NULL) {
+    target_unittype = unit_type_get(target_unit);
+  }
+
+  for (i = 0; i < prog->num_ops; i++) {
+    const struct req_op *op = &prog->ops[i];
+    const struct requirement *req = &op->req;
+    enum fc_tristate eval;
+
+    switch (op->code) {
+    case REQ_OP_OTYPE:
+      eval = BOOL_TO_TRISTATE(target_output
+                              && target_output->index
+                                 == req->source.value.outputtype);
+      break;
+    case REQ_OP_SPECIALIST:
+      eval = BOOL_TO_TRISTATE(target_specialist
+                              && target_specialist
+                                 == req->source.value.specialist);
+      break;
+    case REQ_OP_ACTION:
+      eval = BOOL_TO_TRISTATE(target_action
+                              && action_number(target_action)
+                                 == action_number(req->source.value.action));
+      break;
+    case REQ_OP_GOVERNMENT:
+      eval = (target_player == NULL ? TRI_MAYBE
+              : BOOL_TO_TRISTATE(government_of_player(target_player)
+                                 == req->source.value.govern));
+      break;
+    case REQ_OP_MINSIZE:
+      eval = (target_city == NULL ? TRI_MAYBE
+              : BOOL_TO_TRISTATE(city_size_get(target_city)
+                                 >= req->source.value.minsize));
+      break;
+    case REQ_OP_UTYPE:
+      eval = (target_unittype == NULL ? TRI_MAYBE
+              : is_unittype_in_range(target_unittype,
+                                     req->range, req->survives,
+                                     req->source.value.utype));
+      break;
+    case REQ_OP_UCLASS:
+      eval = (target_unittype == NULL ? TRI_MAYBE
+              : is_unitclass_in_range(target_unittype,
+                                      req->range, req->survives,
+                                      req->source.value.uclass));
+      break;
+    case REQ_OP_GENERIC:
+    default:
+      if (!is_req_active(target_player, other_player, target_city,
+                         target_building, target_tile,
+                         target_unit, target_unittype,
+                         target_output, target_specialist, target_action,
+                         req, prob_type)) {
+        return FALSE;
+      }
+      continue;
+    }
+
+    if (!req_eval_active(eval, req->present, prob_type)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 /**********************************************************************//**
   Return TRUE if this is an "unchanging" requirement.  This means that
   if a target can't meet the requirement now, it probably won't ever be able
@@ -3213,6 +3481,67 @@ bool is_req_unchanging(const struct requirement *req)
   return TRUE;
 }
 
+/**********************************************************************//**
+  Return TRUE if the evaluation of this requirement may depend on the
+  target tile. If not, is_req_active() gives the same result whatever the
+  target tile is, or without one, so the requirement can be evaluated
+  once for many tiles.
+**************************************************************************/
+bool is_req_tile_dependent(const struct requirement *req)
+{
+  switch (req->source.kind) {
+  case VUT_TERRAIN:
+  case VUT_EXTRA:
+  case VUT_GOOD:
+  case VUT_TERRAINCLASS:
+  case VUT_TERRFLAG:
+  case VUT_TERRAINALTER:
+  case VUT_BASEFLAG:
+  case VUT_ROADFLAG:
+  case VUT_EXTRAFLAG:
+  case VUT_MAXTILEUNITS:
+  case VUT_CITYTILE:
+    return TRUE;
+  case VUT_NONE:
+  case VUT_ADVANCE:
+  case VUT_TECHFLAG:
+  case VUT_GOVERNMENT:
+  case VUT_ACHIEVEMENT:
+  case VUT_STYLE:
+  case VUT_IMPROVEMENT:
+  case VUT_IMPR_GENUS:
+  case VUT_NATION:
+  case VUT_NATIONGROUP:
+  case VUT_NATIONALITY:
+  case VUT_DIPLREL:
+  case VUT_UTYPE:
+  case VUT_UTFLAG:
+  case VUT_UCLASS:
+  case VUT_UCFLAG:
+  case VUT_MINVETERAN:
+  case VUT_UNITSTATE:
+  case VUT_MINMOVES:
+  case VUT_MINHP:
+  case VUT_AGE:
+  case VUT_MINTECHS:
+  case VUT_ACTION:
+  case VUT_OTYPE:
+  case VUT_SPECIALIST:
+  case VUT_MINSIZE:
+  case VUT_MINCULTURE:
+  case VUT_AI_LEVEL:
+  case VUT_MINYEAR:
+  case VUT_MINCALFRAG:
+  case VUT_TOPO:
+  case VUT_SERVERSETTING:
+    return FALSE;
+  case VUT_COUNT:
+    break;
+  }
+  fc_assert_msg(FALSE, "Invalid source kind %d.", req->source.kind);
+  return TRUE;
+}
+
 /**********************************************************************//**
   Returns TRUE iff the requirement vector vec contains the requirement
   req.
@@ -23,6 +23,7 @@
 
 /* common */
 #include "fc_types.h"
+#include "effects.h"
 #include "game.h"
 #include "player.h"
 #include "name_translation.h"
@@ -616,6 +617,9 @@ void research_update(struct research *presearch)
       }
     } advance_index_iterate_end;
   }
+
+  /* The tech counts and flags may have changed. */
+  effect_value_cache_changed(VUT_ADVANCE);
 }
 
 /************************************************************************//**
@@ -664,6 +668,8 @@ enum tech_state research_invention_set(struct research *presearch,
     }
   }
 
+  effect_value_cache_changed(VUT_ADVANCE);
+
   return old;
 }
 
@@ -21,6 +21,7 @@
 #include "support.h"
 
 /* common */
+#include "effects.h"
 #include "fc_interface.h"
 #include "game.h"
 #include "map.h"
@@ -142,6 +143,9 @@ void tile_set_terrain(struct tile *ptile, struct terrain *pterrain)
                 terrain_number(pterrain), city_name_get(tile_city(ptile)),
                 tile_city(ptile)->id);
 
+  if (ptile->terrain != pterrain) {
+    effect_value_cache_changed(VUT_TERRAIN);
+  }
   ptile->terrain = pterrain;
   if (ptile->resource != NULL) {
     if (NULL != pterrain
@@ -408,6 +412,9 @@ Continent_id tile_continent(const struct tile *ptile)
 ****************************************************************************/
 void tile_set_continent(struct tile *ptile, Continent_id val)
 {
+  if (ptile->continent != val) {
+    effect_value_cache_changed(VUT_TERRAIN);
+  }
   ptile->continent = val;
 }
 
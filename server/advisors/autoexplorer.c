@@ -136,6 +136,7 @@ static bool explorer_goto(struct unit *punit, struct tile *ptile)
   parameter.omniscience = !has_handicap(pplayer, H_MAP);
   parameter.get_TB = explorer_tb;
   adv_avoid_risks(&parameter, &risk_cost, punit, NORMAL_STACKING_FEARFULNESS);
+  pft_fill_goal(&parameter, ptile);
 
   /* Show the destination in the client */
   punit->goto_tile = ptile;
@@ -450,7 +450,8 @@ adv_want settler_evaluate_improvements(struct unit *punit,
   pft_fill_unit_parameter(&parameter, punit);
   parameter.omniscience = !has_handicap(pplayer, H_MAP);
   parameter.get_TB = autosettler_tile_behavior;
-  pfm = pf_map_new(&parameter);
+  /* Shared with the other workers in the same situation. */
+  pfm = pf_map_cache_get(&parameter);
 
   city_list_iterate(pplayer->cities, pcity) {
     struct tile *pcenter = city_tile(pcity);
@@ -780,8 +781,6 @@ adv_want settler_evaluate_improvements(struct unit *punit,
     *path = *best_tile ? pf_map_path(pfm, *best_tile) : NULL;
   }
 
-  pf_map_destroy(pfm);
-
   return best_newv;
 }
 
@@ -1043,7 +1042,8 @@ bool auto_settler_setup_work(struct player *pplayer, struct unit *punit,
       pft_fill_unit_parameter(&parameter, punit);
       parameter.omniscience = !has_handicap(pplayer, H_MAP);
       parameter.get_TB = autosettler_tile_behavior;
-      pfm = pf_map_new(&parameter);
+      /* Likely the map of settler_evaluate_improvements(). */
+      pfm = pf_map_cache_get(&parameter);
       path = pf_map_path(pfm, best_tile);
     }
 
@@ -1077,10 +1077,6 @@ bool auto_settler_setup_work(struct player *pplayer, struct unit *punit,
                TILE_XY(unit_tile(punit)), TILE_XY(best_tile));
     }
 
-    if (pfm) {
-      pf_map_destroy(pfm);
-    }
-
     return working;
   }
 
@@ -52,6 +52,11 @@
 #include "unitlist.h"
 #include "vision.h"
 
+/* common/aicore */
+#include "path_finding.h"
+#include "pf_cluster.h"
+#include "pf_costgrid.h"
+
 /* common/scriptcore */
 #include "luascript_types.h"
 
@@ -186,6 +191,22 @@ void city_thaw_workers_queue(void)
     return;
   }
 
+  if (1 < game.server.city_threads
+      && 0 < city_list_size(arrange_workers_queue)) {
+    struct city *cities[city_list_size(arrange_workers_queue)];
+    int n = 0;
+
+    city_list_iterate(arrange_workers_queue, pcity) {
+      if (1 == pcity->server.workers_frozen
+          && pcity->server.needs_arrange) {
+        cities[n++] = pcity;
+      }
+    } city_list_iterate_end;
+    if (0 < n) {
+      auto_arrange_workers_prepare(cities, n);
+    }
+  }
+
   city_list_iterate(arrange_workers_queue, pcity) {
     city_thaw_workers(pcity);
   } city_list_iterate_end;
@@ -1096,6 +1117,8 @@ bool transfer_city(struct player *ptaker, struct city *pcity,
 
   fc_assert_ret_val(pgiver != ptaker, TRUE);
 
+  pf_map_cache_clear();
+
   /* Remember what player see what unit. */
   i = 0;
   unit_list_iterate(pcenter->units, aunit) {
@@ -1475,6 +1498,8 @@ void create_city(struct player *pplayer, struct tile *ptile,
 
   log_debug("create_city() %s", name);
 
+  pf_map_cache_clear();
+
   pcity = create_city_virtual(pplayer, ptile, name);
 
   /* Remove units no more seen. Do it before city is really put into the
@@ -1637,6 +1662,9 @@ void remove_city(struct city *pcity)
   CALL_PLR_AI_FUNC(city_lost, powner, powner, pcity);
   CALL_FUNC_EACH_AI(city_destroyed, pcity);
 
+  pf_map_cache_clear();
+  city_refresh_inputs_changed();
+
   BV_CLR_ALL(had_small_wonders);
   city_built_iterate(pcity, pimprove) {
     building_removed(pcity, pimprove, "city_destroyed", NULL);
@@ -1828,6 +1856,8 @@ void remove_city(struct city *pcity)
   vision_free(old_vision);
 
   /* Infrastructures may have changed. */
+  pf_costgrid_tile_changed(pcenter);
+  pf_cluster_tile_changed(pcenter);
   send_tile_info(NULL, pcenter, FALSE);
 
   /* Build a new palace for free if the player lost her capital and
@@ -2124,6 +2154,7 @@ static void broadcast_city_info(struct city *pcity)
 
   /* Send to everyone who can see the city. */
   package_city(pcity, &packet, &web_packet, routes, FALSE);
+  packet_broadcast_begin();
   players_iterate(pplayer) {
     if (can_player_see_city_internals(pplayer, pcity)) {
       if (!send_city_suppressed || pplayer != powner) {
@@ -2151,6 +2182,7 @@ static void broadcast_city_info(struct city *pcity)
       web_send_packet(city_info_addition, pconn, &web_packet, FALSE);
     }
   } conn_list_iterate_end;
+  packet_broadcast_end();
 
   traderoute_packet_list_iterate(routes, route_packet) {
     FC_FREE(route_packet);
@@ -2278,6 +2310,7 @@ void send_city_info_at_tile(struct player *pviewer, struct conn_list *dest,
       /* send all info to the owner */
       update_dumb_city(powner, pcity);
       package_city(pcity, &packet, &web_packet, routes, FALSE);
+      packet_broadcast_begin();
       lsend_packet_city_info(dest, &packet, FALSE);
       web_lsend_packet(city_info_addition, dest, &web_packet, FALSE);
       traderoute_packet_list_iterate(routes, route_packet) {
@@ -2294,6 +2327,7 @@ void send_city_info_at_tile(struct player *pviewer, struct conn_list *dest,
           }
         } conn_list_iterate_end;
       }
+      packet_broadcast_end();
     }
   } else {
     /* send info to non-owner */
@@ -3172,6 +3206,28 @@ void refresh_player_cities_vision(struct player *pplayer)
   } city_list_iterate_end;
 }
 
+/************************************************************************//**
+  Returns the squared city radius the effects give to the city.
+****************************************************************************/
+static int city_map_radius_sq_wanted(const struct city *pcity)
+{
+  int city_radius_sq = game.info.init_city_radius_sq
+                       + get_city_bonus(pcity, EFT_CITY_RADIUS_SQ);
+
+  /* check minimum / maximum allowed city radii */
+  return CLIP(CITY_MAP_MIN_RADIUS_SQ, city_radius_sq,
+              CITY_MAP_MAX_RADIUS_SQ);
+}
+
+/************************************************************************//**
+  Returns whether city_map_update_radius_sq() would change the radius.
+****************************************************************************/
+bool city_map_radius_sq_outdated(const struct city *pcity)
+{
+  return (city_map_tiles(city_map_radius_sq_get(pcity))
+          != city_map_tiles(city_map_radius_sq_wanted(pcity)));
+}
+
 /************************************************************************//**
   Updates the squared city radius. Returns if the radius is changed.
 ****************************************************************************/
@@ -3182,12 +3238,7 @@ bool city_map_update_radius_sq(struct city *pcity)
 
   int city_tiles_old, city_tiles_new;
   int city_radius_sq_old = city_map_radius_sq_get(pcity);
-  int city_radius_sq_new = game.info.init_city_radius_sq
-                           + get_city_bonus(pcity, EFT_CITY_RADIUS_SQ);
-
-  /* check minimum / maximum allowed city radii */
-  city_radius_sq_new = CLIP(CITY_MAP_MIN_RADIUS_SQ, city_radius_sq_new,
-                            CITY_MAP_MAX_RADIUS_SQ);
+  int city_radius_sq_new = city_map_radius_sq_wanted(pcity);
 
   if (city_radius_sq_new == city_radius_sq_old) {
     /* no change */
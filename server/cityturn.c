@@ -22,6 +22,7 @@
 
 /* utility */
 #include "fcintl.h"
+#include "fcthread.h"
 #include "log.h"
 #include "mem.h"
 #include "rand.h"
@@ -41,6 +42,7 @@
 #include "culture.h"
 #include "events.h"
 #include "disaster.h"
+#include "effects.h"
 #include "game.h"
 #include "government.h"
 #include "map.h"
@@ -83,6 +85,19 @@
 /* Queue for pending city_refresh() */
 static struct city_list *city_refresh_queue = NULL;
 
+/* Counts the changes of units and cities which may change the refresh of
+ * other cities, see city_refresh_inputs_changed(). */
+static unsigned int city_refresh_inputs_serial = 0;
+
+/* What the refresh of a city reads beyond the city itself, and which the
+ * update of the other cities may change, see update_city_activities(). */
+struct city_refresh_inputs {
+  unsigned int effects;         /* effect_value_cache_generation() */
+  unsigned int changes;         /* city_refresh_inputs_serial */
+  const struct government *government;
+  int tax, lux, sci;
+};
+
 /* The game is currently considering to remove the listed units because of
  * missing gold upkeep. A unit ends up here if it has gold upkeep that
  * can't be payed. A random unit in the list will be removed until the
@@ -138,7 +153,9 @@ static bool player_balance_treasury_units(struct player *pplayer);
 static bool disband_city(struct city *pcity);
 
 static void define_orig_production_values(struct city *pcity);
-static void update_city_activity(struct city *pcity);
+static void update_city_activity(struct city *pcity, bool is_happy,
+                                 bool is_celebrating,
+                                 const struct city_refresh_inputs *inputs);
 static void nullify_caravan_and_disband_plus(struct city *pcity);
 static bool city_illness_check(const struct city * pcity);
 
@@ -148,10 +165,10 @@ static bool do_city_migration(struct city *pcity_from,
 static bool check_city_migrations_player(const struct player *pplayer);
 
 /**********************************************************************//**
-  Updates unit upkeeps and city internal cached data. Returns whether
-  city radius has changed.
+  First part of city_refresh(), before city_refresh_from_main_map().
+  Returns whether city radius has changed.
 **************************************************************************/
-bool city_refresh(struct city *pcity)
+static bool city_refresh_begin(struct city *pcity)
 {
   bool retval;
 
@@ -159,17 +176,155 @@ bool city_refresh(struct city *pcity)
 
   retval = city_map_update_radius_sq(pcity);
   city_units_upkeep(pcity); /* update unit upkeep */
-  city_refresh_from_main_map(pcity, NULL);
+
+  return retval;
+}
+
+/**********************************************************************//**
+  Last part of city_refresh(), after city_refresh_from_main_map().
+**************************************************************************/
+static void city_refresh_end(struct city *pcity, bool radius_changed)
+{
   city_style_refresh(pcity);
 
-  if (retval) {
+  if (radius_changed) {
     /* Force a sync of the city after the change. */
     send_city_info(city_owner(pcity), pcity);
   }
+}
+
+/**********************************************************************//**
+  Updates unit upkeeps and city internal cached data. Returns whether
+  city radius has changed.
+**************************************************************************/
+bool city_refresh(struct city *pcity)
+{
+  bool retval;
+
+  retval = city_refresh_begin(pcity);
+  city_refresh_from_main_map(pcity, NULL);
+  city_refresh_end(pcity, retval);
+  pcity->server.refreshed_ahead = FALSE;
 
   return retval;
 }
 
+/**********************************************************************//**
+  Units were created, removed, moved or rehomed, or a city was removed:
+  the refresh of other cities than theirs may change. Cities refreshed
+  ahead by update_city_activities() are refreshed again on their turn.
+**************************************************************************/
+void city_refresh_inputs_changed(void)
+{
+  city_refresh_inputs_serial++;
+}
+
+/**********************************************************************//**
+  Fill 'inputs' with what the refresh of the cities of 'pplayer' reads
+  beyond the cities themselves.
+**************************************************************************/
+static void city_refresh_inputs_get(const struct player *pplayer,
+                                    struct city_refresh_inputs *inputs)
+{
+  inputs->effects = effect_value_cache_generation();
+  inputs->changes = city_refresh_inputs_serial;
+  inputs->government = government_of_player(pplayer);
+  inputs->tax = pplayer->economic.tax;
+  inputs->lux = pplayer->economic.luxury;
+  inputs->sci = pplayer->economic.science;
+}
+
+/**********************************************************************//**
+  Return whether the refresh inputs 'a' and 'b' are the same.
+**************************************************************************/
+static bool city_refresh_inputs_equal(const struct city_refresh_inputs *a,
+                                      const struct city_refresh_inputs *b)
+{
+  return (a->effects == b->effects
+          && a->changes == b->changes
+          && a->government == b->government
+          && a->tax == b->tax
+          && a->lux == b->lux
+          && a->sci == b->sci);
+}
+
+/**********************************************************************//**
+  Return whether the city can be refreshed by update_city_activities()
+  before the turn of the other cities, with the same result as if it was
+  refreshed on its own turn. Cities read their trade partners, whose
+  turn may come first, and a change of radius changes the tiles the
+  cities before it can work. Cities waiting in the refresh queue may
+  be refreshed when it is processed.
+**************************************************************************/
+static bool city_can_refresh_ahead(const struct city *pcity)
+{
+  return (0 == trade_route_list_size(pcity->routes)
+          && !pcity->server.needs_refresh
+          && !city_map_radius_sq_outdated(pcity));
+}
+
+/* Cities refreshed per thread at least, see city_refresh_cities(). */
+#define CITY_REFRESH_MIN_PER_THREAD 8
+
+struct city_refresh_tasks {
+  struct city **cities;
+  int *order;                   /* Indices to 'cities', by task. */
+  int *task_start;              /* Start of each task in 'order'. */
+};
+
+/**********************************************************************//**
+  Refresh the cities of one task of city_refresh_cities().
+**************************************************************************/
+static void city_refresh_task(int task, void *data)
+{
+  const struct city_refresh_tasks *tasks = data;
+  int i;
+
+  for (i = tasks->task_start[task]; i < tasks->task_start[task + 1];
+       i++) {
+    city_refresh_from_main_map(tasks->cities[tasks->order[i]], NULL);
+  }
+}
+
+/**********************************************************************//**
+  city_refresh() the 'n' cities of 'pplayer'. radius_changed[i] is set to
+  what city_refresh() returns for cities[i].
+
+  city_refresh_from_main_map() has no side effects, so it runs in up to
+  'citythreads' threads, between the other parts done in order. It only
+  changes the city itself but reads its trade partners, so the cities
+  linked by trade routes are one task, refreshed in their order in
+  'cities'. Thus the result does not depend on the number of threads.
+**************************************************************************/
+static void city_refresh_cities(struct player *pplayer,
+                                struct city **cities, int n,
+                                bool *radius_changed)
+{
+  int num_threads = MIN(game.server.city_threads,
+                        n / CITY_REFRESH_MIN_PER_THREAD);
+  int i;
+
+  for (i = 0; i < n; i++) {
+    radius_changed[i] = city_refresh_begin(cities[i]);
+  }
+
+  if (num_threads <= 1) {
+    for (i = 0; i < n; i++) {
+      city_refresh_from_main_map(cities[i], NULL);
+    }
+  } else {
+    int order[n], task_start[n + 1];
+    struct city_refresh_tasks tasks = { cities, order, task_start };
+    int num_tasks = city_trade_groups(cities, n, order, task_start);
+
+    fc_thread_run_tasks(num_tasks, num_threads, city_refresh_task, &tasks);
+  }
+
+  for (i = 0; i < n; i++) {
+    city_refresh_end(cities[i], radius_changed[i]);
+  }
+}
+
 /**********************************************************************//**
   Called on government change or wonder completion or stuff like that
   -- Syela
@@ -301,6 +456,86 @@ void apply_cmresult_to_city(struct city *pcity,
   } specialist_type_iterate_end;
 }
 
+/**********************************************************************//**
+  Set the city governor parameter auto_arrange_workers() tries first.
+**************************************************************************/
+static void auto_arrange_workers_parameter(struct city *pcity,
+                                           struct cm_parameter *cmp)
+{
+  cm_init_parameter(cmp);
+  cmp->require_happy = FALSE;
+  cmp->allow_disorder = FALSE;
+  cmp->allow_specialists = TRUE;
+
+  /* We used to look at pplayer->ai.xxx_priority to determine the values
+   * to be used here.  However that doesn't work at all because those values
+   * are on a different scale.  Later the ai may wish to adjust its
+   * priorities - this should be done via a separate set of variables. */
+  if (city_size_get(pcity) > 1) {
+    if (city_size_get(pcity) <= game.info.notradesize) {
+      cmp->factor[O_FOOD] = 15;
+    } else {
+      if (city_granary_size(city_size_get(pcity)) == pcity->food_stock) {
+        /* We don't need more food if the granary is full. */
+        cmp->factor[O_FOOD] = 0;
+      } else {
+        cmp->factor[O_FOOD] = 10;
+      }
+    }
+  } else {
+    /* Growing to size 2 is the highest priority. */
+    cmp->factor[O_FOOD] = 20;
+  }
+  cmp->factor[O_SHIELD] = 5;
+  cmp->factor[O_TRADE] = 0; /* Trade only provides gold/science. */
+  cmp->factor[O_GOLD] = 2;
+  cmp->factor[O_LUXURY] = 0; /* Luxury only influences happiness. */
+  cmp->factor[O_SCIENCE] = 2;
+  cmp->happy_factor = 0;
+
+  if (city_granary_size(city_size_get(pcity)) == pcity->food_stock) {
+    cmp->minimal_surplus[O_FOOD] = 0;
+  } else {
+    cmp->minimal_surplus[O_FOOD] = 1;
+  }
+  cmp->minimal_surplus[O_SHIELD] = 1;
+  cmp->minimal_surplus[O_TRADE] = 0;
+  cmp->minimal_surplus[O_GOLD] = -FC_INFINITY;
+  cmp->minimal_surplus[O_LUXURY] = 0;
+  cmp->minimal_surplus[O_SCIENCE] = 0;
+}
+
+/**********************************************************************//**
+  Solve the arrangements of the 'n' frozen cities in up to 'citythreads'
+  threads, before they are thawed. The city governor remembers the
+  results, so the auto_arrange_workers() calls of the thaw, still in
+  order, only apply them.
+**************************************************************************/
+void auto_arrange_workers_prepare(struct city **cities, int n)
+{
+  struct cm_parameter *cmp = fc_calloc(n, sizeof(*cmp));
+  struct cm_result **cmr = fc_calloc(n, sizeof(*cmr));
+  int i;
+
+  for (i = 0; i < n; i++) {
+    fc_assert(0 < cities[i]->server.workers_frozen);
+
+    /* The same steps as auto_arrange_workers(). */
+    city_map_update_all(cities[i]);
+    city_refresh(cities[i]);
+    auto_arrange_workers_parameter(cities[i], &cmp[i]);
+    cmr[i] = cm_result_new(cities[i]);
+  }
+
+  cm_query_results(cities, cmp, cmr, n, FALSE, game.server.city_threads);
+
+  for (i = 0; i < n; i++) {
+    cm_result_destroy(cmr[i]);
+  }
+  free(cmr);
+  free(cmp);
+}
+
 /**********************************************************************//**
   Call sync_cities() to send the affected cities to the clients.
 **************************************************************************/
@@ -332,49 +567,8 @@ void auto_arrange_workers(struct city *pcity)
   city_refresh(pcity);
 
   sanity_check_city(pcity);
-  cm_clear_cache(pcity);
 
-  cm_init_parameter(&cmp);
-  cmp.require_happy = FALSE;
-  cmp.allow_disorder = FALSE;
-  cmp.allow_specialists = TRUE;
-
-  /* We used to look at pplayer->ai.xxx_priority to determine the values
-   * to be used here.  However that doesn't work at all because those values
-   * are on a different scale.  Later the ai may wish to adjust its
-   * priorities - this should be done via a separate set of variables. */
-  if (city_size_get(pcity) > 1) {
-    if (city_size_get(pcity) <= game.info.notradesize) {
-      cmp.factor[O_FOOD] = 15;
-    } else {
-      if (city_granary_size(city_size_get(pcity)) == pcity->food_stock) {
-        /* We don't need more food if the granary is full. */
-        cmp.factor[O_FOOD] = 0;
-      } else {
-        cmp.factor[O_FOOD] = 10;
-      }
-    }
-  } else {
-    /* Growing to size 2 is the highest priority. */
-    cmp.factor[O_FOOD] = 20;
-  }
-  cmp.factor[O_SHIELD] = 5;
-  cmp.factor[O_TRADE] = 0; /* Trade only provides gold/science. */
-  cmp.factor[O_GOLD] = 2;
-  cmp.factor[O_LUXURY] = 0; /* Luxury only influences happiness. */
-  cmp.factor[O_SCIENCE] = 2;
-  cmp.happy_factor = 0;
-
-  if (city_granary_size(city_size_get(pcity)) == pcity->food_stock) {
-    cmp.minimal_surplus[O_FOOD] = 0;
-  } else {
-    cmp.minimal_surplus[O_FOOD] = 1;
-  }
-  cmp.minimal_surplus[O_SHIELD] = 1;
-  cmp.minimal_surplus[O_TRADE] = 0;
-  cmp.minimal_surplus[O_GOLD] = -FC_INFINITY;
-  cmp.minimal_surplus[O_LUXURY] = 0;
-  cmp.minimal_surplus[O_SCIENCE] = 0;
+  auto_arrange_workers_parameter(pcity, &cmp);
 
   /* This must be after city_refresh() so that the result gets created for the right
    * city radius */
@@ -555,8 +749,11 @@ void update_city_activities(struct player *pplayer)
   pplayer->server.bulbs_last_turn = 0;
 
   if (n > 0) {
-    struct city *cities[n];
-    int i = 0, r;
+    struct city *cities[n], *ahead[n];
+    bool is_happy[n], is_celebrating[n], radius_changed[n];
+    struct city_refresh_inputs inputs;
+    bool refresh_ahead;
+    int i = 0, r, num_ahead = 0;
 
     city_list_iterate(pplayer->cities, pcity) {
 
@@ -607,13 +804,37 @@ void update_city_activities(struct player *pplayer)
      *                     the treasury is not balance units and buildings
      *                     are sold. */
 
-    /* Iterate over cities in a random order. */
+    /* Refresh the cities which allow it first, in threads, then update
+     * all the cities in a random order. The cities refreshed ahead are
+     * refreshed again on their turn if the update of the cities before
+     * them changed what the refresh reads, see update_city_activity().
+     * The culture of the player sums up all its cities, so no city is
+     * refreshed ahead if the effects depend on it. */
+    refresh_ahead = !effect_values_depend_on(VUT_MINCULTURE);
+    for (r = 0; r < n; r++) {
+      is_happy[r] = city_happy(cities[r]);
+      is_celebrating[r] = city_celebrating(cities[r]);
+      if (refresh_ahead && city_can_refresh_ahead(cities[r])) {
+        ahead[num_ahead++] = cities[r];
+      }
+    }
+    city_refresh_cities(pplayer, ahead, num_ahead, radius_changed);
+    for (r = 0; r < num_ahead; r++) {
+      fc_assert(!radius_changed[r]);
+      ahead[r]->server.refreshed_ahead = TRUE;
+    }
+    city_refresh_inputs_get(pplayer, &inputs);
+
     while (i > 0) {
       r = fc_rand(i);
       /* update unit upkeep */
       city_units_upkeep(cities[r]);
-      update_city_activity(cities[r]);
-      cities[r] = cities[--i];
+      update_city_activity(cities[r], is_happy[r], is_celebrating[r],
+                           &inputs);
+      i--;
+      cities[r] = cities[i];
+      is_happy[r] = is_happy[i];
+      is_celebrating[r] = is_celebrating[i];
     }
 
     if (pplayer->economic.gold < 0) {
@@ -3011,14 +3232,17 @@ void nullify_prechange_production(struct city *pcity)
 }
 
 /**********************************************************************//**
-  Called every turn, at end of turn, for every city.
+  Called every turn, at end of turn, for every city. If the city was
+  refreshed ahead by update_city_activities(), 'is_happy' and
+  'is_celebrating' tell its state before that, and 'inputs' what the
+  refresh read.
 **************************************************************************/
-static void update_city_activity(struct city *pcity)
+static void update_city_activity(struct city *pcity, bool is_happy,
+                                 bool is_celebrating,
+                                 const struct city_refresh_inputs *inputs)
 {
   struct player *pplayer;
   struct government *gov;
-  bool is_happy;
-  bool is_celebrating;
 
   if (!pcity) {
     return;
@@ -3026,11 +3250,28 @@ static void update_city_activity(struct city *pcity)
 
   pplayer = city_owner(pcity);
   gov = government_of_city(pcity);
-  is_happy = city_happy(pcity);
-  is_celebrating = city_celebrating(pcity);
 
-  if (city_refresh(pcity)) {
-    auto_arrange_workers(pcity);
+  if (pcity->server.refreshed_ahead) {
+    struct city_refresh_inputs now;
+
+    city_refresh_inputs_get(pplayer, &now);
+    if (!city_refresh_inputs_equal(&now, inputs)
+        || pcity->server.needs_refresh) {
+      /* The cities updated before changed what the refresh reads. Its
+       * radius did not change ahead, see city_can_refresh_ahead(). */
+      if (city_refresh(pcity)) {
+        auto_arrange_workers(pcity);
+      }
+    }
+    pcity->server.refreshed_ahead = FALSE;
+  } else {
+    /* Not refreshed ahead, or refreshed again since. */
+    is_happy = city_happy(pcity);
+    is_celebrating = city_celebrating(pcity);
+
+    if (city_refresh(pcity)) {
+      auto_arrange_workers(pcity);
+    }
   }
 
   /* Reporting of celebrations rewritten, copying the treatment of disorder below,
@@ -26,8 +26,10 @@ void city_refresh_for_player(struct player *pplayer); /* tax/govt changed */
 
 void city_refresh_queue_add(struct city *pcity);
 void city_refresh_queue_processing(void);
+void city_refresh_inputs_changed(void);
 
 void auto_arrange_workers(struct city *pcity); /* will arrange the workers */
+void auto_arrange_workers_prepare(struct city **cities, int n);
 void apply_cmresult_to_city(struct city *pcity, const struct cm_result *cmr);
 
 bool city_change_size(struct city *pcity, citizens new_size,
@@ -51,6 +51,7 @@
 #include "capstr.h"
 #include "fc_cmdhelp.h"
 #include "game.h"
+#include "packets.h"
 #include "version.h"
 
 /* server */
@@ -139,6 +140,7 @@ int main(int argc, char *argv[])
   bool showhelp = FALSE;
   bool showvers = FALSE;
   char *option = NULL;
+  char *schema_filename = NULL;
 
   /* Load win32 post-crash debugger */
 #ifdef FREECIV_MSWINDOWS
@@ -295,6 +297,8 @@ int main(int argc, char *argv[])
       srvarg.scenarios_pathname = option;
     } else if ((option = get_option_malloc("--ruleset", argv, &inx, argc, TRUE))) {
       srvarg.ruleset = option;
+    } else if ((option = get_option_malloc("--Packetschema", argv, &inx, argc, TRUE))) {
+      schema_filename = option;
     } else if (is_option("--version", argv[inx])) {
       showvers = TRUE;
     } else if ((option = get_option_malloc("--Announce", argv, &inx, argc, FALSE))) {
@@ -415,6 +419,11 @@ int main(int argc, char *argv[])
                 /* TRANS: "port" is exactly what user must type, do not translate. */
                 _("port PORT"),
                 _("Listen for clients on port PORT"));
+    cmdhelp_add(help, "P",
+                /* TRANS: "Packetschema" is exactly what user must type, do not translate. */
+                _("Packetschema FILE"),
+                _("Write the schema of the tagged packet encoding to FILE "
+                  "and exit"));
     cmdhelp_add(help, "q",
                 /* TRANS: "quitidle" is exactly what user must type, do not translate. */
                 _("quitidle TIME"),
@@ -478,6 +487,13 @@ int main(int argc, char *argv[])
 
   init_our_capability();
 
+  if (schema_filename != NULL) {
+    bool saved = packet_schema_save(schema_filename);
+
+    free(schema_filename);
+    exit(saved ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
   /* have arguments, call the main server loop... */
   srv_main();
 
@@ -684,6 +684,24 @@ static struct command commands[] = {
    NULL, mapimg_help,
    CMD_ECHO_ADMINS, VCF_NONE, 50
   },
+  {"packetstats", ALLOW_ADMIN,
+   /* TRANS: translate text between <> only */
+   N_("packetstats show [<connection-name>]\n"
+      "packetstats csv <file-name>\n"
+      "packetstats reset"),
+   N_("Show statistics about the packets sent by the server."),
+   N_("The server counts, for each packet type and connection, the packets "
+      "sent, the packets not sent because they were unchanged, the bytes "
+      "sent, the bytes saved by the delta protocol (estimated), the bytes "
+      "sent through the compression queue and the time spent encoding the "
+      "packets.\n"
+      "'packetstats show' lists the packet types with the most bytes sent "
+      "to all connections since the server start, or to the given "
+      "connection.\n"
+      "'packetstats csv' writes all the counters to a file in CSV format.\n"
+      "'packetstats reset' resets all the counters."), NULL,
+   CMD_ECHO_ADMINS, VCF_NONE, 0
+  },
   {"rfcstyle",	ALLOW_HACK,
    /* no translatable parameters */
    SYN_ORIG_("rfcstyle"),
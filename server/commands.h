@@ -95,6 +95,7 @@ enum command_id {
   CMD_AICMD,
   CMD_FCDB,
   CMD_MAPIMG,
+  CMD_PACKETSTATS,
 
   /* undocumented */
   CMD_RFCSTYLE,
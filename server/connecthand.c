@@ -136,6 +136,10 @@ void establish_new_connection(struct connection *pconn)
   /* send join_reply packet */
   packet.you_can_join = TRUE;
   sz_strlcpy(packet.capability, our_capability);
+  if (has_capability(PACKET_TAGGED_CAPABILITY, pconn->capability)) {
+    /* Confirm that the next packets will be in the tagged encoding. */
+    sz_strlcat(packet.capability, " " PACKET_TAGGED_CAPABILITY);
+  }
   fc_snprintf(packet.message, sizeof(packet.message), _("%s Welcome"),
               pconn->username);
   sz_strlcpy(packet.challenge_file, new_challenge_filename(pconn));
@@ -358,6 +362,7 @@ bool handle_login_request(struct connection *pconn,
   log_verbose("Client caps: %s", req->capability);
   log_verbose("Server caps: %s", our_capability);
   conn_set_capability(pconn, req->capability);
+  conn_compression_set_method(pconn, game.server.netcompress);
 
   /* Make sure the server has every capability the client needs */
   if (!has_capabilities(our_capability, req->capability)) {
@@ -35,6 +35,9 @@
 #include "research.h"
 #include "unit.h"
 
+/* common/aicore */
+#include "path_finding.h"
+
 /* common/scriptcore */
 #include "luascript_types.h"
 
@@ -410,6 +413,9 @@ void handle_diplomacy_accept_treaty_req(struct player *pplayer,
     call_treaty_accepted(pplayer, pother, ptreaty);
     call_treaty_accepted(pother, pplayer, ptreaty);
 
+    /* The clauses may change where the units can go. */
+    pf_map_cache_clear();
+
     clause_list_iterate(ptreaty->clauses, pclause) {
       struct player *pgiver = pclause->from;
       struct player *pdest = (pplayer == pgiver) ? pother : pplayer;
@@ -39,6 +39,11 @@
 #include "unitlist.h"
 #include "vision.h"
 
+/* common/aicore */
+#include "path_finding.h"
+#include "pf_cluster.h"
+#include "pf_costgrid.h"
+
 /* server */
 #include "citytools.h"
 #include "cityturn.h"
@@ -495,6 +500,7 @@ void send_tile_info(struct conn_list *dest, struct tile *ptile,
     info.spec_sprite[0] = '\0';
   }
 
+  packet_broadcast_begin();
   conn_list_iterate(dest, pconn) {
     struct player *pplayer = pconn->playing;
 
@@ -585,6 +591,7 @@ void send_tile_info(struct conn_list *dest, struct tile *ptile,
     }
   }
   conn_list_iterate_end;
+  packet_broadcast_end();
 }
 
 /**********************************************************************//**
@@ -1365,6 +1372,11 @@ void update_tile_knowledge(struct tile *ptile)
     return;
   }
 
+  /* The paths through the tile may have changed. */
+  pf_cluster_tile_changed(ptile);
+  pf_costgrid_tile_changed(ptile);
+  pf_map_cache_clear();
+
   /* Players */
   players_iterate(pplayer) {
     if (map_is_known_and_seen(ptile, pplayer, V_MAIN)) {
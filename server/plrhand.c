@@ -41,6 +41,9 @@
 #include "tech.h"
 #include "unitlist.h"
 
+/* common/aicore */
+#include "path_finding.h"
+
 /* common/scriptcore */
 #include "luascript_types.h"
 
@@ -748,6 +751,7 @@ void handle_diplomacy_cancel_pact(struct player *pplayer,
   reject_all_treaties(pplayer);
   reject_all_treaties(pplayer2);
   /* else, breaking a treaty */
+  pf_map_cache_clear();
 
   /* check what the new status will be */
   new_type = cancel_pact_result(old_type);
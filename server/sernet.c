@@ -65,6 +65,7 @@
 #include "log.h"
 #include "mem.h"
 #include "netintf.h"
+#include "netpoll.h"
 #include "shared.h"
 #include "support.h"
 #include "timing.h"
@@ -98,10 +99,34 @@ TEndpointInfo serv_info;
 EndpointRef serv_ep;
 #else
 static int *listen_socks;
+static struct netpoll_source **listen_sources;
 static int listen_count;
 static int socklan;
 #endif
 
+/* Readiness of listen sockets, client connections and stdin. */
+static struct netpoll *server_poll = NULL;
+static struct netpoll_source *conn_sources[MAX_NUM_CONNECTIONS];
+static struct netpoll_source *stdin_source = NULL;
+
+/* Client connections are edge-triggered: we must read until the socket
+ * would block. Interest in writing is added only while there is
+ * something to send. */
+#define CONN_POLL_EVENTS (NETPOLL_READ | NETPOLL_EXCEPT | NETPOLL_EDGE)
+
+/* Number of events handled per wakeup; the rest are handled on the next
+ * round. */
+#define POLL_EVENTS_MAX 64
+
+#ifdef NONBLOCKING_SOCKETS
+/* Reads from a single connection per wakeup, before we let the others
+ * have their turn. */
+#define MAX_READS_PER_WAKEUP 8
+#else  /* NONBLOCKING_SOCKETS */
+/* Blocking sockets can only be read once per readiness report. */
+#define MAX_READS_PER_WAKEUP 1
+#endif /* NONBLOCKING_SOCKETS */
+
 #if defined(__VMS)
 #  if defined(_VAX_)
 #    define lib$stop LIB$STOP
@@ -220,6 +245,11 @@ static void close_connection(struct connection *pconn)
   pconn->playing = NULL;
   pconn->client_gui = GUI_STUB;
   pconn->access_level = ALLOW_NONE;
+
+  netpoll_remove(server_poll, conn_sources[pconn - connections]);
+  conn_sources[pconn - connections] = NULL;
+  pconn->notify_of_writable_data = NULL;
+
   connection_common_close(pconn);
 
   send_updated_vote_totals(NULL);
@@ -248,9 +278,15 @@ void close_connections_and_socket(void)
   conn_list_destroy(game.est_connections);
 
   for (i = 0; i < listen_count; i++) {
+    netpoll_remove(server_poll, listen_sources[i]);
     fc_closesocket(listen_socks[i]);
   }
   FC_FREE(listen_socks);
+  FC_FREE(listen_sources);
+
+  netpoll_destroy(server_poll);
+  server_poll = NULL;
+  stdin_source = NULL;
 
   if (srvarg.announce != ANNOUNCE_NONE) {
     fc_closesocket(socklan);
@@ -346,70 +382,199 @@ static void cut_lagging_connection(struct connection *pconn)
 }
 
 /*************************************************************************//**
-  Attempt to flush all information in the send buffers for upto 'netwait'
-  seconds.
+  Called by the network code whenever the send buffer of the connection
+  got flushed, telling whether there is still data waiting. We want to
+  hear about the socket becoming writable only while that is the case.
 *****************************************************************************/
-void flush_packets(void)
+static void server_conn_writable_notify(struct connection *pconn,
+                                        bool data_available)
+{
+  netpoll_modify(server_poll, conn_sources[pconn - connections],
+                 CONN_POLL_EVENTS | (data_available ? NETPOLL_WRITE : 0));
+}
+
+/*************************************************************************//**
+  Return the send queue high-water mark from 'netsendqueue', in bytes.
+*****************************************************************************/
+static int send_queue_hwm(void)
+{
+  return game.server.netsendqueue * 1024;
+}
+
+/*************************************************************************//**
+  Set the maximum size of the send queue of the connection.
+*****************************************************************************/
+static void conn_set_send_queue_limit(struct connection *pconn)
+{
+  pconn->send_buffer->limit = MAX(MAX_LEN_BUFFER, 2 * send_queue_hwm());
+}
+
+/*************************************************************************//**
+  Apply a changed 'netsendqueue' setting to all connections.
+*****************************************************************************/
+void update_send_queue_limits(void)
 {
   int i;
-  int max_desc;
-  fd_set writefs, exceptfs;
-  fc_timeval tv;
-  time_t start;
 
-  (void) time(&start);
+  for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {
+    if (connections[i].used && NULL != connections[i].send_buffer) {
+      conn_set_send_queue_limit(connections + i);
+    }
+  }
+}
 
-  for (;;) {
-    tv.tv_sec = (game.server.netwait - (time(NULL) - start));
-    tv.tv_usec = 0;
+/*************************************************************************//**
+  The send queue of the connection is above the high-water mark. Apply
+  'netlagpolicy' to it. Returns whether we should wait for the connection
+  to catch up.
+*****************************************************************************/
+static bool handle_send_backlog(struct connection *pconn)
+{
+  if (!pconn->server.send_backlogged) {
+    pconn->server.send_backlogged = TRUE;
+    pconn->server.send_backlogs++;
+    log_verbose("connection (%s) lagging, %d bytes waiting",
+                conn_description(pconn), pconn->send_buffer->ndata);
+  }
 
-    if (tv.tv_sec < 0) {
-      return;
+  /* Like in cut_lagging_connection(), never cut HACK connections, nor
+   * the only connection. */
+  if (pconn->access_level == ALLOW_HACK
+      || conn_list_size(game.all_connections) <= 1) {
+    return TRUE;
+  }
+
+  switch (game.server.netlagpolicy) {
+  case NLP_WAIT:
+    return TRUE;
+  case NLP_DROP_OBSERVERS:
+    if (conn_controls_player(pconn)) {
+      return TRUE;
     }
+    break;
+  case NLP_CUT:
+    break;
+  }
 
-    FC_FD_ZERO(&writefs);
-    FC_FD_ZERO(&exceptfs);
-    max_desc = -1;
+  log_verbose("connection (%s) cut due to send backlog",
+              conn_description(pconn));
+  connection_close_server(pconn, _("lagging connection"));
 
-    for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {
-      struct connection *pconn = &connections[i];
+  return FALSE;
+}
 
-      if (pconn->used
-          && !pconn->server.is_closing
-          && 0 < pconn->send_buffer->ndata) {
-        FD_SET(pconn->sock, &writefs);
-        FD_SET(pconn->sock, &exceptfs);
-        max_desc = MAX(pconn->sock, max_desc);
+/*************************************************************************//**
+  Check connections that have data waiting in their send buffer. If the
+  event loop does not know about them yet (data was buffered), try to
+  flush them, which also registers interest in writing. Otherwise, if
+  'cut_lagging' is set, those not marked in 'flushed' (which can be NULL)
+  are cut if they have been lagging for too long. Connections above the
+  send queue high-water mark are handled according to 'netlagpolicy'.
+  Returns whether we should wait for any connection to catch up.
+*****************************************************************************/
+static bool check_pending_output(bool cut_lagging, const bool *flushed)
+{
+  int hwm = send_queue_hwm();
+  bool wait = FALSE;
+
+  conn_list_iterate(game.all_connections, pconn) {
+    struct netpoll_source *src = conn_sources[pconn - connections];
+
+    if (pconn->server.is_closing) {
+      continue;
+    }
+
+    if (0 == pconn->send_buffer->ndata) {
+      pconn->server.send_backlogged = FALSE;
+      continue;
+    }
+
+    if (NULL != src
+        && !(netpoll_source_events(src) & NETPOLL_WRITE)) {
+      flush_connection_send_buffer_all(pconn);
+    } else if (cut_lagging
+               && (NULL == flushed || !flushed[pconn - connections])) {
+      cut_lagging_connection(pconn);
+    }
+
+    if (pconn->server.is_closing) {
+      continue;
+    }
+
+    if (pconn->send_buffer->ndata > hwm) {
+      if (handle_send_backlog(pconn)) {
+        wait = TRUE;
       }
+    } else {
+      pconn->server.send_backlogged = FALSE;
     }
+  } conn_list_iterate_end;
+
+  return wait;
+}
 
-    if (max_desc == -1) {
+/*************************************************************************//**
+  Push out the data waiting in the send buffers, as far as it is possible
+  without blocking. The rest is sent in the background by the main loop.
+  Only for connections that fell behind by more than 'netsendqueue', and
+  that 'netlagpolicy' tells to wait for, we wait up to 'netwait' seconds.
+*****************************************************************************/
+void flush_packets(void)
+{
+  struct netpoll_event events[POLL_EVENTS_MAX];
+  bool flushed[MAX_NUM_CONNECTIONS];
+  time_t start;
+  int i, n, timeout;
+
+  if (NULL == server_poll) {
+    return;
+  }
+
+  (void) time(&start);
+
+  for (;;) {
+    if (!check_pending_output(FALSE, NULL)) {
       return;
     }
 
-    if (fc_select(max_desc + 1, NULL, &writefs, &exceptfs, &tv) <= 0) {
+    timeout = game.server.netwait - (time(NULL) - start);
+
+    if (timeout <= 0) {
       return;
     }
 
-    for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {   /* check for freaky players */
-      struct connection *pconn = &connections[i];
-
-      if (pconn->used && !pconn->server.is_closing) {
-        if (FD_ISSET(pconn->sock, &exceptfs)) {
-          log_verbose("connection (%s) cut due to exception data",
-                      conn_description(pconn));
-          connection_close_server(pconn, _("network exception"));
-        } else {
-          if (pconn->send_buffer && pconn->send_buffer->ndata > 0) {
-            if (FD_ISSET(pconn->sock, &writefs)) {
-              flush_connection_send_buffer_all(pconn);
-            } else {
-              cut_lagging_connection(pconn);
-            }
-          }
-        }
+    /* Only ask for writability; any input readiness is kept for
+     * server_sniff_all_input(). */
+    n = netpoll_wait(server_poll, NETPOLL_WRITE | NETPOLL_EXCEPT,
+                     events, ARRAY_SIZE(events), timeout * 1000);
+    if (n <= 0) {
+      /* Nobody caught up in time. */
+      (void) check_pending_output(TRUE, NULL);
+      return;
+    }
+
+    memset(flushed, 0, sizeof(flushed));
+    for (i = 0; i < n; i++) {   /* check for freaky players */
+      struct connection *pconn = events[i].data;
+
+      if (NULL == pconn || !pconn->used || pconn->server.is_closing) {
+        /* Listen socket, or connection already going away. */
+        continue;
+      }
+
+      if (events[i].events & NETPOLL_EXCEPT) {
+        log_verbose("connection (%s) cut due to exception data",
+                    conn_description(pconn));
+        connection_close_server(pconn, _("network exception"));
+      } else if (events[i].events & NETPOLL_WRITE) {
+        flush_connection_send_buffer_all(pconn);
+        flushed[pconn - connections] = TRUE;
       }
     }
+
+    if (!check_pending_output(TRUE, flushed)) {
+      return;
+    }
   }
 }
 
@@ -482,6 +647,75 @@ static void incoming_client_packets(struct connection *pconn)
 #endif /* PROCESSING_TIME_STATISTICS */
 }
 
+/*************************************************************************//**
+  Read and handle input on a client connection which was reported
+  readable. The readiness is edge-triggered, so we read until the socket
+  would block; a connection flooding us is put back in the queue after a
+  few rounds, so that the others get their turn.
+*****************************************************************************/
+static void server_read_connection(struct connection *pconn,
+                                   struct netpoll_source *src)
+{
+  int reads;
+
+  for (reads = 0; reads < MAX_READS_PER_WAKEUP; reads++) {
+    int nb = read_socket_data(pconn->sock, pconn->buffer);
+
+    if (0 < nb) {
+      /* We read packets; now handle them. */
+      incoming_client_packets(pconn);
+      if (pconn->server.is_closing) {
+        return;
+      }
+    } else if (0 == nb) {
+      /* Would block; drained. */
+      return;
+    } else if (-2 == nb) {
+      connection_close_server(pconn, _("client disconnected"));
+      return;
+    } else {
+      /* Read failure; the connection is closed. */
+      connection_close_server(pconn, _("read error"));
+      return;
+    }
+  }
+
+#ifdef NONBLOCKING_SOCKETS
+  netpoll_requeue(server_poll, src, NETPOLL_READ);
+#endif
+}
+
+/*************************************************************************//**
+  Accept the connections waiting on a listen socket. Like client
+  connections, listen sockets are edge-triggered.
+*****************************************************************************/
+static void server_accept_connections(struct netpoll_source *src)
+{
+  int accepted;
+
+  for (accepted = 0; accepted < MAX_READS_PER_WAKEUP; accepted++) {
+    int result = server_accept_connection(netpoll_source_fd(src));
+
+    if (-2 == result) {
+      /* Nothing (more) to accept. */
+      return;
+    }
+
+    log_verbose("got new connection");
+    if (-1 == result) {
+      /* There will be a log_error() message from
+       * server_accept_connection() if something
+       * goes wrong, so no need to make another
+       * error-level message here. */
+      log_verbose("failed accepting connection");
+    }
+  }
+
+#ifdef NONBLOCKING_SOCKETS
+  netpoll_requeue(server_poll, src, NETPOLL_READ);
+#endif
+}
+
 /*************************************************************************//**
   Get and handle:
   - new connections,
@@ -493,11 +727,10 @@ static void incoming_client_packets(struct connection *pconn)
 *****************************************************************************/
 enum server_events server_sniff_all_input(void)
 {
-  int i, s;
-  int max_desc;
-  bool excepting;
-  fd_set readfs, writefs, exceptfs;
-  fc_timeval tv;
+  int i, nevents;
+  bool stdin_ready;
+  struct netpoll_event events[POLL_EVENTS_MAX];
+  static time_t last_output_check = 0;
 #ifdef FREECIV_SOCKET_ZERO_NOT_STDIN
   char *bufptr;
 #endif
@@ -656,45 +889,36 @@ enum server_events server_sniff_all_input(void)
       return S_E_END_OF_TURN_TIMEOUT;
     }
 
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-
-    FC_FD_ZERO(&readfs);
-    FC_FD_ZERO(&writefs);
-    FC_FD_ZERO(&exceptfs);
-
+#ifndef FREECIV_SOCKET_ZERO_NOT_STDIN
+#if !defined(__VMS)
+    if (!no_input && NULL == stdin_source) {
+      /* Level-triggered: readline consumes the input char by char. */
+      stdin_source = netpoll_add(server_poll, 0, NETPOLL_READ, NULL);
+    } else if (no_input && NULL != stdin_source) {
+      netpoll_remove(server_poll, stdin_source);
+      stdin_source = NULL;
+    }
+#endif /* VMS */
+#else  /* FREECIV_SOCKET_ZERO_NOT_STDIN */
     if (!no_input) {
-#ifdef FREECIV_SOCKET_ZERO_NOT_STDIN
       fc_init_console();
-#else /* FREECIV_SOCKET_ZERO_NOT_STDIN */
-#   if !defined(__VMS)
-      FD_SET(0, &readfs);
-#   endif /* VMS */
-#endif /* FREECIV_SOCKET_ZERO_NOT_STDIN */
     }
+#endif /* FREECIV_SOCKET_ZERO_NOT_STDIN */
 
-    max_desc = 0;
-    for (i = 0; i < listen_count; i++) {
-      FD_SET(listen_socks[i], &readfs);
-      FD_SET(listen_socks[i], &exceptfs);
-      max_desc = MAX(max_desc, listen_socks[i]);
+    /* Catch connections that have been waiting to write for too long,
+     * and buffered data nobody has flushed yet. */
+    if (time(NULL) != last_output_check) {
+      (void) check_pending_output(TRUE, NULL);
+      last_output_check = time(NULL);
     }
 
-    for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {
-      struct connection *pconn = connections + i;
-
-      if (pconn->used && !pconn->server.is_closing) {
-        FD_SET(pconn->sock, &readfs);
-        if (0 < pconn->send_buffer->ndata) {
-          FD_SET(pconn->sock, &writefs);
-        }
-        FD_SET(pconn->sock, &exceptfs);
-        max_desc = MAX(pconn->sock, max_desc);
-      }
-    }
     con_prompt_off();		/* output doesn't generate a new prompt */
 
-    if (fc_select(max_desc + 1, &readfs, &writefs, &exceptfs, &tv) == 0) {
+    stdin_ready = FALSE;
+    nevents = netpoll_wait(server_poll, NETPOLL_ALL,
+                           events, ARRAY_SIZE(events), 1000);
+
+    if (nevents == 0) {
       /* timeout */
       call_ai_refresh();
       script_server_signal_emit("pulse");
@@ -736,7 +960,7 @@ enum server_events server_sniff_all_input(void)
 	    lib$stop(status);
 	  }
 	  if (ttchar.numchars) {
-	    FD_SET(0, &readfs);
+	    stdin_ready = TRUE;
 	  } else {
 	    continue;
 	  }
@@ -748,38 +972,31 @@ enum server_events server_sniff_all_input(void)
 #endif /* FREECIV_SOCKET_ZERO_NOT_STDIN */
 #endif /* !__VMS */
       }
+    } else if (nevents < 0) {
+      nevents = 0;
     }
 
-    excepting = FALSE;
-    for (i = 0; i < listen_count; i++) {
-      if (FD_ISSET(listen_socks[i], &exceptfs)) {
-        excepting = TRUE;
-        break;
-      }
-    }
-    if (excepting) {                  /* handle Ctrl-Z suspend/resume */
-      continue;
-    }
-    for (i = 0; i < listen_count; i++) {
-      s = listen_socks[i];
-      if (FD_ISSET(s, &readfs)) {     /* new players connects */
-        log_verbose("got new connection");
-        if (-1 == server_accept_connection(s)) {
-          /* There will be a log_error() message from
-           * server_accept_connection() if something
-           * goes wrong, so no need to make another
-           * error-level message here. */
-          log_verbose("failed accepting connection");
+    for (i = 0; i < nevents; i++) {
+      if (events[i].source == stdin_source) {
+        stdin_ready = TRUE;
+      } else if (NULL == events[i].data) {
+        /* Listen socket. Exceptions here are caused by Ctrl-Z
+         * suspend/resume; nothing to do about them. */
+        if (events[i].events & NETPOLL_READ) {
+          server_accept_connections(events[i].source);
         }
       }
     }
-    for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {
+
+    for (i = 0; i < nevents; i++) {
       /* check for freaky players */
-      struct connection *pconn = &connections[i];
+      struct connection *pconn = events[i].data;
 
-      if (pconn->used
+      if (NULL != pconn
+          && events[i].source != stdin_source
+          && pconn->used
           && !pconn->server.is_closing
-          && FD_ISSET(pconn->sock, &exceptfs)) {
+          && (events[i].events & NETPOLL_EXCEPT)) {
         log_verbose("connection (%s) cut due to exception data",
                     conn_description(pconn));
         connection_close_server(pconn, _("network exception"));
@@ -794,14 +1011,13 @@ enum server_events server_sniff_all_input(void)
       free(bufptr_internal);
     }
 #else  /* !FREECIV_SOCKET_ZERO_NOT_STDIN */
-    if (!no_input && FD_ISSET(0, &readfs)) {    /* input from server operator */
+    if (!no_input && stdin_ready) {    /* input from server operator */
 #ifdef FREECIV_HAVE_LIBREADLINE
       rl_callback_read_char();
       if (readline_handled_input) {
         readline_handled_input = FALSE;
         con_prompt_enter_clear();
       }
-      continue;
 #else  /* !FREECIV_HAVE_LIBREADLINE */
       ssize_t didget;
       char *buffer = NULL; /* Must be NULL when calling getline() */
@@ -840,49 +1056,39 @@ enum server_events server_sniff_all_input(void)
       }
       free(buffer);
 #endif /* !FREECIV_HAVE_LIBREADLINE */
-    } else
+    }
 #endif /* !FREECIV_SOCKET_ZERO_NOT_STDIN */
 
-    {                             /* input from a player */
-      for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {
-        struct connection *pconn = connections + i;
-        int nb;
-
-        if (!pconn->used
-            || pconn->server.is_closing
-            || !FD_ISSET(pconn->sock, &readfs)) {
-          continue;
-        }
+    /* Input from players, and room to write to them. Unlike with
+     * select(), readiness of the sockets is reported only once, so even
+     * when the operator typed something, we have to handle it now. */
+    for (i = 0; i < nevents; i++) {
+      struct connection *pconn = events[i].data;
 
-        nb = read_socket_data(pconn->sock, pconn->buffer);
-        if (0 <= nb) {
-          /* We read packets; now handle them. */
-          incoming_client_packets(pconn);
-        } else if (-2 == nb) {
-          connection_close_server(pconn, _("client disconnected"));
-        } else {
-          /* Read failure; the connection is closed. */
-          connection_close_server(pconn, _("read error"));
-        }
+      if (NULL == pconn
+          || events[i].source == stdin_source
+          || !pconn->used
+          || pconn->server.is_closing) {
+        continue;
       }
 
-      for (i = 0; i < MAX_NUM_CONNECTIONS; i++) {
-        struct connection *pconn = &connections[i];
+      if (events[i].events & NETPOLL_READ) {
+        server_read_connection(pconn, events[i].source);
+      }
 
-        if (pconn->used
-            && !pconn->server.is_closing
-            && pconn->send_buffer
-            && pconn->send_buffer->ndata > 0) {
-          if (FD_ISSET(pconn->sock, &writefs)) {
-            flush_connection_send_buffer_all(pconn);
-          } else {
-            cut_lagging_connection(pconn);
-          }
-        }
+      if ((events[i].events & NETPOLL_WRITE)
+          && pconn->used
+          && !pconn->server.is_closing
+          && 0 < pconn->send_buffer->ndata) {
+        flush_connection_send_buffer_all(pconn);
       }
-      really_close_connections();
-      break;
     }
+    really_close_connections();
+
+    if (stdin_ready) {
+      continue;
+    }
+    break;
   }
   con_prompt_off();
 
@@ -942,8 +1148,9 @@ static const char *makeup_connection_name(int *id)
 /*************************************************************************//**
   Server accepts connection from client:
   Low level socket stuff, and basic-initialize the connection struct.
-  Returns 0 on success, -1 on failure (bad accept(), or too many
-  connections).
+  Returns 0 on success, -1 on failure (bad accept(), connection rejected,
+  or too many connections), and -2 if there was nothing pending on the
+  non-blocking socket.
 *****************************************************************************/
 static int server_accept_connection(int sockfd)
 {
@@ -966,6 +1173,11 @@ static int server_accept_connection(int sockfd)
   fromlen = sizeof(fromend);
 
   if ((new_sock = accept(sockfd, &fromend.saddr, &fromlen)) == -1) {
+#ifdef NONBLOCKING_SOCKETS
+    if (errno == EWOULDBLOCK || errno == EAGAIN) {
+      return -2;
+    }
+#endif /* NONBLOCKING_SOCKETS */
     log_error("accept failed: %s", fc_strerror(fc_get_errno()));
     return -1;
   }
@@ -1042,13 +1254,23 @@ int server_make_connection(int new_sock, const char *client_addr,
     struct connection *pconn = &connections[i];
 
     if (!pconn->used) {
+      if (NULL != server_poll) {
+        conn_sources[i] = netpoll_add(server_poll, new_sock,
+                                      CONN_POLL_EVENTS, pconn);
+        if (NULL == conn_sources[i]) {
+          log_error("cannot watch the socket of a new connection");
+          fc_closesocket(new_sock);
+          return -1;
+        }
+      }
+
       connection_common_init(pconn);
       pconn->sock = new_sock;
       pconn->observer = FALSE;
       pconn->playing = NULL;
       pconn->capability[0] = '\0';
       pconn->access_level = access_level_for_next_connection();
-      pconn->notify_of_writable_data = NULL;
+      pconn->notify_of_writable_data = server_conn_writable_notify;
       pconn->server.currently_processed_request_id = 0;
       pconn->server.last_request_id_seen = 0;
       pconn->server.auth_tries = 0;
@@ -1059,6 +1281,9 @@ int server_make_connection(int new_sock, const char *client_addr,
       pconn->server.ignore_list =
           conn_pattern_list_new_full(conn_pattern_destroy);
       pconn->server.is_closing = FALSE;
+      pconn->server.send_backlogged = FALSE;
+      pconn->server.send_backlogs = 0;
+      conn_set_send_queue_limit(pconn);
       pconn->ping_time = -1.0;
       pconn->incoming_packet_notify = NULL;
       pconn->outgoing_packet_notify = NULL;
@@ -1224,6 +1449,18 @@ int server_open_socket(void)
 
   fc_sockaddr_list_destroy(list);
 
+  server_poll = netpoll_new();
+  listen_sources = fc_calloc(listen_count, sizeof(listen_sources[0]));
+  for (j = 0; j < listen_count; j++) {
+    /* Edge-triggered; we accept until accept() would block. */
+    fc_nonblock(listen_socks[j]);
+    listen_sources[j] = netpoll_add(server_poll, listen_socks[j],
+                                    NETPOLL_READ | NETPOLL_EXCEPT
+                                    | NETPOLL_EDGE, NULL);
+  }
+  log_verbose("Server waits for network events using %s",
+              netpoll_backend_name(server_poll));
+
   connections_set_close_callback(server_conn_close_callback);
 
   if (srvarg.announce == ANNOUNCE_NONE) {
@@ -35,6 +35,7 @@ enum server_events server_sniff_all_input(void);
 
 int server_open_socket(void);
 void flush_packets(void);
+void update_send_queue_limits(void);
 void close_connections_and_socket(void);
 void init_connections(void);
 int server_make_connection(int new_sock,
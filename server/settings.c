@@ -36,6 +36,7 @@
 #include "plrhand.h"
 #include "report.h"
 #include "rssanity.h"
+#include "sernet.h"
 #include "settings.h"
 #include "srv_main.h"
 #include "stdinhand.h"
@@ -541,6 +542,37 @@ scoreloglevel_name(enum scorelog_level sl_level)
   return NULL;
 }
 
+/************************************************************************//**
+  Network lag policy names accessor.
+****************************************************************************/
+static const struct sset_val_name *netlagpolicy_name(int netlagpolicy)
+{
+  switch (netlagpolicy) {
+  NAME_CASE(NLP_WAIT, "WAIT", N_("Wait for all lagging connections"));
+  NAME_CASE(NLP_DROP_OBSERVERS, "DROP",
+            N_("Disconnect lagging observers, wait for players"));
+  NAME_CASE(NLP_CUT, "CUT", N_("Disconnect all lagging connections"));
+  }
+  return NULL;
+}
+
+/************************************************************************//**
+  Network compression method names accessor.
+****************************************************************************/
+static const struct sset_val_name *netcompress_name(int netcompress)
+{
+  switch (netcompress) {
+  NAME_CASE(COMPRESS_ZLIB, "ZLIB", N_("Using zlib"));
+#ifdef FREECIV_HAVE_LIBZSTD
+  NAME_CASE(COMPRESS_ZSTD, "ZSTD", N_("Using zstd"));
+#endif
+#ifdef FREECIV_HAVE_LIBLZ4
+  NAME_CASE(COMPRESS_LZ4, "LZ4", N_("Using LZ4 (fastest)"));
+#endif
+  }
+  return NULL;
+}
+
 /************************************************************************//**
   Savegame compress type names accessor.
 ****************************************************************************/
@@ -791,6 +823,24 @@ static void metamessage_action(const struct setting *pset)
   }
 }
 
+/************************************************************************//**
+  Apply the new send queue size to the connections.
+****************************************************************************/
+static void netsendqueue_action(const struct setting *pset)
+{
+  update_send_queue_limits();
+}
+
+/************************************************************************//**
+  Switch the connections to the new compression method.
+****************************************************************************/
+static void netcompress_action(const struct setting *pset)
+{
+  conn_list_iterate(game.all_connections, pconn) {
+    conn_compression_set_method(pconn, read_enum_value(pset));
+  } conn_list_iterate_end;
+}
+
 /****************************************************************************
   Validation callback functions.
 ****************************************************************************/
@@ -2791,11 +2841,47 @@ static struct setting settings[] = {
           SSET_META, SSET_NETWORK, SSET_RARE, ALLOW_NONE, ALLOW_BASIC,
           N_("Max seconds for network buffers to drain"),
           N_("The server will wait for up to the value of this "
-             "parameter in seconds, for all client connection network "
-             "buffers to unblock. Zero means the server will not "
-             "wait at all."), NULL, NULL, NULL,
+             "parameter in seconds, for lagging client connections "
+             "to catch up (see 'netsendqueue' and 'netlagpolicy'). "
+             "Zero means the server will not wait at all."),
+          NULL, NULL, NULL,
           GAME_MIN_NETWAIT, GAME_MAX_NETWAIT, GAME_DEFAULT_NETWAIT)
 
+  GEN_INT("netsendqueue", game.server.netsendqueue,
+          SSET_META, SSET_NETWORK, SSET_RARE, ALLOW_NONE, ALLOW_BASIC,
+          N_("Kilobytes of data a connection may fall behind"),
+          N_("Data for a client is queued and sent in the background "
+             "while the game goes on. When more than this many "
+             "kilobytes are waiting for a connection, it is considered "
+             "lagging and the 'netlagpolicy' setting applies. A "
+             "connection is closed when its queue grows beyond twice "
+             "this size, or beyond 512 kilobytes if that is more."),
+          NULL, NULL, netsendqueue_action,
+          GAME_MIN_NETSENDQUEUE, GAME_MAX_NETSENDQUEUE,
+          GAME_DEFAULT_NETSENDQUEUE)
+
+  GEN_ENUM("netlagpolicy", game.server.netlagpolicy,
+           SSET_META, SSET_NETWORK, SSET_RARE, ALLOW_NONE, ALLOW_BASIC,
+           N_("What to do with lagging connections"),
+           /* TRANS: The strings between single quotes are setting names
+            * and shouldn't be translated. */
+           N_("When a connection has more data waiting than allowed by "
+              "'netsendqueue', the server can wait up to 'netwait' "
+              "seconds for it to catch up, or disconnect it at once. "
+              "Connections with hack access level are never "
+              "disconnected this way."),
+           NULL, NULL, NULL, netlagpolicy_name, GAME_DEFAULT_NETLAGPOLICY)
+
+  GEN_ENUM("netcompress", game.server.netcompress,
+           SSET_META, SSET_NETWORK, SSET_RARE, ALLOW_NONE, ALLOW_BASIC,
+           N_("Compression method for network traffic"),
+           N_("Large batches of packets, such as the ones sent at turn "
+              "change, are compressed before sending them. This is "
+              "the method to use, for the clients that support it. "
+              "Others get zlib compressed data."),
+           NULL, NULL, netcompress_action, netcompress_name,
+           GAME_DEFAULT_NETCOMPRESS)
+
   GEN_INT("pingtime", game.server.pingtime,
           SSET_META, SSET_NETWORK, SSET_RARE, ALLOW_NONE, ALLOW_BASIC,
           N_("Seconds between PINGs"),
@@ -2914,6 +3000,17 @@ static struct setting settings[] = {
               "users are not required to wait for the save to finish."),
            NULL, NULL, GAME_DEFAULT_THREADED_SAVE)
 
+  GEN_INT("citythreads", game.server.city_threads,
+          SSET_META, SSET_INTERNAL, SSET_RARE, ALLOW_HACK, ALLOW_HACK,
+          N_("Number of threads refreshing cities at turn end"),
+          N_("At the end of a turn, all the cities of a player are "
+             "refreshed before any of them grows or builds. This work "
+             "is shared by up to this many threads. The result of the "
+             "turn is the same whatever the value."),
+          NULL, NULL, NULL,
+          GAME_MIN_CITY_THREADS, GAME_MAX_CITY_THREADS,
+          GAME_DEFAULT_CITY_THREADS)
+
   GEN_INT("compress", game.server.save_compress_level,
           SSET_META, SSET_INTERNAL, SSET_RARE, ALLOW_HACK, ALLOW_HACK,
           N_("Savegame compression level"),
@@ -60,6 +60,9 @@
 
 /* common/aicore */
 #include "citymap.h"
+#include "path_finding.h"
+#include "pf_cluster.h"
+#include "pf_costgrid.h"
 
 /* common */
 #include "achievements.h"
@@ -1071,6 +1074,8 @@ static void begin_turn(bool is_new_turn)
   log_debug("Begin turn");
 
   event_cache_remove_old();
+  /* The shared pf_maps only live during a turn. */
+  pf_map_cache_clear();
 
   /* Reset this each turn. */
   if (is_new_turn) {
@@ -1406,6 +1411,8 @@ static void end_turn(void)
 
   log_debug("Endturn");
 
+  pf_map_cache_clear();
+
   /* Hack: because observer players never get an end-phase packet we send
    * one here. */
   conn_list_iterate(game.est_connections, pconn) {
@@ -3217,6 +3224,10 @@ static void srv_ready(void)
   send_all_info(game.est_connections);
   conn_list_compression_thaw(game.est_connections);
 
+  /* The map and the cities may have been set up without tracking the
+   * changes, forget the effect values computed so far. */
+  effect_value_cache_flush();
+
   if (game.info.is_new_game) {
     /* Place players' initial units, etc */
     init_new_game();
@@ -3310,6 +3321,10 @@ void server_game_free(void)
   log_civ_score_free();
   playercolor_free();
   citymap_free();
+  pf_clusters_free();
+  pf_costgrids_free();
+  pf_map_cache_free();
+  pf_lattices_free();
   game_free();
 }
 
@@ -158,6 +158,9 @@ static bool playercolor_command(struct connection *caller,
                                 char *str, bool check);
 static bool mapimg_command(struct connection *caller, char *arg, bool check);
 static const char *mapimg_accessor(int i);
+static bool packetstats_command(struct connection *caller, char *arg,
+                                bool check);
+static const char *packetstats_accessor(int i);
 
 static void show_delegations(struct connection *caller);
 
@@ -4412,6 +4415,8 @@ static bool handle_stdin_input_real(struct connection *caller, char *str,
     return fcdb_command(caller, arg, check);
   case CMD_MAPIMG:
     return mapimg_command(caller, arg, check);
+  case CMD_PACKETSTATS:
+    return packetstats_command(caller, arg, check);
   case CMD_RFCSTYLE:	/* see console.h for an explanation */
     if (!check) {
       con_set_style(!con_get_style());
@@ -5776,6 +5781,261 @@ static bool fcdb_command(struct connection *caller, char *arg, bool check)
   return ret;
 }
 
+/* Define the possible arguments to the packetstats command */
+#define SPECENUM_NAME packetstats_args
+#define SPECENUM_VALUE0     PACKETSTATS_SHOW
+#define SPECENUM_VALUE0NAME "show"
+#define SPECENUM_VALUE1     PACKETSTATS_CSV
+#define SPECENUM_VALUE1NAME "csv"
+#define SPECENUM_VALUE2     PACKETSTATS_RESET
+#define SPECENUM_VALUE2NAME "reset"
+#define SPECENUM_COUNT      PACKETSTATS_COUNT
+#include "specenum_gen.h"
+
+/* Number of packet types listed by 'packetstats show'. */
+#define PACKETSTATS_SHOW_NUM 20
+
+struct packetstats_entry {
+  enum packet_type type;
+  const struct packet_profile *profile;
+};
+
+/**********************************************************************//**
+  Returns possible parameters for the packetstats command.
+**************************************************************************/
+static const char *packetstats_accessor(int i)
+{
+  i = CLIP(0, i, packetstats_args_max());
+  return packetstats_args_name((enum packetstats_args) i);
+}
+
+/**********************************************************************//**
+  Sort packet types by decreasing number of bytes sent.
+**************************************************************************/
+static int packetstats_entry_cmp(const void *a, const void *b)
+{
+  const struct packetstats_entry *pa = a;
+  const struct packetstats_entry *pb = b;
+
+  if (pa->profile->bytes != pb->profile->bytes) {
+    return (pa->profile->bytes < pb->profile->bytes ? 1 : -1);
+  }
+  return pa->type - pb->type;
+}
+
+/**********************************************************************//**
+  Show the packet types with the most bytes sent to the connection, or to
+  all the connections if 'pconn' is NULL.
+**************************************************************************/
+static void show_packetstats(struct connection *caller,
+                             const struct connection *pconn)
+{
+  struct packetstats_entry entries[PACKET_LAST];
+  struct packet_profile total;
+  int num = 0, i;
+
+  memset(&total, 0, sizeof(total));
+  for (i = 0; i < PACKET_LAST; i++) {
+    const struct packet_profile *pprofile = packet_profile_get(pconn, i);
+
+    if (0 == pprofile->sent && 0 == pprofile->discarded) {
+      continue;
+    }
+    entries[num].type = i;
+    entries[num].profile = pprofile;
+    num++;
+
+    total.sent += pprofile->sent;
+    total.discarded += pprofile->discarded;
+    total.bytes += pprofile->bytes;
+    total.delta_saved += pprofile->delta_saved;
+    total.queued += pprofile->queued;
+    total.nsec += pprofile->nsec;
+  }
+
+  if (0 == num) {
+    cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT,
+              _("No packets sent."));
+    return;
+  }
+
+  qsort(entries, num, sizeof(*entries), packetstats_entry_cmp);
+
+  cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT,
+            _("Packets sent to %s:"),
+            NULL != pconn ? pconn->username : _("all connections"));
+  cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT, horiz_line);
+  /* TRANS: Column headers of 'packetstats show'. Keep the alignment. */
+  cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT,
+            _("%-32s %8s %8s %10s %10s %5s %8s"), _("Packet"), _("Sent"),
+            _("Unsent"), _("Bytes"), _("Saved"), _("Cmp%"), _("ms"));
+  cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT, horiz_line);
+  for (i = 0; i < MIN(num, PACKETSTATS_SHOW_NUM); i++) {
+    const struct packet_profile *pprofile = entries[i].profile;
+    const char *name = packet_name(entries[i].type);
+
+    /* All the names have the same prefix; leave it out. */
+    if (0 == strncmp(name, "PACKET_", 7)) {
+      name += 7;
+    }
+
+    cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT,
+              "%-32s %8u %8u %10lu %10lu %5d %8llu",
+              name, pprofile->sent,
+              pprofile->discarded, pprofile->bytes, pprofile->delta_saved,
+              0 < pprofile->bytes
+              ? (int) (100 * pprofile->queued / pprofile->bytes) : 0,
+              pprofile->nsec / 1000000);
+  }
+  cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT, horiz_line);
+  cmd_reply(CMD_PACKETSTATS, caller, C_COMMENT,
+            "%-32s %8u %8u %10lu %10lu %5d %8llu",
+            _("Total"), total.sent, total.discarded, total.bytes,
+            total.delta_saved,
+            0 < total.bytes ? (int) (100 * total.queued / total.bytes) : 0,
+            total.nsec / 1000000);
+}
+
+/**********************************************************************//**
+  Write the packet counters of 'pconn' (or of all the connections if
+  NULL) as CSV lines.
+**************************************************************************/
+static void write_packetstats_csv(FILE *file, const struct connection *pconn)
+{
+  int i;
+
+  for (i = 0; i < PACKET_LAST; i++) {
+    const struct packet_profile *pprofile = packet_profile_get(pconn, i);
+
+    if (0 == pprofile->sent && 0 == pprofile->discarded) {
+      continue;
+    }
+    fprintf(file, "%s,%d,%s,%u,%u,%lu,%lu,%lu,%llu\n",
+            NULL != pconn ? pconn->username : "*", i, packet_name(i),
+            pprofile->sent, pprofile->discarded, pprofile->bytes,
+            pprofile->delta_saved, pprofile->queued, pprofile->nsec / 1000);
+  }
+}
+
+/**********************************************************************//**
+  Handle the packetstats command.
+**************************************************************************/
+static bool packetstats_command(struct connection *caller, char *arg,
+                                bool check)
+{
+  enum m_pre_result result;
+  int ind = PACKETSTATS_SHOW, ntokens;
+  char *token[2];
+  bool ret = TRUE;
+
+  ntokens = get_tokens(arg, token, 2, TOKEN_DELIMITERS);
+
+  if (ntokens > 0) {
+    /* match the argument */
+    result = match_prefix(packetstats_accessor, PACKETSTATS_COUNT, 0,
+                          fc_strncasecmp, NULL, token[0], &ind);
+
+    switch (result) {
+    case M_PRE_EXACT:
+    case M_PRE_ONLY:
+      /* we have a match */
+      break;
+    case M_PRE_AMBIGUOUS:
+      cmd_reply(CMD_PACKETSTATS, caller, C_FAIL,
+                _("Ambiguous packetstats command."));
+      ret = FALSE;
+      goto cleanup;
+    case M_PRE_EMPTY:
+    case M_PRE_LONG:
+    case M_PRE_FAIL:
+    case M_PRE_LAST:
+      cmd_reply(CMD_PACKETSTATS, caller, C_SYNTAX, _("Usage:\n%s"),
+                command_synopsis(command_by_number(CMD_PACKETSTATS)));
+      ret = FALSE;
+      goto cleanup;
+    }
+  }
+
+  switch (ind) {
+  case PACKETSTATS_SHOW:
+    {
+      struct connection *pconn = NULL;
+
+      if (ntokens > 1
+          && !(pconn = conn_by_user_prefix(token[1], &result))) {
+        cmd_reply_no_such_conn(CMD_PACKETSTATS, caller, token[1], result);
+        ret = FALSE;
+        goto cleanup;
+      }
+      if (!check) {
+        show_packetstats(caller, pconn);
+      }
+    }
+    break;
+
+  case PACKETSTATS_CSV:
+    {
+      char real_filename[1024];
+      FILE *file;
+
+      if (is_restricted(caller)) {
+        cmd_reply(CMD_PACKETSTATS, caller, C_FAIL,
+                  _("You cannot write packet statistics on this server"
+                    " for security reasons."));
+        ret = FALSE;
+        goto cleanup;
+      }
+      if (ntokens < 2) {
+        cmd_reply(CMD_PACKETSTATS, caller, C_SYNTAX,
+                  _("Missing file name."));
+        ret = FALSE;
+        goto cleanup;
+      }
+      if (check) {
+        break;
+      }
+
+      interpret_tilde(real_filename, sizeof(real_filename), token[1]);
+      if (!is_reg_file_for_access(real_filename, TRUE)
+          || !(file = fc_fopen(real_filename, "w"))) {
+        cmd_reply(CMD_PACKETSTATS, caller, C_FAIL,
+                  _("Cannot write packet statistics to '%s'."),
+                  real_filename);
+        ret = FALSE;
+        goto cleanup;
+      }
+
+      fprintf(file, "connection,type,packet,sent,unsent,bytes,delta_saved,"
+              "compress_queued,usec\n");
+      write_packetstats_csv(file, NULL);
+      conn_list_iterate(game.all_connections, pconn) {
+        write_packetstats_csv(file, pconn);
+      } conn_list_iterate_end;
+      fclose(file);
+
+      cmd_reply(CMD_PACKETSTATS, caller, C_OK,
+                _("Packet statistics written to '%s'."), real_filename);
+    }
+    break;
+
+  case PACKETSTATS_RESET:
+    if (!check) {
+      packet_profile_reset(NULL);
+      conn_list_iterate(game.all_connections, pconn) {
+        packet_profile_reset(pconn);
+      } conn_list_iterate_end;
+      cmd_reply(CMD_PACKETSTATS, caller, C_OK,
+                _("Packet statistics reset."));
+    }
+    break;
+  }
+
+ cleanup:
+  free_tokens(token, ntokens);
+
+  return ret;
+}
+
 /**********************************************************************//**
   Send start command related message
 **************************************************************************/
@@ -6356,6 +6616,14 @@ static void show_connections(struct connection *caller)
                      cmdlevel_name(pconn->access_level));
       }
       cmd_reply(CMD_LIST, caller, C_COMMENT, "%s", buf);
+      /* TRANS: Network send queue statistics of a connection. */
+      cmd_reply(CMD_LIST, caller, C_COMMENT,
+                _("  queued %dkb (peak %dkb), %d stalled writes, "
+                  "lagged %d times"),
+                pconn->send_buffer->ndata >> 10,
+                pconn->statistics.send_queue_peak >> 10,
+                pconn->statistics.send_stalls,
+                pconn->server.send_backlogs);
     } conn_list_iterate_end;
   }
   cmd_reply(CMD_LIST, caller, C_COMMENT, horiz_line);
@@ -6994,6 +7262,15 @@ static char *fcdb_generator(const char *text, int state)
   return generic_generator(text, state, FCDB_COUNT, fcdb_accessor);
 }
 
+/**********************************************************************//**
+  The valid arguments for the first argument to "packetstats".
+**************************************************************************/
+static char *packetstats_generator(const char *text, int state)
+{
+  return generic_generator(text, state, PACKETSTATS_COUNT,
+                           packetstats_accessor);
+}
+
 /**********************************************************************//**
   The valid arguments for the argument to "lua".
 **************************************************************************/
@@ -7377,6 +7654,16 @@ static bool is_fcdb(int start)
                                    FALSE);
 }
 
+/**********************************************************************//**
+  Return whether we are completing first argument for packetstats command
+**************************************************************************/
+static bool is_packetstats(int start)
+{
+  return contains_str_before_start(start,
+                                   command_name_by_number(CMD_PACKETSTATS),
+                                   FALSE);
+}
+
 /**********************************************************************//**
   Return whether we are completing argument for lua command
 **************************************************************************/
@@ -7449,6 +7736,8 @@ char **freeciv_completion(const char *text, int start, int end)
     matches = rl_completion_matches(text, mapimg_generator);
   } else if (is_fcdb(start)) {
     matches = rl_completion_matches(text, fcdb_generator);
+  } else if (is_packetstats(start)) {
+    matches = rl_completion_matches(text, packetstats_generator);
   } else if (is_lua(start)) {
     matches = rl_completion_matches(text, lua_generator);
   } else {
@@ -1560,6 +1560,10 @@ void handle_unit_get_actions(struct connection *pc,
     return;
   }
 
+  /* The targets are looked for by computing the probabilities of the
+   * actions, which are needed again below. */
+  action_prob_cache_freeze();
+
   /* Select the targets. */
 
   if (target_unit_id_client == IDENTITY_NUMBER_ZERO) {
@@ -1583,6 +1587,7 @@ void handle_unit_get_actions(struct connection *pc,
                               target_tile_id, target_extra_id,
                               disturb_player,
                               probabilities);
+    action_prob_cache_thaw();
     return;
   }
 
@@ -1755,6 +1760,8 @@ void handle_unit_get_actions(struct connection *pc,
     explain_why_no_action_enabled(actor_unit,
                                   target_tile, target_city, target_unit);
   }
+
+  action_prob_cache_thaw();
 }
 
 /**********************************************************************//**
@@ -3211,6 +3218,7 @@ static void see_combat(struct unit *pattacker, struct unit *pdefender)
   package_unit(pattacker, &unit_att_packet);
   package_unit(pdefender, &unit_def_packet);
 
+  packet_broadcast_begin();
   conn_list_iterate(game.est_connections, pconn) {
     struct player *pplayer = pconn->playing;
 
@@ -3242,6 +3250,7 @@ static void see_combat(struct unit *pattacker, struct unit *pdefender)
       send_packet_unit_info(pconn, &unit_def_packet);
     }
   } conn_list_iterate_end;
+  packet_broadcast_end();
 }
 
 /**********************************************************************//**
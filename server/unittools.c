@@ -1636,6 +1636,7 @@ struct unit *create_unit_full(struct player *pplayer, struct tile *ptile,
 
   unit_list_prepend(pplayer->units, punit);
   unit_list_prepend(ptile->units, punit);
+  pf_map_cache_clear();
   if (pcity && !utype_has_flag(type, UTYF_NOHOME)) {
     fc_assert(city_owner(pcity) == pplayer);
     unit_list_prepend(pcity->units_supported, punit);
@@ -1656,6 +1657,7 @@ struct unit *create_unit_full(struct player *pplayer, struct tile *ptile,
 
   /* The unit may have changed the available tiles in nearby cities. */
   city_map_update_tile_now(ptile);
+  city_refresh_inputs_changed();
   sync_cities();
 
   unit_get_goods(punit);
@@ -1704,6 +1706,7 @@ static void server_remove_unit_full(struct unit *punit, bool transported,
 
   /* The unit is doomed. */
   punit->server.dying = TRUE;
+  pf_map_cache_clear();
 
 #ifdef FREECIV_DEBUG
   unit_list_iterate(ptile->units, pcargo) {
@@ -1783,6 +1786,7 @@ static void server_remove_unit_full(struct unit *punit, bool transported,
 
   /* This unit may have blocked tiles of adjacent cities. Update them. */
   city_map_update_tile_now(ptile);
+  city_refresh_inputs_changed();
   sync_cities();
 
   if (phomecity) {
@@ -2619,6 +2623,7 @@ void send_unit_info(struct conn_list *dest, struct unit *punit)
   package_short_unit(punit, &sinfo, UNIT_INFO_IDENTITY, 0);
   pdata = punit->server.moving;
 
+  packet_broadcast_begin();
   conn_list_iterate(dest, pconn) {
     struct player *pplayer = conn_get_player(pconn);
 
@@ -2639,6 +2644,7 @@ void send_unit_info(struct conn_list *dest, struct unit *punit)
       }
     }
   } conn_list_iterate_end;
+  packet_broadcast_end();
 }
 
 /**********************************************************************//**
@@ -3516,6 +3522,9 @@ static struct unit_move_data *unit_move_data(struct unit *punit,
   BV_CLR_ALL(pdata->can_see_move);
   pdata->old_vision = punit->server.vision;
 
+  /* The paths of the shared maps may go through both tiles. */
+  pf_map_cache_clear();
+
   /* Remove unit from the source tile. */
   fc_assert(unit_tile(punit) == psrctile);
   success = unit_list_remove(psrctile->units, punit);
@@ -3606,6 +3615,9 @@ bool unit_move(struct unit *punit, struct tile *pdesttile, int move_cost,
 
   pplayer = unit_owner(punit);
   saved_id = punit->id;
+
+  /* The martial law and the available tiles of cities may change. */
+  city_refresh_inputs_changed();
   psrctile = unit_tile(punit);
   adj = base_get_direction_for_step(&(wld.map), psrctile, pdesttile, &facing);
 
@@ -3746,6 +3758,7 @@ bool unit_move(struct unit *punit, struct tile *pdesttile, int move_cost,
   }
 
   /* Notifications of the move to the clients. */
+  packet_broadcast_begin();
   if (adj) {
     /* Special case: 'punit' is moving to adjacent position. Then we show
      * 'punit' move to all users able to see 'psrctile' or 'pdesttile'. */
@@ -3805,6 +3818,7 @@ bool unit_move(struct unit *punit, struct tile *pdesttile, int move_cost,
       }
     } conn_list_iterate_end;
   } unit_move_data_list_iterate_end;
+  packet_broadcast_end();
 
   /* Clear old vision. */
   unit_move_data_list_iterate(plist, pmove_data) {
@@ -0,0 +1,437 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 1996 - A Kjeldberg, L Gregersen, P Unold
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <fc_config.h>
+#endif
+
+#include <signal.h>
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#ifdef FREECIV_MSWINDOWS
+#include <windows.h>
+#endif
+
+/* utility */
+#include "fc_cmdline.h"
+#include "fciconv.h"
+#include "fcintl.h"
+#include "log.h"
+#include "registry.h"
+#include "support.h"
+#include "timing.h"
+
+/* common */
+#include "fc_cmdhelp.h"
+#include "fc_interface.h"
+#include "game.h"
+#include "map.h"
+#include "player.h"
+#include "unit.h"
+
+/* common/aicore */
+#include "path_finding.h"
+#include "pf_tools.h"
+
+/* server */
+#include "diplhand.h"
+#include "maphand.h"
+#include "sernet.h"
+#include "settings.h"
+#include "srv_main.h"
+#include "stdinhand.h"
+
+/* tools/shared */
+#include "tools_fc_interface.h"
+
+/* The workloads, named after the kind of pf_map they build. */
+enum pfb_workload {
+  PFB_NORMAL = 0,       /* Units with neither danger nor fuel. */
+  PFB_DANGER,           /* Units with dangerous positions (triremes). */
+  PFB_FUEL,             /* Units with fuel (aircraft). */
+  PFB_COUNT
+};
+
+static const char *pfb_workload_names[PFB_COUNT] = {
+  "normal", "danger", "fuel"
+};
+
+/* Results of one workload, for one pass. */
+struct pfb_result {
+  int maps;             /* Number of maps, one per unit. */
+  long nodes;           /* Number of positions iterated. */
+  long cities;          /* Number of cities reached. */
+};
+
+static char *savegame_selected = NULL;
+static bool workload_selected[PFB_COUNT] = { TRUE, TRUE, TRUE };
+static int max_turns = -1;
+static int repeat = 1;
+static bool report_timing = FALSE;
+static int fatal_assertions = -1;
+
+/**********************************************************************//**
+  Select the workloads listed in 'list', separated by commas.
+**************************************************************************/
+static bool pfb_select_workloads(const char *list)
+{
+  char *tokens[PFB_COUNT];
+  int ntokens = get_tokens(list, tokens, PFB_COUNT, ",");
+  bool ok = (0 < ntokens);
+  int i, j;
+
+  for (i = 0; i < PFB_COUNT; i++) {
+    workload_selected[i] = FALSE;
+  }
+
+  for (j = 0; j < ntokens; j++) {
+    bool found = FALSE;
+
+    for (i = 0; i < PFB_COUNT; i++) {
+      if (0 == fc_strcasecmp(tokens[j], pfb_workload_names[i])) {
+        workload_selected[i] = TRUE;
+        found = TRUE;
+      }
+    }
+    if (!found) {
+      fc_fprintf(stderr, _("Unknown workload \"%s\".\n"), tokens[j]);
+      ok = FALSE;
+    }
+  }
+  free_tokens(tokens, ntokens);
+
+  return ok;
+}
+
+/**********************************************************************//**
+  Parse freeciv-pfbench commandline parameters.
+**************************************************************************/
+static void pfb_parse_cmdline(int argc, char *argv[])
+{
+  int i = 1;
+
+  while (i < argc) {
+    char *option = NULL;
+
+    if (is_option("--help", argv[i])) {
+      struct cmdhelp *help = cmdhelp_new(argv[0]);
+
+      cmdhelp_add(help, "h", "help",
+                  _("Print a summary of the options"));
+#ifndef FREECIV_NDEBUG
+      cmdhelp_add(help, "F",
+                  /* TRANS: "Fatal" is exactly what user must type, do not translate. */
+                  _("Fatal [SIGNAL]"),
+                  _("Raise a signal on failed assertion"));
+#endif /* FREECIV_NDEBUG */
+      cmdhelp_add(help, "f",
+                  /* TRANS: "file" is exactly what user must type, do not translate. */
+                  _("file FILE"),
+                  _("Load the savegame FILE"));
+      cmdhelp_add(help, "w",
+                  /* TRANS: "workload" is exactly what user must type, do not translate. */
+                  _("workload LIST"),
+                  _("Run the workloads in LIST, separated by commas, "
+                    "among normal, danger and fuel (default: all)"));
+      cmdhelp_add(help, "t",
+                  /* TRANS: "turns" is exactly what user must type, do not translate. */
+                  _("turns NUMBER"),
+                  _("Stop the maps at NUMBER turns (default: no limit)"));
+      cmdhelp_add(help, "r",
+                  /* TRANS: "repeat" is exactly what user must type, do not translate. */
+                  _("repeat NUMBER"),
+                  _("Run every workload NUMBER times (default: 1)"));
+      cmdhelp_add(help, "T", "timing",
+                  _("Also report the times and the memory usage"));
+
+      /* The function below prints a header and footer for the options.
+       * Furthermore, the options are sorted. */
+      cmdhelp_display(help, TRUE, FALSE, TRUE);
+      cmdhelp_destroy(help);
+
+      cmdline_option_values_free();
+
+      exit(EXIT_SUCCESS);
+    } else if ((option = get_option_malloc("--file", argv, &i, argc, TRUE))) {
+      if (savegame_selected != NULL) {
+        fc_fprintf(stderr,
+                   _("Multiple savegames requested. Only one savegame "
+                     "at time supported.\n"));
+      } else {
+        savegame_selected = option;
+      }
+    } else if ((option = get_option_malloc("--workload", argv, &i, argc,
+                                           TRUE))) {
+      if (!pfb_select_workloads(option)) {
+        fc_fprintf(stderr, _("Try using --help.\n"));
+        exit(EXIT_FAILURE);
+      }
+      free(option);
+    } else if ((option = get_option_malloc("--turns", argv, &i, argc,
+                                           TRUE))) {
+      if (!str_to_int(option, &max_turns) || 0 > max_turns) {
+        fc_fprintf(stderr, _("Invalid number of turns \"%s\".\n"), option);
+        fc_fprintf(stderr, _("Try using --help.\n"));
+        exit(EXIT_FAILURE);
+      }
+      free(option);
+    } else if ((option = get_option_malloc("--repeat", argv, &i, argc,
+                                           TRUE))) {
+      if (!str_to_int(option, &repeat) || 0 >= repeat) {
+        fc_fprintf(stderr, _("Invalid repeat count \"%s\".\n"), option);
+        fc_fprintf(stderr, _("Try using --help.\n"));
+        exit(EXIT_FAILURE);
+      }
+      free(option);
+    } else if (is_option("--timing", argv[i])) {
+      report_timing = TRUE;
+#ifndef FREECIV_NDEBUG
+    } else if (is_option("--Fatal", argv[i])) {
+      if (i + 1 >= argc || '-' == argv[i + 1][0]) {
+        fatal_assertions = SIGABRT;
+      } else if (str_to_int(argv[i + 1], &fatal_assertions)) {
+        i++;
+      } else {
+        fc_fprintf(stderr, _("Invalid signal number \"%s\".\n"),
+                   argv[i + 1]);
+        fc_fprintf(stderr, _("Try using --help.\n"));
+        exit(EXIT_FAILURE);
+      }
+#endif /* FREECIV_NDEBUG */
+    } else {
+      fc_fprintf(stderr, _("Unrecognized option: \"%s\"\n"), argv[i]);
+      cmdline_option_values_free();
+      exit(EXIT_FAILURE);
+    }
+
+    i++;
+  }
+}
+
+/**********************************************************************//**
+  Returns the id of the city the player map of 'pplayer' has at 'ptile' or
+  IDENTITY_NUMBER_ZERO if the player map don't have a city there.
+**************************************************************************/
+static int pfb_plr_tile_city_id_get(const struct tile *ptile,
+                                    const struct player *pplayer)
+{
+  const struct player_tile *plrtile = map_get_player_tile(ptile, pplayer);
+
+  return plrtile && plrtile->site ? plrtile->site->identity
+                                  : IDENTITY_NUMBER_ZERO;
+}
+
+/**********************************************************************//**
+  Initialize the fc_interface functions. Unlike the other tools, the
+  path-finding needs the real knowledge of the players.
+**************************************************************************/
+static void pfb_fc_interface_init(void)
+{
+  struct functions *funcs = fc_interface_funcs();
+
+  funcs->create_extra = create_extra;
+  funcs->destroy_extra = destroy_extra;
+  fc_interface_init_tool();
+
+  funcs->player_tile_vision_get = map_is_known_and_seen;
+  funcs->player_tile_city_id_get = pfb_plr_tile_city_id_get;
+}
+
+/**********************************************************************//**
+  Returns the workload the unit belongs to, according to the kind of
+  pf_map pf_map_new() would build for 'param'.
+**************************************************************************/
+static enum pfb_workload pfb_workload_of(const struct pf_parameter *param)
+{
+  if (NULL != param->is_pos_dangerous) {
+    return PFB_DANGER;
+  } else if (NULL != param->get_moves_left_req) {
+    return PFB_FUEL;
+  }
+
+  return PFB_NORMAL;
+}
+
+/**********************************************************************//**
+  Build a map for every unit of the workload, and iterate it until
+  max_turns, counting the positions and the cities reached.
+**************************************************************************/
+static void pfb_run_workload(enum pfb_workload workload,
+                             struct pfb_result *result)
+{
+  result->maps = 0;
+  result->nodes = 0;
+  result->cities = 0;
+
+  players_iterate(pplayer) {
+    unit_list_iterate(pplayer->units, punit) {
+      struct pf_parameter parameter;
+      struct pf_map *pfm;
+
+      if (unit_transported(punit)) {
+        /* Would follow the transporter. */
+        continue;
+      }
+
+      pft_fill_unit_parameter(&parameter, punit);
+      if (pfb_workload_of(&parameter) != workload) {
+        continue;
+      }
+
+      pfm = pf_map_new(&parameter);
+      result->maps++;
+
+      pf_map_positions_iterate(pfm, pos, FALSE) {
+        if (0 <= max_turns && pos.turn > max_turns) {
+          break;
+        }
+        result->nodes++;
+        if (NULL != tile_city(pos.tile)) {
+          result->cities++;
+        }
+      } pf_map_positions_iterate_end;
+
+      pf_map_destroy(pfm);
+    } unit_list_iterate_end;
+  } players_iterate_end;
+}
+
+/**********************************************************************//**
+  Returns the peak resident memory of the process in kilobytes, or -1 if
+  it is not known.
+**************************************************************************/
+static long pfb_peak_memory(void)
+{
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+
+  if (0 == getrusage(RUSAGE_SELF, &usage)) {
+    return usage.ru_maxrss;
+  }
+#endif /* HAVE_SYS_RESOURCE_H */
+
+  return -1;
+}
+
+/**********************************************************************//**
+  Run the selected workloads and print the report. The counts only depend
+  on the savegame and the options, so they can be compared between runs;
+  the times and the memory usage are printed only with --timing.
+**************************************************************************/
+static void pfb_run(void)
+{
+  struct timer *ptimer = timer_new(TIMER_CPU, TIMER_ACTIVE);
+  enum pfb_workload workload;
+
+  fc_printf("# savegame: %s\n", savegame_selected);
+  fc_printf("# turn: %d, map: %dx%d, turns: %d, repeat: %d\n",
+            game.info.turn, wld.map.xsize, wld.map.ysize, max_turns, repeat);
+
+  for (workload = 0; workload < PFB_COUNT; workload++) {
+    struct pfb_result result;
+    int i;
+
+    if (!workload_selected[workload]) {
+      continue;
+    }
+
+    timer_clear(ptimer);
+    timer_start(ptimer);
+    for (i = 0; i < repeat; i++) {
+      pfb_run_workload(workload, &result);
+    }
+    timer_stop(ptimer);
+
+    fc_printf("%-8s maps %6d nodes %10ld cities %8ld",
+              pfb_workload_names[workload],
+              result.maps, result.nodes, result.cities);
+    if (report_timing) {
+      double seconds = timer_read_seconds(ptimer) / repeat;
+
+      fc_printf(" time %.6fs per-map %.3fus", seconds,
+                0 < result.maps ? 1e6 * seconds / result.maps : 0.0);
+    }
+    fc_printf("\n");
+  }
+
+  if (report_timing) {
+    fc_printf("# peak memory: %ld kB\n", pfb_peak_memory());
+  }
+
+  timer_destroy(ptimer);
+}
+
+/**********************************************************************//**
+  Main entry point for freeciv-pfbench
+**************************************************************************/
+int main(int argc, char **argv)
+{
+  enum log_level loglevel = LOG_NORMAL;
+  int ret = EXIT_SUCCESS;
+
+  /* Load win32 post-crash debugger */
+#ifdef FREECIV_MSWINDOWS
+# ifndef FREECIV_NDEBUG
+  if (LoadLibrary("exchndl.dll") == NULL) {
+#  ifdef FREECIV_DEBUG
+    fprintf(stderr, "exchndl.dll could not be loaded, no crash debugger\n");
+#  endif /* FREECIV_DEBUG */
+  }
+# endif /* FREECIV_NDEBUG */
+#endif /* FREECIV_MSWINDOWS */
+
+  /* Initializes the nls, the registry, the character encodings and the
+   * ai modules the savegame may refer to. */
+  srv_init();
+
+  pfb_parse_cmdline(argc, argv);
+
+  if (savegame_selected == NULL) {
+    fc_fprintf(stderr, _("No savegame given.\n"));
+    fc_fprintf(stderr, _("Try using --help.\n"));
+    exit(EXIT_FAILURE);
+  }
+
+  log_init(NULL, loglevel, NULL, NULL, fatal_assertions);
+
+  pfb_fc_interface_init();
+
+  init_connections();
+  settings_init(TRUE);
+  stdinhand_init();
+  diplhand_init();
+  server_game_init(FALSE);
+
+  if (load_command(NULL, savegame_selected, FALSE, TRUE)) {
+    pfb_run();
+  } else {
+    log_error(_("Can't load savegame %s"), savegame_selected);
+    ret = EXIT_FAILURE;
+  }
+
+  server_game_free();
+  diplhand_free();
+  stdinhand_free();
+  settings_free();
+  registry_module_close();
+  log_close();
+  free_libfreeciv();
+  free_nls();
+  free(savegame_selected);
+  cmdline_option_values_free();
+
+  return ret;
+}
@@ -410,3 +410,81 @@ bool has_thread_cond_impl(void)
   return FALSE;
 #endif
 }
+
+struct fc_thread_tasks {
+  fc_mutex mutex;
+  int next;
+  int num_tasks;
+  void (*func) (int task, void *data);
+  void *data;
+};
+
+/*******************************************************************//**
+  Run tasks of fc_thread_run_tasks() until there are none left.
+***********************************************************************/
+static void fc_thread_tasks_work(void *arg)
+{
+  struct fc_thread_tasks *tasks = (struct fc_thread_tasks *) arg;
+
+  while (TRUE) {
+    int task;
+
+    fc_allocate_mutex(&tasks->mutex);
+    task = tasks->next++;
+    fc_release_mutex(&tasks->mutex);
+
+    if (task >= tasks->num_tasks) {
+      break;
+    }
+    tasks->func(task, tasks->data);
+  }
+}
+
+/*******************************************************************//**
+  Call func(task, data) for every task from 0 to num_tasks - 1, using up
+  to num_threads threads (the calling thread included). Returns when all
+  the tasks are done. The tasks may run in any order and at the same
+  time, so they must not depend on each other.
+***********************************************************************/
+void fc_thread_run_tasks(int num_tasks, int num_threads,
+                         void (*func) (int task, void *data), void *data)
+{
+  struct fc_thread_tasks tasks;
+  fc_thread *threads;
+  int started = 0;
+  int i;
+
+  if (num_threads > num_tasks) {
+    num_threads = num_tasks;
+  }
+  if (num_threads <= 1) {
+    for (i = 0; i < num_tasks; i++) {
+      func(i, data);
+    }
+    return;
+  }
+
+  fc_init_mutex(&tasks.mutex);
+  tasks.next = 0;
+  tasks.num_tasks = num_tasks;
+  tasks.func = func;
+  tasks.data = data;
+
+  threads = fc_malloc((num_threads - 1) * sizeof(*threads));
+  for (i = 0; i < num_threads - 1; i++) {
+    if (0 == fc_thread_start(&threads[started], fc_thread_tasks_work,
+                             &tasks)) {
+      started++;
+    }
+  }
+
+  /* The calling thread works too; it finishes the tasks on its own if
+   * no thread could be started. */
+  fc_thread_tasks_work(&tasks);
+
+  for (i = 0; i < started; i++) {
+    fc_thread_wait(&threads[i]);
+  }
+  free(threads);
+  fc_destroy_mutex(&tasks.mutex);
+}
@@ -81,6 +81,9 @@ void fc_thread_cond_signal(fc_thread_cond *cond);
 
 bool has_thread_cond_impl(void);
 
+void fc_thread_run_tasks(int num_tasks, int num_threads,
+                         void (*func) (int task, void *data), void *data);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,594 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 1996 - A Kjeldberg, L Gregersen, P Unold
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+
+/***********************************************************************
+  Socket readiness notification with pluggable backends.
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <fc_config.h>
+#endif
+
+#include "fc_prehdrs.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+/* utility */
+#include "log.h"
+#include "mem.h"
+#include "netintf.h"
+#include "shared.h"             /* MAX(), ARRAY_SIZE() */
+#include "support.h"
+
+#include "netpoll.h"
+
+/* How many ready descriptors we collect from the kernel per system call.
+ * Any others stay queued in the kernel for the next call. */
+#define NETPOLL_BATCH 64
+
+enum netpoll_backend {
+  NETPOLL_SELECT,
+#ifdef HAVE_SYS_EPOLL_H
+  NETPOLL_EPOLL,
+#endif
+};
+
+struct netpoll_source {
+  int fd;
+  int events;                   /* Registered interest, incl. NETPOLL_EDGE */
+  void *data;
+
+  int index;                    /* Position in netpoll->sources */
+
+  /* Readiness we know of, but have not delivered yet. With edge-triggered
+   * backends this must be remembered or it is lost. */
+  int pending;
+  bool queued;                  /* In netpoll->pending */
+
+  /* The backend refused the descriptor (e.g. epoll and a regular file).
+   * Such a descriptor never blocks, so it is always reported ready. */
+  bool always_ready;
+};
+
+struct netpoll {
+  enum netpoll_backend backend;
+#ifdef HAVE_SYS_EPOLL_H
+  int epfd;
+#endif
+
+  struct netpoll_source **sources;
+  int num_sources;
+  int alloc_sources;
+
+  struct netpoll_source **pending;
+  int num_pending;
+  int alloc_pending;
+
+  int num_always_ready;
+};
+
+/*********************************************************************//**
+  Add the source to the pending queue, if not there yet.
+*************************************************************************/
+static void netpoll_queue(struct netpoll *np, struct netpoll_source *src)
+{
+  if (src->queued) {
+    return;
+  }
+
+  if (np->num_pending == np->alloc_pending) {
+    np->alloc_pending = MAX(16, 2 * np->alloc_pending);
+    np->pending = fc_realloc(np->pending,
+                             np->alloc_pending * sizeof(*np->pending));
+  }
+  np->pending[np->num_pending++] = src;
+  src->queued = TRUE;
+}
+
+/*********************************************************************//**
+  Remove the source from the pending queue. Keeps the queue in order.
+*************************************************************************/
+static void netpoll_unqueue(struct netpoll *np, struct netpoll_source *src)
+{
+  int i;
+
+  if (!src->queued) {
+    return;
+  }
+
+  for (i = 0; i < np->num_pending; i++) {
+    if (np->pending[i] == src) {
+      memmove(np->pending + i, np->pending + i + 1,
+              (np->num_pending - i - 1) * sizeof(*np->pending));
+      np->num_pending--;
+      break;
+    }
+  }
+  src->queued = FALSE;
+}
+
+/*********************************************************************//**
+  Record readiness reported by the backend.
+*************************************************************************/
+static void netpoll_mark_ready(struct netpoll *np,
+                               struct netpoll_source *src, int events)
+{
+  events &= src->events & NETPOLL_ALL;
+  if (events != 0) {
+    src->pending |= events;
+    netpoll_queue(np, src);
+  }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/*********************************************************************//**
+  Translate netpoll interest to epoll interest.
+*************************************************************************/
+static uint32_t netpoll_to_epoll(int events)
+{
+  uint32_t result = 0;
+
+  if (events & NETPOLL_READ) {
+    result |= EPOLLIN;
+#ifdef EPOLLRDHUP
+    result |= EPOLLRDHUP;
+#endif
+  }
+  if (events & NETPOLL_WRITE) {
+    result |= EPOLLOUT;
+  }
+  if (events & NETPOLL_EXCEPT) {
+    result |= EPOLLPRI;
+  }
+  if (events & NETPOLL_EDGE) {
+    result |= EPOLLET;
+  }
+
+  return result;
+}
+
+/*********************************************************************//**
+  Translate epoll readiness to netpoll readiness of the source.
+  Hangups and errors are reported as readable (or writable, for write-only
+  sources), so the caller finds out about them from the next I/O call.
+*************************************************************************/
+static int netpoll_from_epoll(const struct netpoll_source *src,
+                              uint32_t revents)
+{
+  int result = 0;
+  uint32_t fail = EPOLLERR | EPOLLHUP;
+
+#ifdef EPOLLRDHUP
+  fail |= EPOLLRDHUP;
+#endif
+
+  if (revents & EPOLLIN) {
+    result |= NETPOLL_READ;
+  }
+  if (revents & EPOLLOUT) {
+    result |= NETPOLL_WRITE;
+  }
+  if (revents & EPOLLPRI) {
+    result |= NETPOLL_EXCEPT;
+  }
+  if (revents & fail) {
+    result |= (src->events & NETPOLL_READ) ? NETPOLL_READ : NETPOLL_WRITE;
+  }
+
+  return result;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+/*********************************************************************//**
+  Create a new netpoll, using the best backend available.
+*************************************************************************/
+struct netpoll *netpoll_new(void)
+{
+  struct netpoll *np = fc_calloc(1, sizeof(*np));
+
+  np->backend = NETPOLL_SELECT;
+
+#ifdef HAVE_SYS_EPOLL_H
+  np->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (np->epfd != -1) {
+    np->backend = NETPOLL_EPOLL;
+  } else {
+    log_verbose("epoll_create1 failed: %s; using select()",
+                fc_strerror(fc_get_errno()));
+  }
+#endif /* HAVE_SYS_EPOLL_H */
+
+  log_verbose("Socket readiness backend: %s", netpoll_backend_name(np));
+
+  return np;
+}
+
+/*********************************************************************//**
+  Free the netpoll and all its sources. Does not close the descriptors.
+*************************************************************************/
+void netpoll_destroy(struct netpoll *np)
+{
+  int i;
+
+  if (np == NULL) {
+    return;
+  }
+
+  for (i = 0; i < np->num_sources; i++) {
+    free(np->sources[i]);
+  }
+  FC_FREE(np->sources);
+  FC_FREE(np->pending);
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (np->backend == NETPOLL_EPOLL) {
+    close(np->epfd);
+  }
+#endif
+
+  free(np);
+}
+
+/*********************************************************************//**
+  Name of the backend in use, for logging.
+*************************************************************************/
+const char *netpoll_backend_name(const struct netpoll *np)
+{
+  switch (np->backend) {
+  case NETPOLL_SELECT:
+    return "select";
+#ifdef HAVE_SYS_EPOLL_H
+  case NETPOLL_EPOLL:
+    return "epoll";
+#endif
+  }
+
+  return "unknown";
+}
+
+/*********************************************************************//**
+  Start watching 'fd' for 'events'. 'data' is handed back with every
+  event of the source. Returns NULL if the descriptor cannot be watched.
+*************************************************************************/
+struct netpoll_source *netpoll_add(struct netpoll *np, int fd, int events,
+                                   void *data)
+{
+  struct netpoll_source *src;
+
+  fc_assert_ret_val(np != NULL, NULL);
+
+#ifndef FREECIV_HAVE_WINSOCK
+  if (np->backend == NETPOLL_SELECT && fd >= FD_SETSIZE) {
+    log_error("Socket %d exceeds FD_SETSIZE (%d)", fd, FD_SETSIZE);
+    return NULL;
+  }
+#endif /* FREECIV_HAVE_WINSOCK */
+
+  src = fc_calloc(1, sizeof(*src));
+  src->fd = fd;
+  src->events = events;
+  src->data = data;
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (np->backend == NETPOLL_EPOLL) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = netpoll_to_epoll(events);
+    ev.data.ptr = src;
+
+    if (epoll_ctl(np->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      if (errno == EPERM) {
+        /* Regular file; never blocks. */
+        src->always_ready = TRUE;
+        np->num_always_ready++;
+      } else {
+        log_error("epoll_ctl(ADD, %d) failed: %s", fd,
+                  fc_strerror(fc_get_errno()));
+        free(src);
+        return NULL;
+      }
+    }
+  }
+#endif /* HAVE_SYS_EPOLL_H */
+
+  if (np->num_sources == np->alloc_sources) {
+    np->alloc_sources = MAX(16, 2 * np->alloc_sources);
+    np->sources = fc_realloc(np->sources,
+                             np->alloc_sources * sizeof(*np->sources));
+  }
+  src->index = np->num_sources;
+  np->sources[np->num_sources++] = src;
+
+  return src;
+}
+
+/*********************************************************************//**
+  Change the interest of the source. Cheap if nothing changes.
+*************************************************************************/
+void netpoll_modify(struct netpoll *np, struct netpoll_source *src,
+                    int events)
+{
+  fc_assert_ret(np != NULL && src != NULL);
+
+  if (src->events == events) {
+    return;
+  }
+  src->events = events;
+  src->pending &= events;
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (np->backend == NETPOLL_EPOLL && !src->always_ready) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = netpoll_to_epoll(events);
+    ev.data.ptr = src;
+
+    /* Modifying an edge-triggered registration rearms it, so a source
+     * that is already ready gets reported again. */
+    if (epoll_ctl(np->epfd, EPOLL_CTL_MOD, src->fd, &ev) == -1) {
+      log_error("epoll_ctl(MOD, %d) failed: %s", src->fd,
+                fc_strerror(fc_get_errno()));
+    }
+  }
+#endif /* HAVE_SYS_EPOLL_H */
+}
+
+/*********************************************************************//**
+  Stop watching the source, and free it. Must be called before the
+  descriptor is closed.
+*************************************************************************/
+void netpoll_remove(struct netpoll *np, struct netpoll_source *src)
+{
+  struct netpoll_source *last;
+
+  if (np == NULL || src == NULL) {
+    return;
+  }
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (np->backend == NETPOLL_EPOLL && !src->always_ready) {
+    struct epoll_event ev;
+
+    /* Non-NULL 'ev' for kernels older than 2.6.9. */
+    if (epoll_ctl(np->epfd, EPOLL_CTL_DEL, src->fd, &ev) == -1) {
+      log_verbose("epoll_ctl(DEL, %d) failed: %s", src->fd,
+                  fc_strerror(fc_get_errno()));
+    }
+  }
+#endif /* HAVE_SYS_EPOLL_H */
+
+  if (src->always_ready) {
+    np->num_always_ready--;
+  }
+
+  netpoll_unqueue(np, src);
+
+  fc_assert(np->sources[src->index] == src);
+  last = np->sources[--np->num_sources];
+  np->sources[src->index] = last;
+  last->index = src->index;
+
+  free(src);
+}
+
+/*********************************************************************//**
+  Have the source reported again by the next netpoll_wait(), without
+  consulting the backend. Used when a caller stops draining an
+  edge-triggered source before it would block.
+*************************************************************************/
+void netpoll_requeue(struct netpoll *np, struct netpoll_source *src,
+                     int events)
+{
+  fc_assert_ret(np != NULL && src != NULL);
+
+  netpoll_mark_ready(np, src, events);
+}
+
+/*********************************************************************//**
+  Descriptor of the source.
+*************************************************************************/
+int netpoll_source_fd(const struct netpoll_source *src)
+{
+  return src->fd;
+}
+
+/*********************************************************************//**
+  Currently registered interest of the source.
+*************************************************************************/
+int netpoll_source_events(const struct netpoll_source *src)
+{
+  return src->events;
+}
+
+/*********************************************************************//**
+  Whether something in the pending queue can be delivered under 'mask'.
+*************************************************************************/
+static bool netpoll_have_deliverable(const struct netpoll *np, int mask)
+{
+  int i;
+
+  for (i = 0; i < np->num_pending; i++) {
+    if (np->pending[i]->pending & mask) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/*********************************************************************//**
+  Ask the select() backend for ready sources.
+*************************************************************************/
+static int netpoll_select(struct netpoll *np, int mask, int timeout_ms)
+{
+  fd_set readfs, writefs, exceptfs;
+  fc_timeval tv;
+  int max_desc = -1;
+  int i, result;
+
+  FC_FD_ZERO(&readfs);
+  FC_FD_ZERO(&writefs);
+  FC_FD_ZERO(&exceptfs);
+
+  for (i = 0; i < np->num_sources; i++) {
+    struct netpoll_source *src = np->sources[i];
+    int events = src->events & mask;
+
+    if (events & NETPOLL_READ) {
+      FD_SET(src->fd, &readfs);
+    }
+    if (events & NETPOLL_WRITE) {
+      FD_SET(src->fd, &writefs);
+    }
+    if (events & NETPOLL_EXCEPT) {
+      FD_SET(src->fd, &exceptfs);
+    }
+    if (events != 0) {
+      max_desc = MAX(max_desc, src->fd);
+    }
+  }
+
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+  result = fc_select(max_desc + 1, &readfs, &writefs, &exceptfs, &tv);
+  if (result <= 0) {
+    return result;
+  }
+
+  for (i = 0; i < np->num_sources; i++) {
+    struct netpoll_source *src = np->sources[i];
+    int events = 0;
+
+    if (FD_ISSET(src->fd, &readfs)) {
+      events |= NETPOLL_READ;
+    }
+    if (FD_ISSET(src->fd, &writefs)) {
+      events |= NETPOLL_WRITE;
+    }
+    if (FD_ISSET(src->fd, &exceptfs)) {
+      events |= NETPOLL_EXCEPT;
+    }
+    netpoll_mark_ready(np, src, events);
+  }
+
+  return result;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/*********************************************************************//**
+  Ask the epoll backend for ready sources.
+*************************************************************************/
+static int netpoll_epoll(struct netpoll *np, int timeout_ms)
+{
+  struct epoll_event evs[NETPOLL_BATCH];
+  int i, result;
+
+  result = epoll_wait(np->epfd, evs, ARRAY_SIZE(evs), timeout_ms);
+
+  for (i = 0; i < result; i++) {
+    struct netpoll_source *src = evs[i].data.ptr;
+
+    netpoll_mark_ready(np, src, netpoll_from_epoll(src, evs[i].events));
+  }
+
+  return result;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+/*********************************************************************//**
+  Wait up to 'timeout_ms' milliseconds (-1 for no limit) for sources to
+  become ready, and store at most 'max_events' of them to 'events'.
+  Only readiness in 'mask' is reported; any other readiness is kept for
+  a later call. Returns the number of events, or -1 on error.
+*************************************************************************/
+int netpoll_wait(struct netpoll *np, int mask,
+                 struct netpoll_event *events, int max_events,
+                 int timeout_ms)
+{
+  int i, j, n, result;
+
+  fc_assert_ret_val(np != NULL, -1);
+
+  if (np->num_always_ready > 0) {
+    for (i = 0; i < np->num_sources; i++) {
+      if (np->sources[i]->always_ready) {
+        netpoll_mark_ready(np, np->sources[i], NETPOLL_READ | NETPOLL_WRITE);
+      }
+    }
+  }
+
+  if (netpoll_have_deliverable(np, mask)) {
+    /* Just pick up whatever else is ready right now. */
+    timeout_ms = 0;
+  }
+
+  switch (np->backend) {
+#ifdef HAVE_SYS_EPOLL_H
+  case NETPOLL_EPOLL:
+    result = netpoll_epoll(np, timeout_ms);
+    break;
+#endif /* HAVE_SYS_EPOLL_H */
+  case NETPOLL_SELECT:
+  default:
+    result = netpoll_select(np, mask, timeout_ms);
+    break;
+  }
+
+  if (result == -1) {
+    if (errno != EINTR) {
+      log_error("netpoll_wait (%s) failed: %s", netpoll_backend_name(np),
+                fc_strerror(fc_get_errno()));
+      return -1;
+    }
+    /* EINTR can happen sometimes, especially when compiling with -pg.
+     * Report what we already have. */
+  }
+
+  /* Deliver, and compact the queue to the sources with something left. */
+  n = 0;
+  j = 0;
+  for (i = 0; i < np->num_pending; i++) {
+    struct netpoll_source *src = np->pending[i];
+    int ready = src->pending & mask;
+
+    if (ready != 0 && n < max_events) {
+      events[n].source = src;
+      events[n].fd = src->fd;
+      events[n].data = src->data;
+      events[n].events = ready;
+      n++;
+
+      src->pending &= ~ready;
+    }
+
+    if (src->pending == 0) {
+      src->queued = FALSE;
+    } else {
+      np->pending[j++] = src;
+    }
+  }
+  np->num_pending = j;
+
+  return n;
+}
@@ -0,0 +1,81 @@
+/***********************************************************************
+ Freeciv - Copyright (C) 1996 - A Kjeldberg, L Gregersen, P Unold
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef FC__NETPOLL_H
+#define FC__NETPOLL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* utility */
+#include "support.h"   /* bool type */
+
+/***********************************************************************
+  Readiness notification for a set of sockets.
+
+  A netpoll watches registered file descriptors ("sources") and reports
+  the ones that became ready. Depending on the platform, it is backed by
+  epoll (Linux) or by select() as the portable fallback. With epoll, the
+  cost of netpoll_wait() is proportional to the number of ready sources,
+  not to the number of registered ones, and there is no FD_SETSIZE limit.
+
+  Sources registered with NETPOLL_EDGE are only reported when their
+  state changes, so the caller has to drain them (read until the socket
+  would block) before waiting again. Callers that cannot drain a source
+  at once use netpoll_requeue() to have it reported again. Level-triggered
+  backends treat NETPOLL_EDGE as a no-op, so callers that follow these
+  rules work with every backend.
+***********************************************************************/
+
+#define NETPOLL_READ    (1 << 0)  /* Data (or EOF/error) to read. */
+#define NETPOLL_WRITE   (1 << 1)  /* Room to write. */
+#define NETPOLL_EXCEPT  (1 << 2)  /* Exceptional condition. */
+#define NETPOLL_EDGE    (1 << 3)  /* Edge-triggered registration. */
+
+#define NETPOLL_ALL (NETPOLL_READ | NETPOLL_WRITE | NETPOLL_EXCEPT)
+
+struct netpoll;
+struct netpoll_source;
+
+struct netpoll_event {
+  struct netpoll_source *source;
+  int fd;
+  void *data;
+  int events;                   /* NETPOLL_READ | ... */
+};
+
+struct netpoll *netpoll_new(void);
+void netpoll_destroy(struct netpoll *np);
+const char *netpoll_backend_name(const struct netpoll *np);
+
+struct netpoll_source *netpoll_add(struct netpoll *np, int fd, int events,
+                                   void *data);
+void netpoll_modify(struct netpoll *np, struct netpoll_source *src,
+                    int events);
+void netpoll_remove(struct netpoll *np, struct netpoll_source *src);
+void netpoll_requeue(struct netpoll *np, struct netpoll_source *src,
+                     int events);
+
+int netpoll_source_fd(const struct netpoll_source *src);
+int netpoll_source_events(const struct netpoll_source *src);
+
+int netpoll_wait(struct netpoll *np, int mask,
+                 struct netpoll_event *events, int max_events,
+                 int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif  /* FC__NETPOLL_H */